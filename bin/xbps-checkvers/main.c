@@ -38,6 +38,7 @@
 #include <limits.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <xbps.h>
 
@@ -55,7 +56,10 @@ typedef struct _rcv_t {
 	xbps_dictionary_t pkgd;
 	xbps_dictionary_t cache;
 	xbps_dictionary_t templates;
-	struct xbps_handle xhp;
+	struct xbps_handle *xhp;
+	FILE *out;
+	/* set while templates are processed in parallel */
+	pthread_mutex_t *lock;
 } rcv_t;
 
 typedef int (*rcv_check_func)(rcv_t *);
@@ -72,6 +76,24 @@ xstrdup(const char *src)
 	return p;
 }
 
+/*
+ * Serializes the accesses to the cache and to the rpool/pkgdb
+ * dictionaries, which are updated on lookups.
+ */
+static void
+rcv_lock(rcv_t *rcv)
+{
+	if (rcv->lock != NULL)
+		pthread_mutex_lock(rcv->lock);
+}
+
+static void
+rcv_unlock(rcv_t *rcv)
+{
+	if (rcv->lock != NULL)
+		pthread_mutex_unlock(rcv->lock);
+}
+
 static int
 show_usage(const char *prog, bool fail)
 {
@@ -110,12 +132,12 @@ rcv_init(rcv_t *rcv, const char *prog)
 	assert(rcv->cache);
 
 	if (rcv->xbps_conf != NULL) {
-		xbps_strlcpy(rcv->xhp.confdir, rcv->xbps_conf, sizeof(rcv->xhp.confdir));
+		xbps_strlcpy(rcv->xhp->confdir, rcv->xbps_conf, sizeof(rcv->xhp->confdir));
 	}
 	if (rcv->rootdir != NULL) {
-		xbps_strlcpy(rcv->xhp.rootdir, rcv->rootdir, sizeof(rcv->xhp.rootdir));
+		xbps_strlcpy(rcv->xhp->rootdir, rcv->rootdir, sizeof(rcv->xhp->rootdir));
 	}
-	if (xbps_init(&rcv->xhp) != 0)
+	if (xbps_init(rcv->xhp) != 0)
 		abort();
 	rcv->templates = xbps_dictionary_create();
 }
@@ -134,7 +156,7 @@ rcv_end(rcv_t *rcv)
 		rcv->env = NULL;
 	}
 
-	xbps_end(&rcv->xhp);
+	xbps_end(rcv->xhp);
 
 	if (rcv->xbps_conf != NULL)
 		free(rcv->xbps_conf);
@@ -369,7 +391,7 @@ rcv_get_pkgver(rcv_t *rcv)
 			exit(1);
 		}
 
-		if (rcv->xhp.flags & XBPS_FLAG_DEBUG)
+		if (rcv->xhp->flags & XBPS_FLAG_DEBUG)
 			fprintf(stderr, "%s: %s %s\n", rcv->fname, key, val);
 
 		free(key);
@@ -393,6 +415,36 @@ nextline:
 	}
 }
 
+/*
+ * A cached entry is used if the template has the same size and
+ * either the same mtime or the same contents, the latter avoids
+ * parsing all templates again after a fresh checkout.
+ */
+static bool
+rcv_cache_valid(xbps_dictionary_t d, const char *fname, struct stat *st)
+{
+	xbps_data_t mtime;
+	const char *sha256 = NULL;
+	uint64_t size = 0;
+
+	if (!xbps_dictionary_get_uint64(d, "size", &size) ||
+	    size != (uint64_t)st->st_size)
+		return false;
+
+	mtime = xbps_dictionary_get(d, "mtime");
+	if (xbps_data_equals_data(mtime, &st->st_mtim, sizeof st->st_mtim))
+		return true;
+
+	if (!xbps_dictionary_get_cstring_nocopy(d, "sha256", &sha256) ||
+	    xbps_file_sha256_check(fname, sha256) != 0)
+		return false;
+
+	mtime = xbps_data_create_data(&st->st_mtim, sizeof st->st_mtim);
+	xbps_dictionary_set(d, "mtime", mtime);
+	xbps_object_release(mtime);
+	return true;
+}
+
 static int
 rcv_process_file(rcv_t *rcv, const char *fname, rcv_check_func check)
 {
@@ -402,6 +454,7 @@ rcv_process_file(rcv_t *rcv, const char *fname, rcv_check_func check)
 	xbps_dictionary_t d;
 	xbps_data_t mtime;
 	const char *pkgname, *version, *revision, *reverts;
+	char sha256[XBPS_SHA256_SIZE];
 	struct stat st;
 	bool allocenv = false;
 
@@ -410,9 +463,12 @@ rcv_process_file(rcv_t *rcv, const char *fname, rcv_check_func check)
 		goto ret;
 	}
 
-	if ((d = xbps_dictionary_get(rcv->cache, fname))) {
-		mtime = xbps_dictionary_get(d, "mtime");
-		if (!xbps_data_equals_data(mtime, &st.st_mtim, sizeof st.st_mtim))
+	rcv_lock(rcv);
+	d = xbps_dictionary_get(rcv->cache, fname);
+	rcv_unlock(rcv);
+	if (d != NULL) {
+		/* only this template's entry is modified here */
+		if (!rcv_cache_valid(d, fname, &st))
 			goto update;
 		rcv->env = d;
 		rcv->have_vars = GOT_PKGNAME_VAR | GOT_VERSION_VAR | GOT_REVISION_VAR;
@@ -439,7 +495,10 @@ update:
 		}
 		if (!d) {
 			d = xbps_dictionary_create();
+			rcv_lock(rcv);
 			xbps_dictionary_set(rcv->cache, fname, d);
+			rcv_unlock(rcv);
+			xbps_object_release(d);
 		}
 		xbps_dictionary_set_cstring(d, "pkgname", pkgname);
 		xbps_dictionary_set_cstring(d, "version", version);
@@ -449,9 +508,17 @@ update:
 		xbps_dictionary_get_cstring_nocopy(rcv->env, "reverts", &reverts);
 		if (reverts)
 			xbps_dictionary_set_cstring(d, "reverts", reverts);
+		else
+			xbps_dictionary_remove(d, "reverts");
 
 		mtime = xbps_data_create_data(&st.st_mtim, sizeof st.st_mtim);
 		xbps_dictionary_set(d, "mtime", mtime);
+		xbps_object_release(mtime);
+		xbps_dictionary_set_uint64(d, "size", (uint64_t)st.st_size);
+		if (xbps_file_sha256(sha256, sizeof sha256, fname))
+			xbps_dictionary_set_cstring(d, "sha256", sha256);
+		else
+			xbps_dictionary_remove(d, "sha256");
 	}
 
 	check(rcv);
@@ -577,10 +644,12 @@ rcv_check_version(rcv_t *rcv)
 	assert(binpkgname);
 
 	repourl = NULL;
+	/* held while the package dictionary is used */
+	rcv_lock(rcv);
 	if (rcv->installed) {
-		rcv->pkgd = xbps_pkgdb_get_pkg(&rcv->xhp, binpkgname);
+		rcv->pkgd = xbps_pkgdb_get_pkg(rcv->xhp, binpkgname);
 	} else {
-		rcv->pkgd = xbps_rpool_get_pkg(&rcv->xhp, binpkgname);
+		rcv->pkgd = xbps_rpool_get_pkg(rcv->xhp, binpkgname);
 		xbps_dictionary_get_cstring_nocopy(rcv->pkgd, "repository", &repourl);
 	}
 	xbps_dictionary_get_cstring_nocopy(rcv->pkgd, "pkgver", &repover);
@@ -595,17 +664,93 @@ rcv_check_version(rcv_t *rcv)
 	else if (rcv->show_removed && rcv->removed)
 		;
 	else if (rcv->show_removed && !rcv->removed)
-		return 0;
+		goto out;
 	else if (repover && (xbps_cmpver(repover, srcver) < 0 ||
 		    (reverts && check_reverts(repover, reverts))))
 		;
 	else
-		return 0;
+		goto out;
 
 	repover = repover ? repover : "?";
 	repourl = repourl ? repourl : "?";
-	rcv_printf(rcv, stdout, pkgname, repover, srcver, repourl);
+	rcv_printf(rcv, rcv->out, pkgname, repover, srcver, repourl);
+out:
+	rcv_unlock(rcv);
+	return 0;
+}
+
+struct rcv_thread_data {
+	rcv_t *rcv;
+	rcv_proc_func process;
+};
+
+static int
+rcv_cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int
+rcv_pkgdb_init_cb(struct xbps_handle *xhp UNUSED,
+		xbps_object_t obj UNUSED,
+		const char *key UNUSED,
+		void *arg UNUSED,
+		bool *done)
+{
+	*done = true;
+	return 0;
+}
 
+static int
+rcv_rpool_init_cb(struct xbps_repo *repo UNUSED, void *arg UNUSED,
+		bool *done UNUSED)
+{
+	return 0;
+}
+
+static int
+rcv_process_dir_cb(struct xbps_handle *xhp UNUSED,
+		xbps_object_t obj,
+		const char *key UNUSED,
+		void *arg,
+		bool *done UNUSED)
+{
+	struct rcv_thread_data *thd = arg;
+	rcv_t rcv;
+	char filename[BUFSIZ], *buf = NULL;
+	const char *pkgname = NULL;
+	size_t bufsz = 0;
+	int rv;
+
+	/*
+	 * Every worker gets its own copy of the per-template state,
+	 * the handle, rpool/pkgdb and the cache are shared and only
+	 * accessed with the lock held.
+	 */
+	memcpy(&rcv, thd->rcv, sizeof(rcv));
+	rcv.buf = rcv.ptr = NULL;
+	rcv.bufsz = rcv.len = 0;
+	rcv.env = rcv.pkgd = NULL;
+	rcv.have_vars = 0;
+	if ((rcv.out = open_memstream(&buf, &bufsz)) == NULL) {
+		fprintf(stderr, "MemError: can't allocate memory: %s\n",
+		    strerror(errno));
+		exit(1);
+	}
+
+	xbps_dictionary_get_cstring_nocopy(obj, "pkgname", &pkgname);
+	snprintf(filename, sizeof(filename), "%s/template", pkgname);
+	rv = thd->process(&rcv, filename, rcv_check_version);
+
+	fclose(rcv.out);
+	/* every worker only modifies its own entry */
+	if (bufsz > 0)
+		xbps_dictionary_set_cstring(obj, "output", buf);
+	/* keep processing the other templates, the error is reported later */
+	if (rv != 0)
+		xbps_dictionary_set_int32(obj, "error", rv);
+	free(buf);
+	free(rcv.buf);
 	return 0;
 }
 
@@ -613,20 +758,27 @@ static int
 rcv_process_dir(rcv_t *rcv, rcv_proc_func process)
 {
 	DIR *dir = NULL;
-	struct dirent entry, *result;
+	struct dirent *result;
 	struct stat st;
-	char filename[BUFSIZ];
-	int i, ret = 0;
+	struct rcv_thread_data thd;
+	pthread_mutex_t lock;
+	xbps_array_t array;
+	xbps_dictionary_t d;
+	const char *output;
+	char **names = NULL;
+	size_t nnames = 0, maxnames = 0;
+	int ret = 0, rv, serrno;
 
 	if (!(dir = opendir(".")))
 		goto error;
 
 	for (;;) {
-		i = readdir_r(dir, &entry, &result);
-		if (i > 0)
-			goto error;
-		if (result == NULL)
+		errno = 0;
+		if ((result = readdir(dir)) == NULL) {
+			if (errno != 0)
+				goto error;
 			break;
+		}
 		if ((strcmp(result->d_name, ".") == 0) ||
 		    (strcmp(result->d_name, "..") == 0))
 			continue;
@@ -639,15 +791,72 @@ rcv_process_dir(rcv_t *rcv, rcv_proc_func process)
 		if (S_ISLNK(st.st_mode) != 0 && !rcv->installed)
 			continue;
 
-		snprintf(filename, sizeof(filename), "%s/template", result->d_name);
-		ret = process(rcv, filename, rcv_check_version);
+		if (nnames == maxnames) {
+			maxnames = maxnames ? maxnames * 2 : 1024;
+			names = realloc(names, maxnames * sizeof(*names));
+			assert(names);
+		}
+		names[nnames++] = xstrdup(result->d_name);
 	}
+	rv = closedir(dir);
+	dir = NULL;
+	if (rv == -1)
+		goto error;
 
-	if ((closedir(dir)) != -1)
-		return ret;
+	/*
+	 * Templates are processed in parallel, sort them so that
+	 * the output order does not depend on readdir(3) or on the
+	 * thread scheduling.
+	 */
+	qsort(names, nnames, sizeof(*names), rcv_cmp_names);
+	array = xbps_array_create();
+	assert(array);
+	for (size_t i = 0; i < nnames; i++) {
+		d = xbps_dictionary_create();
+		assert(d);
+		xbps_dictionary_set_cstring(d, "pkgname", names[i]);
+		xbps_array_add(array, d);
+		xbps_object_release(d);
+		free(names[i]);
+	}
+	free(names);
+
+	/*
+	 * Make sure the pkgdb or all repositories are opened before
+	 * starting the workers, they are shared read-only from now on.
+	 */
+	if (rcv->installed)
+		(void)xbps_pkgdb_foreach_cb(rcv->xhp, rcv_pkgdb_init_cb, NULL);
+	else
+		(void)xbps_rpool_foreach(rcv->xhp, rcv_rpool_init_cb, NULL);
+
+	pthread_mutex_init(&lock, NULL);
+	rcv->lock = &lock;
+	thd.rcv = rcv;
+	thd.process = process;
+	ret = xbps_array_foreach_cb_multi(rcv->xhp, array, NULL,
+	    rcv_process_dir_cb, &thd);
+	rcv->lock = NULL;
+	pthread_mutex_destroy(&lock);
+
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		d = xbps_array_get(array, i);
+		if (xbps_dictionary_get_cstring_nocopy(d, "output", &output))
+			fputs(output, rcv->out);
+		if (ret == 0 && xbps_dictionary_get_int32(d, "error", &rv))
+			ret = rv;
+	}
+	xbps_object_release(array);
+	return ret;
 error:
+	serrno = errno;
+	if (dir != NULL)
+		closedir(dir);
+	for (size_t i = 0; i < nnames; i++)
+		free(names[i]);
+	free(names);
 	fprintf(stderr, "Error: while processing dir '%s/srcpkgs': %s\n",
-	    rcv->distdir, strerror(errno));
+	    rcv->distdir, strerror(serrno));
 	exit(1);
 }
 
@@ -702,6 +911,7 @@ main(int argc, char **argv)
 {
 	int i, c;
 	rcv_t rcv;
+	struct xbps_handle xh;
 	const char *prog = argv[0], *sopts = "hC:D:def:iImR:r:sV";
 	const struct option lopts[] = {
 		{ "help", no_argument, NULL, 'h' },
@@ -721,6 +931,9 @@ main(int argc, char **argv)
 	};
 
 	memset(&rcv, 0, sizeof(rcv_t));
+	memset(&xh, 0, sizeof(xh));
+	rcv.xhp = &xh;
+	rcv.out = stdout;
 	rcv.manual = false;
 	rcv.format = "%n %r %s %t %R";
 
@@ -735,7 +948,7 @@ main(int argc, char **argv)
 			rcv.distdir = xstrdup(optarg);
 			break;
 		case 'd':
-			rcv.xhp.flags |= XBPS_FLAG_DEBUG;
+			xh.flags |= XBPS_FLAG_DEBUG;
 			break;
 		case 'e':
 			rcv.show_removed = true;
@@ -744,7 +957,7 @@ main(int argc, char **argv)
 			rcv.format = optarg;
 			break;
 		case 'i':
-			rcv.xhp.flags |= XBPS_FLAG_IGNORE_CONF_REPOS;
+			xh.flags |= XBPS_FLAG_IGNORE_CONF_REPOS;
 			break;
 		case 'I':
 			rcv.installed = true;
@@ -753,7 +966,7 @@ main(int argc, char **argv)
 			rcv.manual = true;
 			break;
 		case 'R':
-			xbps_repo_store(&rcv.xhp, optarg);
+			xbps_repo_store(&xh, optarg);
 			break;
 		case 'r':
 			rcv.rootdir = optarg;
@@ -803,9 +1016,9 @@ main(int argc, char **argv)
 
 	if (rcv.show_removed) {
 		if (rcv.installed) {
-			xbps_pkgdb_foreach_cb(&rcv.xhp, template_removed_cb, &rcv);
+			xbps_pkgdb_foreach_cb(&xh, template_removed_cb, &rcv);
 		} else {
-			xbps_rpool_foreach(&rcv.xhp, repo_templates_removed_cb, &rcv);
+			xbps_rpool_foreach(&xh, repo_templates_removed_cb, &rcv);
 		}
 	}
 
@@ -100,6 +100,8 @@ usage(bool fail)
 	"                      'vi:/usr/bin/vi:/usr/bin/vim foo:/usr/bin/foo:/usr/bin/blah'\n"
 	" --build-options      A string with the used build options\n"
 	" --compression        Compression format: none, gzip, bzip2, lz4, xz, zstd (default)\n"
+	" --indexed            Write zstd packages with an index of their files, to\n"
+	"                      extract single files from remote packages with range requests\n"
 	" --shlib-provides     List of provided shared libraries (blank separated list,\n"
 	"                      e.g 'libfoo.so.1 libblah.so.2')\n"
 	" --shlib-requires     List of required shared libraries (blank separated list,\n"
@@ -804,6 +806,7 @@ main(int argc, char **argv)
 		{ "compression", required_argument, NULL, '3' },
 		{ "alternatives", required_argument, NULL, '4' },
 		{ "changelog", required_argument, NULL, 'c'},
+		{ "indexed", no_argument, NULL, '5' },
 		{ NULL, 0, NULL, 0 }
 	};
 	struct archive *ar;
@@ -816,8 +819,8 @@ main(int argc, char **argv)
 	const char *buildopts, *shlib_provides, *shlib_requires, *alternatives;
 	const char *compression, *tags = NULL, *srcrevs = NULL;
 	char pkgname[XBPS_NAME_SIZE], *binpkg, *tname, *p, cwd[PATH_MAX-1];
-	bool quiet = false, preserve = false;
-	int c, pkg_fd;
+	bool quiet = false, preserve = false, indexed = false;
+	int c, rv, pkg_fd;
 	mode_t myumask;
 
 	arch = conflicts = deps = homepage = license = maint = compression = NULL;
@@ -911,6 +914,9 @@ main(int argc, char **argv)
 		case '4':
 			alternatives = optarg;
 			break;
+		case '5':
+			indexed = true;
+			break;
 		case '?':
 		default:
 			usage(true);
@@ -1039,11 +1045,16 @@ main(int argc, char **argv)
 	if (ar == NULL)
 		die("cannot create new archive");
 	/*
-	 * Set compression format, zstd by default.
+	 * Set compression format, zstd by default; zstd archives are
+	 * written with a member index if requested.
 	 */
 	if (compression == NULL || strcmp(compression, "zstd") == 0) {
-		archive_write_add_filter_zstd(ar);
-		archive_write_set_options(ar, "compression-level=9");
+		if (!indexed) {
+			archive_write_add_filter_zstd(ar);
+			archive_write_set_options(ar, "compression-level=9");
+		}
+	} else if (indexed) {
+		die("--indexed requires zstd compression");
 	} else if (strcmp(compression, "xz") == 0) {
 		archive_write_add_filter_xz(ar);
 		archive_write_set_options(ar, "compression-level=9");
@@ -1068,8 +1079,22 @@ main(int argc, char **argv)
 	archive_entry_linkresolver_set_strategy(resolver,
 	    archive_format(ar));
 
-	if (archive_write_open_fd(ar, pkg_fd) != ARCHIVE_OK)
+	if (indexed && (rv = xbps_archive_write_open_indexed(ar, pkg_fd, 9)) != 0) {
+		if (rv != ENOTSUP) {
+			errno = rv;
+			die("Failed to open %s fd for writing:", tname);
+		}
+		fprintf(stderr, "%s: built without zstd support, "
+		    "writing %s without index\n", _PROGNAME, pkgver);
+		indexed = false;
+		archive_write_add_filter_zstd(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	}
+	if (!indexed && archive_write_open_fd(ar, pkg_fd) != ARCHIVE_OK)
 		die("Failed to open %s fd for writing:", tname);
+	/* tells clients to look for the index, see xbps_repo_get_pkg_plist() */
+	if (indexed)
+		xbps_dictionary_set_bool(pkg_propsd, "archive-index", true);
 
 	process_archive(ar, resolver, pkgver, quiet);
 	/* Process hardlinks */
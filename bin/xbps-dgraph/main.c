@@ -113,7 +113,7 @@ static void __attribute__((noreturn))
 usage(bool fail)
 {
 	fprintf(stdout,
-	"Usage: xbps-dgraph [OPTIONS] [MODE] <pkgname>\n\n"
+	"Usage: xbps-dgraph [OPTIONS] [MODE] [<pkgname>]\n\n"
 	"OPTIONS\n"
 	" -C, --config <dir>        Path to confdir (xbps.d)\n"
 	" -c, --graph-config <file> Path to the graph configuration file\n"
@@ -124,7 +124,10 @@ usage(bool fail)
 	" -r, --rootdir <dir>       Full path to rootdir\n"
 	" -R, --repository          Enable repository mode. This mode explicitly\n"
 	"                           looks for packages in repositories.\n"
+	" -T, --format <fmt>        Output format for -a: dot (default), json\n"
+	"                           or edges (binary edge list)\n"
 	"MODE\n"
+	" -a, --all                 Generate a dependency graph of all packages\n"
 	" -g, --gen-config          Generate a configuration file\n"
 	" -f, --fulldeptree         Generate a dependency graph\n"
 	" -m, --metadata            Generate a metadata graph (default mode)\n");
@@ -509,11 +512,340 @@ create_dot_graph(struct xbps_handle *xhp,
 	fclose(f);
 }
 
+/*
+ * Whole repository/pkgdb dependency graph.
+ *
+ * Every package gets a node with a stable ID (its position in the list
+ * sorted by package name) and every run-time dependency is resolved
+ * exactly once through name lookups, so the graph is built in a single
+ * pass instead of one full dependency tree walk per package.
+ */
+struct graph_node {
+	const char *pkgver;
+	char pkgname[XBPS_NAME_SIZE];
+	xbps_array_t rundeps;
+	xbps_array_t provides;
+	bool installed;
+};
+
+struct graph {
+	struct graph_node *nodes;
+	unsigned int nnodes, maxnodes;
+	uint32_t *edges;
+	unsigned int nedges, maxedges;
+	unsigned int nmissing;
+	/* pkgname -> node ID */
+	xbps_dictionary_t names;
+	/* virtual pkgname -> array of provider node IDs */
+	xbps_dictionary_t vpkgs;
+};
+
+enum graph_format {
+	GRAPH_FMT_DOT,
+	GRAPH_FMT_JSON,
+	GRAPH_FMT_EDGES
+};
+
+#define GRAPH_EDGES_MAGIC	"XBPSDGE1"
+
+static int
+graph_add_pkg(struct xbps_handle *xhp, struct graph *g, xbps_dictionary_t pkgd)
+{
+	struct graph_node *n;
+	const char *pkgver = NULL;
+
+	if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+		return 0;
+
+	if (g->nnodes == g->maxnodes) {
+		g->maxnodes = g->maxnodes ? g->maxnodes * 2 : 1024;
+		g->nodes = realloc(g->nodes, g->maxnodes * sizeof(*g->nodes));
+		if (g->nodes == NULL)
+			die("%s alloc nodes", __func__);
+	}
+	n = &g->nodes[g->nnodes];
+	if (!xbps_pkg_name(n->pkgname, sizeof(n->pkgname), pkgver))
+		die("invalid pkgver `%s'", pkgver);
+	/* the first repository providing a package wins */
+	if (xbps_dictionary_get(g->names, n->pkgname))
+		return 0;
+	xbps_dictionary_set_bool(g->names, n->pkgname, true);
+
+	n->pkgver = pkgver;
+	n->rundeps = xbps_dictionary_get(pkgd, "run_depends");
+	n->provides = xbps_dictionary_get(pkgd, "provides");
+	n->installed = false;
+	if (xhp != NULL)
+		n->installed = xbps_pkgdb_get_pkg(xhp, pkgver) != NULL;
+	g->nnodes++;
+	return 0;
+}
+
+static int
+graph_pkgdb_cb(struct xbps_handle *xhp, xbps_object_t obj,
+		const char *key UNUSED, void *arg, bool *done UNUSED)
+{
+	return graph_add_pkg(xhp, arg, obj);
+}
+
+struct graph_rpool_data {
+	struct xbps_handle *xhp;
+	struct graph *g;
+};
+
+static int
+graph_rpool_cb(struct xbps_repo *repo, void *arg, bool *done UNUSED)
+{
+	struct graph_rpool_data *grd = arg;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	int rv = 0;
+
+	iter = xbps_dictionary_iterator(repo->idx);
+	assert(iter);
+	while ((obj = xbps_object_iterator_next(iter))) {
+		rv = graph_add_pkg(grd->xhp, grd->g,
+		    xbps_dictionary_get_keysym(repo->idx, obj));
+		if (rv != 0)
+			break;
+	}
+	xbps_object_iterator_release(iter);
+	return rv;
+}
+
+static int
+graph_cmp_nodes(const void *a, const void *b)
+{
+	const struct graph_node *na = a, *nb = b;
+
+	return strcmp(na->pkgname, nb->pkgname);
+}
+
+static void
+graph_add_edge(struct graph *g, unsigned int from, unsigned int to)
+{
+	if (g->nedges == g->maxedges) {
+		g->maxedges = g->maxedges ? g->maxedges * 2 : 4096;
+		g->edges = realloc(g->edges, g->maxedges * 2 * sizeof(*g->edges));
+		if (g->edges == NULL)
+			die("%s alloc edges", __func__);
+	}
+	g->edges[g->nedges * 2] = from;
+	g->edges[g->nedges * 2 + 1] = to;
+	g->nedges++;
+}
+
+/*
+ * Resolves a run-time dependency to a node ID, looking at real packages
+ * first and then at the packages providing it as a virtual package.
+ */
+static bool
+graph_resolve_dep(struct graph *g, const char *pattern, unsigned int *id)
+{
+	char depname[XBPS_NAME_SIZE];
+	xbps_array_t providers;
+	uint32_t idx;
+
+	if (!xbps_pkgpattern_name(depname, sizeof(depname), pattern) &&
+	    !xbps_pkg_name(depname, sizeof(depname), pattern))
+		xbps_strlcpy(depname, pattern, sizeof(depname));
+
+	if (xbps_dictionary_get_uint32(g->names, depname, &idx) &&
+	    xbps_pkgpattern_match(g->nodes[idx].pkgver, pattern)) {
+		*id = idx;
+		return true;
+	}
+	providers = xbps_dictionary_get(g->vpkgs, depname);
+	for (unsigned int i = 0; i < xbps_array_count(providers); i++) {
+		xbps_array_get_uint32(providers, i, &idx);
+		if (xbps_match_virtual_pkg_in_array(g->nodes[idx].provides, pattern)) {
+			*id = idx;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+graph_build(struct xbps_handle *xhp, struct graph *g, bool repomode)
+{
+	struct graph_rpool_data grd;
+	int rv;
+
+	memset(g, 0, sizeof(*g));
+	g->names = xbps_dictionary_create();
+	g->vpkgs = xbps_dictionary_create();
+	if (g->names == NULL || g->vpkgs == NULL)
+		die("%s alloc dictionaries", __func__);
+
+	if (repomode) {
+		grd.xhp = xhp;
+		grd.g = g;
+		rv = xbps_rpool_foreach(xhp, graph_rpool_cb, &grd);
+	} else {
+		rv = xbps_pkgdb_foreach_cb(xhp, graph_pkgdb_cb, g);
+	}
+	if (rv != 0 && rv != ENOTSUP)
+		die("failed to collect packages: %s", strerror(rv));
+
+	/*
+	 * Assign node IDs by package name and index the names
+	 * of real and virtual packages.
+	 */
+	qsort(g->nodes, g->nnodes, sizeof(*g->nodes), graph_cmp_nodes);
+	for (unsigned int i = 0; i < g->nnodes; i++) {
+		struct graph_node *n = &g->nodes[i];
+
+		xbps_dictionary_set_uint32(g->names, n->pkgname, i);
+		for (unsigned int x = 0; x < xbps_array_count(n->provides); x++) {
+			char vpkgname[XBPS_NAME_SIZE];
+			xbps_array_t providers;
+			const char *vpkg = NULL;
+
+			xbps_array_get_cstring_nocopy(n->provides, x, &vpkg);
+			if (!xbps_pkg_name(vpkgname, sizeof(vpkgname), vpkg))
+				continue;
+			providers = xbps_dictionary_get(g->vpkgs, vpkgname);
+			if (providers == NULL) {
+				providers = xbps_array_create();
+				xbps_dictionary_set(g->vpkgs, vpkgname, providers);
+				xbps_object_release(providers);
+			}
+			xbps_array_add_uint32(providers, i);
+		}
+	}
+
+	for (unsigned int i = 0; i < g->nnodes; i++) {
+		struct graph_node *n = &g->nodes[i];
+
+		for (unsigned int x = 0; x < xbps_array_count(n->rundeps); x++) {
+			const char *pattern = NULL;
+			unsigned int id;
+
+			xbps_array_get_cstring_nocopy(n->rundeps, x, &pattern);
+			if (graph_resolve_dep(g, pattern, &id)) {
+				graph_add_edge(g, i, id);
+			} else {
+				xbps_dbg_printf(xhp, "%s: unresolved dependency `%s'\n",
+				    n->pkgver, pattern);
+				g->nmissing++;
+			}
+		}
+	}
+}
+
+static void
+graph_write_dot(FILE *f, struct graph *g, bool repomode)
+{
+	fprintf(f, "/* Graph created by xbps-graph %s */\n\n", XBPS_RELVER);
+	fprintf(f, "digraph pkg_dictionary {\n");
+	fprintf(f, "	graph [");
+	write_conf_property_on_stream(f, "graph");
+	fprintf(f, ",label=\"[XBPS] dependency graph [%s]\"];\n",
+	    repomode ? "repo" : "pkgdb");
+	fprintf(f, "	edge [");
+	write_conf_property_on_stream(f, "edge");
+	fprintf(f, "];\n");
+	fprintf(f, "	node [");
+	write_conf_property_on_stream(f, "node");
+	fprintf(f, "];\n");
+
+	for (unsigned int i = 0; i < g->nnodes; i++) {
+		fprintf(f, "\t%u [label=\"%s\"", i, g->nodes[i].pkgver);
+		if (g->nodes[i].installed)
+			fprintf(f, ",style=\"filled\",fillcolor=\"yellowgreen\"");
+		fprintf(f, "];\n");
+	}
+	for (unsigned int i = 0; i < g->nedges; i++)
+		fprintf(f, "\t%u -> %u;\n", g->edges[i * 2], g->edges[i * 2 + 1]);
+	fprintf(f, "}\n");
+}
+
+static void
+graph_write_json(FILE *f, struct graph *g)
+{
+	fprintf(f, "{\"nodes\":[");
+	for (unsigned int i = 0; i < g->nnodes; i++) {
+		fprintf(f, "%s{\"id\":%u,\"pkgver\":\"%s\"", i ? "," : "",
+		    i, g->nodes[i].pkgver);
+		if (g->nodes[i].installed)
+			fprintf(f, ",\"installed\":true");
+		fprintf(f, "}");
+	}
+	fprintf(f, "],\"edges\":[");
+	for (unsigned int i = 0; i < g->nedges; i++) {
+		fprintf(f, "%s[%u,%u]", i ? "," : "",
+		    g->edges[i * 2], g->edges[i * 2 + 1]);
+	}
+	fprintf(f, "]}\n");
+}
+
+/*
+ * Binary edge list, in host byte order:
+ *
+ *	char     magic[8]	"XBPSDGE1"
+ *	uint32_t nnodes
+ *	uint32_t nedges
+ *	uint32_t edges[nedges][2]	(from, to) node IDs
+ *	char     pkgvers[]	nnodes NUL terminated strings, by node ID
+ */
+static void
+graph_write_edges(FILE *f, struct graph *g)
+{
+	uint32_t hdr[2];
+
+	hdr[0] = g->nnodes;
+	hdr[1] = g->nedges;
+	if (fwrite(GRAPH_EDGES_MAGIC, 1, 8, f) != 8 ||
+	    fwrite(hdr, sizeof(hdr), 1, f) != 1 ||
+	    (g->nedges &&
+	    fwrite(g->edges, 2 * sizeof(*g->edges), g->nedges, f) != g->nedges))
+		die("failed to write edge list");
+	for (unsigned int i = 0; i < g->nnodes; i++) {
+		const char *pkgver = g->nodes[i].pkgver;
+
+		if (fwrite(pkgver, 1, strlen(pkgver) + 1, f) != strlen(pkgver) + 1)
+			die("failed to write edge list");
+	}
+}
+
+static void
+create_whole_graph(struct xbps_handle *xhp, FILE *f, bool repomode,
+		enum graph_format fmt)
+{
+	struct graph g;
+
+	graph_build(xhp, &g, repomode);
+	xbps_dbg_printf(xhp, "graph: %u nodes, %u edges, %u unresolved\n",
+	    g.nnodes, g.nedges, g.nmissing);
+
+	switch (fmt) {
+	case GRAPH_FMT_DOT:
+		graph_write_dot(f, &g, repomode);
+		break;
+	case GRAPH_FMT_JSON:
+		graph_write_json(f, &g);
+		break;
+	case GRAPH_FMT_EDGES:
+		graph_write_edges(f, &g);
+		break;
+	}
+	if (fflush(f) == EOF)
+		die("failed to write graph");
+	fclose(f);
+
+	xbps_object_release(g.names);
+	xbps_object_release(g.vpkgs);
+	free(g.nodes);
+	free(g.edges);
+}
+
 int
 main(int argc, char **argv)
 {
-	const char *shortopts = "C:c:dfghMmRr:V";
+	const char *shortopts = "aC:c:dfghMmRr:T:V";
 	const struct option longopts[] = {
+		{ "all", no_argument, NULL, 'a' },
 		{ "config", required_argument, NULL, 'C' },
 		{ "graph-config", required_argument, NULL, 'c' },
 		{ "debug", no_argument, NULL, 'd' },
@@ -524,6 +856,7 @@ main(int argc, char **argv)
 		{ "metadata", no_argument, NULL, 'm' },
 		{ "repository", no_argument, NULL, 'R' },
 		{ "rootdir", required_argument, NULL, 'r' },
+		{ "format", required_argument, NULL, 'T' },
 		{ "version", no_argument, NULL, 'V' },
 		{ NULL, 0, NULL, 0 },
 	};
@@ -531,14 +864,19 @@ main(int argc, char **argv)
 	struct xbps_handle xh;
 	FILE *f = NULL;
 	const char *pkg, *confdir, *conf_file, *rootdir;
+	enum graph_format fmt = GRAPH_FMT_DOT;
 	int c, rv, flags = 0;
-	bool opmode, repomode, fulldepgraph;
+	bool repomode, fulldepgraph, wholegraph, fmtset;
 
 	pkg = confdir = conf_file = rootdir = NULL;
-	opmode = repomode = fulldepgraph = false;
+	repomode = fulldepgraph = wholegraph = fmtset = false;
 
 	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
 		switch (c) {
+		case 'a':
+			/* generate a dependency graph of all packages */
+			wholegraph = true;
+			break;
 		case 'C':
 			/* xbps.d confdir */
 			confdir = optarg;
@@ -552,7 +890,7 @@ main(int argc, char **argv)
 			break;
 		case 'f':
 			/* generate a full dependency graph */
-			opmode = fulldepgraph = true;
+			fulldepgraph = true;
 			break;
 		case 'g':
 			/* Generate conf file. */
@@ -565,17 +903,27 @@ main(int argc, char **argv)
 			flags |= XBPS_FLAG_REPOS_MEMSYNC;
 			break;
 		case 'm':
-			/* pkgdb metadata mode */
-			opmode = true;
+			/* pkgdb metadata mode (default) */
 			break;
 		case 'R':
 			/* enable repository mode */
-			opmode = repomode = true;
+			repomode = true;
 			break;
 		case 'r':
 			/* Set different rootdir. */
 			rootdir = optarg;
 			break;
+		case 'T':
+			if (strcmp(optarg, "dot") == 0)
+				fmt = GRAPH_FMT_DOT;
+			else if (strcmp(optarg, "json") == 0)
+				fmt = GRAPH_FMT_JSON;
+			else if (strcmp(optarg, "edges") == 0)
+				fmt = GRAPH_FMT_EDGES;
+			else
+				usage(true);
+			fmtset = true;
+			break;
 		case 'v':
 			printf("%s\n", XBPS_RELVER);
 			exit(EXIT_SUCCESS);
@@ -589,10 +937,12 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (!argc && !opmode) {
+	if (!argc && !wholegraph) {
 		usage(true);
 		/* NOTREACHED */
 	}
+	if (fmtset && !wholegraph)
+		die("-T is only supported with -a");
 	pkg = *argv;
 
 	/* Initialize libxbps */
@@ -619,6 +969,14 @@ main(int argc, char **argv)
 
 		confd = create_defconf();
 	}
+
+	if (wholegraph) {
+		if ((f = fdopen(STDOUT_FILENO, "w")) == NULL)
+			die("cannot open stdout");
+		create_whole_graph(&xh, f, repomode, fmt);
+		exit(EXIT_SUCCESS);
+	}
+
 	/*
 	 * Internalize the plist file of the target installed package.
 	 */
@@ -67,5 +67,6 @@ void	print_package_line(const char *, unsigned int, bool);
 bool	print_trans_colmode(struct transaction *, unsigned int);
 int	get_maxcols(void);
 const char	*ttype2str(xbps_dictionary_t);
+int	print_timings(struct xbps_handle *, const char *);
 
 #endif /* !_XBPS_INSTALL_DEFS_H_ */
@@ -47,12 +47,15 @@ usage(bool fail)
 	    " -C, --config <dir>          Path to confdir (xbps.d)\n"
 	    " -c, --cachedir <dir>        Path to cachedir\n"
 	    " -d, --debug                 Debug mode shown to stderr\n"
+	    "     --durability <mode>     Sync mode: transaction, package or none\n"
 	    " -D, --download-only         Download packages and check integrity, nothing else\n"
 	    " -f, --force                 Force package re-installation\n"
 	    "                             If specified twice, all files will be overwritten.\n"
 	    " -h, --help                  Show usage\n"
 	    " -i, --ignore-conf-repos     Ignore repositories defined in xbps.d\n"
 	    " -I, --ignore-file-conflicts Ignore detected file conflicts\n"
+	    "     --low-memory            Don't keep package scripts in memory\n"
+	    "                             during the transaction\n"
 	    " -U, --unpack-only           Unpack packages in transaction, do not configure them\n"
 	    " -M, --memory-sync           Remote repository data is fetched and stored\n"
 	    "                             in memory, ignoring on-disk repodata archives\n"
@@ -60,7 +63,10 @@ usage(bool fail)
 	    " -R, --repository <url>      Add repository to the top of the list\n"
 	    "                             This option can be specified multiple times\n"
 	    " -r, --rootdir <dir>         Full path to rootdir\n"
+	    "     --pkgstore <dir>        Path to the package store\n"
 	    "     --reproducible          Enable reproducible mode in pkgdb\n"
+	    "     --timings[=<file>]      Show per phase timings and counters,\n"
+	    "                             or write them to <file> as a plist\n"
 	    " -S, --sync                  Sync remote repository index\n"
 	    " -u, --update                Update target package(s)\n"
 	    " -v, --verbose               Verbose messages\n"
@@ -118,18 +124,22 @@ main(int argc, char **argv)
 		{ "version", no_argument, NULL, 'V' },
 		{ "yes", no_argument, NULL, 'y' },
 		{ "reproducible", no_argument, NULL, 1 },
+		{ "timings", optional_argument, NULL, 2 },
+		{ "low-memory", no_argument, NULL, 3 },
+		{ "pkgstore", required_argument, NULL, 4 },
+		{ "durability", required_argument, NULL, 5 },
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
 	struct xferstat xfer;
-	const char *rootdir, *cachedir, *confdir;
+	const char *rootdir, *cachedir, *confdir, *timingsf, *storedir;
 	int i, c, flags, rv, fflag = 0;
-	bool syncf, yes, force, drun, update;
-	int maxcols, eexist = 0;
+	bool syncf, yes, force, drun, update, timings;
+	int maxcols, eexist = 0, durability = -1;
 
-	rootdir = cachedir = confdir = NULL;
+	rootdir = cachedir = confdir = timingsf = storedir = NULL;
 	flags = rv = 0;
-	syncf = yes = force = drun = update = false;
+	syncf = yes = force = drun = update = timings = false;
 
 	memset(&xh, 0, sizeof(xh));
 
@@ -138,6 +148,26 @@ main(int argc, char **argv)
 		case 1:
 			flags |= XBPS_FLAG_INSTALL_REPRO;
 			break;
+		case 2:
+			timings = true;
+			timingsf = optarg;
+			break;
+		case 3:
+			flags |= XBPS_FLAG_LOW_MEMORY;
+			break;
+		case 4:
+			storedir = optarg;
+			break;
+		case 5:
+			if (strcmp(optarg, "transaction") == 0)
+				durability = XBPS_DURABILITY_TRANSACTION;
+			else if (strcmp(optarg, "package") == 0)
+				durability = XBPS_DURABILITY_PACKAGE;
+			else if (strcmp(optarg, "none") == 0)
+				durability = XBPS_DURABILITY_NONE;
+			else
+				usage(true);
+			break;
 		case 'A':
 			flags |= XBPS_FLAG_INSTALL_AUTO;
 			break;
@@ -217,9 +247,16 @@ main(int argc, char **argv)
 		xbps_strlcpy(xh.rootdir, rootdir, sizeof(xh.rootdir));
 	if (cachedir)
 		xbps_strlcpy(xh.cachedir, cachedir, sizeof(xh.cachedir));
+	if (storedir)
+		xbps_strlcpy(xh.storedir, storedir, sizeof(xh.storedir));
 	if (confdir)
 		xbps_strlcpy(xh.confdir, confdir, sizeof(xh.confdir));
 	xh.flags = flags;
+	/*
+	 * Don't let a slow terminal stall downloads and unpacking.
+	 */
+	if (isatty(STDOUT_FILENO))
+		xh.flags |= XBPS_FLAG_ASYNC_CB;
 	if (flags & XBPS_FLAG_VERBOSE)
 		xh.unpack_cb = unpack_progress_cb;
 
@@ -228,6 +265,9 @@ main(int argc, char **argv)
 		    strerror(rv));
 		exit(EXIT_FAILURE);
 	}
+	/* the command line overrides the configuration files */
+	if (durability != -1)
+		xh.durability = durability;
 
 	maxcols = get_maxcols();
 
@@ -292,6 +332,8 @@ main(int argc, char **argv)
 	}
 
 out:
+	if (timings)
+		print_timings(&xh, timingsf);
 	xbps_end(&xh);
 	exit(rv);
 }
@@ -34,9 +34,6 @@
 int
 state_cb(const struct xbps_state_cb_data *xscd, void *cbdata UNUSED)
 {
-	xbps_dictionary_t pkgd;
-	const char *instver, *newver;
-	char pkgname[XBPS_NAME_SIZE];
 	int rv = 0;
 	bool slog = false;
 
@@ -99,17 +96,10 @@ state_cb(const struct xbps_state_cb_data *xscd, void *cbdata UNUSED)
 		/* empty */
 		break;
 	case XBPS_STATE_UPDATE:
-		if (!xbps_pkg_name(pkgname, sizeof(pkgname), xscd->arg)) {
-			abort();
-		}
-		newver = xbps_pkg_version(xscd->arg);
-		pkgd = xbps_pkgdb_get_pkg(xscd->xhp, pkgname);
-		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &instver);
-		printf("%s: updating to %s ...\n", instver, newver);
+		printf("%s\n", xscd->desc);
 		if (slog) {
-			syslog(LOG_NOTICE, "%s: updating to %s ... "
-			    "(rootdir: %s)\n", instver, newver,
-			    xscd->xhp->rootdir);
+			syslog(LOG_NOTICE, "%s (rootdir: %s)\n",
+			    xscd->desc, xscd->xhp->rootdir);
 		}
 		break;
 	/* success */
@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <fnmatch.h>
 #include <string.h>
 #include <strings.h>
@@ -221,3 +222,44 @@ print_trans_colmode(struct transaction *trans, unsigned int cols)
 	xbps_object_iterator_reset(trans->iter);
 	return true;
 }
+
+int
+print_timings(struct xbps_handle *xhp, const char *file)
+{
+	xbps_dictionary_t d;
+	unsigned int i;
+	int rv = 0;
+
+	if (file != NULL) {
+		/* machine readable dump */
+		if ((d = xbps_stats_dictionary(xhp)) == NULL)
+			return ENOMEM;
+		if (!xbps_dictionary_externalize_to_file(d, file)) {
+			rv = errno;
+			xbps_error_printf("Failed to write timings to %s: %s\n",
+			    file, strerror(rv));
+		}
+		xbps_object_release(d);
+		return rv;
+	}
+	fprintf(stderr, "%-20s %8s %14s\n", "PHASE", "COUNT", "TIME (ms)");
+	for (i = 0; i < XBPS_STATS_PHASE_MAX; i++) {
+		fprintf(stderr, "%-20s %8" PRIu64 " %14.3f\n",
+		    xbps_stats_phase_name(i), xhp->stats.phase_count[i],
+		    (double)xhp->stats.phase_ns[i] / 1000000.0);
+	}
+	fprintf(stderr, "\n%-20s %23s\n", "COUNTER", "VALUE");
+	for (i = 0; i < XBPS_STATS_COUNTER_MAX; i++) {
+		fprintf(stderr, "%-20s %23" PRIu64 "\n",
+		    xbps_stats_counter_name(i), xhp->stats.counters[i]);
+	}
+	fprintf(stderr, "\n%-20s %11s %11s\n", "MEMORY", "CURRENT", "PEAK");
+	for (i = 0; i < XBPS_STATS_MEM_MAX; i++) {
+		fprintf(stderr, "%-20s %11" PRIu64 " %11" PRIu64 "\n",
+		    xbps_stats_mem_name(i), xhp->stats.mem[i],
+		    xhp->stats.mem_peak[i]);
+	}
+	fprintf(stderr, "%-20s %11" PRIu64 " %11" PRIu64 "\n", "total",
+	    xhp->stats.mem_total, xhp->stats.mem_total_peak);
+	return 0;
+}
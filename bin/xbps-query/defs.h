@@ -66,5 +66,18 @@ int	repo_list(struct xbps_handle *);
 /* from search.c */
 int	search(struct xbps_handle *, bool, const char *, const char *, bool);
 
+/* from query.c */
+int	query_main(int, char **, struct xbps_handle *);
+
+/* from queryd.c */
+#define QUERYD_FALLBACK		-1
+#define QUERYD_SOCKET		"/run/xbps-queryd.sock"
+
+const char	*queryd_socket_path(void);
+int	queryd_client(int, char **);
+bool	queryd_compatible(struct xbps_handle *, struct xbps_handle *);
+void	queryd_accept(void);
+int	queryd_serve(int, struct xbps_handle *);
+
 
 #endif /* !_XBPS_QUERY_DEFS_H_ */
@@ -0,0 +1,522 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __linux__
+# define _GNU_SOURCE	/* for struct ucred */
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <xbps.h>
+#include "defs.h"
+
+#ifndef __arraycount
+# define __arraycount(a) (sizeof(a) / sizeof(*(a)))
+#endif
+
+/*
+ * Protocol between xbps-query and xbps-queryd(8).
+ *
+ * The client connects to the unix socket and sends the magic number
+ * along with its stdout and stderr file descriptors (SCM_RIGHTS),
+ * followed by its working directory, the XBPS_ARCH/XBPS_TARGET_ARCH
+ * environment variables and its arguments, as length prefixed strings.
+ *
+ * Only clients running with the same uid as the daemon, in the same
+ * root directory and mount namespace, are served.
+ *
+ * The daemon runs the query in a forked process writing directly to
+ * the client descriptors, and replies with (type, value) messages:
+ *
+ *	ACCEPT		the preloaded handle is being used
+ *	FALLBACK	the handle settings don't match, run the query locally
+ *	STATUS		the query finished with exit status `value'
+ */
+#define QUERYD_MAGIC		0x58514431	/* XQD1 */
+#define QUERYD_MAXSTR		(1U << 20)
+#define QUERYD_MAXARGS		1024
+
+enum {
+	QUERYD_MSG_ACCEPT = 'A',
+	QUERYD_MSG_FALLBACK = 'F',
+	QUERYD_MSG_STATUS = 'S'
+};
+
+static const char *queryd_envs[] = { "XBPS_ARCH", "XBPS_TARGET_ARCH" };
+
+static int queryd_conn = -1;
+
+const char *
+queryd_socket_path(void)
+{
+	const char *path;
+
+	if ((path = getenv("XBPS_QUERYD_SOCKET")) != NULL)
+		return path;
+	return QUERYD_SOCKET;
+}
+
+static bool
+write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+static bool
+read_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		} else if (n == 0) {
+			return false;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+static bool
+send_uint32(int fd, uint32_t val)
+{
+	return write_all(fd, &val, sizeof(val));
+}
+
+static bool
+recv_uint32(int fd, uint32_t *val)
+{
+	return read_all(fd, val, sizeof(*val));
+}
+
+static bool
+send_string(int fd, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (len >= QUERYD_MAXSTR)
+		return false;
+	return send_uint32(fd, (uint32_t)len) && write_all(fd, str, len);
+}
+
+static char *
+recv_string(int fd)
+{
+	uint32_t len;
+	char *str;
+
+	if (!recv_uint32(fd, &len) || len >= QUERYD_MAXSTR)
+		return NULL;
+	if ((str = malloc(len + 1)) == NULL)
+		return NULL;
+	if (!read_all(fd, str, len)) {
+		free(str);
+		return NULL;
+	}
+	str[len] = '\0';
+	return str;
+}
+
+static bool
+send_msg(int fd, int32_t type, int32_t value)
+{
+	int32_t msg[2] = { type, value };
+
+	return write_all(fd, msg, sizeof(msg));
+}
+
+static bool
+send_fds(int sock, int fd1, int fd2)
+{
+	uint32_t magic = QUERYD_MAGIC;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+	} cmsgbuf;
+	int fds[2] = { fd1, fd2 };
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+	iov.iov_base = &magic;
+	iov.iov_len = sizeof(magic);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(sock, &msg, 0) == (ssize_t)sizeof(magic);
+}
+
+static bool
+recv_fds(int sock, int *fd1, int *fd2)
+{
+	uint32_t magic = 0;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+	} cmsgbuf;
+	int fds[2];
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &magic;
+	iov.iov_len = sizeof(magic);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+	if (recvmsg(sock, &msg, 0) != (ssize_t)sizeof(magic))
+		return false;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+	    cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+		return false;
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	if (magic != QUERYD_MAGIC) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	*fd1 = fds[0];
+	*fd2 = fds[1];
+	return true;
+}
+
+/*
+ * Runs the query in xbps-queryd(8) if it's listening on the socket.
+ * Returns the exit status of the query, or QUERYD_FALLBACK if it must
+ * be run locally.
+ */
+int
+queryd_client(int argc, char **argv)
+{
+	struct sockaddr_un sun;
+	const char *path, *val;
+	char cwd[PATH_MAX];
+	int32_t msg[2];
+	uint32_t nenv = 0;
+	int fd;
+	bool accepted = false;
+
+	path = queryd_socket_path();
+	if (*path == '\0' || strlen(path) >= sizeof(sun.sun_path))
+		return QUERYD_FALLBACK;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return QUERYD_FALLBACK;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return QUERYD_FALLBACK;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	xbps_strlcpy(sun.sun_path, path, sizeof(sun.sun_path));
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		goto fallback;
+
+	/* don't die if the daemon goes away */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!send_fds(fd, STDOUT_FILENO, STDERR_FILENO) || !send_string(fd, cwd))
+		goto fallback;
+	for (unsigned int i = 0; i < __arraycount(queryd_envs); i++) {
+		if (getenv(queryd_envs[i]) != NULL)
+			nenv++;
+	}
+	if (!send_uint32(fd, nenv))
+		goto fallback;
+	for (unsigned int i = 0; i < __arraycount(queryd_envs); i++) {
+		char *env;
+		bool ok;
+
+		if ((val = getenv(queryd_envs[i])) == NULL)
+			continue;
+		env = xbps_xasprintf("%s=%s", queryd_envs[i], val);
+		ok = send_string(fd, env);
+		free(env);
+		if (!ok)
+			goto fallback;
+	}
+	if (!send_uint32(fd, (uint32_t)argc))
+		goto fallback;
+	for (int i = 0; i < argc; i++) {
+		if (!send_string(fd, argv[i]))
+			goto fallback;
+	}
+
+	while (read_all(fd, msg, sizeof(msg))) {
+		switch (msg[0]) {
+		case QUERYD_MSG_ACCEPT:
+			accepted = true;
+			break;
+		case QUERYD_MSG_FALLBACK:
+			goto fallback;
+		case QUERYD_MSG_STATUS:
+			close(fd);
+			return msg[1];
+		}
+	}
+	close(fd);
+	if (accepted) {
+		xbps_error_printf("xbps-queryd: connection lost\n");
+		return EXIT_FAILURE;
+	}
+	return QUERYD_FALLBACK;
+
+fallback:
+	close(fd);
+	return QUERYD_FALLBACK;
+}
+
+/*
+ * Returns true if the handle initialized for the client request has
+ * the same settings as the preloaded one.
+ */
+bool
+queryd_compatible(struct xbps_handle *warm, struct xbps_handle *xhp)
+{
+	const int mask = XBPS_FLAG_REPOS_MEMSYNC|XBPS_FLAG_IGNORE_CONF_REPOS;
+
+	if (strcmp(warm->rootdir, xhp->rootdir) ||
+	    strcmp(warm->metadir, xhp->metadir) ||
+	    strcmp(warm->cachedir, xhp->cachedir) ||
+	    strcmp(warm->confdir, xhp->confdir) ||
+	    strcmp(warm->sysconfdir, xhp->sysconfdir) ||
+	    strcmp(warm->native_arch, xhp->native_arch))
+		return false;
+	if ((warm->target_arch == NULL) != (xhp->target_arch == NULL) ||
+	    (warm->target_arch && strcmp(warm->target_arch, xhp->target_arch)))
+		return false;
+	if ((warm->flags & mask) != (xhp->flags & mask))
+		return false;
+
+	return xbps_array_equals(warm->repositories, xhp->repositories);
+}
+
+void
+queryd_accept(void)
+{
+	if (queryd_conn != -1)
+		(void)send_msg(queryd_conn, QUERYD_MSG_ACCEPT, 0);
+}
+
+static bool
+same_file(const char *path1, const char *path2)
+{
+	struct stat st1, st2;
+
+	if (stat(path1, &st1) == -1 || stat(path2, &st2) == -1)
+		return false;
+	return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+/*
+ * Returns true if the peer on \a conn runs with the same uid as the
+ * daemon and sees the same filesystem: the client's cwd and the
+ * options resolving paths would otherwise refer to other files.
+ */
+static bool
+peer_trusted(int conn, struct xbps_handle *warm)
+{
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	char path[64];
+
+	if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+		xbps_dbg_printf(warm, "[queryd] SO_PEERCRED: %s\n",
+		    strerror(errno));
+		return false;
+	}
+	if (cred.uid != geteuid()) {
+		xbps_dbg_printf(warm, "[queryd] peer uid %u differs, "
+		    "falling back\n", (unsigned int)cred.uid);
+		return false;
+	}
+	snprintf(path, sizeof(path), "/proc/%ld/root", (long)cred.pid);
+	if (!same_file(path, "/proc/self/root")) {
+		xbps_dbg_printf(warm, "[queryd] peer root directory differs, "
+		    "falling back\n");
+		return false;
+	}
+	snprintf(path, sizeof(path), "/proc/%ld/ns/mnt", (long)cred.pid);
+	if (!same_file(path, "/proc/self/ns/mnt")) {
+		xbps_dbg_printf(warm, "[queryd] peer mount namespace differs, "
+		    "falling back\n");
+		return false;
+	}
+	return true;
+#else
+	(void)conn;
+	xbps_dbg_printf(warm, "[queryd] cannot check peer credentials, "
+	    "falling back\n");
+	return false;
+#endif
+}
+
+/*
+ * Serves a client request on \a conn with the preloaded handle \a warm.
+ * Runs in a process forked for the connection.
+ */
+int
+queryd_serve(int conn, struct xbps_handle *warm)
+{
+	char **args = NULL, *cwd = NULL;
+	uint32_t nenv, nargs = 0, i;
+	int fdout, fderr, status, rv = EINVAL;
+	pid_t pid;
+
+	if (!peer_trusted(conn, warm)) {
+		(void)send_msg(conn, QUERYD_MSG_FALLBACK, 0);
+		return 0;
+	}
+	if (!recv_fds(conn, &fdout, &fderr))
+		return EINVAL;
+	if ((cwd = recv_string(conn)) == NULL)
+		goto out;
+
+	(void)unsetenv("XBPS_ARCH");
+	(void)unsetenv("XBPS_TARGET_ARCH");
+	if (!recv_uint32(conn, &nenv) || nenv > __arraycount(queryd_envs))
+		goto out;
+	for (i = 0; i < nenv; i++) {
+		char *env, *p;
+
+		if ((env = recv_string(conn)) == NULL)
+			goto out;
+		if ((p = strchr(env, '=')) == NULL) {
+			free(env);
+			goto out;
+		}
+		*p = '\0';
+		if (strcmp(env, queryd_envs[0]) && strcmp(env, queryd_envs[1])) {
+			free(env);
+			goto out;
+		}
+		setenv(env, p + 1, 1);
+		free(env);
+	}
+
+	if (!recv_uint32(conn, &nargs) || nargs == 0 || nargs > QUERYD_MAXARGS)
+		goto out;
+	if ((args = calloc(nargs + 1, sizeof(char *))) == NULL)
+		goto out;
+	for (i = 0; i < nargs; i++) {
+		if ((args[i] = recv_string(conn)) == NULL)
+			goto out;
+	}
+
+	signal(SIGCHLD, SIG_DFL);
+	if ((pid = fork()) == -1) {
+		rv = errno;
+		goto out;
+	} else if (pid == 0) {
+		if (dup2(fdout, STDOUT_FILENO) == -1 ||
+		    dup2(fderr, STDERR_FILENO) == -1 ||
+		    chdir(cwd) == -1) {
+			(void)send_msg(conn, QUERYD_MSG_FALLBACK, 0);
+			_exit(EXIT_FAILURE);
+		}
+		close(fdout);
+		close(fderr);
+		queryd_conn = conn;
+		/* reset getopt(3) */
+		optind = 0;
+		rv = query_main((int)nargs, args, warm);
+		if (rv == QUERYD_FALLBACK) {
+			(void)send_msg(conn, QUERYD_MSG_FALLBACK, 0);
+			_exit(EXIT_FAILURE);
+		}
+		exit(rv);
+	}
+	close(fdout);
+	close(fderr);
+	fdout = fderr = -1;
+
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			rv = errno;
+			goto out;
+		}
+	}
+	if (WIFEXITED(status))
+		status = WEXITSTATUS(status);
+	else if (WIFSIGNALED(status))
+		status = 128 + WTERMSIG(status);
+	(void)send_msg(conn, QUERYD_MSG_STATUS, status);
+	rv = 0;
+out:
+	if (fdout != -1)
+		close(fdout);
+	if (fderr != -1)
+		close(fderr);
+	if (args != NULL) {
+		for (i = 0; i < nargs; i++)
+			free(args[i]);
+		free(args);
+	}
+	free(cwd);
+	return rv;
+}
@@ -221,6 +221,44 @@ search_repo_cb(struct xbps_repo *repo, void *arg, bool *done UNUSED)
 	return rv;
 }
 
+static int
+search_index_cb(struct xbps_handle *xhp UNUSED,
+		const char *pkgver,
+		const char *desc,
+		void *arg,
+		bool *done UNUSED)
+{
+	struct search_data *sd = arg;
+
+	xbps_array_add_cstring(sd->results, pkgver);
+	xbps_array_add_cstring(sd->results, desc);
+	return 0;
+}
+
+/*
+ * Search all repositories through their search index, this is only
+ * possible if every repository has an up to date search index.
+ */
+static bool
+search_repo_index(struct xbps_handle *xhp, struct search_data *sd)
+{
+	const char *repouri = NULL;
+
+	if (sd->regex || sd->prop || (xhp->flags & XBPS_FLAG_REPOS_MEMSYNC))
+		return false;
+
+	for (unsigned int i = 0; i < xbps_array_count(xhp->repositories); i++) {
+		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
+		if (xbps_repo_search_index(xhp, repouri, sd->pat,
+		    search_index_cb, sd) != 0) {
+			xbps_object_release(sd->results);
+			sd->results = xbps_array_create();
+			return false;
+		}
+	}
+	return true;
+}
+
 int
 search(struct xbps_handle *xhp, bool repo_mode, const char *pat, const char *prop, bool regex)
 {
@@ -244,7 +282,9 @@ search(struct xbps_handle *xhp, bool repo_mode, const char *pat, const char *pro
 			exit(1);
 	}
 
-	if (repo_mode) {
+	if (repo_mode && search_repo_index(xhp, &sd)) {
+		rv = 0;
+	} else if (repo_mode) {
 		rv = xbps_rpool_foreach(xhp, search_repo_cb, &sd);
 		if (rv != 0 && rv != ENOTSUP) {
 			fprintf(stderr, "Failed to initialize rpool: %s\n",
@@ -0,0 +1,337 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <xbps.h>
+#include "../xbps-query/defs.h"
+
+struct queryd {
+	struct xbps_handle xh;
+	const char *rootdir, *cachedir, *confdir;
+	xbps_array_t repos;
+	int flags;
+	uint64_t fingerprint;
+	unsigned long generation;
+};
+
+static volatile sig_atomic_t quit, reload;
+
+static void __attribute__((noreturn))
+usage(bool fail)
+{
+	fprintf(stdout,
+	    "Usage: xbps-queryd [OPTIONS]\n\n"
+	    "OPTIONS\n"
+	    " -C, --config <dir>        Path to confdir (xbps.d)\n"
+	    " -c, --cachedir <dir>      Path to cachedir\n"
+	    " -d, --debug               Debug mode shown to stderr\n"
+	    " -h, --help                Show usage\n"
+	    " -i, --ignore-conf-repos   Ignore repositories defined in xbps.d\n"
+	    " -M, --memory-sync         Remote repository data is fetched and stored\n"
+	    "                           in memory, ignoring on-disk repodata archives\n"
+	    "     --repository=<url>    Add repository to the top of the list.\n"
+	    "                           This option can be specified multiple times\n"
+	    " -r, --rootdir <dir>       Full path to rootdir\n"
+	    " -s, --socket <path>       Path to the unix socket\n"
+	    " -V, --version             Show XBPS version\n");
+	exit(fail ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void
+sighandler(int sig)
+{
+	if (sig == SIGHUP)
+		reload = 1;
+	else
+		quit = 1;
+}
+
+static int
+pkgdb_init_cb(struct xbps_handle *xhp UNUSED, xbps_object_t obj UNUSED,
+		const char *key UNUSED, void *arg UNUSED, bool *done)
+{
+	*done = true;
+	return 0;
+}
+
+static int
+rpool_init_cb(struct xbps_repo *repo UNUSED, void *arg UNUSED, bool *done UNUSED)
+{
+	return 0;
+}
+
+static uint64_t
+stat_hash(uint64_t hash, const char *path)
+{
+	struct stat st;
+	uint64_t v[5];
+	const unsigned char *p = (const unsigned char *)v;
+
+	memset(v, 0, sizeof(v));
+	if (path != NULL && stat(path, &st) == 0) {
+		v[0] = (uint64_t)st.st_dev;
+		v[1] = (uint64_t)st.st_ino;
+		v[2] = (uint64_t)st.st_size;
+		v[3] = (uint64_t)st.st_mtim.tv_sec;
+		v[4] = (uint64_t)st.st_mtim.tv_nsec;
+	}
+	/* FNV-1a */
+	for (size_t i = 0; i < sizeof(v); i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+ * Fingerprint of the files the preloaded state comes from: the pkgdb
+ * and the repository archives (plus the staging archive of local
+ * repositories). Any change in their inode, size or mtime triggers
+ * a reload.
+ */
+static uint64_t
+state_fingerprint(struct xbps_handle *xhp)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const char *uri = NULL;
+	char *path;
+
+	hash = stat_hash(hash, xhp->pkgdb_plist);
+	for (unsigned int i = 0; i < xbps_array_count(xhp->repositories); i++) {
+		xbps_array_get_cstring_nocopy(xhp->repositories, i, &uri);
+		path = xbps_repo_archive_path(xhp, uri);
+		hash = stat_hash(hash, path);
+		free(path);
+		if (xbps_repository_is_remote(uri))
+			continue;
+		path = xbps_repo_path_with_name(xhp, uri, "stagedata");
+		hash = stat_hash(hash, path);
+		free(path);
+	}
+	return hash;
+}
+
+static int
+queryd_init(struct queryd *qd)
+{
+	struct xbps_handle *xhp = &qd->xh;
+	const char *repo = NULL;
+	int rv;
+
+	memset(xhp, 0, sizeof(*xhp));
+	if (qd->rootdir)
+		xbps_strlcpy(xhp->rootdir, qd->rootdir, sizeof(xhp->rootdir));
+	if (qd->cachedir)
+		xbps_strlcpy(xhp->cachedir, qd->cachedir, sizeof(xhp->cachedir));
+	if (qd->confdir)
+		xbps_strlcpy(xhp->confdir, qd->confdir, sizeof(xhp->confdir));
+	for (unsigned int i = 0; i < xbps_array_count(qd->repos); i++) {
+		xbps_array_get_cstring_nocopy(qd->repos, i, &repo);
+		xbps_repo_store(xhp, repo);
+	}
+	xhp->flags = qd->flags;
+
+	if ((rv = xbps_init(xhp)) != 0) {
+		xbps_error_printf("Failed to initialize libxbps: %s\n",
+		    strerror(rv));
+		return rv;
+	}
+
+	/* preload the pkgdb and the repository pool */
+	rv = xbps_pkgdb_foreach_cb(xhp, pkgdb_init_cb, NULL);
+	if (rv != 0 && rv != ENOENT) {
+		xbps_error_printf("Failed to initialize pkgdb: %s\n",
+		    strerror(rv));
+		return rv;
+	}
+	(void)xbps_rpool_foreach(xhp, rpool_init_cb, NULL);
+
+	qd->fingerprint = state_fingerprint(xhp);
+	qd->generation++;
+	xbps_dbg_printf(xhp, "[queryd] state generation %lu loaded\n",
+	    qd->generation);
+	return 0;
+}
+
+static void
+queryd_fini(struct queryd *qd)
+{
+	xbps_rpool_release(&qd->xh);
+	xbps_end(&qd->xh);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *shortopts = "C:c:dhiMr:s:V";
+	const struct option longopts[] = {
+		{ "config", required_argument, NULL, 'C' },
+		{ "cachedir", required_argument, NULL, 'c' },
+		{ "debug", no_argument, NULL, 'd' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "ignore-conf-repos", no_argument, NULL, 'i' },
+		{ "memory-sync", no_argument, NULL, 'M' },
+		{ "repository", required_argument, NULL, 1 },
+		{ "rootdir", required_argument, NULL, 'r' },
+		{ "socket", required_argument, NULL, 's' },
+		{ "version", no_argument, NULL, 'V' },
+		{ NULL, 0, NULL, 0 },
+	};
+	struct queryd qd;
+	struct sockaddr_un sun;
+	struct sigaction sa;
+	const char *sockpath;
+	mode_t omask;
+	pid_t pid;
+	int c, sock, conn, rv;
+
+	memset(&qd, 0, sizeof(qd));
+	qd.repos = xbps_array_create();
+	sockpath = queryd_socket_path();
+
+	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
+		switch (c) {
+		case 'C':
+			qd.confdir = optarg;
+			break;
+		case 'c':
+			qd.cachedir = optarg;
+			break;
+		case 'd':
+			qd.flags |= XBPS_FLAG_DEBUG;
+			break;
+		case 'h':
+			usage(false);
+			/* NOTREACHED */
+		case 'i':
+			qd.flags |= XBPS_FLAG_IGNORE_CONF_REPOS;
+			break;
+		case 'M':
+			qd.flags |= XBPS_FLAG_REPOS_MEMSYNC;
+			break;
+		case 1:
+			xbps_array_add_cstring(qd.repos, optarg);
+			break;
+		case 'r':
+			qd.rootdir = optarg;
+			break;
+		case 's':
+			sockpath = optarg;
+			break;
+		case 'V':
+			printf("%s\n", XBPS_RELVER);
+			exit(EXIT_SUCCESS);
+		case '?':
+		default:
+			usage(true);
+			/* NOTREACHED */
+		}
+	}
+	if (argc != optind)
+		usage(true);
+
+	if (*sockpath == '\0' || strlen(sockpath) >= sizeof(sun.sun_path)) {
+		xbps_error_printf("invalid socket path `%s'\n", sockpath);
+		exit(EXIT_FAILURE);
+	}
+
+	if (queryd_init(&qd) != 0)
+		exit(EXIT_FAILURE);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	/* reap connection handlers automatically */
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		xbps_error_printf("socket: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	xbps_strlcpy(sun.sun_path, sockpath, sizeof(sun.sun_path));
+	(void)unlink(sockpath);
+	/* only accessible by the daemon's user */
+	omask = umask(0077);
+	rv = bind(sock, (struct sockaddr *)&sun, sizeof(sun));
+	umask(omask);
+	if (rv == -1 || chmod(sockpath, 0600) == -1 ||
+	    listen(sock, SOMAXCONN) == -1) {
+		xbps_error_printf("cannot listen on `%s': %s\n",
+		    sockpath, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	xbps_dbg_printf(&qd.xh, "[queryd] listening on %s\n", sockpath);
+
+	rv = EXIT_SUCCESS;
+	while (!quit) {
+		if ((conn = accept(sock, NULL, NULL)) == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			xbps_error_printf("accept: %s\n", strerror(errno));
+			rv = EXIT_FAILURE;
+			break;
+		}
+		if (reload || state_fingerprint(&qd.xh) != qd.fingerprint) {
+			reload = 0;
+			queryd_fini(&qd);
+			if (queryd_init(&qd) != 0) {
+				close(conn);
+				rv = EXIT_FAILURE;
+				break;
+			}
+		}
+		if ((pid = fork()) == -1) {
+			xbps_error_printf("fork: %s\n", strerror(errno));
+		} else if (pid == 0) {
+			close(sock);
+			_exit(queryd_serve(conn, &qd.xh) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		close(conn);
+	}
+	close(sock);
+	(void)unlink(sockpath);
+	queryd_fini(&qd);
+	xbps_object_release(qd.repos);
+	exit(rv);
+}
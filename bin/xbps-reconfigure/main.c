@@ -45,6 +45,7 @@ usage(bool fail)
 	    " -d, --debug          Debug mode shown to stderr\n"
 	    " -f, --force          Force reconfiguration\n"
 	    "     --fulldeptree    Full dependency tree for -x/--deps\n"
+	    "     --parallel       Configure packages concurrently with -a/--all\n"
 	    " -h, --help           Show usage\n"
 	    " -i, --ignore PKG     Ignore PKG with -a/--all\n"
 	    " -r, --rootdir <dir>  Full path to rootdir\n"
@@ -106,6 +107,7 @@ main(int argc, char **argv)
 		{ "verbose", no_argument, NULL, 'v' },
 		{ "version", no_argument, NULL, 'V' },
 		{ "fulldeptree", no_argument, NULL, 1 },
+		{ "parallel", no_argument, NULL, 2 },
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
@@ -152,6 +154,9 @@ main(int argc, char **argv)
 		case 1:
 			fulldeptree = true;
 			break;
+		case 2:
+			flags |= XBPS_FLAG_PARALLEL_CONFIGURE;
+			break;
 		case '?':
 		default:
 			usage(true);
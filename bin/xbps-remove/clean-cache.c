@@ -22,7 +22,6 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -32,11 +31,42 @@
 #include <assert.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <sys/stat.h>
 
 #include <xbps.h>
 #include "defs.h"
 
+/*
+ * Sidecar index stored in cachedir, mapping binary package filenames to
+ * their size, mtime and SHA256 hash. Entries are trusted as long as the
+ * size and mtime of the file did not change, so that unchanged packages
+ * do not have to be hashed again on every run.
+ */
+#define CACHE_INDEX	".xbps-cache-index.plist"
+
+struct cachefile {
+	char *binpkg;
+	char *pkgname;
+	char *pkgver;
+	const char *reason;
+	uint64_t size;
+	struct timespec mtime;
+	time_t lastuse;
+	/* computed by the workers, added to the index afterwards */
+	char sha256[XBPS_SHA256_SIZE];
+	bool hashed;
+	bool current;
+	bool remove;
+};
+
+struct cleaner_data {
+	struct cachefile *files;
+	size_t nfiles;
+	xbps_dictionary_t index;
+};
+
 static int
 binpkg_parse(char *buf, size_t bufsz, const char *path, const char **pkgver, const char **arch)
 {
@@ -64,23 +94,217 @@ binpkg_parse(char *buf, size_t bufsz, const char *path, const char **pkgver, con
 	return 0;
 }
 
+/*
+ * Called concurrently from the workers, the index is only read here.
+ */
+static const char *
+cachefile_sha256(struct cleaner_data *cd, struct cachefile *cf)
+{
+	xbps_dictionary_t d;
+	const char *sha256 = NULL;
+	uint64_t size = 0, sec = 0, nsec = 0;
+
+	d = xbps_dictionary_get(cd->index, cf->binpkg);
+	if (d != NULL &&
+	    xbps_dictionary_get_uint64(d, "size", &size) && size == cf->size &&
+	    xbps_dictionary_get_uint64(d, "mtime", &sec) &&
+	    (time_t)sec == cf->mtime.tv_sec &&
+	    xbps_dictionary_get_uint64(d, "mtime-nsec", &nsec) &&
+	    (long)nsec == cf->mtime.tv_nsec &&
+	    xbps_dictionary_get_cstring_nocopy(d, "sha256", &sha256))
+		return sha256;
+
+	if (!xbps_file_sha256(cf->sha256, sizeof(cf->sha256), cf->binpkg))
+		return NULL;
+	cf->hashed = true;
+	return cf->sha256;
+}
+
+static void
+cachefile_index_add(struct cleaner_data *cd, struct cachefile *cf)
+{
+	xbps_dictionary_t d;
+
+	d = xbps_dictionary_create();
+	xbps_dictionary_set_uint64(d, "size", cf->size);
+	xbps_dictionary_set_uint64(d, "mtime", (uint64_t)cf->mtime.tv_sec);
+	xbps_dictionary_set_uint64(d, "mtime-nsec", (uint64_t)cf->mtime.tv_nsec);
+	xbps_dictionary_set_cstring(d, "sha256", cf->sha256);
+	xbps_dictionary_set(cd->index, cf->binpkg, d);
+	xbps_object_release(d);
+}
+
 static int
 cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj,
 		const char *key UNUSED, void *arg,
 		bool *done UNUSED)
 {
-	char buf[PATH_MAX];
+	struct cleaner_data *cd = arg;
+	struct cachefile *cf;
 	xbps_dictionary_t repo_pkgd;
-	const char *binpkg, *rsha256;
-	const char *binpkgver, *binpkgarch;
-	bool drun = false;
+	const char *rsha256, *lsha256;
+
+	cf = &cd->files[xbps_number_unsigned_integer_value(obj)];
+
+	/*
+	 * Remove binary pkg if it's not registered in any repository
+	 * or if hash doesn't match.
+	 */
+	repo_pkgd = xbps_rpool_get_pkg(xhp, cf->pkgver);
+	if (repo_pkgd == NULL) {
+		cf->reason = "obsolete";
+		return 0;
+	}
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd,
+	    "filename-sha256", &rsha256);
+	lsha256 = cachefile_sha256(cd, cf);
+	if (lsha256 == NULL) {
+		xbps_error_printf("Failed to checksum `%s': %s\n",
+		    cf->binpkg, strerror(errno));
+		cf->current = true;
+		return 0;
+	}
+	if (rsha256 != NULL && strcmp(lsha256, rsha256) == 0) {
+		/* hash matched */
+		cf->current = true;
+		return 0;
+	}
+	cf->reason = "obsolete";
+	cf->remove = true;
+	return 0;
+}
+
+static int
+rpool_init_cb(struct xbps_repo *repo UNUSED, void *arg UNUSED, bool *done)
+{
+	*done = true;
+	return 0;
+}
+
+static int
+cachefile_cmp_pkgver(const void *a, const void *b)
+{
+	const struct cachefile *fa = a, *fb = b;
 	int r;
 
-	/* Extract drun (dry-run) flag from arg*/
-	if (arg != NULL)
-		drun = *(bool*)arg;
+	if ((r = strcmp(fa->pkgname, fb->pkgname)) != 0)
+		return r;
+	/* newest version first */
+	return xbps_cmpver(fb->pkgver, fa->pkgver);
+}
+
+static int
+cachefile_cmp_lastuse(const void *a, const void *b)
+{
+	const struct cachefile *fa = a, *fb = b;
+
+	if (fa->lastuse != fb->lastuse)
+		return fa->lastuse < fb->lastuse ? -1 : 1;
+	return strcmp(fa->binpkg, fb->binpkg);
+}
+
+static int
+cachefile_cmp_name(const void *a, const void *b)
+{
+	const struct cachefile *fa = a, *fb = b;
+
+	return strcmp(fa->binpkg, fb->binpkg);
+}
+
+static int
+cachefile_cmp_key(const void *key, const void *elem)
+{
+	const struct cachefile *cf = elem;
+
+	return strcmp(key, cf->binpkg);
+}
+
+/*
+ * Keep at most `keep' versions of each package, newest first. Packages
+ * still available in a repository count towards the limit but are never
+ * removed by this policy. With keep == 0 all obsolete packages are removed.
+ */
+static void
+plan_keep_versions(struct cleaner_data *cd, unsigned int keep)
+{
+	size_t i, j, n;
+
+	qsort(cd->files, cd->nfiles, sizeof(*cd->files), cachefile_cmp_pkgver);
+	for (i = 0; i < cd->nfiles; i = j) {
+		n = 0;
+		for (j = i; j < cd->nfiles &&
+		    strcmp(cd->files[i].pkgname, cd->files[j].pkgname) == 0; j++) {
+			struct cachefile *cf = &cd->files[j];
+
+			if (cf->remove)
+				continue;
+			if (cf->current || n < keep) {
+				n++;
+				continue;
+			}
+			cf->remove = true;
+		}
+	}
+}
+
+/*
+ * Remove least recently used packages until the cache fits into
+ * `maxsize' bytes.
+ */
+static void
+plan_max_size(struct cleaner_data *cd, uint64_t maxsize)
+{
+	uint64_t total = 0;
+	size_t i;
+
+	for (i = 0; i < cd->nfiles; i++) {
+		if (!cd->files[i].remove)
+			total += cd->files[i].size;
+	}
+	if (total <= maxsize)
+		return;
+
+	qsort(cd->files, cd->nfiles, sizeof(*cd->files), cachefile_cmp_lastuse);
+	for (i = 0; i < cd->nfiles && total > maxsize; i++) {
+		struct cachefile *cf = &cd->files[i];
+
+		if (cf->remove)
+			continue;
+		cf->remove = true;
+		cf->reason = "cache size limit";
+		total -= cf->size;
+	}
+}
+
+static void
+cachefile_remove(struct cleaner_data *cd, int dfd, struct cachefile *cf, bool drun)
+{
+	char sig[PATH_MAX];
+
+	if (!drun && unlinkat(dfd, cf->binpkg, 0) == -1) {
+		xbps_error_printf("Failed to remove `%s': %s\n",
+		    cf->binpkg, strerror(errno));
+		return;
+	}
+	printf("Removed %s from cachedir (%s)\n", cf->binpkg, cf->reason);
+	xbps_dictionary_remove(cd->index, cf->binpkg);
+	snprintf(sig, sizeof(sig), "%s.sig", cf->binpkg);
+	if (!drun && unlinkat(dfd, sig, 0) == -1 && errno != ENOENT) {
+		xbps_error_printf("Failed to remove `%s': %s\n",
+		    sig, strerror(errno));
+	}
+}
+
+static int
+cachefile_add(struct xbps_handle *xhp, struct cleaner_data *cd, size_t *maxfiles,
+		int dfd, const char *binpkg)
+{
+	char buf[PATH_MAX], pkgname[XBPS_NAME_SIZE];
+	struct cachefile *cf;
+	struct stat st;
+	const char *binpkgver, *binpkgarch;
+	int r;
 
-	binpkg = xbps_string_cstring_nocopy(obj);
 	r = binpkg_parse(buf, sizeof(buf), binpkg, &binpkgver, &binpkgarch);
 	if (r < 0) {
 		xbps_error_printf("Binary package filename: %s: %s\n", binpkg, strerror(-r));
@@ -91,56 +315,72 @@ cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj,
 		xbps_dbg_printf(xhp, "%s: ignoring binpkg with unmatched arch\n", binpkg);
 		return 0;
 	}
-
-	/*
-	 * Remove binary pkg if it's not registered in any repository
-	 * or if hash doesn't match.
-	 */
-	repo_pkgd = xbps_rpool_get_pkg(xhp, binpkgver);
-	if (repo_pkgd) {
-		xbps_dictionary_get_cstring_nocopy(repo_pkgd,
-		    "filename-sha256", &rsha256);
-		r = xbps_file_sha256_check(binpkg, rsha256);
-		if (r == 0) {
-			/* hash matched */
-			return 0;
-		}
-		if (r != ERANGE) {
-			xbps_error_printf("Failed to checksum `%s': %s\n", binpkg, strerror(r));
-			return 0;
-		}
-	}
-	snprintf(buf, sizeof(buf), "%s.sig", binpkg);
-	if (!drun && unlink(binpkg) == -1) {
-		xbps_error_printf("Failed to remove `%s': %s\n",
-		    binpkg, strerror(errno));
-	} else {
-		printf("Removed %s from cachedir (obsolete)\n", binpkg);
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), binpkgver)) {
+		xbps_error_printf("Binary package filename: %s: %s\n", binpkg, strerror(EINVAL));
+		return 0;
 	}
-	if (!drun && unlink(buf) == -1 && errno != ENOENT) {
-		xbps_error_printf("Failed to remove `%s': %s\n",
-		    buf, strerror(errno));
+	if (fstatat(dfd, binpkg, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+		xbps_error_printf("Failed to stat `%s': %s\n", binpkg, strerror(errno));
+		return 0;
 	}
+	if (!S_ISREG(st.st_mode))
+		return 0;
 
+	if (cd->nfiles == *maxfiles) {
+		struct cachefile *files;
+		size_t n = *maxfiles ? *maxfiles * 2 : 256;
+
+		files = realloc(cd->files, n * sizeof(*files));
+		if (files == NULL)
+			return ENOMEM;
+		cd->files = files;
+		*maxfiles = n;
+	}
+	cf = &cd->files[cd->nfiles];
+	memset(cf, 0, sizeof(*cf));
+	if ((cf->binpkg = strdup(binpkg)) == NULL)
+		return ENOMEM;
+	if ((cf->pkgver = strdup(binpkgver)) == NULL ||
+	    (cf->pkgname = strdup(pkgname)) == NULL) {
+		free(cf->binpkg);
+		free(cf->pkgver);
+		return ENOMEM;
+	}
+	cf->size = (uint64_t)st.st_size;
+	cf->mtime = st.st_mtim;
+	cf->lastuse = st.st_atime > st.st_mtime ? st.st_atime : st.st_mtime;
+	cd->nfiles++;
 	return 0;
 }
 
 int
-clean_cachedir(struct xbps_handle *xhp, bool drun)
+clean_cachedir(struct xbps_handle *xhp, bool drun, unsigned int keep, uint64_t maxsize)
 {
+	struct cleaner_data cd;
 	xbps_array_t array = NULL;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
 	DIR *dirp;
 	struct dirent *dp;
 	char *ext;
-	int rv = 0;
+	size_t i, maxfiles = 0;
+	int dfd, rv = 0;
 
 	if (chdir(xhp->cachedir) == -1)
 		return -1;
 
-	if ((dirp = opendir(xhp->cachedir)) == NULL)
+	if ((dfd = open(".", O_RDONLY|O_DIRECTORY|O_CLOEXEC)) == -1)
+		return 0;
+	if ((dirp = fdopendir(dup(dfd))) == NULL) {
+		close(dfd);
 		return 0;
+	}
+
+	memset(&cd, 0, sizeof(cd));
+	cd.index = xbps_dictionary_internalize_from_file(CACHE_INDEX);
+	if (cd.index == NULL)
+		cd.index = xbps_dictionary_create();
 
-	array = xbps_array_create();
 	while ((dp = readdir(dirp)) != NULL) {
 		if ((strcmp(dp->d_name, ".") == 0) ||
 		    (strcmp(dp->d_name, "..") == 0))
@@ -153,13 +393,69 @@ clean_cachedir(struct xbps_handle *xhp, bool drun)
 			xbps_dbg_printf(xhp, "ignoring unknown file: %s\n", dp->d_name);
 			continue;
 		}
-		xbps_array_add_cstring(array, dp->d_name);
+		if ((rv = cachefile_add(xhp, &cd, &maxfiles, dfd, dp->d_name)) != 0)
+			break;
 	}
 	(void)closedir(dirp);
+	if (rv != 0)
+		goto out;
 
-	if (xbps_array_count(array)) {
-		rv = xbps_array_foreach_cb_multi(xhp, array, NULL, cleaner_cb, (void*)&drun);
+	/*
+	 * Make sure the repository pool is initialized before
+	 * it's accessed concurrently.
+	 */
+	(void)xbps_rpool_foreach(xhp, rpool_init_cb, NULL);
+
+	array = xbps_array_create();
+	for (i = 0; i < cd.nfiles; i++)
+		xbps_array_add_uint64(array, i);
+	if (xbps_array_count(array))
+		rv = xbps_array_foreach_cb_multi(xhp, array, NULL, cleaner_cb, &cd);
+	xbps_object_release(array);
+	if (rv != 0)
+		goto out;
+
+	for (i = 0; i < cd.nfiles; i++) {
+		if (cd.files[i].hashed)
+			cachefile_index_add(&cd, &cd.files[i]);
+	}
+
+	plan_keep_versions(&cd, keep);
+	if (maxsize > 0)
+		plan_max_size(&cd, maxsize);
+
+	qsort(cd.files, cd.nfiles, sizeof(*cd.files), cachefile_cmp_name);
+	for (i = 0; i < cd.nfiles; i++) {
+		if (cd.files[i].remove)
+			cachefile_remove(&cd, dfd, &cd.files[i], drun);
+	}
+
+	if (!drun) {
+		/* drop index entries of files that are gone */
+		array = xbps_dictionary_all_keys(cd.index);
+		iter = xbps_array_iterator(array);
+		while ((obj = xbps_object_iterator_next(iter)) != NULL) {
+			const char *key = xbps_dictionary_keysym_cstring_nocopy(obj);
+
+			if (bsearch(key, cd.files, cd.nfiles, sizeof(*cd.files),
+			    cachefile_cmp_key) == NULL)
+				xbps_dictionary_remove_keysym(cd.index, obj);
+		}
+		xbps_object_iterator_release(iter);
 		xbps_object_release(array);
+		if (!xbps_dictionary_externalize_to_file(cd.index, CACHE_INDEX)) {
+			xbps_dbg_printf(xhp, "failed to write %s: %s\n",
+			    CACHE_INDEX, strerror(errno));
+		}
+	}
+out:
+	for (i = 0; i < cd.nfiles; i++) {
+		free(cd.files[i].binpkg);
+		free(cd.files[i].pkgver);
+		free(cd.files[i].pkgname);
 	}
+	free(cd.files);
+	xbps_object_release(cd.index);
+	close(dfd);
 	return rv;
 }
@@ -27,6 +27,7 @@
 #define _XBPS_REMOVE_DEFS_H_
 
 /* From clean-cache.c */
-int	clean_cachedir(struct xbps_handle *, bool drun);
+int	clean_cachedir(struct xbps_handle *, bool drun, unsigned int keep,
+	    uint64_t maxsize);
 
 #endif /* !_XBPS_REMOVE_DEFS_H_ */
@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <syslog.h>
+#include <limits.h>
 
 #include <xbps.h>
 #include "../xbps-install/defs.h"
@@ -52,6 +53,11 @@ usage(bool fail)
 	    "                           unresolved shared libraries\n"
 	    " -f, --force               Force package files removal\n"
 	    " -h, --help                Show usage\n"
+	    "     --keep-versions <N>   Keep the N most recent versions of each\n"
+	    "                           package when cleaning the cachedir\n"
+	    "     --max-cache-size <size>\n"
+	    "                           Remove least recently used packages until\n"
+	    "                           the cachedir fits in size (K, M, G suffix)\n"
 	    " -n, --dry-run             Dry-run mode\n"
 	    " -O, --clean-cache         Remove obsolete packages in cachedir\n"
 	    " -o, --remove-orphans      Remove package orphans\n"
@@ -63,6 +69,34 @@ usage(bool fail)
 	exit(fail ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+static bool
+parse_size(const char *str, uint64_t *size)
+{
+	char *end;
+	unsigned long long n;
+
+	errno = 0;
+	n = strtoull(str, &end, 10);
+	if (errno != 0 || end == str)
+		return false;
+	switch (*end) {
+	case 'G': case 'g':
+		n *= 1024;
+		/* FALLTHROUGH */
+	case 'M': case 'm':
+		n *= 1024;
+		/* FALLTHROUGH */
+	case 'K': case 'k':
+		n *= 1024;
+		end++;
+		break;
+	}
+	if (*end != '\0')
+		return false;
+	*size = n;
+	return true;
+}
+
 static int
 state_cb_rm(const struct xbps_state_cb_data *xscd, void *cbdata UNUSED)
 {
@@ -174,10 +208,15 @@ main(int argc, char **argv)
 		{ "verbose", no_argument, NULL, 'v' },
 		{ "version", no_argument, NULL, 'V' },
 		{ "yes", no_argument, NULL, 'y' },
+		{ "keep-versions", required_argument, NULL, 1 },
+		{ "max-cache-size", required_argument, NULL, 2 },
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
 	const char *rootdir, *cachedir, *confdir;
+	char *end;
+	uint64_t maxsize = 0;
+	unsigned long keep = 0;
 	int c, flags, rv;
 	bool yes, drun, recursive, clean_cache, orphans;
 	int maxcols, missing;
@@ -230,6 +269,23 @@ main(int argc, char **argv)
 		case 'y':
 			yes = true;
 			break;
+		case 1:
+			errno = 0;
+			keep = strtoul(optarg, &end, 10);
+			if (errno != 0 || *optarg == '\0' || *end != '\0' ||
+			    keep > UINT_MAX) {
+				xbps_error_printf("invalid --keep-versions value: %s\n",
+				    optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 2:
+			if (!parse_size(optarg, &maxsize)) {
+				xbps_error_printf("invalid --max-cache-size value: %s\n",
+				    optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case '?':
 		default:
 			usage(true);
@@ -264,7 +320,7 @@ main(int argc, char **argv)
 	maxcols = get_maxcols();
 
 	if (clean_cache) {
-		rv = clean_cachedir(&xh, drun);
+		rv = clean_cachedir(&xh, drun, (unsigned int)keep, maxsize);
 		if (!orphans || rv)
 			exit(rv);;
 	}
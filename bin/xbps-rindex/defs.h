@@ -33,6 +33,9 @@
 /* From index-add.c */
 int	index_add(struct xbps_handle *, int, int, char **, bool, const char *);
 
+/* From index-delta.c */
+int	index_delta(struct xbps_handle *, int, int, char **, const char *);
+
 /* From index-clean.c */
 int	index_clean(struct xbps_handle *, const char *, bool, const char *);
 
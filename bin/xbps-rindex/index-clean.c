@@ -45,6 +45,62 @@ struct CleanerCbInfo {
 	bool hashcheck;
 };
 
+/*
+ * Removes the delta files of a package that was dropped from the index;
+ * for a package that is kept, drops the deltas whose file is unreadable
+ * or (with hashcheck) doesn't match.
+ */
+static void
+idx_clean_deltas(struct CleanerCbInfo *info, xbps_dictionary_t pkgd,
+		const char *pkgname, bool removed)
+{
+	xbps_array_t deltas;
+	xbps_dictionary_t deltad, newpkgd;
+	const char *dfile, *sha256;
+	unsigned int count;
+	char *filen;
+	bool stale;
+
+	deltas = xbps_dictionary_get(pkgd, "deltas");
+	if ((count = xbps_array_count(deltas)) == 0)
+		return;
+	deltas = xbps_array_copy_mutable(deltas);
+	if (deltas == NULL)
+		return;
+
+	for (unsigned int i = count; i-- > 0;) {
+		deltad = xbps_array_get(deltas, i);
+		if (!xbps_dictionary_get_cstring_nocopy(deltad, "filename", &dfile) ||
+		    strchr(dfile, '/')) {
+			xbps_array_remove(deltas, i);
+			continue;
+		}
+		filen = xbps_xasprintf("%s/%s", info->repourl, dfile);
+		stale = removed || access(filen, R_OK) == -1;
+		if (!stale && info->hashcheck) {
+			stale = !xbps_dictionary_get_cstring_nocopy(deltad,
+			    "filename-sha256", &sha256) ||
+			    xbps_file_sha256_check(filen, sha256) != 0;
+		}
+		if (stale) {
+			if (remove(filen) == 0)
+				printf("index: removed delta %s\n", dfile);
+			xbps_array_remove(deltas, i);
+		}
+		free(filen);
+	}
+	if (!removed && xbps_array_count(deltas) != count) {
+		newpkgd = xbps_dictionary_copy_mutable(pkgd);
+		if (xbps_array_count(deltas) == 0)
+			xbps_dictionary_remove(newpkgd, "deltas");
+		else
+			xbps_dictionary_set(newpkgd, "deltas", deltas);
+		xbps_dictionary_set(dest, pkgname, newpkgd);
+		xbps_object_release(newpkgd);
+	}
+	xbps_object_release(deltas);
+}
+
 static int
 idx_cleaner_cb(struct xbps_handle *xhp,
 		xbps_object_t obj,
@@ -55,9 +111,12 @@ idx_cleaner_cb(struct xbps_handle *xhp,
 	struct CleanerCbInfo *info = arg;
 	const char *arch = NULL, *pkgver = NULL, *sha256 = NULL;
 	char *filen, pkgname[XBPS_NAME_SIZE];
+	bool removed = false;
 
-	xbps_dictionary_get_cstring_nocopy(obj, "architecture", &arch);
-	xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
+	if (!xbps_dictionary_get_cstring_nocopy(obj, "architecture", &arch) ||
+	    !xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver) ||
+	    !xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		return 0;
 
 	xbps_dbg_printf(xhp, "%s: checking %s [%s] ...\n", info->repourl, pkgver, arch);
 
@@ -67,10 +126,9 @@ idx_cleaner_cb(struct xbps_handle *xhp,
 		 * File cannot be read, might be permissions,
 		 * broken or simply unexistent; either way, remove it.
 		 */
-		if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
-			goto out;
 		xbps_dictionary_remove(dest, pkgname);
 		printf("index: removed pkg %s\n", pkgver);
+		removed = true;
 	} else if (info->hashcheck) {
 		/*
 		 * File can be read; check its hash.
@@ -78,13 +136,12 @@ idx_cleaner_cb(struct xbps_handle *xhp,
 		xbps_dictionary_get_cstring_nocopy(obj,
 				"filename-sha256", &sha256);
 		if (xbps_file_sha256_check(filen, sha256) != 0) {
-			if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
-				goto out;
 			xbps_dictionary_remove(dest, pkgname);
 			printf("index: removed pkg %s\n", pkgver);
+			removed = true;
 		}
 	}
-out:
+	idx_clean_deltas(info, obj, pkgname, removed);
 	free(filen);
 	return 0;
 }
@@ -129,7 +186,8 @@ cleanup_repo(struct xbps_handle *xhp, const char *repodir, struct xbps_repo *rep
 
 /*
  * Removes stalled pkg entries in repository's XBPS_REPOIDX file, if any
- * binary package cannot be read (unavailable, not enough perms, etc).
+ * binary package cannot be read (unavailable, not enough perms, etc),
+ * along with the delta files announced for them.
  */
 int
 index_clean(struct xbps_handle *xhp, const char *repodir, const bool hashcheck, const char *compression)
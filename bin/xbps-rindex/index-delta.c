@@ -0,0 +1,217 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <assert.h>
+
+#include <xbps.h>
+#include "defs.h"
+
+static xbps_dictionary_t
+delta_add(struct xbps_handle *xhp, const char *repodir, const char *newpkg,
+	const char *newpkgver, const char *arch, const char *oldpkg)
+{
+	xbps_dictionary_t binpkgd, deltad = NULL;
+	struct stat st;
+	const char *pkgver = NULL, *oarch = NULL;
+	char sha256[XBPS_SHA256_SIZE], dsha256[XBPS_SHA256_SIZE];
+	char pkgname[XBPS_NAME_SIZE], opkgname[XBPS_NAME_SIZE];
+	char *delta, *dfile;
+	int rv;
+
+	binpkgd = xbps_archive_fetch_plist(oldpkg, "/props.plist");
+	if (binpkgd == NULL) {
+		fprintf(stderr, "delta: failed to read %s metadata for "
+		    "`%s', skipping!\n", XBPS_PKGPROPS, oldpkg);
+		return NULL;
+	}
+	if (!xbps_dictionary_get_cstring_nocopy(binpkgd, "pkgver", &pkgver) ||
+	    !xbps_dictionary_get_cstring_nocopy(binpkgd, "architecture", &oarch)) {
+		fprintf(stderr, "delta: incomplete %s metadata for `%s', "
+		    "skipping!\n", XBPS_PKGPROPS, oldpkg);
+		xbps_object_release(binpkgd);
+		return NULL;
+	}
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), newpkgver) ||
+	    !xbps_pkg_name(opkgname, sizeof(opkgname), pkgver) ||
+	    strcmp(pkgname, opkgname) || strcmp(arch, oarch) ||
+	    strcmp(pkgver, newpkgver) == 0) {
+		fprintf(stderr, "delta: `%s' is not another version of `%s' (%s), "
+		    "skipping!\n", oldpkg, newpkgver, arch);
+		xbps_object_release(binpkgd);
+		return NULL;
+	}
+
+	dfile = xbps_xasprintf("%s.%s.from-%s.xbps-delta", newpkgver, arch,
+	    xbps_pkg_version(pkgver));
+	delta = xbps_xasprintf("%s/%s", repodir, dfile);
+	if ((rv = xbps_delta_create(oldpkg, newpkg, delta)) != 0) {
+		fprintf(stderr, "delta: failed to create `%s': %s\n",
+		    delta, strerror(rv));
+		goto out;
+	}
+	if (stat(delta, &st) == -1 ||
+	    !xbps_file_sha256(sha256, sizeof sha256, oldpkg) ||
+	    !xbps_file_sha256(dsha256, sizeof dsha256, delta)) {
+		fprintf(stderr, "delta: failed to hash `%s': %s\n",
+		    delta, strerror(errno));
+		(void)remove(delta);
+		goto out;
+	}
+	deltad = xbps_dictionary_create();
+	xbps_dictionary_set_cstring(deltad, "from-pkgver", pkgver);
+	xbps_dictionary_set_cstring(deltad, "from-sha256", sha256);
+	xbps_dictionary_set_cstring(deltad, "filename", dfile);
+	xbps_dictionary_set_cstring(deltad, "filename-sha256", dsha256);
+	xbps_dictionary_set_uint64(deltad, "filename-size", (uint64_t)st.st_size);
+	if (xhp->flags & XBPS_FLAG_VERBOSE)
+		printf("delta: created `%s' (%ju bytes).\n", dfile,
+		    (uintmax_t)st.st_size);
+out:
+	xbps_object_release(binpkgd);
+	free(delta);
+	free(dfile);
+	return deltad;
+}
+
+int
+index_delta(struct xbps_handle *xhp, int args, int argmax, char **argv,
+	const char *compression)
+{
+	xbps_array_t deltas = NULL;
+	xbps_dictionary_t idx = NULL, idxmeta = NULL, binpkgd = NULL, curpkgd;
+	xbps_dictionary_t pkgd = NULL, deltad;
+	struct xbps_repo *repo = NULL;
+	const char *newpkg, *pkgver = NULL, *arch = NULL, *curpkgver = NULL;
+	const char *fromver, *dfromver;
+	char pkgname[XBPS_NAME_SIZE];
+	char *tmprepodir, *repodir, *rlockfname = NULL;
+	int rv = 0, rlockfd = -1;
+
+	assert(argv);
+	newpkg = argv[args];
+	if ((tmprepodir = strdup(newpkg)) == NULL)
+		return ENOMEM;
+
+	repodir = dirname(tmprepodir);
+	if (!xbps_repo_lock(xhp, repodir, &rlockfd, &rlockfname)) {
+		fprintf(stderr, "xbps-rindex: cannot lock repository "
+		    "%s: %s\n", repodir, strerror(errno));
+		rv = -1;
+		goto out;
+	}
+	if ((repo = xbps_repo_public_open(xhp, repodir)) == NULL) {
+		fprintf(stderr, "xbps-rindex: cannot open repository "
+		    "%s: %s\n", repodir, strerror(errno));
+		rv = -1;
+		goto out;
+	}
+	binpkgd = xbps_archive_fetch_plist(newpkg, "/props.plist");
+	if (binpkgd == NULL) {
+		fprintf(stderr, "delta: failed to read %s metadata for "
+		    "`%s'\n", XBPS_PKGPROPS, newpkg);
+		rv = -1;
+		goto out;
+	}
+	if (!xbps_dictionary_get_cstring_nocopy(binpkgd, "pkgver", &pkgver) ||
+	    !xbps_dictionary_get_cstring_nocopy(binpkgd, "architecture", &arch) ||
+	    !xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
+		fprintf(stderr, "delta: incomplete %s metadata for `%s'\n",
+		    XBPS_PKGPROPS, newpkg);
+		rv = EINVAL;
+		goto out;
+	}
+	/*
+	 * Deltas are only announced for the binary package registered
+	 * in the repository index.
+	 */
+	idx = xbps_dictionary_copy_mutable(repo->idx);
+	idxmeta = xbps_dictionary_copy_mutable(repo->idxmeta);
+	curpkgd = xbps_dictionary_get(idx, pkgname);
+	if (curpkgd == NULL ||
+	    !xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &curpkgver) ||
+	    strcmp(curpkgver, pkgver)) {
+		fprintf(stderr, "delta: `%s' is not registered in the index "
+		    "of %s\n", pkgver, repodir);
+		rv = -1;
+		goto out;
+	}
+	pkgd = xbps_dictionary_copy_mutable(curpkgd);
+	deltas = xbps_array_copy_mutable(xbps_dictionary_get(pkgd, "deltas"));
+	if (deltas == NULL)
+		deltas = xbps_array_create();
+
+	for (int i = args + 1; i < argmax; i++) {
+		deltad = delta_add(xhp, repodir, newpkg, pkgver, arch, argv[i]);
+		if (deltad == NULL)
+			continue;
+		/* replace a previous delta from the same version */
+		xbps_dictionary_get_cstring_nocopy(deltad, "from-pkgver", &fromver);
+		for (unsigned int j = 0; j < xbps_array_count(deltas); j++) {
+			if (xbps_dictionary_get_cstring_nocopy(
+			    xbps_array_get(deltas, j), "from-pkgver", &dfromver) &&
+			    strcmp(fromver, dfromver) == 0) {
+				xbps_array_remove(deltas, j);
+				break;
+			}
+		}
+		xbps_array_add(deltas, deltad);
+		printf("index: added delta for `%s' from `%s' (%s).\n",
+		    pkgver, fromver, arch);
+		xbps_object_release(deltad);
+	}
+	xbps_dictionary_set(pkgd, "deltas", deltas);
+	xbps_dictionary_set(idx, pkgname, pkgd);
+	if (!repodata_flush(xhp, repodir, "repodata", idx, idxmeta, compression)) {
+		fprintf(stderr, "%s: failed to write repodata: %s\n",
+		    _XBPS_RINDEX, strerror(errno));
+		rv = -1;
+	}
+
+out:
+	if (deltas)
+		xbps_object_release(deltas);
+	if (pkgd)
+		xbps_object_release(pkgd);
+	if (binpkgd)
+		xbps_object_release(binpkgd);
+	if (idx)
+		xbps_object_release(idx);
+	if (idxmeta)
+		xbps_object_release(idxmeta);
+	if (repo)
+		xbps_repo_release(repo);
+	xbps_repo_unlock(rlockfd, rlockfname);
+	free(tmprepodir);
+
+	return rv;
+}
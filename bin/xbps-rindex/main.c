@@ -49,6 +49,8 @@ usage(bool fail)
 	    "MODE\n"
 	    " -a, --add <repodir/file.xbps> ...  Add package(s) to repository index\n"
 	    " -c, --clean <repodir>              Clean repository index\n"
+	    " -D, --delta <repodir/file.xbps> <old.xbps> ...\n"
+	    "                                    Add deltas from older packages to repository index\n"
 	    " -r, --remove-obsoletes <repodir>   Removes obsolete packages from repository\n"
 	    " -s, --sign <repodir>               Initialize repository metadata signature\n"
 	    " -S, --sign-pkg <file.xbps> ...     Sign binary package archive\n");
@@ -58,11 +60,12 @@ usage(bool fail)
 int
 main(int argc, char **argv)
 {
-	const char *shortopts = "acdfhrsCSVv";
+	const char *shortopts = "acdfhrsCDSVv";
 	struct option longopts[] = {
 		{ "add", no_argument, NULL, 'a' },
 		{ "clean", no_argument, NULL, 'c' },
 		{ "debug", no_argument, NULL, 'd' },
+		{ "delta", no_argument, NULL, 'D' },
 		{ "force", no_argument, NULL, 'f' },
 		{ "help", no_argument, NULL, 'h' },
 		{ "remove-obsoletes", no_argument, NULL, 'r' },
@@ -80,11 +83,11 @@ main(int argc, char **argv)
 	const char *compression = NULL;
 	const char *privkey = NULL, *signedby = NULL;
 	int rv, c, flags = 0;
-	bool add_mode, clean_mode, rm_mode, sign_mode, sign_pkg_mode, force,
-			 hashcheck;
+	bool add_mode, clean_mode, delta_mode, rm_mode, sign_mode, sign_pkg_mode,
+			 force, hashcheck;
 
-	add_mode = clean_mode = rm_mode = sign_mode = sign_pkg_mode = force =
-		hashcheck = false;
+	add_mode = clean_mode = delta_mode = rm_mode = sign_mode =
+		sign_pkg_mode = force = hashcheck = false;
 
 	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
 		switch (c) {
@@ -106,6 +109,9 @@ main(int argc, char **argv)
 		case 'd':
 			flags |= XBPS_FLAG_DEBUG;
 			break;
+		case 'D':
+			delta_mode = true;
+			break;
 		case 'f':
 			force = true;
 			break;
@@ -137,15 +143,13 @@ main(int argc, char **argv)
 		}
 	}
 	if ((argc == optind) ||
-	    (!add_mode && !clean_mode && !rm_mode && !sign_mode && !sign_pkg_mode)) {
+	    (!add_mode && !clean_mode && !delta_mode && !rm_mode && !sign_mode &&
+	     !sign_pkg_mode) || (delta_mode && argc - optind < 2)) {
 		usage(true);
 		/* NOTREACHED */
-	} else if ((add_mode && (clean_mode || rm_mode || sign_mode || sign_pkg_mode)) ||
-		   (clean_mode && (add_mode || rm_mode || sign_mode || sign_pkg_mode)) ||
-		   (rm_mode && (add_mode || clean_mode || sign_mode || sign_pkg_mode)) ||
-		   (sign_mode && (add_mode || clean_mode || rm_mode || sign_pkg_mode)) ||
-		   (sign_pkg_mode && (add_mode || clean_mode || rm_mode || sign_mode))) {
-		fprintf(stderr, "Only one mode can be specified: add, clean, "
+	} else if (add_mode + clean_mode + delta_mode + rm_mode + sign_mode +
+		   sign_pkg_mode > 1) {
+		fprintf(stderr, "Only one mode can be specified: add, clean, delta, "
 		    "remove-obsoletes, sign or sign-pkg.\n");
 		exit(EXIT_FAILURE);
 	}
@@ -161,6 +165,8 @@ main(int argc, char **argv)
 
 	if (add_mode)
 		rv = index_add(&xh, optind, argc, argv, force, compression);
+	else if (delta_mode)
+		rv = index_delta(&xh, optind, argc, argv, compression);
 	else if (clean_mode)
 		rv = index_clean(&xh, argv[optind], hashcheck, compression);
 	else if (rm_mode)
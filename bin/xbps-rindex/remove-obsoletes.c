@@ -108,10 +108,71 @@ cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj, const char *key UNUSED, v
 	return 0;
 }
 
+/*
+ * Collects the delta files announced by the packages in `idx'.
+ */
+static void
+index_deltas(xbps_dictionary_t idx, xbps_dictionary_t known)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	xbps_array_t deltas;
+	const char *dfile;
+
+	if ((iter = xbps_dictionary_iterator(idx)) == NULL)
+		return;
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		deltas = xbps_dictionary_get(
+		    xbps_dictionary_get_keysym(idx, keysym), "deltas");
+		for (unsigned int i = 0; i < xbps_array_count(deltas); i++) {
+			if (xbps_dictionary_get_cstring_nocopy(
+			    xbps_array_get(deltas, i), "filename", &dfile))
+				xbps_dictionary_set_bool(known, dfile, true);
+		}
+	}
+	xbps_object_iterator_release(iter);
+}
+
+/*
+ * Removes the delta files not announced by any package in the index
+ * or the stage.
+ */
+static int
+remove_deltas(struct xbps_repo *repo, struct xbps_repo *stage,
+		xbps_array_t deltas)
+{
+	xbps_dictionary_t known;
+	const char *dfile;
+	int rv = 0;
+
+	if ((known = xbps_dictionary_create()) == NULL)
+		return errno;
+	index_deltas(repo->idx, known);
+	if (stage)
+		index_deltas(stage->idx, known);
+
+	for (unsigned int i = 0; i < xbps_array_count(deltas); i++) {
+		xbps_array_get_cstring_nocopy(deltas, i, &dfile);
+		if (xbps_dictionary_get(known, dfile))
+			continue;
+		if (remove(dfile) == -1) {
+			if (errno != ENOENT) {
+				rv = errno;
+				fprintf(stderr, "xbps-rindex: failed to remove "
+				    "delta `%s': %s\n", dfile, strerror(rv));
+			}
+			continue;
+		}
+		printf("Removed obsolete delta `%s'.\n", dfile);
+	}
+	xbps_object_release(known);
+	return rv;
+}
+
 int
 remove_obsoletes(struct xbps_handle *xhp, const char *repodir)
 {
-	xbps_array_t array = NULL;
+	xbps_array_t array = NULL, deltas = NULL;
 	struct xbps_repo *repos[2], *repo, *stage;
 	DIR *dirp;
 	struct dirent *dp;
@@ -145,6 +206,13 @@ remove_obsoletes(struct xbps_handle *xhp, const char *repodir)
 			continue;
 		if ((ext = strrchr(dp->d_name, '.')) == NULL)
 			continue;
+		if (strcmp(ext, ".xbps-delta") == 0) {
+			if (deltas == NULL)
+				deltas = xbps_array_create();
+
+			xbps_array_add_cstring(deltas, dp->d_name);
+			continue;
+		}
 		if (strcmp(ext, ".xbps"))
 			continue;
 		if (array == NULL)
@@ -157,10 +225,14 @@ remove_obsoletes(struct xbps_handle *xhp, const char *repodir)
 	repos[0] = repo;
 	repos[1] = stage;
 	rv = xbps_array_foreach_cb_multi(xhp, array, NULL, cleaner_cb, repos);
+	if (rv == 0 && deltas)
+		rv = remove_deltas(repo, stage, deltas);
 out:
 	xbps_repo_release(repo);
 	xbps_repo_release(stage);
 	xbps_object_release(array);
+	if (deltas)
+		xbps_object_release(deltas);
 
 	return rv;
 }
@@ -139,6 +139,11 @@ repodata_flush(struct xbps_handle *xhp, const char *repodir,
 		goto out;
 	}
 	result = true;
+	/* the search index is optional, don't fail if it can't be written */
+	if ((rv = xbps_repo_search_index_update(xhp, repodir)) != 0) {
+		fprintf(stderr, "%s: failed to write search index: %s\n",
+		    _XBPS_RINDEX, strerror(rv));
+	}
 out:
 	free(repofile);
 	free(tname);
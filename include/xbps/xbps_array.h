@@ -142,6 +142,7 @@ bool		xbps_array_get_cstring_nocopy(xbps_array_t,
 bool		xbps_array_set_cstring_nocopy(xbps_array_t,
 						   unsigned int,
 						   const char *);
+const char *	xbps_array_cstring_nocopy_at(xbps_array_t, unsigned int);
 bool		xbps_array_add_and_rel(xbps_array_t, xbps_object_t);
 
 #ifdef __cplusplus
@@ -71,6 +71,10 @@ bool		xbps_dictionary_set_keysym(xbps_dictionary_t,
 void		xbps_dictionary_remove_keysym(xbps_dictionary_t,
 					      xbps_dictionary_keysym_t);
 
+xbps_dictionary_keysym_t xbps_dictionary_keysym_at(xbps_dictionary_t,
+						   unsigned int);
+xbps_object_t	xbps_dictionary_get_at(xbps_dictionary_t, unsigned int);
+
 bool		xbps_dictionary_equals(xbps_dictionary_t, xbps_dictionary_t);
 
 char *		xbps_dictionary_externalize(xbps_dictionary_t);
@@ -28,6 +28,7 @@
 #define _XBPS_API_IMPL_H_
 
 #include <assert.h>
+#include <time.h>
 #include "xbps.h"
 
 /*
@@ -59,6 +60,23 @@
 #define __arraycount(x) (sizeof(x) / sizeof(*x))
 #endif
 
+/*
+ * Static tracepoints (USDT) in the `xbps' provider, enabled with
+ * --enable-usdt. When disabled the arguments are not evaluated.
+ */
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+#define XBPS_PROBE0(name)		DTRACE_PROBE(xbps, name)
+#define XBPS_PROBE1(name, a)		DTRACE_PROBE1(xbps, name, a)
+#define XBPS_PROBE2(name, a, b)		DTRACE_PROBE2(xbps, name, a, b)
+#define XBPS_PROBE3(name, a, b, c)	DTRACE_PROBE3(xbps, name, a, b, c)
+#else
+#define XBPS_PROBE0(name)		do { } while (0)
+#define XBPS_PROBE1(name, a)		do { } while (0)
+#define XBPS_PROBE2(name, a, b)		do { } while (0)
+#define XBPS_PROBE3(name, a, b, c)	do { } while (0)
+#endif
+
 /**
  * @private
  */
@@ -103,19 +121,46 @@ int HIDDEN xbps_transaction_fetch(struct xbps_handle *,
 		xbps_object_iterator_t);
 int HIDDEN xbps_transaction_pkg_deps(struct xbps_handle *, xbps_array_t, xbps_dictionary_t);
 int HIDDEN xbps_transaction_internalize(struct xbps_handle *, xbps_object_iterator_t);
+int HIDDEN xbps_transaction_load_scripts(struct xbps_handle *,
+		xbps_dictionary_t);
+void HIDDEN xbps_transaction_release_scripts(struct xbps_handle *,
+		xbps_dictionary_t);
+int HIDDEN xbps_internalize_script(struct xbps_handle *, xbps_dictionary_t,
+		const char *, struct archive *, struct archive_entry *);
 
 char HIDDEN *xbps_get_remote_repo_string(const char *);
 int HIDDEN xbps_repo_sync(struct xbps_handle *, const char *);
 int HIDDEN xbps_file_hash_check_dictionary(struct xbps_handle *,
 		xbps_dictionary_t, const char *, const char *);
+bool HIDDEN xbps_dictionary_write_file(struct xbps_handle *,
+		xbps_dictionary_t, const char *, bool, char *);
+void HIDDEN *xbps_zstd_compress(const void *, size_t, size_t *);
+char HIDDEN *xbps_zstd_decompress(const void *, size_t);
+char HIDDEN *xbps_plist_read_file(const char *, size_t *);
+struct archive HIDDEN *xbps_archive_open_indexed(const char *, const char *,
+		bool *);
+char HIDDEN *xbps_archive_fetch_member(const char *, const char *, bool);
+int HIDDEN xbps_archive_fetch_member_into_fd(const char *, const char *, bool,
+		int);
 int HIDDEN xbps_file_exec(struct xbps_handle *, const char *, ...);
 void HIDDEN xbps_set_cb_fetch(struct xbps_handle *, off_t, off_t, off_t,
 		const char *, bool, bool, bool);
 int HIDDEN xbps_set_cb_state(struct xbps_handle *, xbps_state_t, int,
 		const char *, const char *, ...);
+void HIDDEN xbps_set_cb_unpack(struct xbps_handle *,
+		const struct xbps_unpack_cb_data *);
+void HIDDEN xbps_cb_queue_destroy(struct xbps_handle *);
+void HIDDEN xbps_cb_flush_all(void);
+void HIDDEN xbps_keyring_release(struct xbps_handle *);
 int HIDDEN xbps_unpack_binary_pkg(struct xbps_handle *, xbps_dictionary_t);
 int HIDDEN xbps_remove_pkg(struct xbps_handle *, const char *, bool);
+int HIDDEN xbps_remove_pkg_files(struct xbps_handle *, xbps_array_t,
+		const char *, bool);
 int HIDDEN xbps_register_pkg(struct xbps_handle *, xbps_dictionary_t);
+int HIDDEN xbps_alternatives_begin(struct xbps_handle *);
+int HIDDEN xbps_alternatives_commit(struct xbps_handle *);
+void HIDDEN xbps_alternatives_discard(struct xbps_handle *);
+void HIDDEN xbps_alternatives_claim(struct xbps_handle *, const char *);
 char HIDDEN *xbps_archive_get_file(struct archive *, struct archive_entry *);
 xbps_dictionary_t HIDDEN xbps_archive_get_dictionary(struct archive *,
 		struct archive_entry *);
@@ -125,5 +170,44 @@ xbps_array_t HIDDEN xbps_get_pkg_fulldeptree(struct xbps_handle *,
 struct xbps_repo HIDDEN *xbps_regget_repo(struct xbps_handle *,
 		const char *);
 int HIDDEN xbps_conf_init(struct xbps_handle *);
+bool HIDDEN xbps_parse_size(const char *, uint64_t *);
+unsigned int HIDDEN xbps_cpu_count(void);
+unsigned int HIDDEN xbps_thread_pool_size(struct xbps_handle *);
+int HIDDEN xbps_thread_pool_run(struct xbps_handle *, void (*)(void *), void *);
+void HIDDEN xbps_thread_pool_destroy(struct xbps_handle *);
+void HIDDEN xbps_stats_start(struct timespec *);
+void HIDDEN xbps_stats_end(struct xbps_handle *, xbps_stats_phase_t,
+		const struct timespec *);
+void HIDDEN xbps_stats_add(struct xbps_handle *, xbps_stats_counter_t,
+		uint64_t);
+void HIDDEN xbps_stats_mem_add(struct xbps_handle *, xbps_stats_mem_t,
+		uint64_t);
+void HIDDEN xbps_stats_mem_sub(struct xbps_handle *, xbps_stats_mem_t,
+		uint64_t);
+bool HIDDEN xbps_low_memory(struct xbps_handle *);
+
+/* package store, see lib/package_store.c */
+struct xbps_pkgstore {
+	char *dir;
+	char *tmpdir;		/* set while the store entry is being filled */
+	char *key;		/* archive pathname of the current data */
+	char *parent;
+	int parentfd;
+	xbps_array_t entries;
+	unsigned int idx;
+	struct archive_entry *entry; /* set if unpacking from the store */
+	bool data;		/* the current entry's data is in the store */
+};
+
+int HIDDEN xbps_pkgstore_open(struct xbps_handle *, xbps_dictionary_t,
+		xbps_dictionary_t, struct xbps_pkgstore *);
+int HIDDEN xbps_pkgstore_next(struct xbps_pkgstore *,
+		struct archive_entry **);
+int HIDDEN xbps_pkgstore_add(struct xbps_handle *, struct xbps_pkgstore *,
+		struct archive *, struct archive_entry *);
+int HIDDEN xbps_pkgstore_extract(struct xbps_handle *, struct xbps_pkgstore *,
+		struct archive_entry *);
+void HIDDEN xbps_pkgstore_close(struct xbps_handle *, struct xbps_pkgstore *,
+		bool);
 
 #endif /* !_XBPS_API_IMPL_H_ */
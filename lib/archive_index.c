@@ -0,0 +1,505 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "xbps_api_impl.h"
+#include "fetch.h"
+
+/*
+ * Indexed binary packages.
+ *
+ * Binary packages written with xbps_archive_write_open_indexed() are
+ * compressed with zstd as a sequence of independent frames holding
+ * INDEX_FRAME_SIZE bytes of the tar stream each, followed by a zstd
+ * skippable frame with an index of the archive members, which zstd
+ * decompressors ignore:
+ *
+ *	<frame> ... <frame> <skippable frame: <index> <footer>>
+ *
+ *	index:	zstd compressed plist dictionary:
+ *		frame-size	uncompressed size of the frames
+ *		frames		array with the file offset of each frame
+ *		members		dictionary of member paths (without the
+ *				leading dot) to the offset of their header
+ *				in the tar stream
+ *	footer:	<index size: u64 LE> "XBPSIDX1"
+ *
+ * A member of a remote binary package can then be extracted by
+ * fetching the footer, the index and the frames holding the member
+ * with range requests, rather than streaming the whole archive.
+ */
+
+#define INDEX_FRAME_SIZE	(1024 * 1024)
+#define INDEX_MAGIC		"XBPSIDX1"
+#define INDEX_FOOTER_SIZE	16
+#define ZSTD_SKIPPABLE_MAGIC	0x184D2A5EU
+
+#ifdef HAVE_LIBZSTD
+struct index_writer {
+	ZSTD_CCtx *cctx;
+	xbps_array_t frames;
+	uint64_t offset;
+	size_t inframe;
+	int fd, error;
+	size_t bufsize;
+	char *buf;
+};
+
+static void
+put_le(unsigned char *p, uint64_t v, int len)
+{
+	for (int i = 0; i < len; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+static uint64_t
+get_le(const unsigned char *p, int len)
+{
+	uint64_t v = 0;
+
+	for (int i = len - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static int
+write_all(struct index_writer *w, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t wr;
+
+	while (len > 0) {
+		if ((wr = write(w->fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		p += wr;
+		len -= wr;
+		w->offset += wr;
+	}
+	return 0;
+}
+
+static int
+compress_data(struct index_writer *w, const void *buf, size_t len,
+		ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer in = { buf, len, 0 };
+	ZSTD_outBuffer out;
+	size_t rem;
+	int rv;
+
+	do {
+		out.dst = w->buf;
+		out.size = w->bufsize;
+		out.pos = 0;
+		rem = ZSTD_compressStream2(w->cctx, &out, &in, mode);
+		if (ZSTD_isError(rem))
+			return EINVAL;
+		if ((rv = write_all(w, w->buf, out.pos)) != 0)
+			return rv;
+	} while (mode == ZSTD_e_end ? rem != 0 : in.pos < in.size);
+	return 0;
+}
+
+static ssize_t
+index_write(struct archive *ar, void *data, const void *buf, size_t len)
+{
+	struct index_writer *w = data;
+	const char *p = buf;
+	size_t n;
+	int rv;
+
+	while (len > 0) {
+		/* frames start at multiples of INDEX_FRAME_SIZE */
+		if (w->inframe == 0)
+			xbps_array_add_uint64(w->frames, w->offset);
+		n = INDEX_FRAME_SIZE - w->inframe;
+		if (n > len)
+			n = len;
+		w->inframe += n;
+		rv = compress_data(w, p, n, w->inframe == INDEX_FRAME_SIZE ?
+		    ZSTD_e_end : ZSTD_e_continue);
+		if (rv != 0) {
+			w->error = rv;
+			archive_set_error(ar, rv, "cannot compress archive");
+			return -1;
+		}
+		if (w->inframe == INDEX_FRAME_SIZE)
+			w->inframe = 0;
+		p += n;
+		len -= n;
+	}
+	return p - (const char *)buf;
+}
+
+/*
+ * Reads back the archive to find the offset of each member.
+ */
+static xbps_dictionary_t
+index_members(int fd)
+{
+	xbps_dictionary_t members;
+	struct archive *ar;
+	struct archive_entry *entry;
+	const char *path;
+	int rv;
+
+	if (lseek(fd, 0, SEEK_SET) == -1 || (ar = archive_read_new()) == NULL)
+		return NULL;
+	archive_read_support_filter_zstd(ar);
+	archive_read_support_format_tar(ar);
+	if (archive_read_open_fd(ar, fd, 32768) != ARCHIVE_OK) {
+		archive_read_free(ar);
+		return NULL;
+	}
+	members = xbps_dictionary_create();
+	while ((rv = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
+		path = archive_entry_pathname(entry);
+		if (path[0] == '.')
+			path++; /* skip first dot */
+		xbps_dictionary_set_uint64(members, path,
+		    (uint64_t)archive_read_header_position(ar));
+		archive_read_data_skip(ar);
+	}
+	archive_read_free(ar);
+	if (rv != ARCHIVE_EOF) {
+		xbps_object_release(members);
+		return NULL;
+	}
+	return members;
+}
+
+static int
+write_index(struct index_writer *w)
+{
+	xbps_dictionary_t idx, members;
+	unsigned char hdr[8], footer[INDEX_FOOTER_SIZE];
+	char *xml;
+	void *zidx = NULL;
+	size_t zlen;
+	int rv = 0;
+
+	if ((members = index_members(w->fd)) == NULL)
+		return errno ? errno : EINVAL;
+	idx = xbps_dictionary_create();
+	xbps_dictionary_set_uint64(idx, "frame-size", INDEX_FRAME_SIZE);
+	xbps_dictionary_set(idx, "frames", w->frames);
+	xbps_dictionary_set(idx, "members", members);
+	xbps_object_release(members);
+	xml = xbps_dictionary_externalize(idx);
+	xbps_object_release(idx);
+	if (xml == NULL ||
+	    (zidx = xbps_zstd_compress(xml, strlen(xml), &zlen)) == NULL) {
+		rv = errno ? errno : ENOMEM;
+		goto out;
+	}
+	if (lseek(w->fd, 0, SEEK_END) == -1) {
+		rv = errno;
+		goto out;
+	}
+	put_le(hdr, ZSTD_SKIPPABLE_MAGIC, 4);
+	put_le(hdr + 4, zlen + INDEX_FOOTER_SIZE, 4);
+	put_le(footer, zlen, 8);
+	memcpy(footer + 8, INDEX_MAGIC, 8);
+	if ((rv = write_all(w, hdr, sizeof(hdr))) == 0 &&
+	    (rv = write_all(w, zidx, zlen)) == 0)
+		rv = write_all(w, footer, sizeof(footer));
+out:
+	free(xml);
+	free(zidx);
+	return rv;
+}
+
+static int
+index_close(struct archive *ar, void *data)
+{
+	struct index_writer *w = data;
+	int rv = ARCHIVE_OK, error = w->error;
+
+	if (error == 0 && w->inframe > 0)
+		error = compress_data(w, NULL, 0, ZSTD_e_end);
+	if (error == 0)
+		error = write_index(w);
+	if (error != 0) {
+		archive_set_error(ar, error, "cannot write archive index: %s",
+		    strerror(error));
+		rv = ARCHIVE_FATAL;
+	}
+	ZSTD_freeCCtx(w->cctx);
+	xbps_object_release(w->frames);
+	free(w->buf);
+	free(w);
+	return rv;
+}
+
+int
+xbps_archive_write_open_indexed(struct archive *ar, int fd, int level)
+{
+	struct index_writer *w;
+
+	if ((w = calloc(1, sizeof(*w))) == NULL)
+		return ENOMEM;
+	w->fd = fd;
+	w->bufsize = ZSTD_CStreamOutSize();
+	w->buf = malloc(w->bufsize);
+	w->cctx = ZSTD_createCCtx();
+	w->frames = xbps_array_create();
+	if (w->buf == NULL || w->cctx == NULL || w->frames == NULL) {
+		ZSTD_freeCCtx(w->cctx);
+		if (w->frames != NULL)
+			xbps_object_release(w->frames);
+		free(w->buf);
+		free(w);
+		return ENOMEM;
+	}
+	ZSTD_CCtx_setParameter(w->cctx, ZSTD_c_compressionLevel, level);
+	ZSTD_CCtx_setParameter(w->cctx, ZSTD_c_checksumFlag, 1);
+
+	archive_write_set_bytes_in_last_block(ar, 1);
+	if (archive_write_open(ar, w, NULL, index_write, index_close) != ARCHIVE_OK)
+		return archive_errno(ar) ? archive_errno(ar) : EINVAL;
+	return 0;
+}
+
+struct index_reader {
+	struct url *url;
+	struct fetchIO *fetch;
+	ZSTD_DCtx *dctx;
+	ZSTD_inBuffer in;
+	uint64_t skip;
+	char ibuf[32768];
+	char obuf[65536];
+};
+
+/*
+ * Fetches `len' bytes at `offset' of `url' into `buf' with a range
+ * request; fails if the server does not support ranges.
+ */
+static bool
+fetch_range(struct url *url, off_t offset, void *buf, size_t len)
+{
+	struct fetchIO *fetch;
+	char *p = buf;
+	ssize_t rd;
+
+	url->offset = offset;
+	url->length = 0;
+	if ((fetch = fetchGet(url, NULL)) == NULL)
+		return false;
+	if (url->offset != offset) {
+		fetchIO_close(fetch);
+		errno = ENOTSUP;
+		return false;
+	}
+	while (len > 0 && (rd = fetchIO_read(fetch, p, len)) > 0) {
+		p += rd;
+		len -= rd;
+	}
+	fetchIO_close(fetch);
+	if (len > 0) {
+		errno = EIO;
+		return false;
+	}
+	return true;
+}
+
+static xbps_dictionary_t
+fetch_index(struct url *url)
+{
+	xbps_dictionary_t idx;
+	struct url_stat us;
+	unsigned char footer[INDEX_FOOTER_SIZE];
+	uint64_t len;
+	char *zidx, *xml;
+
+	if (fetchStat(url, &us, NULL) == -1 || us.size < INDEX_FOOTER_SIZE)
+		return NULL;
+	if (!fetch_range(url, us.size - INDEX_FOOTER_SIZE, footer, sizeof(footer)))
+		return NULL;
+	len = get_le(footer, 8);
+	if (memcmp(footer + 8, INDEX_MAGIC, 8) != 0 ||
+	    len > (uint64_t)us.size - INDEX_FOOTER_SIZE) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if ((zidx = malloc(len)) == NULL)
+		return NULL;
+	if (!fetch_range(url, us.size - INDEX_FOOTER_SIZE - len, zidx, len)) {
+		free(zidx);
+		return NULL;
+	}
+	xml = xbps_zstd_decompress(zidx, len);
+	free(zidx);
+	if (xml == NULL)
+		return NULL;
+	idx = xbps_dictionary_internalize(xml);
+	free(xml);
+	return idx;
+}
+
+static ssize_t
+index_read(struct archive *ar, void *data, const void **buf)
+{
+	struct index_reader *r = data;
+	ZSTD_outBuffer out;
+	ssize_t rd;
+	size_t rv;
+
+	for (;;) {
+		if (r->in.pos == r->in.size) {
+			rd = fetchIO_read(r->fetch, r->ibuf, sizeof(r->ibuf));
+			if (rd <= 0)
+				return rd;
+			r->in.src = r->ibuf;
+			r->in.size = rd;
+			r->in.pos = 0;
+		}
+		out.dst = r->obuf;
+		out.size = sizeof(r->obuf);
+		out.pos = 0;
+		rv = ZSTD_decompressStream(r->dctx, &out, &r->in);
+		if (ZSTD_isError(rv)) {
+			archive_set_error(ar, EINVAL, "%s", ZSTD_getErrorName(rv));
+			return -1;
+		}
+		/* skip the members before the one we want in the frame */
+		if (out.pos <= r->skip) {
+			r->skip -= out.pos;
+			continue;
+		}
+		*buf = r->obuf + r->skip;
+		rd = out.pos - r->skip;
+		r->skip = 0;
+		return rd;
+	}
+}
+
+static int
+index_read_close(struct archive *ar UNUSED, void *data)
+{
+	struct index_reader *r = data;
+
+	if (r->fetch != NULL)
+		fetchIO_close(r->fetch);
+	ZSTD_freeDCtx(r->dctx);
+	fetchFreeURL(r->url);
+	free(r);
+	return ARCHIVE_OK;
+}
+
+struct archive HIDDEN *
+xbps_archive_open_indexed(const char *url, const char *fname, bool *missing)
+{
+	xbps_dictionary_t idx;
+	struct index_reader *r;
+	struct archive *ar;
+	uint64_t fsize = 0, pos = 0, offset = 0;
+	off_t off;
+
+	*missing = false;
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+	if ((r->url = fetchParseURL(url)) == NULL) {
+		free(r);
+		return NULL;
+	}
+	if ((idx = fetch_index(r->url)) == NULL) {
+		fetchFreeURL(r->url);
+		free(r);
+		return NULL;
+	}
+	xbps_dictionary_get_uint64(idx, "frame-size", &fsize);
+	if (!xbps_dictionary_get_uint64(xbps_dictionary_get(idx, "members"),
+	    fname, &pos)) {
+		/* not in the archive */
+		xbps_object_release(idx);
+		fetchFreeURL(r->url);
+		free(r);
+		*missing = true;
+		return NULL;
+	}
+	if (fsize == 0 || !xbps_array_get_uint64(xbps_dictionary_get(idx,
+	    "frames"), pos / fsize, &offset)) {
+		xbps_object_release(idx);
+		fetchFreeURL(r->url);
+		free(r);
+		errno = EINVAL;
+		return NULL;
+	}
+	xbps_object_release(idx);
+	r->skip = pos % fsize;
+
+	off = offset;
+	r->url->offset = off;
+	r->url->length = 0;
+	if ((r->dctx = ZSTD_createDCtx()) == NULL ||
+	    (r->fetch = fetchGet(r->url, NULL)) == NULL ||
+	    r->url->offset != off) {
+		index_read_close(NULL, r);
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if ((ar = archive_read_new()) == NULL) {
+		index_read_close(NULL, r);
+		return NULL;
+	}
+	archive_read_support_format_tar(ar);
+	if (archive_read_open(ar, r, NULL, index_read,
+	    index_read_close) != ARCHIVE_OK) {
+		archive_read_free(ar);
+		return NULL;
+	}
+	return ar;
+}
+#else
+int
+xbps_archive_write_open_indexed(struct archive *ar UNUSED, int fd UNUSED,
+		int level UNUSED)
+{
+	return ENOTSUP;
+}
+
+struct archive HIDDEN *
+xbps_archive_open_indexed(const char *url UNUSED, const char *fname UNUSED,
+		bool *missing)
+{
+	*missing = false;
+	errno = ENOTSUP;
+	return NULL;
+}
+#endif
@@ -30,16 +30,629 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wformat-nonliteral"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
 #endif
 
+/**
+ * @file lib/cb_util.c
+ * @brief Function callbacks
+ *
+ * If XBPS_FLAG_ASYNC_CB is set the callbacks are not called from the
+ * library code paths; events are copied into a bounded queue and
+ * delivered in order from a thread owned by the handle, created on
+ * first use and joined by xbps_end().
+ *
+ * - Consecutive fetch progress updates of the same file are coalesced
+ *   into the last queued one, and dropped if the queue is full.
+ * - The state description is not formatted by the producer: its format
+ *   string and arguments are copied and it's formatted by the
+ *   dispatcher thread, only if there's a state callback.
+ * - States that need the return value of the callback
+ *   (XBPS_STATE_REPO_KEY_IMPORT) wait for the queue to be drained and
+ *   are delivered synchronously.
+ * - The queue is drained before package scripts are executed and before
+ *   xbps_error_printf() and xbps_warn_printf() print anything, so their
+ *   output comes after the events queued before them. Callbacks calling
+ *   these functions don't wait for the queue.
+ */
+
+#define CBQ_SIZE	1024
+#define CB_MAXARGS	8
+
+enum cb_type {
+	CB_STATE,
+	CB_FETCH,
+	CB_UNPACK
+};
+
+struct cb_arg {
+	char conv;
+	union {
+		long long i;
+		unsigned long long u;
+		char *s;
+	} v;
+};
+
+struct cb_event {
+	enum cb_type type;
+	union {
+		struct {
+			xbps_state_t state;
+			int err;
+			char *arg;
+			char *desc;
+			const char *fmt;
+			unsigned int nargs;
+			struct cb_arg args[CB_MAXARGS];
+		} state;
+		struct {
+			off_t size;
+			off_t offset;
+			off_t dloaded;
+			char *name;
+			bool start;
+			bool update;
+			bool end;
+		} fetch;
+		struct {
+			char *pkgver;
+			char *entry;
+			int64_t entry_size;
+			ssize_t extract_count;
+			ssize_t total_count;
+			bool is_conf;
+		} unpack;
+	} u;
+};
+
+struct xbps_cb_queue {
+	pthread_mutex_t lock;
+	pthread_mutex_t cb_lock;
+	pthread_cond_t cond;
+	pthread_cond_t idle_cond;
+	pthread_t thread;
+	struct cb_event events[CBQ_SIZE];
+	unsigned int head;
+	unsigned int count;
+	struct xbps_cb_queue *next;
+	/* flushers waiting on the queue, protected by cbq_create_lock */
+	unsigned int refs;
+	pid_t pid;
+	bool dispatching;
+	bool shutdown;
+};
+
+static pthread_mutex_t cbq_create_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cbq_refs_cond = PTHREAD_COND_INITIALIZER;
+static struct xbps_cb_queue *cbq_list;
+/* set while the calling thread is running a callback */
+static pthread_key_t cb_key;
+static pthread_once_t cb_key_once = PTHREAD_ONCE_INIT;
+
+static void
+cb_key_init(void)
+{
+	(void)pthread_key_create(&cb_key, NULL);
+}
+
+static bool
+in_callback(void)
+{
+	pthread_once(&cb_key_once, cb_key_init);
+	return pthread_getspecific(cb_key) != NULL;
+}
+
+static void
+cb_enter(struct xbps_cb_queue *q)
+{
+	pthread_mutex_lock(&q->cb_lock);
+	(void)pthread_setspecific(cb_key, q);
+}
+
+static void
+cb_leave(struct xbps_cb_queue *q)
+{
+	(void)pthread_setspecific(cb_key, NULL);
+	pthread_mutex_unlock(&q->cb_lock);
+}
+
+/*
+ * Copies the arguments of a state description. Only the conversions
+ * used by libxbps are supported (no `*' widths, no floating point);
+ * returns false for anything else and the caller formats it eagerly.
+ */
+static bool
+capture_args(struct cb_event *ev, const char *fmt, va_list ap)
+{
+	const char *p;
+	unsigned int n = 0;
+	int lmod;
+	char c;
+
+	for (p = fmt; *p != '\0'; p++) {
+		if (*p != '%')
+			continue;
+		if (*++p == '%')
+			continue;
+		while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+			p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		if (*p == '.') {
+			p++;
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+		for (lmod = 0; *p != '\0' && strchr("hlzjt", *p) != NULL; p++) {
+			if (*p == 'h')
+				continue;
+			lmod = (*p == 'l' && lmod == 'l') ? 'L' : *p;
+		}
+		c = *p;
+		if (c == '\0' || strchr("diouxXcs", c) == NULL ||
+		    n == CB_MAXARGS)
+			goto fail;
+		ev->u.state.args[n].conv = c;
+		if (c == 's') {
+			const char *s = va_arg(ap, const char *);
+
+			ev->u.state.args[n].v.s = strdup(s ? s : "(null)");
+			if (ev->u.state.args[n].v.s == NULL)
+				goto fail;
+		} else if (c == 'd' || c == 'i') {
+			switch (lmod) {
+			case 'l': ev->u.state.args[n].v.i = va_arg(ap, long); break;
+			case 'L': ev->u.state.args[n].v.i = va_arg(ap, long long); break;
+			case 'z': ev->u.state.args[n].v.i = va_arg(ap, ssize_t); break;
+			case 'j': ev->u.state.args[n].v.i = va_arg(ap, intmax_t); break;
+			case 't': ev->u.state.args[n].v.i = va_arg(ap, ptrdiff_t); break;
+			default: ev->u.state.args[n].v.i = va_arg(ap, int); break;
+			}
+		} else if (c == 'c') {
+			ev->u.state.args[n].v.i = va_arg(ap, int);
+		} else {
+			switch (lmod) {
+			case 'l': ev->u.state.args[n].v.u = va_arg(ap, unsigned long); break;
+			case 'L': ev->u.state.args[n].v.u = va_arg(ap, unsigned long long); break;
+			case 'z': ev->u.state.args[n].v.u = va_arg(ap, size_t); break;
+			case 'j': ev->u.state.args[n].v.u = va_arg(ap, uintmax_t); break;
+			case 't': ev->u.state.args[n].v.u = (unsigned long long)va_arg(ap, ptrdiff_t); break;
+			default: ev->u.state.args[n].v.u = va_arg(ap, unsigned int); break;
+			}
+		}
+		n++;
+	}
+	ev->u.state.fmt = fmt;
+	ev->u.state.nargs = n;
+	return true;
+fail:
+	while (n-- > 0) {
+		if (ev->u.state.args[n].conv == 's')
+			free(ev->u.state.args[n].v.s);
+	}
+	ev->u.state.nargs = 0;
+	return false;
+}
+
+/*
+ * Formats a description from the arguments copied by capture_args(),
+ * one conversion at a time with the length modifier normalized.
+ */
+static char *
+format_args(const struct cb_event *ev)
+{
+	const struct cb_arg *arg = ev->u.state.args;
+	const char *p, *start;
+	char spec[32], *buf = NULL, *nbuf;
+	size_t len = 0, sz = 0, speclen;
+	int n;
+
+	for (p = ev->u.state.fmt; *p != '\0'; p++) {
+		char tmp[128], *out = tmp, *big = NULL;
+
+		if (*p != '%' || p[1] == '%') {
+			tmp[0] = *p;
+			tmp[1] = '\0';
+			if (*p == '%')
+				p++;
+			n = 1;
+		} else {
+			start = p++;
+			while (strchr("-+ #0123456789.", *p) != NULL)
+				p++;
+			speclen = (size_t)(p - start);
+			while (strchr("hlzjt", *p) != NULL)
+				p++;
+			if (speclen + 4 > sizeof(spec))
+				goto fail;
+			memcpy(spec, start, speclen);
+			if (arg->conv == 'd' || arg->conv == 'i' ||
+			    strchr("ouxX", arg->conv) != NULL) {
+				spec[speclen++] = 'l';
+				spec[speclen++] = 'l';
+			}
+			spec[speclen++] = arg->conv;
+			spec[speclen] = '\0';
+			switch (arg->conv) {
+			case 's':
+				n = snprintf(tmp, sizeof(tmp), spec, arg->v.s);
+				if (n >= (int)sizeof(tmp)) {
+					if ((big = malloc((size_t)n + 1)) == NULL)
+						goto fail;
+					snprintf(big, (size_t)n + 1, spec, arg->v.s);
+					out = big;
+				}
+				break;
+			case 'c':
+				n = snprintf(tmp, sizeof(tmp), spec, (int)arg->v.i);
+				break;
+			case 'd':
+			case 'i':
+				n = snprintf(tmp, sizeof(tmp), spec, arg->v.i);
+				break;
+			default:
+				n = snprintf(tmp, sizeof(tmp), spec, arg->v.u);
+				break;
+			}
+			if (n < 0 || (big == NULL && n >= (int)sizeof(tmp)))
+				goto fail;
+			arg++;
+		}
+		if (len + (size_t)n + 1 > sz) {
+			sz = (len + (size_t)n + 1) * 2;
+			if ((nbuf = realloc(buf, sz)) == NULL) {
+				free(big);
+				goto fail;
+			}
+			buf = nbuf;
+		}
+		memcpy(buf + len, out, (size_t)n);
+		len += (size_t)n;
+		buf[len] = '\0';
+		free(big);
+	}
+	return buf;
+fail:
+	free(buf);
+	return NULL;
+}
+
+static void
+event_free(struct cb_event *ev)
+{
+	unsigned int i;
+
+	switch (ev->type) {
+	case CB_STATE:
+		free(ev->u.state.arg);
+		free(ev->u.state.desc);
+		for (i = 0; i < ev->u.state.nargs; i++) {
+			if (ev->u.state.args[i].conv == 's')
+				free(ev->u.state.args[i].v.s);
+		}
+		break;
+	case CB_FETCH:
+		free(ev->u.fetch.name);
+		break;
+	case CB_UNPACK:
+		free(ev->u.unpack.pkgver);
+		free(ev->u.unpack.entry);
+		break;
+	}
+}
+
+static void
+event_deliver(struct xbps_handle *xhp, struct cb_event *ev)
+{
+	struct xbps_state_cb_data xscd;
+	struct xbps_fetch_cb_data xfcd;
+	struct xbps_unpack_cb_data xucd;
+
+	switch (ev->type) {
+	case CB_STATE:
+		if (xhp->state_cb == NULL)
+			break;
+		if (ev->u.state.desc == NULL && ev->u.state.fmt != NULL)
+			ev->u.state.desc = format_args(ev);
+		xscd.xhp = xhp;
+		xscd.state = ev->u.state.state;
+		xscd.err = ev->u.state.err;
+		xscd.arg = ev->u.state.arg;
+		xscd.desc = ev->u.state.desc;
+		(void)(*xhp->state_cb)(&xscd, xhp->state_cb_data);
+		break;
+	case CB_FETCH:
+		if (xhp->fetch_cb == NULL)
+			break;
+		xfcd.xhp = xhp;
+		xfcd.file_size = ev->u.fetch.size;
+		xfcd.file_offset = ev->u.fetch.offset;
+		xfcd.file_dloaded = ev->u.fetch.dloaded;
+		xfcd.file_name = ev->u.fetch.name;
+		xfcd.cb_start = ev->u.fetch.start;
+		xfcd.cb_update = ev->u.fetch.update;
+		xfcd.cb_end = ev->u.fetch.end;
+		(*xhp->fetch_cb)(&xfcd, xhp->fetch_cb_data);
+		break;
+	case CB_UNPACK:
+		if (xhp->unpack_cb == NULL)
+			break;
+		xucd.xhp = xhp;
+		xucd.pkgver = ev->u.unpack.pkgver;
+		xucd.entry = ev->u.unpack.entry;
+		xucd.entry_size = ev->u.unpack.entry_size;
+		xucd.entry_extract_count = ev->u.unpack.extract_count;
+		xucd.entry_total_count = ev->u.unpack.total_count;
+		xucd.entry_is_conf = ev->u.unpack.is_conf;
+		(*xhp->unpack_cb)(&xucd, xhp->unpack_cb_data);
+		break;
+	}
+}
+
+struct cbq_thread_arg {
+	struct xbps_handle *xhp;
+	struct xbps_cb_queue *q;
+};
+
+static void *
+cbq_dispatcher(void *arg)
+{
+	struct cbq_thread_arg targ = *(struct cbq_thread_arg *)arg;
+	struct xbps_cb_queue *q = targ.q;
+	struct cb_event ev;
+
+	free(arg);
+	pthread_mutex_lock(&q->lock);
+	for (;;) {
+		while (q->count == 0 && !q->shutdown)
+			pthread_cond_wait(&q->cond, &q->lock);
+		if (q->count == 0)
+			break;
+		ev = q->events[q->head];
+		q->head = (q->head + 1) % CBQ_SIZE;
+		q->count--;
+		q->dispatching = true;
+		/* wake up producers waiting for a free slot */
+		pthread_cond_broadcast(&q->cond);
+		pthread_mutex_unlock(&q->lock);
+
+		cb_enter(q);
+		event_deliver(targ.xhp, &ev);
+		cb_leave(q);
+		event_free(&ev);
+
+		pthread_mutex_lock(&q->lock);
+		q->dispatching = false;
+		if (q->count == 0)
+			pthread_cond_broadcast(&q->idle_cond);
+	}
+	q->dispatching = false;
+	pthread_cond_broadcast(&q->idle_cond);
+	pthread_mutex_unlock(&q->lock);
+	return NULL;
+}
+
+/*
+ * The dispatcher doesn't survive fork(2), the child delivers its events
+ * synchronously. So do callbacks, the dispatcher can't wait for itself.
+ */
+static struct xbps_cb_queue *
+cbq_usable(struct xbps_cb_queue *q)
+{
+	if (q->pid != getpid() || pthread_getspecific(cb_key) == q)
+		return NULL;
+	return q;
+}
+
+static struct xbps_cb_queue *
+cbq_get(struct xbps_handle *xhp)
+{
+	struct xbps_cb_queue *q;
+	struct cbq_thread_arg *targ;
+	int rv;
+
+	if ((xhp->flags & XBPS_FLAG_ASYNC_CB) == 0)
+		return NULL;
+
+#ifdef HAVE_ATOMICS
+	if ((q = __atomic_load_n(&xhp->cb_queue, __ATOMIC_ACQUIRE)) != NULL)
+		return cbq_usable(q);
+#endif
+	pthread_once(&cb_key_once, cb_key_init);
+	pthread_mutex_lock(&cbq_create_lock);
+	if (xhp->cb_queue != NULL) {
+		q = cbq_usable(xhp->cb_queue);
+		pthread_mutex_unlock(&cbq_create_lock);
+		return q;
+	}
+	if ((q = calloc(1, sizeof(*q))) == NULL ||
+	    (targ = malloc(sizeof(*targ))) == NULL) {
+		free(q);
+		pthread_mutex_unlock(&cbq_create_lock);
+		return NULL;
+	}
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_mutex_init(&q->cb_lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+	pthread_cond_init(&q->idle_cond, NULL);
+	q->pid = getpid();
+	targ->xhp = xhp;
+	targ->q = q;
+	if ((rv = pthread_create(&q->thread, NULL, cbq_dispatcher, targ)) != 0) {
+		xbps_dbg_printf(xhp, "[cb] failed to create thread: %s\n",
+		    strerror(rv));
+		pthread_cond_destroy(&q->cond);
+		pthread_cond_destroy(&q->idle_cond);
+		pthread_mutex_destroy(&q->cb_lock);
+		pthread_mutex_destroy(&q->lock);
+		free(targ);
+		free(q);
+		/* don't try again */
+		xhp->flags &= ~XBPS_FLAG_ASYNC_CB;
+		q = NULL;
+	} else {
+		q->next = cbq_list;
+		cbq_list = q;
+	}
+#ifdef HAVE_ATOMICS
+	__atomic_store_n(&xhp->cb_queue, q, __ATOMIC_RELEASE);
+#else
+	xhp->cb_queue = q;
+#endif
+	pthread_mutex_unlock(&cbq_create_lock);
+	return q;
+}
+
+/*
+ * Queues an event, blocking while the queue is full. A fetch progress
+ * update is merged into the last queued update of the same file.
+ */
+static void
+cbq_push(struct xbps_cb_queue *q, struct cb_event *ev)
+{
+	struct cb_event *last;
+	bool coalesce;
+
+	coalesce = ev->type == CB_FETCH && ev->u.fetch.update &&
+	    !ev->u.fetch.start && !ev->u.fetch.end;
+
+	pthread_mutex_lock(&q->lock);
+	if (coalesce && q->count > 0) {
+		last = &q->events[(q->head + q->count - 1) % CBQ_SIZE];
+		if (last->type == CB_FETCH && last->u.fetch.update &&
+		    !last->u.fetch.start && !last->u.fetch.end &&
+		    strcmp(last->u.fetch.name, ev->u.fetch.name) == 0) {
+			last->u.fetch.size = ev->u.fetch.size;
+			last->u.fetch.offset = ev->u.fetch.offset;
+			last->u.fetch.dloaded = ev->u.fetch.dloaded;
+			pthread_mutex_unlock(&q->lock);
+			event_free(ev);
+			return;
+		}
+	}
+	if (coalesce && q->count == CBQ_SIZE) {
+		/* the next update or the end event supersede it */
+		pthread_mutex_unlock(&q->lock);
+		event_free(ev);
+		return;
+	}
+	while (q->count == CBQ_SIZE)
+		pthread_cond_wait(&q->cond, &q->lock);
+	q->events[(q->head + q->count) % CBQ_SIZE] = *ev;
+	q->count++;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static void
+cbq_wait(struct xbps_cb_queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	while (q->count > 0 || q->dispatching)
+		pthread_cond_wait(&q->idle_cond, &q->lock);
+	pthread_mutex_unlock(&q->lock);
+}
+
+void
+xbps_cb_flush(struct xbps_handle *xhp)
+{
+	struct xbps_cb_queue *q = xhp->cb_queue;
+
+	if (q == NULL || q->pid != getpid() || in_callback())
+		return;
+	cbq_wait(q);
+}
+
+void HIDDEN
+xbps_cb_flush_all(void)
+{
+	struct xbps_cb_queue *q, **qs;
+	size_t i, n = 0;
+
+	/* the dispatcher would wait for itself */
+	if (in_callback())
+		return;
+
+	/*
+	 * Don't hold the list lock while waiting, a callback creating
+	 * a queue or being destroyed would wait for us.
+	 */
+	pthread_mutex_lock(&cbq_create_lock);
+	for (q = cbq_list; q != NULL; q = q->next)
+		n++;
+	if (n == 0 || (qs = calloc(n, sizeof(*qs))) == NULL) {
+		pthread_mutex_unlock(&cbq_create_lock);
+		return;
+	}
+	n = 0;
+	for (q = cbq_list; q != NULL; q = q->next) {
+		if (q->pid != getpid())
+			continue;
+		q->refs++;
+		qs[n++] = q;
+	}
+	pthread_mutex_unlock(&cbq_create_lock);
+
+	for (i = 0; i < n; i++)
+		cbq_wait(qs[i]);
+
+	pthread_mutex_lock(&cbq_create_lock);
+	for (i = 0; i < n; i++)
+		qs[i]->refs--;
+	pthread_cond_broadcast(&cbq_refs_cond);
+	pthread_mutex_unlock(&cbq_create_lock);
+	free(qs);
+}
+
+void HIDDEN
+xbps_cb_queue_destroy(struct xbps_handle *xhp)
+{
+	struct xbps_cb_queue *q = xhp->cb_queue;
+	struct xbps_cb_queue **qp;
+
+	if (q == NULL || q->pid != getpid())
+		return;
+
+	pthread_mutex_lock(&cbq_create_lock);
+	for (qp = &cbq_list; *qp != NULL; qp = &(*qp)->next) {
+		if (*qp == q) {
+			*qp = q->next;
+			break;
+		}
+	}
+	/* a flusher may still be waiting for it to go idle */
+	while (q->refs > 0)
+		pthread_cond_wait(&cbq_refs_cond, &cbq_create_lock);
+	pthread_mutex_unlock(&cbq_create_lock);
+
+	pthread_mutex_lock(&q->lock);
+	q->shutdown = true;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+	pthread_join(q->thread, NULL);
+
+	pthread_cond_destroy(&q->cond);
+	pthread_cond_destroy(&q->idle_cond);
+	pthread_mutex_destroy(&q->cb_lock);
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+	xhp->cb_queue = NULL;
+}
+
 void HIDDEN
 xbps_set_cb_fetch(struct xbps_handle *xhp,
 		  off_t file_size,
@@ -51,10 +664,26 @@ xbps_set_cb_fetch(struct xbps_handle *xhp,
 		  bool cb_end)
 {
 	struct xbps_fetch_cb_data xfcd;
+	struct xbps_cb_queue *q;
+	struct cb_event ev;
+	int serrno = errno;
 
 	if (xhp->fetch_cb == NULL)
 		return;
 
+	if ((q = cbq_get(xhp)) != NULL &&
+	    (ev.u.fetch.name = strdup(file_name)) != NULL) {
+		ev.type = CB_FETCH;
+		ev.u.fetch.size = file_size;
+		ev.u.fetch.offset = file_offset;
+		ev.u.fetch.dloaded = file_dloaded;
+		ev.u.fetch.start = cb_start;
+		ev.u.fetch.update = cb_update;
+		ev.u.fetch.end = cb_end;
+		cbq_push(q, &ev);
+		errno = serrno;
+		return;
+	}
 	xfcd.xhp = xhp;
 	xfcd.file_size = file_size;
 	xfcd.file_offset = file_offset;
@@ -63,7 +692,39 @@ xbps_set_cb_fetch(struct xbps_handle *xhp,
 	xfcd.cb_start = cb_start;
 	xfcd.cb_update = cb_update;
 	xfcd.cb_end = cb_end;
+	if (q != NULL) {
+		cbq_wait(q);
+		cb_enter(q);
+	}
 	(*xhp->fetch_cb)(&xfcd, xhp->fetch_cb_data);
+	if (q != NULL)
+		cb_leave(q);
+}
+
+void HIDDEN
+xbps_set_cb_unpack(struct xbps_handle *xhp,
+		   const struct xbps_unpack_cb_data *xucd)
+{
+	struct xbps_cb_queue *q;
+	struct cb_event ev;
+	int serrno = errno;
+
+	if (xhp->unpack_cb == NULL)
+		return;
+
+	if ((q = cbq_get(xhp)) != NULL) {
+		ev.type = CB_UNPACK;
+		ev.u.unpack.pkgver = xucd->pkgver ? strdup(xucd->pkgver) : NULL;
+		ev.u.unpack.entry = xucd->entry ? strdup(xucd->entry) : NULL;
+		ev.u.unpack.entry_size = xucd->entry_size;
+		ev.u.unpack.extract_count = xucd->entry_extract_count;
+		ev.u.unpack.total_count = xucd->entry_total_count;
+		ev.u.unpack.is_conf = xucd->entry_is_conf;
+		cbq_push(q, &ev);
+		errno = serrno;
+		return;
+	}
+	(*xhp->unpack_cb)(xucd, xhp->unpack_cb_data);
 }
 
 int HIDDEN
@@ -75,17 +736,43 @@ xbps_set_cb_state(struct xbps_handle *xhp,
 		  ...)
 {
 	struct xbps_state_cb_data xscd;
+	struct xbps_cb_queue *q;
+	struct cb_event ev;
 	char *buf = NULL;
 	va_list va;
-	int retval;
+	int retval, serrno = errno;
 
 	if (xhp->state_cb == NULL)
 		return 0;
 
+	q = cbq_get(xhp);
+	if (q != NULL && state != XBPS_STATE_REPO_KEY_IMPORT) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = CB_STATE;
+		ev.u.state.state = state;
+		ev.u.state.err = err;
+		ev.u.state.arg = arg ? strdup(arg) : NULL;
+		if (fmt != NULL) {
+			va_start(va, fmt);
+			if (!capture_args(&ev, fmt, va)) {
+				va_end(va);
+				va_start(va, fmt);
+				if (vasprintf(&ev.u.state.desc, fmt, va) <= 0)
+					ev.u.state.desc = NULL;
+			}
+			va_end(va);
+		}
+		cbq_push(q, &ev);
+		/* callers often return errno after reporting it */
+		errno = serrno;
+		return 0;
+	}
+
 	xscd.xhp = xhp;
 	xscd.state = state;
 	xscd.err = err;
 	xscd.arg = arg;
+	xscd.desc = NULL;
 	if (fmt != NULL) {
 		va_start(va, fmt);
 		retval = vasprintf(&buf, fmt, va);
@@ -95,7 +782,13 @@ xbps_set_cb_state(struct xbps_handle *xhp,
 		else
 			xscd.desc = buf;
 	}
+	if (q != NULL) {
+		cbq_wait(q);
+		cb_enter(q);
+	}
 	retval = (*xhp->state_cb)(&xscd, xhp->state_cb_data);
+	if (q != NULL)
+		cb_leave(q);
 	if (buf != NULL)
 		free(buf);
 
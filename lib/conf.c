@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <glob.h>
 #include <libgen.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -150,6 +151,40 @@ store_noextract(struct xbps_handle *xhp, const char *value)
 	xbps_dbg_printf(xhp, "Added noextract pattern: %s\n", value);
 }
 
+/*
+ * Parses a size in bytes with an optional K, M or G (binary) suffix.
+ */
+bool HIDDEN
+xbps_parse_size(const char *str, uint64_t *sizep)
+{
+	unsigned long long n;
+	unsigned int shift = 0;
+	char *end;
+
+	errno = 0;
+	n = strtoull(str, &end, 10);
+	if (errno != 0 || end == str || *str == '-')
+		return false;
+	switch (*end) {
+	case 'K': case 'k':
+		shift = 10;
+		end++;
+		break;
+	case 'M': case 'm':
+		shift = 20;
+		end++;
+		break;
+	case 'G': case 'g':
+		shift = 30;
+		end++;
+		break;
+	}
+	if (*end != '\0' || (n << shift) >> shift != n)
+		return false;
+	*sizep = (uint64_t)n << shift;
+	return true;
+}
+
 enum {
 	KEY_ERROR = 0,
 	KEY_ARCHITECTURE,
@@ -164,6 +199,11 @@ enum {
 	KEY_SYSLOG,
 	KEY_VIRTUALPKG,
 	KEY_KEEPCONF,
+	KEY_JOBS,
+	KEY_MEMORYBUDGET,
+	KEY_PKGSTORE,
+	KEY_DURABILITY,
+	KEY_METACOMPRESSION,
 };
 
 static const struct key {
@@ -174,10 +214,15 @@ static const struct key {
 	{ "architecture", 12, KEY_ARCHITECTURE },
 	{ "bestmatching", 12, KEY_BESTMATCHING },
 	{ "cachedir",      8, KEY_CACHEDIR },
+	{ "durability",   10, KEY_DURABILITY },
 	{ "ignorepkg",     9, KEY_IGNOREPKG },
 	{ "include",       7, KEY_INCLUDE },
+	{ "jobs",          4, KEY_JOBS },
 	{ "keepconf",      8, KEY_KEEPCONF },
+	{ "memorybudget", 12, KEY_MEMORYBUDGET },
+	{ "metacompression", 15, KEY_METACOMPRESSION },
 	{ "noextract",     9, KEY_NOEXTRACT },
+	{ "pkgstore",      8, KEY_PKGSTORE },
 	{ "preserve",      8, KEY_PRESERVE },
 	{ "repository",   10, KEY_REPOSITORY },
 	{ "rootdir",       7, KEY_ROOTDIR },
@@ -280,7 +325,8 @@ parse_file(struct xbps_handle *xhp, const char *path, bool nested)
 	char *line = NULL;
 	int rv = 0;
 	int size, rs;
-	char *dir;
+	char *dir, *end;
+	unsigned long jobs;
 
 	if ((fp = fopen(path, "r")) == NULL) {
 		rv = errno;
@@ -383,6 +429,74 @@ parse_file(struct xbps_handle *xhp, const char *path, bool nested)
 				xbps_dbg_printf(xhp, "%s: pkg best matching disabled\n", path);
 			}
 			break;
+		case KEY_JOBS:
+			errno = 0;
+			jobs = strtoul(val, &end, 10);
+			if (errno != 0 || end == val || *end != '\0' ||
+			    jobs > UINT_MAX) {
+				xbps_dbg_printf(xhp, "%s: ignoring invalid jobs "
+				    "value at line %zu\n", path, nlines);
+				break;
+			}
+			xhp->jobs = (unsigned int)jobs;
+			xbps_dbg_printf(xhp, "%s: jobs set to %u\n", path, xhp->jobs);
+			break;
+		case KEY_MEMORYBUDGET:
+			if (!xbps_parse_size(val, &xhp->memory_budget)) {
+				xbps_dbg_printf(xhp, "%s: ignoring invalid "
+				    "memorybudget value at line %zu\n", path,
+				    nlines);
+				break;
+			}
+			xbps_dbg_printf(xhp, "%s: memorybudget set to %" PRIu64
+			    "\n", path, xhp->memory_budget);
+			break;
+		case KEY_PKGSTORE:
+			size = sizeof xhp->storedir;
+			rs = snprintf(xhp->storedir, size, "%s", val);
+			if (rs < 0 || rs >= size) {
+				rv = ENOMEM;
+				break;
+			}
+			xbps_dbg_printf(xhp, "%s: pkgstore set to %s\n", path, val);
+			break;
+		case KEY_METACOMPRESSION:
+			if (strcasecmp(val, "zstd") == 0) {
+#ifdef HAVE_LIBZSTD
+				xhp->flags |= XBPS_FLAG_ZSTD_METAFILES;
+#else
+				xbps_dbg_printf(xhp, "%s: built without "
+				    "zstd support, ignoring metacompression\n",
+				    path);
+				break;
+#endif
+			} else if (strcasecmp(val, "none") == 0) {
+				xhp->flags &= ~XBPS_FLAG_ZSTD_METAFILES;
+			} else {
+				xbps_dbg_printf(xhp, "%s: ignoring invalid "
+				    "metacompression value at line %zu\n", path,
+				    nlines);
+				break;
+			}
+			xbps_dbg_printf(xhp, "%s: metacompression set to %s\n",
+			    path, val);
+			break;
+		case KEY_DURABILITY:
+			if (strcasecmp(val, "transaction") == 0) {
+				xhp->durability = XBPS_DURABILITY_TRANSACTION;
+			} else if (strcasecmp(val, "package") == 0) {
+				xhp->durability = XBPS_DURABILITY_PACKAGE;
+			} else if (strcasecmp(val, "none") == 0) {
+				xhp->durability = XBPS_DURABILITY_NONE;
+			} else {
+				xbps_dbg_printf(xhp, "%s: ignoring invalid "
+				    "durability value at line %zu\n", path,
+				    nlines);
+				break;
+			}
+			xbps_dbg_printf(xhp, "%s: durability set to %s\n",
+			    path, val);
+			break;
 		case KEY_IGNOREPKG:
 			store_ignored_pkg(xhp, val);
 			break;
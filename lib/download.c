@@ -56,13 +56,12 @@
  * XBPS download related functions, frontend for NetBSD's libfetch.
  */
 static const char *
-print_time(time_t *t)
+print_time(char *buf, size_t len, time_t *t)
 {
 	struct tm tm;
-	static char buf[255];
 
 	gmtime_r(t, &tm);
-	strftime(buf, sizeof(buf), "%d %b %Y %H:%M", &tm);
+	strftime(buf, len, "%d %b %Y %H:%M", &tm);
 	return buf;
 }
 
@@ -103,7 +102,7 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	off_t bytes_dload = 0;
 	ssize_t bytes_read = 0, bytes_written = 0;
 	char buf[4096], *tempfile = NULL;
-	char fetch_flags[8];
+	char fetch_flags[8], timebuf[64];
 	int fd = -1, rv = 0;
 	bool refetch = false, restart = false;
 	SHA256_CTX sha256;
@@ -173,11 +172,15 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 
 	/* debug stuff */
 	xbps_dbg_printf(xhp, "st.st_size: %zd\n", (ssize_t)stp->st_size);
-	xbps_dbg_printf(xhp, "st.st_atime: %s\n", print_time(&stp->st_atime));
-	xbps_dbg_printf(xhp, "st.st_mtime: %s\n", print_time(&stp->st_mtime));
+	xbps_dbg_printf(xhp, "st.st_atime: %s\n",
+	    print_time(timebuf, sizeof(timebuf), &stp->st_atime));
+	xbps_dbg_printf(xhp, "st.st_mtime: %s\n",
+	    print_time(timebuf, sizeof(timebuf), &stp->st_mtime));
 	xbps_dbg_printf(xhp, "url_stat.size: %zd\n", (ssize_t)url_st.size);
-	xbps_dbg_printf(xhp, "url_stat.atime: %s\n", print_time(&url_st.atime));
-	xbps_dbg_printf(xhp, "url_stat.mtime: %s\n", print_time(&url_st.mtime));
+	xbps_dbg_printf(xhp, "url_stat.atime: %s\n",
+	    print_time(timebuf, sizeof(timebuf), &url_st.atime));
+	xbps_dbg_printf(xhp, "url_stat.mtime: %s\n",
+	    print_time(timebuf, sizeof(timebuf), &url_st.mtime));
 
 	if (fio == NULL) {
 		if (fetchLastErrCode == FETCH_UNCHANGED) {
@@ -211,7 +214,7 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	xbps_dbg_printf(xhp, "url->offset: %zd\n", (ssize_t)url->offset);
 	xbps_dbg_printf(xhp, "url->length: %zu\n", url->length);
 	xbps_dbg_printf(xhp, "url->last_modified: %s\n",
-	    print_time(&url->last_modified));
+	    print_time(timebuf, sizeof(timebuf), &url->last_modified));
 	/*
 	 * If restarting, open the file for appending otherwise create it.
 	 */
@@ -28,6 +28,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
 
 #include "xbps_api_impl.h"
 
@@ -43,11 +45,18 @@
 int
 xbps_init(struct xbps_handle *xhp)
 {
-	const char *native_arch = NULL;
+	struct timespec ts;
+	const char *native_arch = NULL, *jobs, *budget;
 	int rv = 0;
 
 	assert(xhp != NULL);
 
+	memset(&xhp->stats, 0, sizeof(xhp->stats));
+	SIMPLEQ_INIT(&xhp->rpool);
+	xhp->pkgdb_fd = -1;
+	xhp->pkgdb_rv = 0;
+	xhp->pkgdb_names_mapped = false;
+
 	xbps_dbg_printf(xhp, "%s\n", XBPS_RELVER);
 
 	/* Set rootdir */
@@ -98,7 +107,10 @@ xbps_init(struct xbps_handle *xhp)
 		return errno ? errno : ENOMEM;
 
 	/* process xbps.d directories */
-	if ((rv = xbps_conf_init(xhp)) != 0)
+	xbps_stats_start(&ts);
+	rv = xbps_conf_init(xhp);
+	xbps_stats_end(xhp, XBPS_STATS_CONF, &ts);
+	if (rv != 0)
 		return rv;
 
 	/* target arch only through env var */
@@ -113,6 +125,22 @@ xbps_init(struct xbps_handle *xhp)
 			return ENOBUFS;
 	}
 
+	/* allow to overwrite the number of threads with env variable */
+	if ((jobs = getenv("XBPS_JOBS")) && *jobs != '\0') {
+		char *end;
+		unsigned long n;
+
+		errno = 0;
+		n = strtoul(jobs, &end, 10);
+		if (errno == 0 && *end == '\0' && n <= UINT_MAX)
+			xhp->jobs = (unsigned int)n;
+	}
+	if (xhp->jobs == 0)
+		xhp->jobs = xbps_cpu_count();
+
+	if ((budget = getenv("XBPS_MEMORY_BUDGET")) && *budget != '\0')
+		(void)xbps_parse_size(budget, &xhp->memory_budget);
+
 	if (*xhp->native_arch == '\0') {
 		struct utsname un;
 		if (uname(&un) == -1)
@@ -151,14 +179,32 @@ xbps_init(struct xbps_handle *xhp)
 	if (xbps_path_clean(xhp->metadir) == -1)
 		return ENOTSUP;
 
+	/* Set storedir, shared by rootdirs so relative to cwd */
+	if (xhp->storedir[0] != '\0') {
+		if (xhp->storedir[0] != '/') {
+			char cwd[XBPS_MAXPATH];
+
+			if (getcwd(cwd, sizeof(cwd)) == NULL)
+				return ENOBUFS;
+			if (xbps_path_prepend(xhp->storedir,
+			    sizeof xhp->storedir, cwd) == -1)
+				return ENOBUFS;
+		}
+		if (xbps_path_clean(xhp->storedir) == -1)
+			return ENOTSUP;
+	}
+
 	xbps_dbg_printf(xhp, "rootdir=%s\n", xhp->rootdir);
 	xbps_dbg_printf(xhp, "metadir=%s\n", xhp->metadir);
 	xbps_dbg_printf(xhp, "cachedir=%s\n", xhp->cachedir);
+	xbps_dbg_printf(xhp, "storedir=%s\n", xhp->storedir);
 	xbps_dbg_printf(xhp, "confdir=%s\n", xhp->confdir);
 	xbps_dbg_printf(xhp, "sysconfdir=%s\n", xhp->sysconfdir);
 	xbps_dbg_printf(xhp, "syslog=%s\n", xhp->flags & XBPS_FLAG_DISABLE_SYSLOG ? "false" : "true");
 	xbps_dbg_printf(xhp, "bestmatching=%s\n", xhp->flags & XBPS_FLAG_BESTMATCH ? "true" : "false");
 	xbps_dbg_printf(xhp, "keepconf=%s\n", xhp->flags & XBPS_FLAG_KEEP_CONFIG ? "true" : "false");
+	xbps_dbg_printf(xhp, "jobs=%u\n", xhp->jobs);
+	xbps_dbg_printf(xhp, "memorybudget=%" PRIu64 "\n", xhp->memory_budget);
 	xbps_dbg_printf(xhp, "Architecture: %s\n", xhp->native_arch);
 	xbps_dbg_printf(xhp, "Target Architecture: %s\n", xhp->target_arch ? xhp->target_arch : "(null)");
 
@@ -179,5 +225,10 @@ xbps_end(struct xbps_handle *xhp)
 {
 	assert(xhp);
 
+	xbps_cb_queue_destroy(xhp);
+	xbps_alternatives_discard(xhp);
+	xbps_thread_pool_destroy(xhp);
+	xbps_keyring_release(xhp);
+	xbps_rpool_release(xhp);
 	xbps_pkgdb_release(xhp);
 }
@@ -88,6 +88,7 @@ xbps_error_printf(const char *fmt, ...)
 {
 	va_list ap;
 
+	xbps_cb_flush_all();
 	va_start(ap, fmt);
 	common_printf(stderr, "ERROR: ", fmt, ap);
 	va_end(ap);
@@ -98,6 +99,7 @@ xbps_warn_printf(const char *fmt, ...)
 {
 	va_list ap;
 
+	xbps_cb_flush_all();
 	va_start(ap, fmt);
 	common_printf(stderr, "WARNING: ", fmt, ap);
 	va_end(ap);
@@ -109,128 +109,629 @@ relpath(char *from, char *to)
 	return rel;
 }
 
+/*
+ * Alternatives symlinks are not changed while the groups are being
+ * registered, unregistered or switched. The first time a group is
+ * changed, the links of its current provider are recorded in the plan.
+ * When the plan is committed, at the end of the transaction or of the
+ * call otherwise, the links of the resulting provider of every changed
+ * group are computed once and applied as a single batch.
+ */
+struct xbps_alt_plan {
+	/* group name -> links of its provider when first changed */
+	xbps_dictionary_t groups;
+	/* pkgname -> alternatives of the packages being registered */
+	xbps_dictionary_t pkgs;
+	/* paths of the links in place, built on the first claim */
+	xbps_dictionary_t links;
+	/* paths of the links above taken over by packages */
+	xbps_dictionary_t claimed;
+};
+
+struct alt_link {
+	const char *grname;
+	char *name;	/* link as specified in the group */
+	char *dest;	/* target as specified in the group */
+	char *path;	/* link path in rootdir */
+	char *target;	/* symlink contents, NULL if the link is removed */
+	char *tmp;	/* new link staged aside */
+	char *old;	/* previous symlink contents, to roll back */
+	bool skip;	/* already as planned */
+	bool done;	/* renamed or unlinked */
+};
+
+struct alt_batch {
+	struct alt_link *links;
+	unsigned int nlinks;
+	unsigned int size;
+	/* link path -> index in links */
+	xbps_dictionary_t paths;
+};
+
+int HIDDEN
+xbps_alternatives_begin(struct xbps_handle *xhp)
+{
+	struct xbps_alt_plan *plan;
+
+	if (xhp->alt_plan != NULL)
+		return 0;
+	if ((plan = calloc(1, sizeof(*plan))) == NULL)
+		return errno;
+	if ((plan->groups = xbps_dictionary_create()) == NULL) {
+		free(plan);
+		return ENOMEM;
+	}
+	if ((plan->pkgs = xbps_dictionary_create()) == NULL) {
+		xbps_object_release(plan->groups);
+		free(plan);
+		return ENOMEM;
+	}
+	if ((plan->claimed = xbps_dictionary_create()) == NULL) {
+		xbps_object_release(plan->groups);
+		xbps_object_release(plan->pkgs);
+		free(plan);
+		return ENOMEM;
+	}
+	xhp->alt_plan = plan;
+	return 0;
+}
+
+void HIDDEN
+xbps_alternatives_discard(struct xbps_handle *xhp)
+{
+	struct xbps_alt_plan *plan = xhp->alt_plan;
+
+	if (plan == NULL)
+		return;
+	xbps_object_release(plan->groups);
+	xbps_object_release(plan->pkgs);
+	xbps_object_release(plan->claimed);
+	if (plan->links != NULL)
+		xbps_object_release(plan->links);
+	free(plan);
+	xhp->alt_plan = NULL;
+}
+
+/*
+ * Returns the path in rootdir of a link specified as name:dest.
+ */
+static char *
+alt_link_path(struct xbps_handle *xhp, const char *name, const char *dest)
+{
+	char *p, *path;
+
+	if (name[0] != '/') {
+		/* add target dir to relative links */
+		if ((p = strdup(dest)) == NULL)
+			return NULL;
+		path = xbps_xasprintf("%s/%s/%s", xhp->rootdir, dirname(p), name);
+		free(p);
+	} else {
+		path = xbps_xasprintf("%s/%s", xhp->rootdir, name);
+	}
+	return path;
+}
+
+static bool
+alt_valid(const char *str)
+{
+	const char *sep;
+
+	return str != NULL && (sep = strchr(str, ':')) != NULL &&
+	    sep != str && sep[1] != '\0';
+}
+
+/*
+ * Records the links of the current provider of a group, before the
+ * group is changed for the first time.
+ */
 static int
-remove_symlinks(struct xbps_handle *xhp, xbps_array_t a, const char *grname)
+alt_plan_touch(struct xbps_handle *xhp, xbps_dictionary_t alternatives,
+		const char *grname)
 {
-	unsigned int i, cnt;
-	struct stat st;
+	struct xbps_alt_plan *plan = xhp->alt_plan;
+	xbps_dictionary_t pkgd;
+	xbps_array_t links = NULL;
+	const char *first = NULL;
+	bool ok;
 
-	cnt = xbps_array_count(a);
-	for (i = 0; i < cnt; i++) {
-		xbps_string_t str;
-		char *l, *lnk;
-
-		str = xbps_array_get(a, i);
-		l = left(xbps_string_cstring_nocopy(str));
-		assert(l);
-		if (l[0] != '/') {
-			const char *tgt;
-			char *tgt_dup, *tgt_dir;
-			tgt = right(xbps_string_cstring_nocopy(str));
-			tgt_dup = strdup(tgt);
-			assert(tgt_dup);
-			tgt_dir = dirname(tgt_dup);
-			lnk = xbps_xasprintf("%s%s/%s", xhp->rootdir, tgt_dir, l);
-			free(tgt_dup);
-		} else {
-			lnk = xbps_xasprintf("%s%s", xhp->rootdir, l);
-		}
-		if (lstat(lnk, &st) == -1 || !S_ISLNK(st.st_mode)) {
-			free(lnk);
-			free(l);
+	if (xbps_dictionary_get(plan->groups, grname) != NULL)
+		return 0;
+
+	if (xbps_array_get_cstring_nocopy(xbps_dictionary_get(alternatives,
+	    grname), 0, &first) && (pkgd = xbps_pkgdb_get_pkg(xhp, first)))
+		links = xbps_dictionary_get(xbps_dictionary_get(pkgd,
+		    "alternatives"), grname);
+	if (links != NULL)
+		return xbps_dictionary_set(plan->groups, grname, links) ?
+		    0 : ENOMEM;
+
+	if ((links = xbps_array_create()) == NULL)
+		return ENOMEM;
+	ok = xbps_dictionary_set(plan->groups, grname, links);
+	xbps_object_release(links);
+	return ok ? 0 : ENOMEM;
+}
+
+static void
+alt_links_add(struct xbps_handle *xhp, xbps_dictionary_t paths,
+		xbps_array_t links)
+{
+	for (unsigned int i = 0; i < xbps_array_count(links); i++) {
+		const char *str = xbps_array_cstring_nocopy_at(links, i);
+		char *name, *path;
+
+		if (!alt_valid(str) || (name = left(str)) == NULL)
 			continue;
+		path = alt_link_path(xhp, name, right(str));
+		free(name);
+		if (path == NULL)
+			continue;
+		normpath(path);
+		xbps_dictionary_set_bool(paths, path, true);
+		free(path);
+	}
+}
+
+/*
+ * Collects the paths of the alternatives links in place: those of the
+ * providers recorded in the plan and of the current providers of the
+ * groups not changed yet.
+ */
+static xbps_dictionary_t
+alt_plan_links(struct xbps_handle *xhp)
+{
+	struct xbps_alt_plan *plan = xhp->alt_plan;
+	xbps_dictionary_t alternatives, paths, pkgd;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	const char *grname, *first;
+
+	if ((paths = xbps_dictionary_create()) == NULL)
+		return NULL;
+	if ((iter = xbps_dictionary_iterator(plan->groups)) != NULL) {
+		while ((keysym = xbps_object_iterator_next(iter)) != NULL) {
+			alt_links_add(xhp, paths,
+			    xbps_dictionary_get_keysym(plan->groups, keysym));
 		}
-		xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_LINK_REMOVED, 0, NULL,
-		    "Removing '%s' alternatives group symlink: %s", grname, l);
-		unlink(lnk);
-		free(lnk);
-		free(l);
+		xbps_object_iterator_release(iter);
 	}
+	alternatives = xbps_dictionary_get(xhp->pkgdb, "_XBPS_ALTERNATIVES_");
+	if (alternatives != NULL &&
+	    (iter = xbps_dictionary_iterator(alternatives)) != NULL) {
+		while ((keysym = xbps_object_iterator_next(iter)) != NULL) {
+			grname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+			first = NULL;
+			if (xbps_dictionary_get(plan->groups, grname) ||
+			    !xbps_array_get_cstring_nocopy(
+			    xbps_dictionary_get_keysym(alternatives, keysym),
+			    0, &first) ||
+			    (pkgd = xbps_pkgdb_get_pkg(xhp, first)) == NULL)
+				continue;
+			alt_links_add(xhp, paths, xbps_dictionary_get(
+			    xbps_dictionary_get(pkgd, "alternatives"), grname));
+		}
+		xbps_object_iterator_release(iter);
+	}
+	return paths;
+}
 
-	return 0;
+/*
+ * A symlink at entry is being unpacked by a package: if it replaces
+ * an alternatives link, the link is not removed afterwards.
+ */
+void HIDDEN
+xbps_alternatives_claim(struct xbps_handle *xhp, const char *entry)
+{
+	struct xbps_alt_plan *plan = xhp->alt_plan;
+	char *path;
+
+	if (plan == NULL)
+		return;
+	if (plan->links == NULL && (plan->links = alt_plan_links(xhp)) == NULL)
+		return;
+	if (xbps_dictionary_count(plan->links) == 0)
+		return;
+	path = xbps_xasprintf("%s/%s", xhp->rootdir, entry);
+	normpath(path);
+	if (xbps_dictionary_get(plan->links, path))
+		xbps_dictionary_set_bool(plan->claimed, path, true);
+	free(path);
 }
 
+/*
+ * Returns the position of pkgname in the providers of a group,
+ * -1 if it doesn't provide it.
+ */
 static int
-create_symlinks(struct xbps_handle *xhp, xbps_array_t a, const char *grname)
+alt_provider_index(xbps_array_t array, const char *pkgname)
 {
-	int rv;
-	unsigned int i, n;
-	char *alternative, *tok1, *tok2, *linkpath, *target, *dir, *p;
+	const char *str;
+
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		str = xbps_array_cstring_nocopy_at(array, i);
+		if (str != NULL && strcmp(str, pkgname) == 0)
+			return (int)i;
+	}
+	return -1;
+}
 
-	n = xbps_array_count(a);
+static bool
+alt_provider_set_first(xbps_array_t array, int idx, const char *pkgname)
+{
+	xbps_string_t kstr;
+	bool ok;
+
+	if (idx == 0)
+		return true;
+	if ((kstr = xbps_string_create_cstring(pkgname)) == NULL)
+		return false;
+	if (idx > 0)
+		xbps_array_remove(array, (unsigned int)idx);
+	ok = xbps_array_add_first(array, kstr);
+	xbps_object_release(kstr);
+	return ok;
+}
+
+static int
+alt_plan_end(struct xbps_handle *xhp, bool own, int rv)
+{
+	int rv2;
+
+	if (!own)
+		return rv;
+	rv2 = xbps_alternatives_commit(xhp);
+	return rv ? rv : rv2;
+}
+
+static void
+alt_link_free(struct alt_link *l)
+{
+	if (l->tmp != NULL) {
+		(void)unlink(l->tmp);
+		free(l->tmp);
+	}
+	free(l->name);
+	free(l->dest);
+	free(l->path);
+	free(l->target);
+	free(l->old);
+}
+
+static void
+alt_batch_free(struct alt_batch *b)
+{
+	for (unsigned int i = 0; i < b->nlinks; i++)
+		alt_link_free(&b->links[i]);
+	free(b->links);
+	if (b->paths != NULL)
+		xbps_object_release(b->paths);
+}
 
-	for (i = 0; i < n; i++) {
-		alternative = xbps_string_cstring(xbps_array_get(a, i));
+/*
+ * Adds a link of a group to the batch. A link to create replaces one
+ * added before with the same path, a link to remove is ignored if the
+ * path is already in the batch or it has been taken over by a package.
+ */
+static int
+alt_batch_add(struct xbps_handle *xhp, struct alt_batch *b,
+		const char *grname, const char *str, bool create)
+{
+	struct alt_link *l, nl;
+	char *p;
+	uint32_t idx;
 
-		if (!(tok1 = strtok(alternative, ":")) ||
-		    !(tok2 = strtok(NULL, ":"))) {
-			free(alternative);
-			return -1;
+	if (!alt_valid(str)) {
+		xbps_dbg_printf(xhp, "invalid alternative '%s' in group '%s'\n",
+		    str ? str : "", grname);
+		return EINVAL;
+	}
+	memset(&nl, 0, sizeof(nl));
+	nl.grname = grname;
+	nl.name = left(str);
+	nl.dest = strdup(right(str));
+	if (nl.name == NULL || nl.dest == NULL) {
+		alt_link_free(&nl);
+		return ENOMEM;
+	}
+	if ((nl.path = alt_link_path(xhp, nl.name, nl.dest)) == NULL) {
+		alt_link_free(&nl);
+		return ENOMEM;
+	}
+	if (create) {
+		if (nl.dest[0] == '/') {
+			if ((p = strdup(nl.dest)) == NULL) {
+				alt_link_free(&nl);
+				return ENOMEM;
+			}
+			nl.target = relpath(nl.path + strlen(xhp->rootdir), p);
+			free(p);
+		} else {
+			nl.target = strdup(nl.dest);
 		}
+		if (nl.target == NULL) {
+			alt_link_free(&nl);
+			return ENOMEM;
+		}
+	}
+	normpath(nl.path);
 
-		target = strdup(tok2);
-		dir = dirname(tok2);
+	if (!create &&
+	    xbps_dictionary_get(xhp->alt_plan->claimed, nl.path) != NULL) {
+		alt_link_free(&nl);
+		return 0;
+	}
+	if (xbps_dictionary_get_uint32(b->paths, nl.path, &idx)) {
+		l = &b->links[idx];
+		if (!create || l->target == NULL) {
+			alt_link_free(&nl);
+			return 0;
+		}
+		/* same link specified twice, the last one wins */
+		alt_link_free(l);
+		*l = nl;
+		return 0;
+	}
+	if (b->nlinks == b->size) {
+		unsigned int size = b->size ? b->size * 2 : 16;
 
-		/* add target dir to relative links */
-		if (tok1[0] != '/')
-			linkpath = xbps_xasprintf("%s/%s/%s", xhp->rootdir, dir, tok1);
-		else
-			linkpath = xbps_xasprintf("%s/%s", xhp->rootdir, tok1);
-
-		/* create target directory, necessary for dangling symlinks */
-		dir = xbps_xasprintf("%s/%s", xhp->rootdir, dir);
-		if (strcmp(dir, ".") && xbps_mkpath(dir, 0755) && errno != EEXIST) {
-			rv = errno;
-			xbps_dbg_printf(xhp,
-			    "failed to create target dir '%s' for group '%s': %s\n",
-			    dir, grname, strerror(errno));
-			free(dir);
-			goto err;
+		if ((l = realloc(b->links, size * sizeof(*l))) == NULL) {
+			alt_link_free(&nl);
+			return ENOMEM;
 		}
-		free(dir);
+		b->links = l;
+		b->size = size;
+	}
+	if (!xbps_dictionary_set_uint32(b->paths, nl.path, b->nlinks)) {
+		alt_link_free(&nl);
+		return ENOMEM;
+	}
+	b->links[b->nlinks++] = nl;
+	return 0;
+}
+
+static char *
+read_symlink(const char *path)
+{
+	struct stat st;
+	ssize_t r;
+	char *lnk;
 
+	if (lstat(path, &st) == -1 || !S_ISLNK(st.st_mode))
+		return NULL;
+	if ((lnk = malloc(st.st_size + 1)) == NULL)
+		return NULL;
+	r = readlink(path, lnk, st.st_size + 1);
+	if (r < 0 || r > st.st_size) {
+		free(lnk);
+		return NULL;
+	}
+	lnk[r] = '\0';
+	return lnk;
+}
+
+static int
+stage_symlink(const char *target, const char *tmp)
+{
+	(void)unlink(tmp);
+	return symlink(target, tmp) == 0 ? 0 : errno;
+}
+
+static int
+alt_link_mkdirs(struct xbps_handle *xhp, struct alt_link *l)
+{
+	char *p, *dir;
+	int rv = 0;
+
+	/* create target directory, necessary for dangling symlinks */
+	if ((p = strdup(l->dest)) == NULL)
+		return ENOMEM;
+	dir = xbps_xasprintf("%s/%s", xhp->rootdir, dirname(p));
+	free(p);
+	if (xbps_mkpath(dir, 0755) == -1 && errno != EEXIST)
+		rv = errno;
+	free(dir);
+	if (rv == 0) {
 		/* create link directory, necessary for dangling symlinks */
-		p = strdup(linkpath);
-		dir = dirname(p);
-		if (strcmp(dir, ".") && xbps_mkpath(dir, 0755) && errno != EEXIST) {
+		if ((p = strdup(l->path)) == NULL)
+			return ENOMEM;
+		if (xbps_mkpath(dirname(p), 0755) == -1 && errno != EEXIST)
 			rv = errno;
+		free(p);
+	}
+	if (rv != 0) {
+		xbps_dbg_printf(xhp,
+		    "failed to create dirs of alt symlink '%s' for group '%s': %s\n",
+		    l->path, l->grname, strerror(rv));
+	}
+	return rv;
+}
+
+/*
+ * Puts back the links changed so far. A regular file replaced by a
+ * new link is not restored.
+ */
+static void
+alt_batch_rollback(struct xbps_handle *xhp, struct alt_batch *b)
+{
+	struct alt_link *l;
+	char *tmp;
+
+	for (unsigned int i = b->nlinks; i-- > 0;) {
+		l = &b->links[i];
+		if (l->tmp != NULL) {
+			(void)unlink(l->tmp);
+			free(l->tmp);
+			l->tmp = NULL;
+		}
+		if (!l->done)
+			continue;
+		l->done = false;
+		if (l->old == NULL) {
+			(void)unlink(l->path);
+			continue;
+		}
+		tmp = xbps_xasprintf("%s.xbps-alt-new", l->path);
+		if (stage_symlink(l->old, tmp) != 0 ||
+		    rename(tmp, l->path) == -1) {
 			xbps_dbg_printf(xhp,
-			    "failed to create symlink dir '%s' for group '%s': %s\n",
-			    dir, grname, strerror(errno));
-			free(p);
-			goto err;
+			    "failed to restore alt symlink '%s' for group '%s': %s\n",
+			    l->path, l->grname, strerror(errno));
+			(void)unlink(tmp);
 		}
-		free(p);
+		free(tmp);
+	}
+}
 
-		xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_LINK_ADDED, 0, NULL,
-		    "Creating '%s' alternatives group symlink: %s -> %s",
-		    grname, tok1, target);
+/*
+ * Stages all new links aside, renames them over the old ones and then
+ * removes the links that are gone. If any step fails, the links changed
+ * so far are put back.
+ */
+static int
+alt_batch_apply(struct xbps_handle *xhp, struct alt_batch *b)
+{
+	struct alt_link *l;
+	unsigned int i;
+	int rv;
 
-		if (target[0] == '/') {
-			p = relpath(linkpath + strlen(xhp->rootdir), target);
-			free(target);
-			target = p;
+	for (i = 0; i < b->nlinks; i++) {
+		l = &b->links[i];
+		l->old = read_symlink(l->path);
+		if (l->target == NULL) {
+			/* only symlinks are removed */
+			l->skip = l->old == NULL;
+			continue;
 		}
-
-		unlink(linkpath);
-		if ((rv = symlink(target, linkpath)) != 0) {
+		if (l->old != NULL && strcmp(l->old, l->target) == 0) {
+			l->skip = true;
+			continue;
+		}
+		if ((rv = alt_link_mkdirs(xhp, l)) != 0)
+			goto fail;
+		l->tmp = xbps_xasprintf("%s.xbps-alt-new", l->path);
+		if ((rv = stage_symlink(l->target, l->tmp)) != 0) {
 			xbps_dbg_printf(xhp,
 			    "failed to create alt symlink '%s' for group '%s': %s\n",
-			    linkpath, grname,  strerror(errno));
-			goto err;
+			    l->path, l->grname, strerror(rv));
+			free(l->tmp);
+			l->tmp = NULL;
+			goto fail;
 		}
-
-		free(alternative);
-		free(target);
-		free(linkpath);
+	}
+	for (i = 0; i < b->nlinks; i++) {
+		l = &b->links[i];
+		if (l->skip || l->target == NULL)
+			continue;
+		if (rename(l->tmp, l->path) == -1) {
+			rv = errno;
+			xbps_dbg_printf(xhp,
+			    "failed to rename alt symlink '%s' for group '%s': %s\n",
+			    l->path, l->grname, strerror(rv));
+			goto fail;
+		}
+		free(l->tmp);
+		l->tmp = NULL;
+		l->done = true;
+	}
+	for (i = 0; i < b->nlinks; i++) {
+		l = &b->links[i];
+		if (l->skip || l->target != NULL)
+			continue;
+		if (unlink(l->path) == -1 && errno != ENOENT) {
+			rv = errno;
+			xbps_dbg_printf(xhp,
+			    "failed to remove alt symlink '%s' for group '%s': %s\n",
+			    l->path, l->grname, strerror(rv));
+			goto fail;
+		}
+		l->done = true;
 	}
 
+	for (i = 0; i < b->nlinks; i++) {
+		l = &b->links[i];
+		if (!l->done)
+			continue;
+		if (l->target == NULL) {
+			xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_LINK_REMOVED,
+			    0, NULL,
+			    "Removing '%s' alternatives group symlink: %s",
+			    l->grname, l->name);
+		} else {
+			xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_LINK_ADDED,
+			    0, NULL,
+			    "Creating '%s' alternatives group symlink: %s -> %s",
+			    l->grname, l->name, l->dest);
+		}
+	}
 	return 0;
 
-err:
-	free(alternative);
-	free(target);
-	free(linkpath);
+fail:
+	alt_batch_rollback(xhp, b);
+	return rv;
+}
+
+int HIDDEN
+xbps_alternatives_commit(struct xbps_handle *xhp)
+{
+	struct xbps_alt_plan *plan = xhp->alt_plan;
+	struct alt_batch b;
+	xbps_object_iterator_t iter = NULL;
+	xbps_object_t keysym;
+	xbps_dictionary_t alternatives, pkgalts;
+	xbps_array_t links;
+	const char *grname, *first;
+	int rv = 0;
+
+	if (plan == NULL)
+		return 0;
+
+	memset(&b, 0, sizeof(b));
+	if ((b.paths = xbps_dictionary_create()) == NULL ||
+	    (iter = xbps_dictionary_iterator(plan->groups)) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	alternatives = xbps_dictionary_get(xhp->pkgdb, "_XBPS_ALTERNATIVES_");
+
+	/* the links of the resulting providers */
+	while ((keysym = xbps_object_iterator_next(iter)) != NULL) {
+		grname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		first = NULL;
+		if (!xbps_array_get_cstring_nocopy(
+		    xbps_dictionary_get(alternatives, grname), 0, &first))
+			continue;
+		if ((pkgalts = xbps_dictionary_get(plan->pkgs, first)) == NULL)
+			pkgalts = xbps_dictionary_get(
+			    xbps_pkgdb_get_pkg(xhp, first), "alternatives");
+		links = xbps_dictionary_get(pkgalts, grname);
+		for (unsigned int i = 0; i < xbps_array_count(links); i++) {
+			rv = alt_batch_add(xhp, &b, grname,
+			    xbps_array_cstring_nocopy_at(links, i), true);
+			if (rv != 0)
+				goto out;
+		}
+	}
+	xbps_object_iterator_reset(iter);
+
+	/* and the links of the previous providers that are gone */
+	while ((keysym = xbps_object_iterator_next(iter)) != NULL) {
+		grname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		links = xbps_dictionary_get_keysym(plan->groups, keysym);
+		for (unsigned int i = 0; i < xbps_array_count(links); i++) {
+			rv = alt_batch_add(xhp, &b, grname,
+			    xbps_array_cstring_nocopy_at(links, i), false);
+			if (rv != 0)
+				goto out;
+		}
+	}
+
+	rv = alt_batch_apply(xhp, &b);
+out:
+	if (iter != NULL)
+		xbps_object_iterator_release(iter);
+	alt_batch_free(&b);
+	xbps_alternatives_discard(xhp);
 	return rv;
 }
 
@@ -239,8 +740,9 @@ xbps_alternatives_set(struct xbps_handle *xhp, const char *pkgname,
 		const char *group)
 {
 	xbps_array_t allkeys;
-	xbps_dictionary_t alternatives, pkg_alternatives, pkgd, prevpkgd, prevpkg_alts;
-	const char *pkgver = NULL, *prevpkgname = NULL;
+	xbps_dictionary_t alternatives, pkg_alternatives, pkgd;
+	const char *pkgver = NULL;
+	bool own;
 	int rv = 0;
 
 	assert(xhp);
@@ -263,11 +765,14 @@ xbps_alternatives_set(struct xbps_handle *xhp, const char *pkgname,
 
 	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
 
+	own = xhp->alt_plan == NULL;
+	if ((rv = xbps_alternatives_begin(xhp)) != 0)
+		return rv;
+
 	allkeys = xbps_dictionary_all_keys(pkg_alternatives);
 	for (unsigned int i = 0; i < xbps_array_count(allkeys); i++) {
 		xbps_array_t array;
 		xbps_object_t keysym;
-		xbps_string_t kstr;
 		const char *keyname;
 
 		keysym = xbps_array_get(allkeys, i);
@@ -280,51 +785,22 @@ xbps_alternatives_set(struct xbps_handle *xhp, const char *pkgname,
 		if (array == NULL)
 			continue;
 
-		/* remove symlinks from previous alternative */
-		xbps_array_get_cstring_nocopy(array, 0, &prevpkgname);
-		if (prevpkgname && strcmp(pkgname, prevpkgname) != 0) {
-			if ((prevpkgd = xbps_pkgdb_get_pkg(xhp, prevpkgname)) &&
-			    (prevpkg_alts = xbps_dictionary_get(prevpkgd, "alternatives")) &&
-			    xbps_dictionary_count(prevpkg_alts)) {
-				rv = remove_symlinks(xhp,
-				    xbps_dictionary_get(prevpkg_alts, keyname),
-				    keyname);
-				if (rv != 0)
-					break;
-			}
-		}
+		if ((rv = alt_plan_touch(xhp, alternatives, keyname)) != 0)
+			break;
 
 		/* put this alternative group at the head */
-		xbps_remove_string_from_array(array, pkgname);
-		kstr = xbps_string_create_cstring(pkgname);
-		xbps_array_add_first(array, kstr);
-		xbps_object_release(kstr);
-
-		/* apply the alternatives group */
+		if (!alt_provider_set_first(array,
+		    alt_provider_index(array, pkgname), pkgname)) {
+			rv = ENOMEM;
+			break;
+		}
 		xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_ADDED, 0, NULL,
 		    "%s: applying '%s' alternatives group", pkgver, keyname);
-		rv = create_symlinks(xhp, xbps_dictionary_get(pkg_alternatives, keyname), keyname);
-		if (rv != 0 || group)
+		if (group)
 			break;
 	}
 	xbps_object_release(allkeys);
-	return rv;
-}
-
-static int
-switch_alt_group(struct xbps_handle *xhp, const char *grpn, const char *pkgn,
-		xbps_dictionary_t *pkg_alternatives)
-{
-	xbps_dictionary_t curpkgd, pkgalts;
-
-	curpkgd = xbps_pkgdb_get_pkg(xhp, pkgn);
-	assert(curpkgd);
-
-	xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_SWITCHED, 0, NULL,
-		"Switched '%s' alternatives group to '%s'", grpn, pkgn);
-	pkgalts = xbps_dictionary_get(curpkgd, "alternatives");
-	if (pkg_alternatives) *pkg_alternatives = pkgalts;
-	return create_symlinks(xhp, xbps_dictionary_get(pkgalts, grpn), grpn);
+	return alt_plan_end(xhp, own, rv);
 }
 
 int
@@ -333,7 +809,7 @@ xbps_alternatives_unregister(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 	xbps_array_t allkeys;
 	xbps_dictionary_t alternatives, pkg_alternatives;
 	const char *pkgver, *pkgname;
-	bool update = false;
+	bool update = false, own;
 	int rv = 0;
 
 	assert(xhp);
@@ -351,12 +827,16 @@ xbps_alternatives_unregister(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 
 	xbps_dictionary_get_bool(pkgd, "alternatives-update", &update);
 
+	own = xhp->alt_plan == NULL;
+	if ((rv = xbps_alternatives_begin(xhp)) != 0)
+		return rv;
+
 	allkeys = xbps_dictionary_all_keys(pkg_alternatives);
 	for (unsigned int i = 0; i < xbps_array_count(allkeys); i++) {
 		xbps_array_t array;
 		xbps_object_t keysym;
-		bool current = false;
 		const char *first = NULL, *keyname;
+		int idx;
 
 		keysym = xbps_array_get(allkeys, i);
 		keyname = xbps_dictionary_keysym_cstring_nocopy(keysym);
@@ -365,39 +845,31 @@ xbps_alternatives_unregister(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 		if (array == NULL)
 			continue;
 
-		xbps_array_get_cstring_nocopy(array, 0, &first);
-		if (strcmp(pkgname, first) == 0) {
-			/* this pkg is the current alternative for this group */
-			current = true;
-			rv = remove_symlinks(xhp,
-				xbps_dictionary_get(pkg_alternatives, keyname),
-				keyname);
-			if (rv != 0)
-				break;
-		}
+		idx = alt_provider_index(array, pkgname);
+		/* this pkg is the current alternative for this group */
+		if (idx == 0 &&
+		    (rv = alt_plan_touch(xhp, alternatives, keyname)) != 0)
+			break;
 
 		if (!update) {
 			xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_REMOVED, 0, NULL,
 			    "%s: unregistered '%s' alternatives group", pkgver, keyname);
-			xbps_remove_string_from_array(array, pkgname);
-			xbps_array_get_cstring_nocopy(array, 0, &first);
+			if (idx >= 0)
+				xbps_array_remove(array, (unsigned int)idx);
 		}
 
 		if (xbps_array_count(array) == 0) {
 			xbps_dictionary_remove(alternatives, keyname);
-			continue;
+		} else if (!update && idx == 0) {
+			/* the next one is the new alternative group package */
+			xbps_array_get_cstring_nocopy(array, 0, &first);
+			xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_SWITCHED, 0, NULL,
+			    "Switched '%s' alternatives group to '%s'", keyname, first);
 		}
-
-		if (update || !current)
-			continue;
-
-		/* get the new alternative group package */
-		if (switch_alt_group(xhp, keyname, first, &pkg_alternatives) != 0)
-			break;
 	}
 	xbps_object_release(allkeys);
 
-	return rv;
+	return alt_plan_end(xhp, own, rv);
 }
 
 /*
@@ -407,39 +879,41 @@ xbps_alternatives_unregister(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
  * that what is happening is an upgrade, because it's only invoked when
  * the repo and installed alternatives sets differ for a specific package.
  */
-static void
-prune_altgroup(struct xbps_handle *xhp, xbps_dictionary_t repod,
-		const char *pkgname, const char *pkgver, const char *keyname)
+static int
+prune_altgroup(struct xbps_handle *xhp, xbps_dictionary_t alternatives,
+		xbps_dictionary_t repod, const char *pkgname, const char *pkgver,
+		const char *keyname)
 {
-	const char *newpkg = NULL, *curpkg = NULL;
+	const char *newpkg = NULL;
 	xbps_array_t array;
-	xbps_dictionary_t alternatives;
 	xbps_string_t kstr;
 	unsigned int grp_count;
-	bool current = false;
+	int idx, rv;
 
 	xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_REMOVED, 0, NULL,
 		"%s: unregistered '%s' alternatives group", pkgver, keyname);
 
-	alternatives = xbps_dictionary_get(xhp->pkgdb, "_XBPS_ALTERNATIVES_");
-	assert(alternatives);
 	array = xbps_dictionary_get(alternatives, keyname);
+	if (array == NULL)
+		return 0;
 
 	/* if using alt group from another package, we won't switch anything */
-	xbps_array_get_cstring_nocopy(array, 0, &curpkg);
-	current = (strcmp(pkgname, curpkg) == 0);
+	idx = alt_provider_index(array, pkgname);
+	if (idx == 0 && (rv = alt_plan_touch(xhp, alternatives, keyname)) != 0)
+		return rv;
 
 	/* actually prune the alt group for the current package */
-	xbps_remove_string_from_array(array, pkgname);
+	if (idx >= 0)
+		xbps_array_remove(array, (unsigned int)idx);
 	grp_count = xbps_array_count(array);
 	if (grp_count == 0) {
 		/* it was the last one, ditch the whole thing */
 		xbps_dictionary_remove(alternatives, keyname);
-		return;
+		return 0;
 	}
-	if (!current) {
+	if (idx != 0) {
 		/* not the last one, and ours wasn't the one being used */
-		return;
+		return 0;
 	}
 
 	if (xbps_array_count(xbps_dictionary_get(repod, "run_depends")) == 0 &&
@@ -449,89 +923,91 @@ prune_altgroup(struct xbps_handle *xhp, xbps_dictionary_t repod,
 		 * use the first available group after ours has been pruned
 		 */
 		xbps_array_get_cstring_nocopy(array, 0, &newpkg);
-		switch_alt_group(xhp, keyname, newpkg, NULL);
-		return;
+	} else {
+		/*
+		 * Use the last group, as this indicates that a transitional
+		 * metapackage is replacing the original and therefore a new
+		 * package has registered a replacement group, which should be
+		 * last in the array (most recent).
+		 */
+		kstr = xbps_array_get(array, grp_count - 1);
+		xbps_object_retain(kstr);
+		xbps_array_remove(array, grp_count - 1);
+		if (!xbps_array_add_first(array, kstr)) {
+			xbps_object_release(kstr);
+			return ENOMEM;
+		}
+		xbps_object_release(kstr);
+		xbps_array_get_cstring_nocopy(array, 0, &newpkg);
 	}
-
-	/*
-	 * Use the last group, as this indicates that a transitional metapackage
-	 * is replacing the original and therefore a new package has registered
-	 * a replacement group, which should be last in the array (most recent).
-	 */
-	xbps_array_get_cstring_nocopy(array, grp_count - 1, &newpkg);
-
-	/* put the new package as head */
-	kstr = xbps_string_create_cstring(newpkg);
-	xbps_remove_string_from_array(array, newpkg);
-	xbps_array_add_first(array, kstr);
-	xbps_array_get_cstring_nocopy(array, 0, &newpkg);
-	xbps_object_release(kstr);
-
-	switch_alt_group(xhp, keyname, newpkg, NULL);
+	xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_SWITCHED, 0, NULL,
+		"Switched '%s' alternatives group to '%s'", keyname, newpkg);
+	return 0;
 }
 
-
-static void
+static int
 remove_obsoletes(struct xbps_handle *xhp, const char *pkgname, const char *pkgver,
-		xbps_dictionary_t pkgdb_alts, xbps_dictionary_t repod)
+		xbps_dictionary_t alternatives, xbps_dictionary_t repod)
 {
 	xbps_array_t allkeys;
 	xbps_dictionary_t pkgd, pkgd_alts, repod_alts;
+	int rv = 0;
 
 	pkgd = xbps_pkgdb_get_pkg(xhp, pkgname);
 	if (xbps_object_type(pkgd) != XBPS_TYPE_DICTIONARY) {
-		return;
+		return 0;
 	}
 
 	pkgd_alts = xbps_dictionary_get(pkgd, "alternatives");
 	repod_alts = xbps_dictionary_get(repod, "alternatives");
 
 	if (xbps_object_type(pkgd_alts) != XBPS_TYPE_DICTIONARY) {
-		return;
+		return 0;
 	}
 
 	allkeys = xbps_dictionary_all_keys(pkgd_alts);
 	for (unsigned int i = 0; i < xbps_array_count(allkeys); i++) {
-		xbps_array_t array, array2, array_repo;
+		xbps_array_t array, array_repo;
 		xbps_object_t keysym;
-		const char *keyname, *first = NULL;
+		const char *keyname;
 
 		keysym = xbps_array_get(allkeys, i);
 		array = xbps_dictionary_get_keysym(pkgd_alts, keysym);
 		keyname = xbps_dictionary_keysym_cstring_nocopy(keysym);
 
 		array_repo = xbps_dictionary_get(repod_alts, keyname);
-		if (!xbps_array_equals(array, array_repo)) {
-			/*
-			 * Check if current provider in pkgdb is this pkg.
-			 */
-			array2 = xbps_dictionary_get(pkgdb_alts, keyname);
-			if (array2) {
-				xbps_array_get_cstring_nocopy(array2, 0, &first);
-				if (strcmp(pkgname, first) == 0) {
-					remove_symlinks(xhp, array_repo, keyname);
-				}
-			}
-		}
+		/*
+		 * The links of the group change if this pkg is its current
+		 * provider, the plan replaces them.
+		 */
+		if (!xbps_array_equals(array, array_repo) &&
+		    alt_provider_index(xbps_dictionary_get(alternatives,
+		    keyname), pkgname) == 0 &&
+		    (rv = alt_plan_touch(xhp, alternatives, keyname)) != 0)
+			break;
 		/*
 		 * There is nothing left in the alternatives group, which means
 		 * the package is being upgraded and is removing it; if we don't
 		 * prune it, the system will keep it set after removal of its
 		 * parent package, but it will be empty and invalid...
 		 */
-		if (xbps_array_count(array_repo) == 0) {
-			prune_altgroup(xhp, repod, pkgname, pkgver, keyname);
-		}
+		if (xbps_array_count(array_repo) == 0 &&
+		    (rv = prune_altgroup(xhp, alternatives, repod, pkgname,
+		    pkgver, keyname)) != 0)
+			break;
 	}
 	xbps_object_release(allkeys);
+	return rv;
 }
 
 int
 xbps_alternatives_register(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 {
+	struct xbps_alt_plan *plan;
 	xbps_array_t allkeys;
 	xbps_dictionary_t alternatives, pkg_alternatives;
 	const char *pkgver, *pkgname;
+	bool own;
 	int rv = 0;
 
 	assert(xhp);
@@ -551,63 +1027,78 @@ xbps_alternatives_register(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
 	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgname", &pkgname);
 
+	own = xhp->alt_plan == NULL;
+	if ((rv = xbps_alternatives_begin(xhp)) != 0)
+		return rv;
+	plan = xhp->alt_plan;
+
+	/*
+	 * The links of this package are taken from the new version, which
+	 * may not be in the pkgdb yet.
+	 */
+	pkg_alternatives = xbps_dictionary_get(pkg_repod, "alternatives");
+	if (xbps_object_type(pkg_alternatives) == XBPS_TYPE_DICTIONARY) {
+		if (!xbps_dictionary_set(plan->pkgs, pkgname, pkg_alternatives))
+			rv = ENOMEM;
+	} else {
+		xbps_dictionary_t empty = xbps_dictionary_create();
+
+		if (empty == NULL ||
+		    !xbps_dictionary_set(plan->pkgs, pkgname, empty))
+			rv = ENOMEM;
+		if (empty != NULL)
+			xbps_object_release(empty);
+	}
+	if (rv != 0)
+		return alt_plan_end(xhp, own, rv);
+
 	/*
 	 * Compare alternatives from pkgdb and repo and then remove obsolete
 	 * symlinks, also remove obsolete (empty) alternatives groups.
 	 */
-	remove_obsoletes(xhp, pkgname, pkgver, alternatives, pkg_repod);
-
-	pkg_alternatives = xbps_dictionary_get(pkg_repod, "alternatives");
-	if (!xbps_dictionary_count(pkg_alternatives))
-		return 0;
+	if ((rv = remove_obsoletes(xhp, pkgname, pkgver, alternatives,
+	    pkg_repod)) != 0 || !xbps_dictionary_count(pkg_alternatives))
+		return alt_plan_end(xhp, own, rv);
 
 	allkeys = xbps_dictionary_all_keys(pkg_alternatives);
 	for (unsigned int i = 0; i < xbps_array_count(allkeys); i++) {
 		xbps_array_t array;
 		xbps_object_t keysym;
-		const char *keyname, *first = NULL;
+		const char *keyname;
+		int idx;
 
 		keysym = xbps_array_get(allkeys, i);
 		keyname = xbps_dictionary_keysym_cstring_nocopy(keysym);
 
 		array = xbps_dictionary_get(alternatives, keyname);
-		if (array == NULL) {
-			array = xbps_array_create();
-		} else {
-			if (xbps_match_string_in_array(array, pkgname)) {
-				xbps_array_get_cstring_nocopy(array, 0, &first);
-				if (strcmp(pkgname, first)) {
-					/* current alternative does not match */
-					continue;
-				}
+		if (array != NULL) {
+			idx = alt_provider_index(array, pkgname);
+			if (idx == 0) {
 				/* already registered, update symlinks */
-				rv = create_symlinks(xhp,
-					xbps_dictionary_get(pkg_alternatives, keyname),
-					keyname);
-				if (rv != 0)
+				if ((rv = alt_plan_touch(xhp, alternatives,
+				    keyname)) != 0)
 					break;
-			} else {
+			} else if (idx < 0) {
 				/* not registered, add provider */
 				xbps_array_add_cstring(array, pkgname);
 				xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_ADDED, 0, NULL,
 				    "%s: registered '%s' alternatives group", pkgver, keyname);
 			}
+			/* otherwise the current alternative does not match */
 			continue;
 		}
 
+		/* apply alternatives for this group */
+		if ((rv = alt_plan_touch(xhp, alternatives, keyname)) != 0)
+			break;
+		array = xbps_array_create();
 		xbps_array_add_cstring(array, pkgname);
 		xbps_dictionary_set(alternatives, keyname, array);
+		xbps_object_release(array);
 		xbps_set_cb_state(xhp, XBPS_STATE_ALTGROUP_ADDED, 0, NULL,
 		    "%s: registered '%s' alternatives group", pkgver, keyname);
-		/* apply alternatives for this group */
-		rv = create_symlinks(xhp,
-			xbps_dictionary_get(pkg_alternatives, keyname),
-			keyname);
-		xbps_object_release(array);
-		if (rv != 0)
-			break;
 	}
 	xbps_object_release(allkeys);
 
-	return rv;
+	return alt_plan_end(xhp, own, rv);
 }
@@ -141,6 +141,7 @@ xbps_entry_install_conf_file(struct xbps_handle *xhp,
 		if (strcmp(entry_pname, buf)) {
 			continue;
 		}
+		xbps_stats_add(xhp, XBPS_STATS_FILES_HASHED, 1);
 		if (!xbps_file_sha256(sha256_cur, sizeof sha256_cur, buf)) {
 			if (errno == ENOENT) {
 				/*
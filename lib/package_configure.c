@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 /**
@@ -45,17 +46,41 @@
   member, the package (or packages) will be reconfigured even if its
  * state is XBPS_PKG_STATE_INSTALLED.
  */
-int
-xbps_configure_packages(struct xbps_handle *xhp, xbps_array_t ignpkgs)
+
+struct cfg_pkg {
+	xbps_dictionary_t pkgd;
+	const char *pkgver;
+	unsigned int *rdeps;
+	unsigned int nrdeps;
+	unsigned int ndeps;
+	bool started;
+};
+
+struct configure_job {
+	struct xbps_handle *xhp;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct cfg_pkg *pkgs;
+	unsigned int *ready;
+	unsigned int npkgs;
+	unsigned int rhead;
+	unsigned int rtail;
+	unsigned int pending;
+	unsigned int running;
+	int error;
+};
+
+static int configure_pkg(struct xbps_handle *, const char *, bool, bool,
+		pthread_mutex_t *);
+
+static int
+configure_packages_serial(struct xbps_handle *xhp, xbps_array_t ignpkgs)
 {
 	xbps_dictionary_t pkgd;
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
 	const char *pkgver;
-	int rv;
-
-	if ((rv = xbps_pkgdb_init(xhp)) != 0)
-		return rv;
+	int rv = 0;
 
 	iter = xbps_dictionary_iterator(xhp->pkgdb);
 	assert(iter);
@@ -83,18 +108,244 @@ xbps_configure_packages(struct xbps_handle *xhp, xbps_array_t ignpkgs)
 	return rv;
 }
 
+/*
+ * Runs in every thread of the pool: packages are taken from the ready
+ * queue, which holds the packages whose run_depends have been configured.
+ * If the queue is empty and nothing is running the remaining packages
+ * depend on each other, the first one is configured to break the cycle.
+ */
+static void
+configure_job(void *arg)
+{
+	struct configure_job *job = arg;
+	struct cfg_pkg *pkg;
+	unsigned int i, j;
+	int rv;
+
+	pthread_mutex_lock(&job->lock);
+	for (;;) {
+		while (job->rhead == job->rtail && job->pending > 0 &&
+		    job->running > 0 && job->error == 0)
+			pthread_cond_wait(&job->cond, &job->lock);
+		if (job->error != 0 || job->pending == 0)
+			break;
+		if (job->rhead == job->rtail) {
+			for (i = 0; job->pkgs[i].started; i++)
+				;
+		} else {
+			i = job->ready[job->rhead++];
+		}
+		pkg = &job->pkgs[i];
+		pkg->started = true;
+		job->pending--;
+		job->running++;
+		pthread_mutex_unlock(&job->lock);
+
+		rv = configure_pkg(job->xhp, pkg->pkgver, true, false,
+		    &job->lock);
+
+		pthread_mutex_lock(&job->lock);
+		job->running--;
+		if (rv != 0 && job->error == 0) {
+			xbps_dbg_printf(job->xhp, "%s: failed to configure "
+			    "%s: %s\n", __func__, pkg->pkgver, strerror(rv));
+			job->error = rv;
+		}
+		for (j = 0; j < pkg->nrdeps; j++) {
+			i = pkg->rdeps[j];
+			if (--job->pkgs[i].ndeps == 0 && !job->pkgs[i].started)
+				job->ready[job->rtail++] = i;
+		}
+		pthread_cond_broadcast(&job->cond);
+	}
+	pthread_mutex_unlock(&job->lock);
+}
+
+/*
+ * Adds an edge from the package providing `dep' to the package `idx'.
+ */
+static int
+add_dependency(struct xbps_handle *xhp, struct configure_job *job,
+		xbps_dictionary_t pkgidx, unsigned int idx, const char *dep)
+{
+	xbps_dictionary_t depd;
+	struct cfg_pkg *pkg;
+	const char *depver = NULL;
+	char depname[XBPS_NAME_SIZE];
+	unsigned int *rdeps, i;
+
+	if ((depd = xbps_pkgdb_get_pkg(xhp, dep)) == NULL &&
+	    (depd = xbps_pkgdb_get_virtualpkg(xhp, dep)) == NULL)
+		return 0;
+	if (!xbps_dictionary_get_cstring_nocopy(depd, "pkgver", &depver) ||
+	    !xbps_pkg_name(depname, sizeof(depname), depver) ||
+	    !xbps_dictionary_get_uint32(pkgidx, depname, &i) || i == idx)
+		return 0;
+
+	pkg = &job->pkgs[i];
+	rdeps = realloc(pkg->rdeps, (pkg->nrdeps + 1) * sizeof(*rdeps));
+	if (rdeps == NULL)
+		return ENOMEM;
+	rdeps[pkg->nrdeps++] = idx;
+	pkg->rdeps = rdeps;
+	job->pkgs[idx].ndeps++;
+	return 0;
+}
+
+static int
+configure_packages_multi(struct xbps_handle *xhp, xbps_array_t ignpkgs)
+{
+	struct configure_job job;
+	xbps_dictionary_t pkgd, pkgidx;
+	xbps_array_t allkeys, rundeps;
+	const char *pkgver, *dep;
+	char pkgname[XBPS_NAME_SIZE];
+	unsigned int i, j, count;
+	mode_t myumask;
+	int rv = 0;
+
+	allkeys = xbps_dictionary_all_keys(xhp->pkgdb);
+	assert(allkeys);
+	count = xbps_array_count(allkeys);
+
+	memset(&job, 0, sizeof(job));
+	job.xhp = xhp;
+	job.pkgs = calloc(count + 1, sizeof(*job.pkgs));
+	job.ready = calloc(count + 1, sizeof(*job.ready));
+	pkgidx = xbps_dictionary_create();
+	if (job.pkgs == NULL || job.ready == NULL || pkgidx == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		pkgd = xbps_dictionary_get_keysym(xhp->pkgdb,
+		    xbps_array_get(allkeys, i));
+		if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+			continue;
+		if (xbps_array_count(ignpkgs)) {
+			if ((xbps_match_string_in_array(ignpkgs, pkgver)) ||
+			    (xbps_match_pkgver_in_array(ignpkgs, pkgver))) {
+				xbps_dbg_printf(xhp, "%s: ignoring pkg %s\n",
+				    __func__, pkgver);
+				continue;
+			}
+		}
+		if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver) ||
+		    !xbps_dictionary_set_uint32(pkgidx, pkgname, job.npkgs)) {
+			rv = EINVAL;
+			goto out;
+		}
+		job.pkgs[job.npkgs].pkgd = pkgd;
+		job.pkgs[job.npkgs].pkgver = pkgver;
+		job.npkgs++;
+	}
+	for (i = 0; i < job.npkgs; i++) {
+		rundeps = xbps_dictionary_get(job.pkgs[i].pkgd, "run_depends");
+		for (j = 0; j < xbps_array_count(rundeps); j++) {
+			if ((dep = xbps_array_cstring_nocopy_at(rundeps, j)) == NULL)
+				continue;
+			if ((rv = add_dependency(xhp, &job, pkgidx, i, dep)) != 0)
+				goto out;
+		}
+	}
+	for (i = 0; i < job.npkgs; i++) {
+		if (job.pkgs[i].ndeps == 0)
+			job.ready[job.rtail++] = i;
+	}
+	job.pending = job.npkgs;
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	myumask = umask(022);
+	if ((rv = xbps_thread_pool_run(xhp, configure_job, &job)) != 0) {
+		/* pool unavailable or busy (nested call), do it here */
+		xbps_dbg_printf(xhp, "[pool] running single threaded: %s\n",
+		    strerror(rv));
+		configure_job(&job);
+	}
+	umask(myumask);
+	xbps_cb_flush(xhp);
+	pthread_cond_destroy(&job.cond);
+	pthread_mutex_destroy(&job.lock);
+	rv = job.error;
+
+out:
+	for (i = 0; i < job.npkgs; i++)
+		free(job.pkgs[i].rdeps);
+	free(job.pkgs);
+	free(job.ready);
+	if (pkgidx != NULL)
+		xbps_object_release(pkgidx);
+	xbps_object_release(allkeys);
+	return rv;
+}
+
+/*
+ * With XBPS_FLAG_PARALLEL_CONFIGURE and more than one job (see
+ * xbps_handle::jobs) the packages are configured concurrently, each
+ * one once the packages in its run_depends have been configured.
+ */
+int
+xbps_configure_packages(struct xbps_handle *xhp, xbps_array_t ignpkgs)
+{
+	int rv;
+
+	if ((rv = xbps_pkgdb_init(xhp)) != 0)
+		return rv;
+
+	if ((xhp->flags & XBPS_FLAG_PARALLEL_CONFIGURE) == 0 ||
+	    xbps_thread_pool_size(xhp) <= 1)
+		return configure_packages_serial(xhp, ignpkgs);
+
+	return configure_packages_multi(xhp, ignpkgs);
+}
+
 int
 xbps_configure_pkg(struct xbps_handle *xhp,
 		   const char *pkgver,
 		   bool check_state,
 		   bool update)
+{
+	mode_t myumask;
+	int rv;
+
+	myumask = umask(022);
+	rv = configure_pkg(xhp, pkgver, check_state, update, NULL);
+	umask(myumask);
+	return rv;
+}
+
+static void
+cb_lock(pthread_mutex_t *lock)
+{
+	if (lock != NULL)
+		pthread_mutex_lock(lock);
+}
+
+static void
+cb_unlock(pthread_mutex_t *lock)
+{
+	if (lock != NULL)
+		pthread_mutex_unlock(lock);
+}
+
+/*
+ * If `lock' is set packages are being configured concurrently, it's
+ * held while the package state is updated and the callbacks invoked.
+ */
+static int
+configure_pkg(struct xbps_handle *xhp,
+	      const char *pkgver,
+	      bool check_state,
+	      bool update,
+	      pthread_mutex_t *lock)
 {
 	xbps_dictionary_t pkgd;
+	struct timespec ts;
 	const char *p;
 	char pkgname[XBPS_NAME_SIZE];
 	int rv = 0;
 	pkg_state_t state = 0;
-	mode_t myumask;
 
 	assert(pkgver != NULL);
 
@@ -129,31 +380,38 @@ xbps_configure_pkg(struct xbps_handle *xhp,
 		}
 	}
 
-	myumask = umask(022);
+	xbps_stats_start(&ts);
 
+	cb_lock(lock);
 	xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE, 0, pkgver, NULL);
+	cb_unlock(lock);
 
 	rv = xbps_pkg_exec_script(xhp, pkgd, "install-script", "post", update);
 	if (rv != 0) {
+		cb_lock(lock);
 		xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_FAIL,
 		    errno, pkgver,
 		    "%s: [configure] INSTALL script failed to execute "
 		    "the post ACTION: %s", pkgver, strerror(rv));
-		umask(myumask);
+		cb_unlock(lock);
+		xbps_stats_end(xhp, XBPS_STATS_CONFIGURE, &ts);
 		return rv;
 	}
+	cb_lock(lock);
 	rv = xbps_set_pkg_state_dictionary(pkgd, XBPS_PKG_STATE_INSTALLED);
 	if (rv != 0) {
 		xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_FAIL, rv,
 		    pkgver, "%s: [configure] failed to set state to installed: %s",
 		    pkgver, strerror(rv));
-		umask(myumask);
+		cb_unlock(lock);
+		xbps_stats_end(xhp, XBPS_STATS_CONFIGURE, &ts);
 		return rv;
 	}
-	if (rv == 0)
-		xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_DONE, 0, pkgver, NULL);
-
-	umask(myumask);
+	xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_DONE, 0, pkgver, NULL);
 	/* show install-msg if exists */
-	return xbps_cb_message(xhp, pkgd, "install-msg");
+	rv = xbps_cb_message(xhp, pkgd, "install-msg");
+	cb_unlock(lock);
+
+	xbps_stats_end(xhp, XBPS_STATS_CONFIGURE, &ts);
+	return rv;
 }
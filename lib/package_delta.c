@@ -0,0 +1,379 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <openssl/sha.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Delta binary packages.
+ *
+ * A delta rebuilds a binary package byte by byte from an older binary
+ * package of the same package, so that the result can be verified
+ * against the sha256 hash and RSA signature of the original:
+ *
+ *	header:	"XBPSDLT1"
+ *		<old size: u64> <old sha256: 32 bytes>
+ *		<new size: u64> <new sha256: 32 bytes>
+ *	ops:	'C' <offset: u64> <length: u64>	copy from the old package
+ *		'D' <length: u64> <data>	literal data
+ *		'E'				end of delta
+ *
+ * Integers are big endian. The copies are found by matching blocks of
+ * the old package with a rolling hash, as rsync does.
+ */
+
+#define DELTA_MAGIC	"XBPSDLT1"
+#define DELTA_HDRSIZE	(8 + 8 + SHA256_DIGEST_LENGTH + 8 + SHA256_DIGEST_LENGTH)
+#define DELTA_BLOCK	64
+#define DELTA_PRIME	16777619U
+#define DELTA_CHAIN	32
+
+static void
+put_u64(unsigned char *p, uint64_t v)
+{
+	for (int i = 7; i >= 0; i--) {
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static uint64_t
+get_u64(const unsigned char *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static uint32_t
+block_hash(const unsigned char *p)
+{
+	uint32_t h = 0;
+
+	for (size_t i = 0; i < DELTA_BLOCK; i++)
+		h = h * DELTA_PRIME + p[i];
+	return h;
+}
+
+static void
+emit_copy(FILE *fp, size_t off, size_t len)
+{
+	unsigned char op[17];
+
+	op[0] = 'C';
+	put_u64(op + 1, off);
+	put_u64(op + 9, len);
+	(void)fwrite(op, 1, sizeof(op), fp);
+}
+
+static void
+emit_data(FILE *fp, const unsigned char *buf, size_t len)
+{
+	unsigned char op[9];
+
+	if (len == 0)
+		return;
+	op[0] = 'D';
+	put_u64(op + 1, len);
+	(void)fwrite(op, 1, sizeof(op), fp);
+	(void)fwrite(buf, 1, len, fp);
+}
+
+static int
+delta_encode(FILE *fp, const unsigned char *obuf, size_t olen,
+		const unsigned char *nbuf, size_t nlen)
+{
+	size_t *head, *next, nblocks, mask, i, lit, k, off, len, boff = 0, blen;
+	uint32_t h = 0, pw = 1;
+	unsigned int n;
+
+	nblocks = olen / DELTA_BLOCK;
+	for (mask = 1; mask < nblocks; mask <<= 1)
+		;
+	head = calloc(mask, sizeof(*head));
+	next = calloc(nblocks + 1, sizeof(*next));
+	if (head == NULL || next == NULL) {
+		free(head);
+		free(next);
+		return ENOMEM;
+	}
+	mask--;
+	/* blocks are numbered from 1, 0 ends a chain */
+	for (k = 0; k < nblocks; k++) {
+		h = block_hash(obuf + k * DELTA_BLOCK) & mask;
+		next[k + 1] = head[h];
+		head[h] = k + 1;
+	}
+	for (k = 1; k < DELTA_BLOCK; k++)
+		pw *= DELTA_PRIME;
+
+	i = lit = 0;
+	if (nlen >= DELTA_BLOCK)
+		h = block_hash(nbuf);
+	while (nblocks && i + DELTA_BLOCK <= nlen) {
+		blen = 0;
+		for (k = head[h & mask], n = 0; k && n < DELTA_CHAIN;
+		    k = next[k], n++) {
+			off = (k - 1) * DELTA_BLOCK;
+			if (memcmp(obuf + off, nbuf + i, DELTA_BLOCK) != 0)
+				continue;
+			len = DELTA_BLOCK;
+			while (off + len < olen && i + len < nlen &&
+			    obuf[off + len] == nbuf[i + len])
+				len++;
+			if (len > blen) {
+				blen = len;
+				boff = off;
+			}
+		}
+		if (blen) {
+			/* extend the match backwards into pending data */
+			while (i > lit && boff > 0 && obuf[boff - 1] == nbuf[i - 1]) {
+				i--;
+				boff--;
+				blen++;
+			}
+			emit_data(fp, nbuf + lit, i - lit);
+			emit_copy(fp, boff, blen);
+			i += blen;
+			lit = i;
+			if (i + DELTA_BLOCK <= nlen)
+				h = block_hash(nbuf + i);
+			continue;
+		}
+		if (i + DELTA_BLOCK < nlen)
+			h = (h - nbuf[i] * pw) * DELTA_PRIME + nbuf[i + DELTA_BLOCK];
+		i++;
+	}
+	emit_data(fp, nbuf + lit, nlen - lit);
+	(void)fputc('E', fp);
+
+	free(head);
+	free(next);
+	return 0;
+}
+
+int
+xbps_delta_create(const char *oldpkg, const char *newpkg, const char *delta)
+{
+	unsigned char hdr[DELTA_HDRSIZE];
+	void *omf = NULL, *nmf = NULL;
+	size_t omflen, nmflen, olen, nlen;
+	char *tmpfile;
+	FILE *fp;
+	int fd, rv = 0;
+
+	if (!xbps_mmap_file(oldpkg, &omf, &omflen, &olen))
+		return errno;
+	if (!xbps_mmap_file(newpkg, &nmf, &nmflen, &nlen)) {
+		rv = errno;
+		(void)munmap(omf, omflen);
+		return rv;
+	}
+	tmpfile = xbps_xasprintf("%s.XXXXXX", delta);
+	if ((fd = mkstemp(tmpfile)) == -1) {
+		rv = errno;
+		goto out;
+	}
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		rv = errno;
+		close(fd);
+		(void)unlink(tmpfile);
+		goto out;
+	}
+	memcpy(hdr, DELTA_MAGIC, 8);
+	put_u64(hdr + 8, olen);
+	SHA256(omf, olen, hdr + 16);
+	put_u64(hdr + 16 + SHA256_DIGEST_LENGTH, nlen);
+	SHA256(nmf, nlen, hdr + 24 + SHA256_DIGEST_LENGTH);
+	(void)fwrite(hdr, 1, sizeof(hdr), fp);
+
+	rv = delta_encode(fp, omf, olen, nmf, nlen);
+	if (rv == 0 && (fflush(fp) == EOF || ferror(fp)))
+		rv = errno ? errno : EIO;
+	if (rv == 0 && fchmod(fileno(fp), 0644) == -1)
+		rv = errno;
+	if (fclose(fp) == EOF && rv == 0)
+		rv = errno;
+	if (rv == 0 && rename(tmpfile, delta) == -1)
+		rv = errno;
+	if (rv != 0)
+		(void)unlink(tmpfile);
+out:
+	free(tmpfile);
+	(void)munmap(omf, omflen);
+	(void)munmap(nmf, nmflen);
+	return rv;
+}
+
+static int
+write_data(int fd, SHA256_CTX *ctx, const unsigned char *buf, size_t len)
+{
+	ssize_t wr;
+
+	SHA256_Update(ctx, buf, len);
+	while (len > 0) {
+		if ((wr = write(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buf += wr;
+		len -= wr;
+	}
+	return 0;
+}
+
+static bool
+digest_match(const unsigned char *digest, const char *sha256)
+{
+	char hex[SHA256_DIGEST_LENGTH * 2 + 1];
+
+	for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+		snprintf(hex + i * 2, 3, "%02x", digest[i]);
+	return strcmp(hex, sha256) == 0;
+}
+
+int
+xbps_delta_apply(const char *oldpkg, const char *delta, const char *newpkg,
+		const char *sha256)
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	SHA256_CTX ctx;
+	const unsigned char *d, *p, *end;
+	void *omf = NULL, *dmf = NULL;
+	size_t omflen, dmflen, olen, dlen;
+	uint64_t nlen, total = 0, off, len;
+	char *tmpfile = NULL;
+	int fd = -1, rv = 0;
+
+	if (!xbps_mmap_file(oldpkg, &omf, &omflen, &olen))
+		return errno;
+	if (!xbps_mmap_file(delta, &dmf, &dmflen, &dlen)) {
+		rv = errno;
+		(void)munmap(omf, omflen);
+		return rv;
+	}
+	d = dmf;
+	end = d + dlen;
+	if (dlen < DELTA_HDRSIZE || memcmp(d, DELTA_MAGIC, 8) != 0) {
+		rv = EINVAL;
+		goto out;
+	}
+	/* the delta must have been made from this very binary package */
+	SHA256(omf, olen, digest);
+	if (get_u64(d + 8) != olen ||
+	    memcmp(d + 16, digest, SHA256_DIGEST_LENGTH) != 0) {
+		rv = ERANGE;
+		goto out;
+	}
+	nlen = get_u64(d + 16 + SHA256_DIGEST_LENGTH);
+	p = d + DELTA_HDRSIZE;
+
+	tmpfile = xbps_xasprintf("%s.XXXXXX", newpkg);
+	if ((fd = mkstemp(tmpfile)) == -1) {
+		rv = errno;
+		goto out;
+	}
+	SHA256_Init(&ctx);
+	for (;;) {
+		if (p == end) {
+			rv = EINVAL;
+			break;
+		}
+		if (*p == 'E')
+			break;
+		if (*p == 'C' && end - p >= 17) {
+			off = get_u64(p + 1);
+			len = get_u64(p + 9);
+			p += 17;
+			if (off > olen || len > olen - off) {
+				rv = EINVAL;
+				break;
+			}
+			rv = write_data(fd, &ctx, (const unsigned char *)omf + off, len);
+		} else if (*p == 'D' && end - p >= 9) {
+			len = get_u64(p + 1);
+			p += 9;
+			if (len > (uint64_t)(end - p)) {
+				rv = EINVAL;
+				break;
+			}
+			rv = write_data(fd, &ctx, p, len);
+			p += len;
+		} else {
+			rv = EINVAL;
+		}
+		if (rv != 0)
+			break;
+		if ((total += len) > nlen) {
+			rv = EINVAL;
+			break;
+		}
+	}
+	if (rv != 0)
+		goto out;
+
+	SHA256_Final(digest, &ctx);
+	if (total != nlen) {
+		rv = EINVAL;
+		goto out;
+	}
+	if (memcmp(d + 24 + SHA256_DIGEST_LENGTH, digest,
+	    SHA256_DIGEST_LENGTH) != 0 ||
+	    (sha256 != NULL && !digest_match(digest, sha256))) {
+		rv = ERANGE;
+		goto out;
+	}
+	if (fchmod(fd, 0644) == -1)
+		rv = errno;
+	if (close(fd) == -1 && rv == 0)
+		rv = errno;
+	fd = -1;
+	if (rv == 0 && rename(tmpfile, newpkg) == -1)
+		rv = errno;
+out:
+	if (fd != -1)
+		close(fd);
+	if (rv != 0 && tmpfile != NULL)
+		(void)unlink(tmpfile);
+	free(tmpfile);
+	(void)munmap(omf, omflen);
+	(void)munmap(dmf, dmflen);
+	return rv;
+}
@@ -47,29 +47,33 @@ struct item {
 	UT_hash_handle hh;
 };
 
-static struct item *items = NULL;
-static xbps_array_t result;
+/* per call state, the handle can be used from several threads */
+struct fulldeptree {
+	struct item *items;
+	xbps_array_t result;
+};
 
 static struct item *
-lookupItem(const char *pkgn)
+lookupItem(struct fulldeptree *ft, const char *pkgn)
 {
 	struct item *item = NULL;
 
 	assert(pkgn);
 
-	HASH_FIND_STR(items, pkgn, item);
+	HASH_FIND_STR(ft->items, pkgn, item);
 	return item;
 }
 
 static struct item *
-addItem(xbps_array_t rdeps, const char *pkgn, const char *pkgver)
+addItem(struct fulldeptree *ft, xbps_array_t rdeps, const char *pkgn,
+		const char *pkgver)
 {
 	struct item *item = NULL;
 
 	assert(pkgn);
 	assert(pkgver);
 
-	HASH_FIND_STR(items, pkgn, item);
+	HASH_FIND_STR(ft->items, pkgn, item);
 	if (item)
 		return item;
 
@@ -79,7 +83,7 @@ addItem(xbps_array_t rdeps, const char *pkgn, const char *pkgver)
 	item->pkgver = pkgver;
 	item->rdeps = rdeps;
 	item->dbase = NULL;
-	HASH_ADD_KEYPTR(hh, items, item->pkgn, strlen(pkgn), item);
+	HASH_ADD_KEYPTR(hh, ft->items, item->pkgn, strlen(pkgn), item);
 
 	return item;
 }
@@ -99,35 +103,38 @@ addDepn(struct item *item, struct item *xitem)
 }
 
 static void
-add_deps_recursive(struct item *item, bool first)
+add_deps_recursive(struct fulldeptree *ft, struct item *item, bool first)
 {
 	struct depn *dep;
 	xbps_string_t str;
 
-	if (xbps_match_string_in_array(result, item->pkgver))
+	if (xbps_match_string_in_array(ft->result, item->pkgver))
 		return;
 
 	for (dep = item->dbase; dep; dep = dep->dnext)
-		add_deps_recursive(dep->item, false);
+		add_deps_recursive(ft, dep->item, false);
 
 	if (first)
 		return;
 
 	str = xbps_string_create_cstring(item->pkgver);
 	assert(str);
-	xbps_array_add_first(result, str);
+	xbps_array_add_first(ft->result, str);
 	xbps_object_release(str);
 }
 
 static void
-cleanup(void)
+cleanup(struct fulldeptree *ft)
 {
 	struct item *item, *itmp;
+	struct depn *dep;
 
-	HASH_ITER(hh, items, item, itmp) {
-		HASH_DEL(items, item);
-		if (item->dbase)
-			free(item->dbase);
+	HASH_ITER(hh, ft->items, item, itmp) {
+		HASH_DEL(ft->items, item);
+		while ((dep = item->dbase) != NULL) {
+			item->dbase = dep->dnext;
+			free(dep);
+		}
 		free(item->pkgn);
 		free(item);
 	}
@@ -137,8 +144,8 @@ cleanup(void)
  * Recursively calculate all dependencies.
  */
 static struct item *
-ordered_depends(struct xbps_handle *xhp, xbps_dictionary_t pkgd, bool rpool,
-		size_t depth)
+ordered_depends(struct xbps_handle *xhp, struct fulldeptree *ft,
+		xbps_dictionary_t pkgd, bool rpool, size_t depth)
 {
 	xbps_array_t rdeps, provides;
 	xbps_string_t str;
@@ -152,9 +159,9 @@ ordered_depends(struct xbps_handle *xhp, xbps_dictionary_t pkgd, bool rpool,
 	provides = xbps_dictionary_get(pkgd, "provides");
 	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgname", &pkgname);
 
-	item = lookupItem(pkgname);
+	item = lookupItem(ft, pkgname);
 	if (item) {
-		add_deps_recursive(item, depth == 0);
+		add_deps_recursive(ft, item, depth == 0);
 		return item;
 	}
 
@@ -162,7 +169,7 @@ ordered_depends(struct xbps_handle *xhp, xbps_dictionary_t pkgd, bool rpool,
 		abort();
 	}
 
-	item = addItem(rdeps, pkgname, pkgver);
+	item = addItem(ft, rdeps, pkgname, pkgver);
 	assert(item);
 
 	for (unsigned int i = 0; i < xbps_array_count(rdeps); i++) {
@@ -197,12 +204,12 @@ ordered_depends(struct xbps_handle *xhp, xbps_dictionary_t pkgd, bool rpool,
 			    "already in provides\n", pkgver, curdep);
 			continue;
 		}
-		xitem = lookupItem(curdepname);
+		xitem = lookupItem(ft, curdepname);
 		if (xitem) {
-			add_deps_recursive(xitem, false);
+			add_deps_recursive(ft, xitem, false);
 			continue;
 		}
-		xitem = ordered_depends(xhp, curpkgd, rpool, depth+1);
+		xitem = ordered_depends(xhp, ft, curpkgd, rpool, depth+1);
 		if (xitem == NULL) {
 			/* package depends on missing dependencies */
 			xbps_dbg_printf(xhp, "%s: missing dependency '%s'\n", pkgver, curdep);
@@ -213,10 +220,10 @@ ordered_depends(struct xbps_handle *xhp, xbps_dictionary_t pkgd, bool rpool,
 		addDepn(item, xitem);
 	}
 	/* all deps were processed, add item to head */
-	if (depth > 0 && !xbps_match_string_in_array(result, item->pkgver)) {
+	if (depth > 0 && !xbps_match_string_in_array(ft->result, item->pkgver)) {
 		str = xbps_string_create_cstring(item->pkgver);
 		assert(str);
-		xbps_array_add_first(result, str);
+		xbps_array_add_first(ft->result, str);
 		xbps_object_release(str);
 	}
 	return item;
@@ -225,11 +232,9 @@ ordered_depends(struct xbps_handle *xhp, xbps_dictionary_t pkgd, bool rpool,
 xbps_array_t HIDDEN
 xbps_get_pkg_fulldeptree(struct xbps_handle *xhp, const char *pkg, bool rpool)
 {
+	struct fulldeptree ft = { NULL, NULL };
 	xbps_dictionary_t pkgd;
 
-	result = xbps_array_create();
-	assert(result);
-
 	if (rpool) {
 		if (((pkgd = xbps_rpool_get_pkg(xhp, pkg)) == NULL) &&
 		    ((pkgd = xbps_rpool_get_virtualpkg(xhp, pkg)) == NULL))
@@ -239,9 +244,16 @@ xbps_get_pkg_fulldeptree(struct xbps_handle *xhp, const char *pkg, bool rpool)
 		    ((pkgd = xbps_pkgdb_get_virtualpkg(xhp, pkg)) == NULL))
 			return NULL;
 	}
-	if (ordered_depends(xhp, pkgd, rpool, 0) == NULL)
+
+	ft.result = xbps_array_create();
+	assert(ft.result);
+
+	if (ordered_depends(xhp, &ft, pkgd, rpool, 0) == NULL) {
+		cleanup(&ft);
+		xbps_object_release(ft.result);
 		return NULL;
+	}
 
-	cleanup();
-	return result;
+	cleanup(&ft);
+	return ft.result;
 }
@@ -95,13 +95,17 @@ xbps_register_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgrd)
 		}
 	}
 	/*
-	 * Create a hash for the pkg's metafile if it exists.
+	 * Create a hash for the pkg's metafile if it exists, unless it
+	 * was hashed while unpacking the package.
 	 */
-	buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
-	if (xbps_file_sha256(sha256, sizeof sha256, buf)) {
-		xbps_dictionary_set_cstring(pkgd, "metafile-sha256", sha256);
+	if (!xbps_dictionary_get(pkgd, "metafile-sha256")) {
+		buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
+		xbps_stats_add(xhp, XBPS_STATS_FILES_HASHED, 1);
+		if (xbps_file_sha256(sha256, sizeof sha256, buf)) {
+			xbps_dictionary_set_cstring(pkgd, "metafile-sha256", sha256);
+		}
+		free(buf);
 	}
-	free(buf);
 	/*
 	 * Remove self replacement when applicable.
 	 */
@@ -119,6 +123,7 @@ xbps_register_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgrd)
 	xbps_dictionary_remove(pkgd, "remove-and-update");
 	xbps_dictionary_remove(pkgd, "transaction");
 	xbps_dictionary_remove(pkgd, "skip-obsoletes");
+	xbps_dictionary_remove(pkgd, "scripts-deferred");
 	xbps_dictionary_remove(pkgd, "pkgname");
 	xbps_dictionary_remove(pkgd, "version");
 
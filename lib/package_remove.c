@@ -36,73 +36,197 @@
 
 #include "xbps_api_impl.h"
 
+/*
+ * Obsolete files are removed grouped by their parent directory, relative
+ * to a directory fd opened once per group, rather than paying a full path
+ * lookup for each file.  The groups are sorted by the length of the parent
+ * directory, longest first, so that directory contents are always removed
+ * before the directory itself.
+ */
+struct rment {
+	const char *file;
+	const char *name;
+	size_t dirlen;
+};
+
+static int
+rment_cmp(const void *l1, const void *l2)
+{
+	const struct rment *a = l1, *b = l2;
+
+	if (a->dirlen != b->dirlen)
+		return (a->dirlen < b->dirlen) - (b->dirlen < a->dirlen);
+	return memcmp(a->file, b->file, a->dirlen);
+}
+
+static struct rment *
+rment_sort(xbps_array_t obsoletes, unsigned int *cnt)
+{
+	struct rment *ents;
+	const char *file, *p;
+	unsigned int i, n = 0;
+
+	*cnt = xbps_array_count(obsoletes);
+	if ((ents = calloc(*cnt, sizeof(*ents))) == NULL)
+		return NULL;
+
+	for (i = 0; i < *cnt; i++) {
+		if ((file = xbps_array_cstring_nocopy_at(obsoletes, i)) == NULL)
+			continue;
+		ents[n].file = file;
+		if ((p = strrchr(file, '/')) != NULL && p[1] != '\0') {
+			ents[n].dirlen = p - file;
+			ents[n].name = p + 1;
+		} else {
+			ents[n].dirlen = 0;
+			ents[n].name = file;
+		}
+		n++;
+	}
+	*cnt = n;
+	qsort(ents, n, sizeof(*ents), rment_cmp);
+	return ents;
+}
+
+/*
+ * Opens the parent directory of the group starting at ents[i] and returns
+ * the index of the first entry of the next group.  If the directory cannot
+ * be opened entries are handled by path, with AT_FDCWD.
+ */
+static unsigned int
+rment_group(struct rment *ents, unsigned int cnt, unsigned int i, int *dfd)
+{
+	char dir[PATH_MAX];
+	unsigned int j;
+	bool bypath = false;
+
+	*dfd = AT_FDCWD;
+	if (ents[i].dirlen > 0 && ents[i].dirlen < sizeof(dir)) {
+		memcpy(dir, ents[i].file, ents[i].dirlen);
+		dir[ents[i].dirlen] = '\0';
+		*dfd = open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+		bypath = *dfd == -1;
+		if (bypath)
+			*dfd = AT_FDCWD;
+	} else if (ents[i].dirlen > 0) {
+		bypath = true;
+	}
+
+	for (j = i; j < cnt && rment_cmp(&ents[i], &ents[j]) == 0; j++) {
+		if (bypath)
+			ents[j].name = ents[j].file;
+	}
+	return j;
+}
+
 static bool
 check_remove_pkg_files(struct xbps_handle *xhp,
 	xbps_array_t obsoletes, const char *pkgver, uid_t euid)
 {
 	struct stat st;
+	struct rment *ents;
+	unsigned int i, j, next, cnt;
+	int dfd;
 	bool fail = false;
 
 	if (euid == 0)
 		return false;
 
-	for (unsigned int i = 0; i < xbps_array_count(obsoletes); i++) {
-		const char *file = NULL;
-		xbps_array_get_cstring_nocopy(obsoletes, i, &file);
-		/*
-		 * Check if effective user ID owns the file; this is
-		 * enough to ensure the user has write permissions
-		 * on the directory.
-		 */
-		if (lstat(file, &st) == 0 && euid == st.st_uid) {
-			/* success */
-			continue;
-		}
-		if (errno != ENOENT) {
+	if ((ents = rment_sort(obsoletes, &cnt)) == NULL)
+		return true;
+
+	for (i = 0; i < cnt; i = next) {
+		next = rment_group(ents, cnt, i, &dfd);
+		for (j = i; j < next; j++) {
+			const char *file = ents[j].file;
 			/*
-			 * only bail out if something else than ENOENT
-			 * is returned.
+			 * Check if effective user ID owns the file; this is
+			 * enough to ensure the user has write permissions
+			 * on the directory.
 			 */
-			int rv = errno;
-			if (rv == 0) {
-				/* lstat succeeds but euid != uid */
-				rv = EPERM;
+			errno = 0;
+			if (fstatat(dfd, ents[j].name, &st,
+			    AT_SYMLINK_NOFOLLOW) == 0 && euid == st.st_uid) {
+				/* success */
+				continue;
+			}
+			if (errno != ENOENT) {
+				/*
+				 * only bail out if something else than ENOENT
+				 * is returned.
+				 */
+				int rv = errno;
+				if (rv == 0) {
+					/* lstat succeeds but euid != uid */
+					rv = EPERM;
+				}
+				fail = true;
+				xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FILE_FAIL,
+					rv, pkgver,
+					"%s: cannot remove `%s': %s",
+					pkgver, file, strerror(rv));
 			}
-			fail = true;
-			xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FILE_FAIL,
-				rv, pkgver,
-				"%s: cannot remove `%s': %s",
-				pkgver, file, strerror(rv));
 		}
+		if (dfd != AT_FDCWD)
+			close(dfd);
 		errno = 0;
 	}
+	free(ents);
 	return fail;
 }
 
-static int
-remove_pkg_files(struct xbps_handle *xhp,
+/*
+ * Removes the files in `obsoletes', reporting them as obsolete entries
+ * of an updated package if `obsolete' is set.
+ */
+int HIDDEN
+xbps_remove_pkg_files(struct xbps_handle *xhp,
 		 xbps_array_t obsoletes,
-		 const char *pkgver)
+		 const char *pkgver,
+		 bool obsolete)
 {
-	int rv = 0;
+	struct rment *ents;
+	unsigned int i, j, next, cnt;
+	int dfd, r, rv = 0;
 
-	for (unsigned int i = 0; i < xbps_array_count(obsoletes); i++) {
-		const char *file = NULL;
-		xbps_array_get_cstring_nocopy(obsoletes, i, &file);
-		/*
-		 * Remove the object if possible.
-		 */
-		if (remove(file) == -1) {
-			xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FILE_FAIL,
-			    errno, pkgver,
-			    "%s: failed to remove `%s': %s", pkgver,
-			    file, strerror(errno));
-		} else {
-			/* success */
-			xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FILE,
-			    0, pkgver, "Removed `%s'", file);
+	if ((ents = rment_sort(obsoletes, &cnt)) == NULL)
+		return ENOMEM;
+
+	for (i = 0; i < cnt; i = next) {
+		next = rment_group(ents, cnt, i, &dfd);
+		for (j = i; j < next; j++) {
+			const char *file = ents[j].file;
+			/*
+			 * Remove the object if possible, like remove(3).
+			 */
+			r = unlinkat(dfd, ents[j].name, 0);
+			if (r == -1 && (errno == EISDIR || errno == EPERM))
+				r = unlinkat(dfd, ents[j].name, AT_REMOVEDIR);
+			if (r == -1 && obsolete) {
+				xbps_set_cb_state(xhp,
+				    XBPS_STATE_REMOVE_FILE_OBSOLETE_FAIL,
+				    errno, pkgver,
+				    "%s: failed to remove obsolete entry `%s': %s",
+				    pkgver, file, strerror(errno));
+			} else if (r == -1) {
+				xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FILE_FAIL,
+				    errno, pkgver,
+				    "%s: failed to remove `%s': %s", pkgver,
+				    file, strerror(errno));
+			} else if (obsolete) {
+				xbps_set_cb_state(xhp,
+				    XBPS_STATE_REMOVE_FILE_OBSOLETE, 0, pkgver,
+				    "%s: removed obsolete entry: %s", pkgver, file);
+			} else {
+				/* success */
+				xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FILE,
+				    0, pkgver, "Removed `%s'", file);
+			}
 		}
+		if (dfd != AT_FDCWD)
+			close(dfd);
 	}
+	free(ents);
 
 	return rv;
 }
@@ -189,7 +313,7 @@ xbps_remove_pkg(struct xbps_handle *xhp, const char *pkgver, bool update)
 			goto out;
 		}
 		/* Remove links */
-		if ((rv = remove_pkg_files(xhp, obsoletes, pkgver)) != 0)
+		if ((rv = xbps_remove_pkg_files(xhp, obsoletes, pkgver, false)) != 0)
 			goto out;
 	}
 
@@ -61,6 +61,8 @@ xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 		    "install/remove action.\n", pkgver, action);
 		return 0;
 	}
+	/* the script output must come after the queued messages */
+	xbps_cb_flush(xhp);
 
 	if (strcmp(xhp->rootdir, "/") == 0) {
 		tmpdir = getenv("TMPDIR");
@@ -95,14 +97,18 @@ xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 		goto out;
 	}
 	fchmod(fd, 0750);
+	if (xhp->durability != XBPS_DURABILITY_NONE) {
 #ifdef HAVE_FDATASYNC
-	fdatasync(fd);
+		fdatasync(fd);
 #else
-	fsync(fd);
+		fsync(fd);
 #endif
+	}
 	close(fd);
 
 	/* exec script */
+	xbps_stats_add(xhp, XBPS_STATS_SCRIPTS_RUN, 1);
+	XBPS_PROBE2(script, pkgver, action);
 	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
 		abort();
 	}
@@ -130,6 +136,7 @@ xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 	} else {
 		rv = -1;
 	}
+	XBPS_PROBE3(script_done, pkgver, action, rv);
 
 out:
 	remove(fpath);
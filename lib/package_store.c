@@ -0,0 +1,575 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "xbps_api_impl.h"
+
+/*
+ * Package store.
+ *
+ * If xbps_handle::storedir is set, the entries of each package are kept
+ * in `<storedir>/<pkgver>.<sha256>', keyed by the checksum of the binary
+ * package: the data of regular files below `files' and the metadata of
+ * every entry, in archive order, in `entries.plist'.
+ *
+ * A package missing in the store is unpacked from the archive as usual,
+ * but the data of its regular files is first written into a temporary
+ * directory in the store and cloned (FICLONE) or copied from there into
+ * the rootdir. All entries are added, even those that are not extracted
+ * (noextract, preserved or unchanged files), and the temporary directory
+ * is renamed into place once the package has been unpacked successfully.
+ *
+ * A package found in the store is unpacked from it: the archive is not
+ * read past files.plist, and regular files are cloned or copied from the
+ * store after all of them have been checked against the checksums in
+ * files.plist. A store entry failing the check is replaced.
+ *
+ * Files are never hardlinked to the store, so modifying an installed
+ * file cannot modify the store.
+ */
+
+static int
+rm_entry(const char *path, const struct stat *sb UNUSED, int type UNUSED,
+		struct FTW *ftw UNUSED)
+{
+	(void)remove(path);
+	return 0;
+}
+
+static void
+store_abort(struct xbps_pkgstore *store)
+{
+	if (store->tmpdir == NULL)
+		return;
+	(void)nftw(store->tmpdir, rm_entry, 16, FTW_DEPTH|FTW_PHYS);
+	free(store->tmpdir);
+	store->tmpdir = NULL;
+	if (store->entries != NULL)
+		xbps_object_release(store->entries);
+	store->entries = NULL;
+	store->data = false;
+}
+
+/*
+ * Returns the path of the data of `file' (an archive pathname) below
+ * the store directory `dir'.
+ */
+static char *
+store_path(const char *dir, const char *file)
+{
+	if (strncmp(file, "./", 2) == 0)
+		file += 2;
+	else if (file[0] == '/')
+		file++;
+	return xbps_xasprintf("%s/files/%s", dir, file);
+}
+
+static bool
+entry_has_data(xbps_dictionary_t d)
+{
+	uint32_t mode = 0;
+
+	xbps_dictionary_get_uint32(d, "mode", &mode);
+	return S_ISREG(mode) && xbps_dictionary_get(d, "hardlink") == NULL;
+}
+
+static int
+clone_file(int sfd, int dfd)
+{
+	char buf[65536];
+	ssize_t rd, wr, off;
+
+#ifdef FICLONE
+	if (ioctl(dfd, FICLONE, sfd) == 0)
+		return 0;
+#endif
+	while ((rd = read(sfd, buf, sizeof(buf))) != 0) {
+		if (rd == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		for (off = 0; off < rd; off += wr) {
+			wr = write(dfd, buf + off, rd - off);
+			if (wr == -1) {
+				if (errno == EINTR) {
+					wr = 0;
+					continue;
+				}
+				return errno;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Returns an fd of the parent directory of `path' (relative to the
+ * rootdir) and its last component in `name'. Symlinks in the path
+ * are not followed, as with ARCHIVE_EXTRACT_SECURE_SYMLINKS; missing
+ * directories are created.
+ */
+static int
+parent_dir(struct xbps_pkgstore *store, const char *path, const char **name)
+{
+	char *dir, *comp, *sp = NULL;
+	int fd, nfd;
+
+	if (strncmp(path, "./", 2) == 0)
+		path += 2;
+	if ((*name = strrchr(path, '/')) == NULL) {
+		*name = path;
+		return AT_FDCWD;
+	}
+	dir = strndup(path, *name - path);
+	(*name)++;
+	if (dir == NULL)
+		return -1;
+
+	if (store->parent != NULL && strcmp(store->parent, dir) == 0) {
+		free(dir);
+		return store->parentfd;
+	}
+	free(store->parent);
+	store->parent = NULL;
+	if (store->parentfd != -1) {
+		close(store->parentfd);
+		store->parentfd = -1;
+	}
+
+	store->parent = strdup(dir);
+	fd = AT_FDCWD;
+	for (comp = strtok_r(dir, "/", &sp); comp != NULL;
+	    comp = strtok_r(NULL, "/", &sp)) {
+		nfd = openat(fd, comp, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		if (nfd == -1 && errno == ENOENT &&
+		    (mkdirat(fd, comp, 0755) == 0 || errno == EEXIST))
+			nfd = openat(fd, comp,
+			    O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		if (fd != AT_FDCWD)
+			close(fd);
+		if ((fd = nfd) == -1)
+			break;
+	}
+	free(dir);
+	if (fd == -1 || store->parent == NULL) {
+		if (fd != -1)
+			close(fd);
+		free(store->parent);
+		store->parent = NULL;
+		return -1;
+	}
+	store->parentfd = fd;
+	return fd;
+}
+
+/*
+ * Checks that the entries of the store match the package files
+ * metadata: every file, configuration file and link is there and
+ * the data of all regular files matches its checksum.
+ */
+static int
+store_verify(struct xbps_pkgstore *store, xbps_dictionary_t filesd)
+{
+	static const char *keys[] = { "files", "conf_files", "links" };
+	xbps_dictionary_t paths, d, filed;
+	xbps_array_t array;
+	const char *file, *sha256;
+	char *spath;
+	unsigned int ndata = 0, nverified = 0;
+	int rv = 0;
+
+	if ((paths = xbps_dictionary_create()) == NULL)
+		return ENOMEM;
+	for (unsigned int i = 0; i < xbps_array_count(store->entries); i++) {
+		d = xbps_array_get(store->entries, i);
+		if (!xbps_dictionary_get_cstring_nocopy(d, "file", &file) ||
+		    file[0] != '.' || file[1] != '/') {
+			rv = EINVAL;
+			goto out;
+		}
+		if (!xbps_dictionary_set(paths, file + 1, d)) {
+			rv = ENOMEM;
+			goto out;
+		}
+		if (entry_has_data(d))
+			ndata++;
+	}
+	for (unsigned int i = 0; i < __arraycount(keys); i++) {
+		array = xbps_dictionary_get(filesd, keys[i]);
+		for (unsigned int j = 0; j < xbps_array_count(array); j++) {
+			filed = xbps_array_get(array, j);
+			if (!xbps_dictionary_get_cstring_nocopy(filed, "file",
+			    &file) || (d = xbps_dictionary_get(paths, file)) == NULL) {
+				rv = ENOENT;
+				goto out;
+			}
+			if (!entry_has_data(d))
+				continue;
+			if (!xbps_dictionary_get_cstring_nocopy(filed, "sha256",
+			    &sha256)) {
+				rv = EINVAL;
+				goto out;
+			}
+			spath = store_path(store->dir, file);
+			rv = xbps_file_sha256_check(spath, sha256);
+			free(spath);
+			if (rv != 0)
+				goto out;
+			nverified++;
+		}
+	}
+	/* data that is not in files.plist cannot be verified */
+	if (nverified != ndata)
+		rv = EINVAL;
+out:
+	xbps_object_release(paths);
+	return rv;
+}
+
+static xbps_dictionary_t
+entry_dictionary(struct archive_entry *entry)
+{
+	xbps_dictionary_t d;
+	const char *s;
+	bool ok;
+
+	if ((d = xbps_dictionary_create()) == NULL)
+		return NULL;
+	ok = xbps_dictionary_set_cstring(d, "file",
+	    archive_entry_pathname(entry)) &&
+	    xbps_dictionary_set_uint32(d, "mode", archive_entry_mode(entry)) &&
+	    xbps_dictionary_set_int64(d, "uid", archive_entry_uid(entry)) &&
+	    xbps_dictionary_set_int64(d, "gid", archive_entry_gid(entry)) &&
+	    xbps_dictionary_set_int64(d, "size", archive_entry_size(entry)) &&
+	    xbps_dictionary_set_int64(d, "mtime", archive_entry_mtime(entry)) &&
+	    xbps_dictionary_set_int64(d, "mtime-nsec",
+	    archive_entry_mtime_nsec(entry));
+	if (ok && (s = archive_entry_uname(entry)) != NULL)
+		ok = xbps_dictionary_set_cstring(d, "uname", s);
+	if (ok && (s = archive_entry_gname(entry)) != NULL)
+		ok = xbps_dictionary_set_cstring(d, "gname", s);
+	if (ok && (s = archive_entry_hardlink(entry)) != NULL)
+		ok = xbps_dictionary_set_cstring(d, "hardlink", s);
+	else if (ok && (s = archive_entry_symlink(entry)) != NULL)
+		ok = xbps_dictionary_set_cstring(d, "symlink", s);
+	if (!ok) {
+		xbps_object_release(d);
+		return NULL;
+	}
+	return d;
+}
+
+static void
+store_remove(struct xbps_handle *xhp, struct xbps_pkgstore *store)
+{
+	char *old;
+
+	old = xbps_xasprintf("%s.old", store->tmpdir);
+	if (rename(store->dir, old) == 0)
+		(void)nftw(old, rm_entry, 16, FTW_DEPTH|FTW_PHYS);
+	else if (errno != ENOENT)
+		xbps_dbg_printf(xhp, "[store] cannot remove %s: %s\n",
+		    store->dir, strerror(errno));
+	free(old);
+}
+
+int HIDDEN
+xbps_pkgstore_open(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		xbps_dictionary_t filesd, struct xbps_pkgstore *store)
+{
+	struct stat st;
+	const char *pkgver = NULL, *sha256 = NULL;
+	char *path;
+	int rv;
+
+	memset(store, 0, sizeof(*store));
+	store->parentfd = -1;
+
+	if (xhp->storedir[0] == '\0')
+		return 0;
+
+	if (!xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver) ||
+	    !xbps_dictionary_get_cstring_nocopy(pkg_repod,
+	    "filename-sha256", &sha256))
+		return 0;
+
+	store->dir = xbps_xasprintf("%s/%s.%s", xhp->storedir, pkgver, sha256);
+	store->tmpdir = xbps_xasprintf("%s/.%s.%s.%ld", xhp->storedir,
+	    pkgver, sha256, (long)getpid());
+
+	if (stat(store->dir, &st) == 0) {
+		path = xbps_xasprintf("%s/entries.plist", store->dir);
+		store->entries = xbps_array_internalize_from_file(path);
+		free(path);
+		if (store->entries == NULL)
+			rv = EINVAL;
+		else
+			rv = store_verify(store, filesd);
+		if (rv == 0 && (store->entry = archive_entry_new()) != NULL) {
+			xbps_dbg_printf(xhp, "[store] %s: using %s\n",
+			    pkgver, store->dir);
+			free(store->tmpdir);
+			store->tmpdir = NULL;
+			return 0;
+		}
+		xbps_dbg_printf(xhp, "[store] %s: replacing %s: %s\n",
+		    pkgver, store->dir, strerror(rv));
+		if (store->entries != NULL)
+			xbps_object_release(store->entries);
+		store->entries = NULL;
+		store_remove(xhp, store);
+	}
+
+	if ((store->entries = xbps_array_create()) == NULL ||
+	    (xbps_mkpath(store->tmpdir, 0755) == -1 && errno != EEXIST)) {
+		xbps_dbg_printf(xhp, "[store] %s: cannot create %s: %s\n",
+		    pkgver, store->tmpdir, strerror(errno));
+		store_abort(store);
+		free(store->dir);
+		store->dir = NULL;
+		return 0;
+	}
+	xbps_dbg_printf(xhp, "[store] %s: adding to %s\n", pkgver, store->dir);
+	return 0;
+}
+
+int HIDDEN
+xbps_pkgstore_next(struct xbps_pkgstore *store, struct archive_entry **entryp)
+{
+	struct archive_entry *entry = store->entry;
+	xbps_dictionary_t d;
+	const char *s;
+	uint32_t mode = 0;
+	int64_t uid = 0, gid = 0, size = 0, mtime = 0, nsec = 0;
+
+	if (store->idx >= xbps_array_count(store->entries))
+		return ARCHIVE_EOF;
+	d = xbps_array_get(store->entries, store->idx++);
+	if (!xbps_dictionary_get_cstring_nocopy(d, "file", &s))
+		return ARCHIVE_FATAL;
+
+	free(store->key);
+	if ((store->key = strdup(s)) == NULL)
+		return ARCHIVE_FATAL;
+	xbps_dictionary_get_uint32(d, "mode", &mode);
+	xbps_dictionary_get_int64(d, "uid", &uid);
+	xbps_dictionary_get_int64(d, "gid", &gid);
+	xbps_dictionary_get_int64(d, "size", &size);
+	xbps_dictionary_get_int64(d, "mtime", &mtime);
+	xbps_dictionary_get_int64(d, "mtime-nsec", &nsec);
+
+	archive_entry_clear(entry);
+	archive_entry_copy_pathname(entry, s);
+	archive_entry_set_mode(entry, mode);
+	archive_entry_set_uid(entry, uid);
+	archive_entry_set_gid(entry, gid);
+	archive_entry_set_size(entry, size);
+	archive_entry_set_mtime(entry, mtime, nsec);
+	if (xbps_dictionary_get_cstring_nocopy(d, "uname", &s))
+		archive_entry_copy_uname(entry, s);
+	if (xbps_dictionary_get_cstring_nocopy(d, "gname", &s))
+		archive_entry_copy_gname(entry, s);
+	if (xbps_dictionary_get_cstring_nocopy(d, "hardlink", &s)) {
+		archive_entry_copy_hardlink(entry, s);
+		archive_entry_set_size(entry, 0);
+	} else if (xbps_dictionary_get_cstring_nocopy(d, "symlink", &s)) {
+		archive_entry_copy_symlink(entry, s);
+		archive_entry_set_size(entry, 0);
+	}
+	store->data = entry_has_data(d);
+	*entryp = entry;
+	return ARCHIVE_OK;
+}
+
+int HIDDEN
+xbps_pkgstore_add(struct xbps_handle *xhp, struct xbps_pkgstore *store,
+		struct archive *ar, struct archive_entry *entry)
+{
+	xbps_dictionary_t d;
+	const char *path;
+	char *spath, *p = NULL;
+	int fd, rv;
+
+	if (store->tmpdir == NULL)
+		return 0;
+
+	store->data = false;
+	if ((d = entry_dictionary(entry)) == NULL) {
+		store_abort(store);
+		return 0;
+	}
+	if (!xbps_array_add(store->entries, d)) {
+		xbps_object_release(d);
+		store_abort(store);
+		return 0;
+	}
+	xbps_object_release(d);
+	if (archive_entry_filetype(entry) != AE_IFREG ||
+	    archive_entry_hardlink(entry) != NULL)
+		return 0;
+
+	path = archive_entry_pathname(entry);
+	free(store->key);
+	store->key = strdup(path);
+	spath = store_path(store->tmpdir, path);
+	if (store->key == NULL || (p = strdup(spath)) == NULL ||
+	    (xbps_mkpath(dirname(p), 0755) == -1 && errno != EEXIST) ||
+	    (fd = open(spath, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC,
+	    0644)) == -1) {
+		/* nothing read yet, extract it from the archive */
+		xbps_dbg_printf(xhp, "[store] cannot add %s to %s: %s\n",
+		    path, store->tmpdir, strerror(errno));
+		free(p);
+		free(spath);
+		store_abort(store);
+		return 0;
+	}
+	free(p);
+	free(spath);
+	/*
+	 * The data cannot be read again from the archive, a failure
+	 * here fails the unpack.
+	 */
+	if (archive_read_data_into_fd(ar, fd) != ARCHIVE_OK) {
+		if ((rv = archive_errno(ar)) == 0)
+			rv = EIO;
+		close(fd);
+		store_abort(store);
+		return rv;
+	}
+	close(fd);
+	store->data = true;
+	return 0;
+}
+
+int HIDDEN
+xbps_pkgstore_extract(struct xbps_handle *xhp, struct xbps_pkgstore *store,
+		struct archive_entry *entry)
+{
+	struct timespec ts[2];
+	const char *name;
+	char *spath;
+	int sfd, dfd, pfd, rv;
+
+	spath = store_path(store->tmpdir ? store->tmpdir : store->dir,
+	    store->key);
+	sfd = open(spath, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+	if (sfd == -1) {
+		rv = errno;
+		xbps_dbg_printf(xhp, "[store] cannot open %s: %s\n",
+		    spath, strerror(rv));
+		free(spath);
+		return rv;
+	}
+	free(spath);
+	if ((pfd = parent_dir(store, archive_entry_pathname(entry),
+	    &name)) == -1) {
+		rv = errno;
+		close(sfd);
+		return rv;
+	}
+	(void)unlinkat(pfd, name, 0);
+	dfd = openat(pfd, name, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC,
+	    0600);
+	if (dfd == -1) {
+		rv = errno;
+		close(sfd);
+		return rv;
+	}
+	if ((rv = clone_file(sfd, dfd)) != 0)
+		goto fail;
+	if (geteuid() == 0 && fchown(dfd, archive_entry_uid(entry),
+	    archive_entry_gid(entry)) == -1) {
+		rv = errno;
+		goto fail;
+	}
+	if (fchmod(dfd, archive_entry_mode(entry) & 07777) == -1) {
+		rv = errno;
+		goto fail;
+	}
+	ts[0].tv_sec = archive_entry_atime_is_set(entry) ?
+	    archive_entry_atime(entry) : archive_entry_mtime(entry);
+	ts[0].tv_nsec = archive_entry_atime_is_set(entry) ?
+	    archive_entry_atime_nsec(entry) : archive_entry_mtime_nsec(entry);
+	ts[1].tv_sec = archive_entry_mtime(entry);
+	ts[1].tv_nsec = archive_entry_mtime_nsec(entry);
+	(void)futimens(dfd, ts);
+	close(dfd);
+	close(sfd);
+	return 0;
+
+fail:
+	close(dfd);
+	close(sfd);
+	(void)unlinkat(pfd, name, 0);
+	return rv;
+}
+
+void HIDDEN
+xbps_pkgstore_close(struct xbps_handle *xhp, struct xbps_pkgstore *store,
+		bool commit)
+{
+	char *path;
+
+	if (store->tmpdir != NULL && commit) {
+		path = xbps_xasprintf("%s/entries.plist", store->tmpdir);
+		if (xbps_array_externalize_to_file(store->entries, path) &&
+		    rename(store->tmpdir, store->dir) == 0) {
+			xbps_dbg_printf(xhp, "[store] added %s\n", store->dir);
+			free(store->tmpdir);
+			store->tmpdir = NULL;
+		}
+		free(path);
+	}
+	/* failed or added meanwhile by another process */
+	store_abort(store);
+	if (store->entries != NULL)
+		xbps_object_release(store->entries);
+	if (store->entry != NULL)
+		archive_entry_free(store->entry);
+	if (store->parentfd != -1)
+		close(store->parentfd);
+	free(store->parent);
+	free(store->dir);
+	free(store->key);
+	memset(store, 0, sizeof(*store));
+	store->parentfd = -1;
+}
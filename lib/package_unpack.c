@@ -83,17 +83,20 @@ unpack_archive(struct xbps_handle *xhp,
 	ssize_t entry_size;
 	const char *entry_pname, *pkgname;
 	char *buf = NULL;
+	struct xbps_pkgstore store = { .parentfd = -1 };
+	uint64_t filesd_size = 0;
 	int ar_rv, rv, error, entry_type, flags;
 	bool preserve, update, file_exists, keep_conf_file;
-	bool skip_extract, force, xucd_stats;
+	bool skip_extract, force, xucd_stats, deferred;
 	uid_t euid;
 
 	binpkg_filesd = pkg_filesd = NULL;
-	force = preserve = update = file_exists = false;
+	force = preserve = update = file_exists = deferred = false;
 	xucd_stats = false;
 	ar_rv = rv = error = entry_type = flags = 0;
 
 	xbps_dictionary_get_bool(pkg_repod, "preserve", &preserve);
+	xbps_dictionary_get_bool(pkg_repod, "scripts-deferred", &deferred);
 	ttype = xbps_transaction_pkg_type(pkg_repod);
 
 	memset(&xucd, 0, sizeof(xucd));
@@ -118,21 +121,8 @@ unpack_archive(struct xbps_handle *xhp,
 	if (!preserve &&
 	    xbps_dictionary_get_dict(xhp->transd, "obsolete_files", &obsd) &&
 	    (obsoletes = xbps_dictionary_get(obsd, pkgname))) {
-		for (unsigned int i = 0; i < xbps_array_count(obsoletes); i++) {
-			const char *file = NULL;
-			xbps_array_get_cstring_nocopy(obsoletes, i, &file);
-			if (remove(file) == -1) {
-				xbps_set_cb_state(xhp,
-					XBPS_STATE_REMOVE_FILE_OBSOLETE_FAIL,
-					errno, pkgver,
-					"%s: failed to remove obsolete entry `%s': %s",
-					pkgver, file, strerror(errno));
-				continue;
-			}
-			xbps_set_cb_state(xhp,
-				XBPS_STATE_REMOVE_FILE_OBSOLETE,
-				0, pkgver, "%s: removed obsolete entry: %s", pkgver, file);
-		}
+		if ((rv = xbps_remove_pkg_files(xhp, obsoletes, pkgver, true)) != 0)
+			return rv;
 	}
 
 	/*
@@ -158,7 +148,18 @@ unpack_archive(struct xbps_handle *xhp,
 		entry_pname = archive_entry_pathname(entry);
 		entry_size = archive_entry_size(entry);
 
-		if (strcmp("./INSTALL", entry_pname) == 0 ||
+		if (deferred && (strcmp("./INSTALL", entry_pname) == 0 ||
+		    strcmp("./REMOVE", entry_pname) == 0)) {
+			/*
+			 * Not kept in low memory mode, read them again
+			 * to be registered in the pkgdb.
+			 */
+			rv = -xbps_internalize_script(xhp, pkg_repod,
+			    entry_pname[2] == 'I' ? "install-script" :
+			    "remove-script", ar, entry);
+			if (rv != 0)
+				goto out;
+		} else if (strcmp("./INSTALL", entry_pname) == 0 ||
 		    strcmp("./REMOVE", entry_pname) == 0 ||
 		    strcmp("./props.plist", entry_pname) == 0) {
 			archive_read_data_skip(ar);
@@ -168,6 +169,10 @@ unpack_archive(struct xbps_handle *xhp,
 				rv = EINVAL;
 				goto out;
 			}
+			xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
+			filesd_size = (uint64_t)entry_size;
+			xbps_stats_mem_add(xhp, XBPS_STATS_MEM_PKG_PLISTS,
+			    filesd_size);
 			break;
 		} else {
 			break;
@@ -198,11 +203,18 @@ unpack_archive(struct xbps_handle *xhp,
 	 */
 	pkg_filesd = xbps_pkgdb_get_pkg_files(xhp, pkgname);
 
+	xbps_pkgstore_open(xhp, pkg_repod, binpkg_filesd, &store);
+
 	/*
-	 * Unpack all files on archive now.
+	 * Unpack all files on archive now, or from the package store
+	 * if the package is there; the rest of the archive is then
+	 * not read and skipping entry data does nothing.
 	 */
 	for (;;) {
-		ar_rv = archive_read_next_header(ar, &entry);
+		if (store.entry != NULL)
+			ar_rv = xbps_pkgstore_next(&store, &entry);
+		else
+			ar_rv = archive_read_next_header(ar, &entry);
 		if (ar_rv == ARCHIVE_EOF || ar_rv == ARCHIVE_FATAL)
 			break;
 		else if (ar_rv == ARCHIVE_RETRY)
@@ -219,6 +231,18 @@ unpack_archive(struct xbps_handle *xhp,
 			archive_read_data_skip(ar);
 			continue;
 		}
+		/*
+		 * Add the entry to the package store before deciding
+		 * whether it's extracted.
+		 */
+		if ((error = xbps_pkgstore_add(xhp, &store, ar, entry)) != 0) {
+			xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
+			    error, pkgver,
+			    "%s: [unpack] failed to add file `%s' to the "
+			    "package store: %s", pkgver, entry_pname,
+			    strerror(error));
+			break;
+		}
 		/*
 		 * Prepare unpack callback ops.
 		 */
@@ -256,6 +280,9 @@ unpack_archive(struct xbps_handle *xhp,
 			archive_read_data_skip(ar);
 			continue;
 		}
+		/* the package takes over an alternatives link */
+		if (entry_type == AE_IFLNK)
+			xbps_alternatives_claim(xhp, entry_pname);
 		/*
 		 * Always check that extracted file exists and hash
 		 * doesn't match, in that case overwrite the file.
@@ -402,21 +429,25 @@ unpack_archive(struct xbps_handle *xhp,
 		 */
 		entry_pname = archive_entry_pathname(entry);
 		/*
-		 * Extract entry from archive.
+		 * Extract entry from archive, or its data from the
+		 * package store.
 		 */
-		if (archive_read_extract(ar, entry, flags) != 0) {
-			error = archive_errno(ar);
+		if (store.data)
+			error = xbps_pkgstore_extract(xhp, &store, entry);
+		else if (archive_read_extract(ar, entry, flags) != 0)
+			error = archive_errno(ar) ? archive_errno(ar) : EINVAL;
+		if (error != 0) {
 			xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
 			    error, pkgver,
 			    "%s: [unpack] failed to extract file `%s': %s",
 			    pkgver, entry_pname, strerror(error));
 			break;
-		} else {
-			if (xhp->unpack_cb != NULL) {
-				xucd.entry = entry_pname;
-				xucd.entry_extract_count++;
-				(*xhp->unpack_cb)(&xucd, xhp->unpack_cb_data);
-			}
+		}
+		XBPS_PROBE3(unpack_entry, pkgver, entry_pname, entry_size);
+		if (xhp->unpack_cb != NULL) {
+			xucd.entry = entry_pname;
+			xucd.entry_extract_count++;
+			xbps_set_cb_unpack(xhp, &xucd);
 		}
 	}
 	/*
@@ -435,10 +466,12 @@ unpack_archive(struct xbps_handle *xhp,
 	 * Externalize binpkg files.plist to disk, if not empty.
 	 */
 	if (xbps_dictionary_count(binpkg_filesd)) {
+		char sha256[XBPS_SHA256_SIZE];
 		mode_t prev_umask;
 		prev_umask = umask(022);
 		buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
-		if (!xbps_dictionary_externalize_to_file(binpkg_filesd, buf)) {
+		if (!xbps_dictionary_write_file(xhp, binpkg_filesd, buf,
+		    xhp->flags & XBPS_FLAG_ZSTD_METAFILES, sha256)) {
 			rv = errno;
 			umask(prev_umask);
 			free(buf);
@@ -449,6 +482,8 @@ unpack_archive(struct xbps_handle *xhp,
 		}
 		umask(prev_umask);
 		free(buf);
+		/* registered by xbps_register_pkg() */
+		xbps_dictionary_set_cstring(pkg_repod, "metafile-sha256", sha256);
 	}
 out:
 	/*
@@ -458,8 +493,13 @@ out:
 		buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
 		unlink(buf);
 		free(buf);
+		xbps_dictionary_remove(pkg_repod, "metafile-sha256");
 	}
 	xbps_object_release(binpkg_filesd);
+	if (pkg_filesd != NULL)
+		xbps_object_release(pkg_filesd);
+	xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_PKG_PLISTS, filesd_size);
+	xbps_pkgstore_close(xhp, &store, rv == 0);
 
 	return rv;
 }
@@ -469,8 +509,10 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 {
 	struct archive *ar = NULL;
 	struct stat st;
+	struct timespec ts;
 	const char *pkgver;
 	char *bpkg = NULL;
+	uint64_t blksize = 0;
 	int pkg_fd = -1, rv = 0;
 	mode_t myumask;
 
@@ -492,6 +534,7 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 		free(bpkg);
 		return ENOMEM;
 	}
+	xbps_stats_start(&ts);
 	/*
 	 * Enable support for tar format and some compression methods.
 	 */
@@ -521,6 +564,8 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 		    pkgver, bpkg, strerror(rv));
 		goto out;
 	}
+	blksize = (uint64_t)st.st_blksize;
+	xbps_stats_mem_add(xhp, XBPS_STATS_MEM_ARCHIVE, blksize);
 	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
 		rv = archive_errno(ar);
 		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
@@ -572,13 +617,20 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 out:
 	if (pkg_fd != -1)
 		close(pkg_fd);
-	if (ar != NULL)
+	if (ar != NULL) {
+		if (archive_filter_bytes(ar, 0) > 0) {
+			xbps_stats_add(xhp, XBPS_STATS_BYTES_DECOMPRESSED,
+			    (uint64_t)archive_filter_bytes(ar, 0));
+		}
 		archive_read_free(ar);
+	}
+	xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_ARCHIVE, blksize);
 	if (bpkg)
 		free(bpkg);
 
 	/* restore */
 	umask(myumask);
+	xbps_stats_end(xhp, XBPS_STATS_UNPACK, &ts);
 
 	return rv;
 }
@@ -59,9 +59,6 @@
  * data type is specified on its edge, i.e array, bool, integer, string,
  * dictionary.
  */
-static int pkgdb_fd = -1;
-static bool pkgdb_map_names_done = false;
-
 int
 xbps_pkgdb_lock(struct xbps_handle *xhp)
 {
@@ -89,7 +86,8 @@ xbps_pkgdb_lock(struct xbps_handle *xhp)
 		}
 		/* if pkgdb is unexistent, create it with an empty dictionary */
 		xhp->pkgdb = xbps_dictionary_create();
-		if (!xbps_dictionary_externalize_to_file(xhp->pkgdb, xhp->pkgdb_plist)) {
+		if (!xbps_dictionary_write_file(xhp, xhp->pkgdb, xhp->pkgdb_plist,
+		    false, NULL)) {
 			rv = errno;
 			xbps_dbg_printf(xhp, "[pkgdb] failed to create pkgdb "
 			    "%s: %s\n", xhp->pkgdb_plist, strerror(rv));
@@ -97,7 +95,7 @@ xbps_pkgdb_lock(struct xbps_handle *xhp)
 		}
 	}
 
-	if ((pkgdb_fd = open(xhp->pkgdb_plist, O_CREAT|O_RDWR|O_CLOEXEC, 0664)) == -1) {
+	if ((xhp->pkgdb_fd = open(xhp->pkgdb_plist, O_CREAT|O_RDWR|O_CLOEXEC, 0664)) == -1) {
 		rv = errno;
 		xbps_dbg_printf(xhp, "[pkgdb] cannot open pkgdb for locking "
 		    "%s: %s\n", xhp->pkgdb_plist, strerror(rv));
@@ -108,7 +106,7 @@ xbps_pkgdb_lock(struct xbps_handle *xhp)
 	/*
 	 * If we've acquired the file lock, then pkgdb is writable.
 	 */
-	if (lockf(pkgdb_fd, F_TLOCK, 0) == -1) {
+	if (lockf(xhp->pkgdb_fd, F_TLOCK, 0) == -1) {
 		rv = errno;
 		xbps_dbg_printf(xhp, "[pkgdb] cannot lock pkgdb: %s\n", strerror(rv));
 	}
@@ -128,14 +126,14 @@ ret:
 void
 xbps_pkgdb_unlock(struct xbps_handle *xhp)
 {
-	xbps_dbg_printf(xhp, "%s: pkgdb_fd %d\n", __func__, pkgdb_fd);
+	xbps_dbg_printf(xhp, "%s: pkgdb_fd %d\n", __func__, xhp->pkgdb_fd);
 
-	if (pkgdb_fd != -1) {
-		if (lockf(pkgdb_fd, F_ULOCK, 0) == -1)
+	if (xhp->pkgdb_fd != -1) {
+		if (lockf(xhp->pkgdb_fd, F_ULOCK, 0) == -1)
 			xbps_dbg_printf(xhp, "[pkgdb] failed to unlock pkgdb: %s\n", strerror(errno));
 
-		(void)close(pkgdb_fd);
-		pkgdb_fd = -1;
+		(void)close(xhp->pkgdb_fd);
+		xhp->pkgdb_fd = -1;
 	}
 }
 
@@ -202,7 +200,7 @@ pkgdb_map_names(struct xbps_handle *xhp)
 	xbps_object_t obj;
 	int rv = 0;
 
-	if (pkgdb_map_names_done || !xbps_dictionary_count(xhp->pkgdb))
+	if (xhp->pkgdb_names_mapped || !xbps_dictionary_count(xhp->pkgdb))
 		return 0;
 
 	/*
@@ -232,7 +230,7 @@ pkgdb_map_names(struct xbps_handle *xhp)
 	}
 	xbps_object_iterator_release(iter);
 	if (!rv) {
-		pkgdb_map_names_done = true;
+		xhp->pkgdb_names_mapped = true;
 	}
 	return rv;
 }
@@ -281,22 +279,31 @@ int
 xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 {
 	xbps_dictionary_t pkgdb_storage;
+	struct timespec ts;
+	struct stat st;
 	mode_t prev_umask;
-	static int cached_rv;
 	int rv = 0;
 
-	if (cached_rv && !flush)
-		return cached_rv;
+	if (xhp->pkgdb_rv && !flush)
+		return xhp->pkgdb_rv;
 
 	if (xhp->pkgdb && flush) {
+		XBPS_PROBE1(pkgdb_flush, xhp->pkgdb_plist);
+		xbps_stats_start(&ts);
 		pkgdb_storage = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist);
+		if (pkgdb_storage != NULL)
+			xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
 		if (pkgdb_storage == NULL ||
 		    !xbps_dictionary_equals(xhp->pkgdb, pkgdb_storage)) {
 			/* flush dictionary to storage */
 			prev_umask = umask(022);
-			if (!xbps_dictionary_externalize_to_file(xhp->pkgdb, xhp->pkgdb_plist)) {
+			if (!xbps_dictionary_write_file(xhp, xhp->pkgdb, xhp->pkgdb_plist,
+			    false, NULL)) {
 				umask(prev_umask);
-				return errno;
+				rv = errno;
+				xbps_stats_end(xhp, XBPS_STATS_PKGDB_FLUSH, &ts);
+				XBPS_PROBE2(pkgdb_flush_done, xhp->pkgdb_plist, rv);
+				return rv;
 			}
 			umask(prev_umask);
 		}
@@ -305,12 +312,17 @@ xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 
 		xbps_object_release(xhp->pkgdb);
 		xhp->pkgdb = NULL;
-		cached_rv = 0;
+		xhp->pkgdb_rv = 0;
+		xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_PKGDB,
+		    xhp->stats.mem[XBPS_STATS_MEM_PKGDB]);
+		xbps_stats_end(xhp, XBPS_STATS_PKGDB_FLUSH, &ts);
+		XBPS_PROBE2(pkgdb_flush_done, xhp->pkgdb_plist, 0);
 	}
 	if (!update)
 		return rv;
 
 	/* update copy in memory */
+	xbps_stats_start(&ts);
 	if ((xhp->pkgdb = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist)) == NULL) {
 		rv = errno;
 		if (!rv)
@@ -321,8 +333,15 @@ xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 		else
 			xbps_error_printf("cannot access to pkgdb: %s\n", strerror(rv));
 
-		cached_rv = rv = errno;
+		xhp->pkgdb_rv = rv = errno;
+	} else {
+		xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
+		if (stat(xhp->pkgdb_plist, &st) == 0 && st.st_size > 0) {
+			xbps_stats_mem_add(xhp, XBPS_STATS_MEM_PKGDB,
+			    (uint64_t)st.st_size);
+		}
 	}
+	xbps_stats_end(xhp, XBPS_STATS_PKGDB_LOAD, &ts);
 
 	return rv;
 }
@@ -335,6 +354,8 @@ xbps_pkgdb_release(struct xbps_handle *xhp)
 	xbps_pkgdb_unlock(xhp);
 	if (xhp->pkgdb)
 		xbps_object_release(xhp->pkgdb);
+	xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_PKGDB,
+	    xhp->stats.mem[XBPS_STATS_MEM_PKGDB]);
 	xbps_dbg_printf(xhp, "[pkgdb] released ok.\n");
 }
 
@@ -380,6 +401,7 @@ xbps_pkgdb_get_pkg(struct xbps_handle *xhp, const char *pkg)
 	if (xbps_pkgdb_init(xhp) != 0)
 		return NULL;
 
+	xbps_stats_add(xhp, XBPS_STATS_PKG_LOOKUPS, 1);
 	return xbps_find_pkg_in_dict(xhp->pkgdb, pkg);
 }
 
@@ -389,6 +411,7 @@ xbps_pkgdb_get_virtualpkg(struct xbps_handle *xhp, const char *vpkg)
 	if (xbps_pkgdb_init(xhp) != 0)
 		return NULL;
 
+	xbps_stats_add(xhp, XBPS_STATS_PKG_LOOKUPS, 1);
 	return xbps_find_virtualpkg_in_dict(xhp, xhp->pkgdb, vpkg);
 }
 
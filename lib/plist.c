@@ -32,18 +32,20 @@
 
 #include "xbps_api_impl.h"
 
-struct thread_data {
-	pthread_t thread;
+struct foreach_job {
 	xbps_array_t array;
 	xbps_dictionary_t dict;
 	struct xbps_handle *xhp;
-	unsigned int start;
 	unsigned int arraycount;
-	unsigned int *reserved;
-	pthread_mutex_t *reserved_lock;
-	unsigned int slicecount;
+	unsigned int chunk;
+	unsigned int next;
+	int error;
+	bool cancel;
 	int (*fn)(struct xbps_handle *, xbps_object_t, const char *, void *, bool *);
 	void *fn_arg;
+#ifndef HAVE_ATOMICS
+	pthread_mutex_t lock;
+#endif
 };
 
 /**
@@ -54,23 +56,90 @@ struct thread_data {
  * These functions manipulate plist files and objects shared by almost
  * all library functions.
  */
-static void *
-array_foreach_thread(void *arg)
+/*
+ * The shared state of a job; without atomics it's protected by the
+ * job mutex.
+ */
+static bool
+job_cancelled(struct foreach_job *job)
+{
+#ifdef HAVE_ATOMICS
+	return __atomic_load_n(&job->cancel, __ATOMIC_RELAXED);
+#else
+	bool cancel;
+
+	pthread_mutex_lock(&job->lock);
+	cancel = job->cancel;
+	pthread_mutex_unlock(&job->lock);
+	return cancel;
+#endif
+}
+
+static unsigned int
+job_claim(struct foreach_job *job)
+{
+#ifdef HAVE_ATOMICS
+	return __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED);
+#else
+	unsigned int i;
+
+	pthread_mutex_lock(&job->lock);
+	i = job->next;
+	job->next += job->chunk;
+	pthread_mutex_unlock(&job->lock);
+	return i;
+#endif
+}
+
+/*
+ * Cancels the remaining work, keeping the first error.
+ */
+static void
+job_cancel(struct foreach_job *job, int rv)
+{
+#ifdef HAVE_ATOMICS
+	int expected = 0;
+
+	if (rv != 0)
+		__atomic_compare_exchange_n(&job->error, &expected, rv,
+		    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	__atomic_store_n(&job->cancel, true, __ATOMIC_RELAXED);
+#else
+	pthread_mutex_lock(&job->lock);
+	if (job->error == 0)
+		job->error = rv;
+	job->cancel = true;
+	pthread_mutex_unlock(&job->lock);
+#endif
+}
+
+/*
+ * Runs in every thread of the pool: chunks of the array are claimed by
+ * incrementing the next index, and the first callback that fails or
+ * sets its done argument cancels the remaining work.
+ */
+static void
+array_foreach_job(void *arg)
 {
+	struct foreach_job *job = arg;
 	xbps_object_t obj, pkgd;
-	struct thread_data *thd = arg;
 	const char *key;
+	unsigned int i, end;
 	int rv;
 	bool loop_done = false;
-	unsigned i = thd->start;
-	unsigned int end = i + thd->slicecount;
 
-	while(i < thd->arraycount) {
-		/* process pkgs from start until end */
-		for (; i < end && i < thd->arraycount; i++) {
-			obj = xbps_array_get(thd->array, i);
-			if (xbps_object_type(thd->dict) == XBPS_TYPE_DICTIONARY) {
-				pkgd = xbps_dictionary_get_keysym(thd->dict, obj);
+	while (!job_cancelled(job)) {
+		i = job_claim(job);
+		if (i >= job->arraycount)
+			break;
+		end = i + job->chunk;
+		if (end > job->arraycount)
+			end = job->arraycount;
+
+		for (; i < end; i++) {
+			obj = xbps_array_get(job->array, i);
+			if (xbps_object_type(job->dict) == XBPS_TYPE_DICTIONARY) {
+				pkgd = xbps_dictionary_get_keysym(job->dict, obj);
 				key = xbps_dictionary_keysym_cstring_nocopy(obj);
 				/* ignore internal objs */
 				if (strncmp(key, "_XBPS_", 6) == 0)
@@ -79,18 +148,15 @@ array_foreach_thread(void *arg)
 				pkgd = obj;
 				key = NULL;
 			}
-			rv = (*thd->fn)(thd->xhp, pkgd, key, thd->fn_arg, &loop_done);
-			if (rv != 0 || loop_done)
-				return NULL;
+			rv = (*job->fn)(job->xhp, pkgd, key, job->fn_arg, &loop_done);
+			if (rv != 0 || loop_done) {
+				job_cancel(job, rv);
+				return;
+			}
+			if (job_cancelled(job))
+				return;
 		}
-		/* Reserve more elements to compute */
-		pthread_mutex_lock(thd->reserved_lock);
-		i = *thd->reserved;
-		end = i + thd->slicecount;
-		*thd->reserved = end;
-		pthread_mutex_unlock(thd->reserved_lock);
 	}
-	return NULL;
 }
 
 int
@@ -100,11 +166,9 @@ xbps_array_foreach_cb_multi(struct xbps_handle *xhp,
 	int (*fn)(struct xbps_handle *, xbps_object_t, const char *, void *, bool *),
 	void *arg)
 {
-	struct thread_data *thd;
-	unsigned int arraycount, slicecount;
-	int rv = 0, error = 0, i, maxthreads;
-	unsigned int reserved;
-	pthread_mutex_t reserved_lock = PTHREAD_MUTEX_INITIALIZER;
+	struct foreach_job job;
+	unsigned int arraycount, nthreads;
+	int rv;
 
 	assert(fn != NULL);
 
@@ -115,54 +179,42 @@ xbps_array_foreach_cb_multi(struct xbps_handle *xhp,
 	if (arraycount == 0)
 		return 0;
 
-	maxthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
-	if (maxthreads <= 1 || arraycount <= 1) /* use single threaded routine */
+	nthreads = xbps_thread_pool_size(xhp);
+	if (nthreads <= 1 || arraycount <= 1) /* use single threaded routine */
 		return xbps_array_foreach_cb(xhp, array, dict, fn, arg);
 
-	thd = calloc(maxthreads, sizeof(*thd));
-	assert(thd);
-
-	// maxthread is boundchecked to be > 1
-	if((unsigned int)maxthreads >= arraycount) {
-		maxthreads = arraycount;
-		slicecount = 1;
-	} else {
-		slicecount = arraycount / maxthreads;
-		if (slicecount > 32) {
-			slicecount = 32;
-		}
-	}
-
-	reserved = slicecount * maxthreads;
-
-	for (i = 0; i < maxthreads; i++) {
-		thd[i].array = array;
-		thd[i].dict = dict;
-		thd[i].xhp = xhp;
-		thd[i].fn = fn;
-		thd[i].fn_arg = arg;
-		thd[i].start = i * slicecount;
-		thd[i].reserved = &reserved;
-		thd[i].reserved_lock = &reserved_lock;
-		thd[i].slicecount = slicecount;
-		thd[i].arraycount = arraycount;
+	memset(&job, 0, sizeof(job));
+	job.array = array;
+	job.dict = dict;
+	job.xhp = xhp;
+	job.fn = fn;
+	job.fn_arg = arg;
+	job.arraycount = arraycount;
+	/*
+	 * Small chunks keep the threads balanced when callbacks
+	 * take different times, big enough to not contend on the
+	 * shared index.
+	 */
+	job.chunk = arraycount / (nthreads * 8);
+	if (job.chunk < 1)
+		job.chunk = 1;
+	else if (job.chunk > 64)
+		job.chunk = 64;
 
-		if ((rv = pthread_create(&thd[i].thread, NULL, array_foreach_thread, &thd[i])) != 0) {
-			error = rv;
-			break;
-		}
-
-	}
-	/* wait for all threads that were created successfully */
-	for (int c = 0; c < i; c++) {
-		if ((rv = pthread_join(thd[c].thread, NULL)) != 0)
-			error = rv;
+#ifndef HAVE_ATOMICS
+	pthread_mutex_init(&job.lock, NULL);
+#endif
+	rv = xbps_thread_pool_run(xhp, array_foreach_job, &job);
+#ifndef HAVE_ATOMICS
+	pthread_mutex_destroy(&job.lock);
+#endif
+	if (rv != 0) {
+		/* pool unavailable or busy (nested call), do it here */
+		xbps_dbg_printf(xhp, "[pool] running single threaded: %s\n",
+		    strerror(rv));
+		return xbps_array_foreach_cb(xhp, array, dict, fn, arg);
 	}
-
-	free(thd);
-	pthread_mutex_destroy(&reserved_lock);
-
-	return error ? error : rv;
+	return job.error;
 }
 
 int
@@ -146,17 +146,39 @@ open_archive(const char *url)
 	return a;
 }
 
-char *
-xbps_archive_fetch_file(const char *url, const char *fname)
+/*
+ * Opens the archive to extract `fname'. Remote archives known to have
+ * a member index are read from the frame holding `fname' onwards,
+ * otherwise the archive is streamed from the beginning. Returns NULL
+ * and sets `missing' if the index was read and has no such member.
+ */
+static struct archive *
+open_archive_member(const char *url, const char *fname, bool indexed,
+		bool *missing)
+{
+	struct archive *a;
+
+	*missing = false;
+	if (indexed && xbps_repository_is_remote(url)) {
+		if ((a = xbps_archive_open_indexed(url, fname, missing)) != NULL ||
+		    *missing)
+			return a;
+	}
+	return open_archive(url);
+}
+
+char HIDDEN *
+xbps_archive_fetch_member(const char *url, const char *fname, bool indexed)
 {
 	struct archive *a;
 	struct archive_entry *entry;
 	char *buf = NULL;
+	bool missing;
 
 	assert(url);
 	assert(fname);
 
-	if ((a = open_archive(url)) == NULL)
+	if ((a = open_archive_member(url, fname, indexed, &missing)) == NULL)
 		return NULL;
 
 	while ((archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
@@ -177,6 +199,12 @@ xbps_archive_fetch_file(const char *url, const char *fname)
 	return buf;
 }
 
+char *
+xbps_archive_fetch_file(const char *url, const char *fname)
+{
+	return xbps_archive_fetch_member(url, fname, false);
+}
+
 bool
 xbps_repo_fetch_remote(struct xbps_repo *repo, const char *url)
 {
@@ -225,19 +253,21 @@ xbps_repo_fetch_remote(struct xbps_repo *repo, const char *url)
 	return false;
 }
 
-int
-xbps_archive_fetch_file_into_fd(const char *url, const char *fname, int fd)
+int HIDDEN
+xbps_archive_fetch_member_into_fd(const char *url, const char *fname,
+		bool indexed, int fd)
 {
 	struct archive *a;
 	struct archive_entry *entry;
 	int rv = 0;
+	bool missing;
 
 	assert(url);
 	assert(fname);
 	assert(fd != -1);
 
-	if ((a = open_archive(url)) == NULL)
-		return EINVAL;
+	if ((a = open_archive_member(url, fname, indexed, &missing)) == NULL)
+		return missing ? 0 : EINVAL;
 
 	for (;;) {
 		const char *bfile;
@@ -277,6 +307,12 @@ xbps_archive_fetch_file_into_fd(const char *url, const char *fname, int fd)
 	return rv;
 }
 
+int
+xbps_archive_fetch_file_into_fd(const char *url, const char *fname, int fd)
+{
+	return xbps_archive_fetch_member_into_fd(url, fname, false, fd);
+}
+
 xbps_dictionary_t
 xbps_archive_fetch_plist(const char *url, const char *plistf)
 {
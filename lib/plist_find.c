@@ -37,22 +37,20 @@
 static xbps_dictionary_t
 get_pkg_in_array(xbps_array_t array, const char *str, xbps_trans_type_t tt, bool virtual)
 {
-	xbps_object_t obj;
-	xbps_object_iterator_t iter;
+	xbps_object_t obj = NULL;
 	xbps_trans_type_t ttype;
+	unsigned int i, cnt;
 	bool found = false;
 
 	assert(array);
 	assert(str);
 
-	iter = xbps_array_iterator(array);
-	if (!iter)
-		return NULL;
-
-	while ((obj = xbps_object_iterator_next(iter))) {
+	cnt = xbps_array_count(array);
+	for (i = 0; i < cnt; i++) {
 		const char *pkgver = NULL;
 		char pkgname[XBPS_NAME_SIZE] = {0};
 
+		obj = xbps_array_get(array, i);
 		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver)) {
 			continue;
 		}
@@ -87,7 +85,6 @@ get_pkg_in_array(xbps_array_t array, const char *str, xbps_trans_type_t tt, bool
 			}
 		}
 	}
-	xbps_object_iterator_release(iter);
 
 	ttype = xbps_transaction_pkg_type(obj);
 	if (found && tt && (ttype != tt)) {
@@ -191,9 +188,9 @@ const char HIDDEN *
 vpkg_user_conf(struct xbps_handle *xhp, const char *vpkg, bool only_conf)
 {
 	xbps_dictionary_t d;
-	xbps_object_t obj;
-	xbps_object_iterator_t iter;
+	xbps_dictionary_keysym_t ksym;
 	const char *pkg = NULL;
+	unsigned int i, cnt;
 	bool found = false;
 
 	assert(xhp);
@@ -210,17 +207,16 @@ vpkg_user_conf(struct xbps_handle *xhp, const char *vpkg, bool only_conf)
 	if (d == NULL)
 		return NULL;
 
-	iter = xbps_dictionary_iterator(d);
-	assert(iter);
-
-	while ((obj = xbps_object_iterator_next(iter))) {
+	cnt = xbps_dictionary_count(d);
+	for (i = 0; i < cnt; i++) {
 		xbps_string_t rpkg;
 		char buf[XBPS_NAME_SIZE] = {0};
 		char *vpkgver = NULL, *vpkgname = NULL;
 		const char *vpkg_conf = NULL;
 
-		vpkg_conf = xbps_dictionary_keysym_cstring_nocopy(obj);
-		rpkg = xbps_dictionary_get_keysym(xhp->vpkgd, obj);
+		ksym = xbps_dictionary_keysym_at(d, i);
+		vpkg_conf = xbps_dictionary_keysym_cstring_nocopy(ksym);
+		rpkg = xbps_dictionary_get_keysym(xhp->vpkgd, ksym);
 		pkg = xbps_string_cstring_nocopy(rpkg);
 
 		if (xbps_pkg_version(vpkg_conf)) {
@@ -267,7 +263,6 @@ vpkg_user_conf(struct xbps_handle *xhp, const char *vpkg, bool only_conf)
 		found = true;
 		break;
 	}
-	xbps_object_iterator_release(iter);
 
 	return found ? pkg : NULL;
 }
@@ -302,10 +297,9 @@ xbps_find_virtualpkg_in_dict(struct xbps_handle *xhp,
 			     xbps_dictionary_t d,
 			     const char *pkg)
 {
-	xbps_object_t obj;
-	xbps_object_iterator_t iter;
 	xbps_dictionary_t pkgd = NULL;
 	const char *vpkg;
+	unsigned int i, cnt;
 
 	/* Try matching vpkg via xhp->vpkgd */
 	vpkg = vpkg_user_conf(xhp, pkg, false);
@@ -321,17 +315,12 @@ xbps_find_virtualpkg_in_dict(struct xbps_handle *xhp,
 			return pkgd;
 	}
 	/* ... otherwise match the first one in dictionary */
-	iter = xbps_dictionary_iterator(d);
-	assert(iter);
-
-	while ((obj = xbps_object_iterator_next(iter))) {
-		pkgd = xbps_dictionary_get_keysym(d, obj);
-		if (xbps_match_virtual_pkg_in_dict(pkgd, pkg)) {
-			xbps_object_iterator_release(iter);
+	cnt = xbps_dictionary_count(d);
+	for (i = 0; i < cnt; i++) {
+		pkgd = xbps_dictionary_get_at(d, i);
+		if (xbps_match_virtual_pkg_in_dict(pkgd, pkg))
 			return pkgd;
-		}
 	}
-	xbps_object_iterator_release(iter);
 
 	return NULL;
 }
@@ -71,28 +71,20 @@ bool
 xbps_match_any_virtualpkg_in_rundeps(xbps_array_t rundeps,
 				     xbps_array_t provides)
 {
-	xbps_object_t obj, obj2;
-	xbps_object_iterator_t iter, iter2;
 	const char *vpkgver, *pkgpattern;
+	unsigned int i, j, nprovides, nrundeps;
 
-	iter = xbps_array_iterator(provides);
-	assert(iter);
-
-	while ((obj = xbps_object_iterator_next(iter))) {
-		vpkgver = xbps_string_cstring_nocopy(obj);
-		iter2 = xbps_array_iterator(rundeps);
-		assert(iter2);
-		while ((obj2 = xbps_object_iterator_next(iter2))) {
-			pkgpattern = xbps_string_cstring_nocopy(obj2);
-			if (xbps_pkgpattern_match(vpkgver, pkgpattern)) {
-				xbps_object_iterator_release(iter2);
-				xbps_object_iterator_release(iter);
+	nprovides = xbps_array_count(provides);
+	nrundeps = xbps_array_count(rundeps);
+
+	for (i = 0; i < nprovides; i++) {
+		vpkgver = xbps_array_cstring_nocopy_at(provides, i);
+		for (j = 0; j < nrundeps; j++) {
+			pkgpattern = xbps_array_cstring_nocopy_at(rundeps, j);
+			if (xbps_pkgpattern_match(vpkgver, pkgpattern))
 				return true;
-			}
 		}
-		xbps_object_iterator_release(iter2);
 	}
-	xbps_object_iterator_release(iter);
 
 	return false;
 }
@@ -100,62 +92,45 @@ xbps_match_any_virtualpkg_in_rundeps(xbps_array_t rundeps,
 static bool
 match_string_in_array(xbps_array_t array, const char *str, int mode)
 {
-	xbps_object_iterator_t iter;
-	xbps_object_t obj;
 	const char *pkgdep;
 	char pkgname[XBPS_NAME_SIZE];
-	bool found = false;
+	unsigned int i, cnt;
 
 	assert(xbps_object_type(array) == XBPS_TYPE_ARRAY);
 	assert(str != NULL);
 
-	iter = xbps_array_iterator(array);
-	assert(iter);
+	/* match by pkgver against pkgname */
+	if (mode == 2 && !xbps_pkg_name(pkgname, XBPS_NAME_SIZE, str))
+		return false;
 
-	while ((obj = xbps_object_iterator_next(iter))) {
+	cnt = xbps_array_count(array);
+	for (i = 0; i < cnt; i++) {
+		pkgdep = xbps_array_cstring_nocopy_at(array, i);
 		if (mode == 0) {
 			/* match by string */
-			if (xbps_string_equals_cstring(obj, str)) {
-				found = true;
-				break;
-			}
+			if (pkgdep != NULL && strcmp(pkgdep, str) == 0)
+				return true;
 		} else if (mode == 1) {
 			/* match by pkgname against pkgver */
-			pkgdep = xbps_string_cstring_nocopy(obj);
 			if (!xbps_pkg_name(pkgname, XBPS_NAME_SIZE, pkgdep))
 				break;
-			if (strcmp(pkgname, str) == 0) {
-				found = true;
-				break;
-			}
+			if (strcmp(pkgname, str) == 0)
+				return true;
 		} else if (mode == 2) {
-			/* match by pkgver against pkgname */
-			pkgdep = xbps_string_cstring_nocopy(obj);
-			if (!xbps_pkg_name(pkgname, XBPS_NAME_SIZE, str))
-				break;
-			if (strcmp(pkgname, pkgdep) == 0) {
-				found = true;
-				break;
-			}
+			if (strcmp(pkgname, pkgdep) == 0)
+				return true;
 		} else if (mode == 3) {
 			/* match pkgpattern against pkgdep */
-			pkgdep = xbps_string_cstring_nocopy(obj);
-			if (xbps_pkgpattern_match(pkgdep, str)) {
-				found = true;
-				break;
-			}
+			if (xbps_pkgpattern_match(pkgdep, str))
+				return true;
 		} else if (mode == 4) {
 			/* match pkgdep against pkgpattern */
-			pkgdep = xbps_string_cstring_nocopy(obj);
-			if (xbps_pkgpattern_match(str, pkgdep)) {
-				found = true;
-				break;
-			}
+			if (xbps_pkgpattern_match(str, pkgdep))
+				return true;
 		}
 	}
-	xbps_object_iterator_release(iter);
 
-	return found;
+	return false;
 }
 
 bool
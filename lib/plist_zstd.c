@@ -0,0 +1,194 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "xbps_api_impl.h"
+
+/*
+ * zstd compressed property lists.
+ *
+ * The package files metadata can be stored compressed with zstd (see
+ * XBPS_FLAG_ZSTD_METAFILES); compressed files are recognized by the
+ * zstd frame magic number and read transparently by
+ * xbps_plist_dictionary_from_file().
+ */
+
+#define ZSTD_MAGIC	"\x28\xb5\x2f\xfd"
+
+#ifdef HAVE_LIBZSTD
+void HIDDEN *
+xbps_zstd_compress(const void *src, size_t srclen, size_t *dstlen)
+{
+	void *dst;
+	size_t len;
+
+	len = ZSTD_compressBound(srclen);
+	if ((dst = malloc(len)) == NULL)
+		return NULL;
+	len = ZSTD_compress(dst, len, src, srclen, ZSTD_CLEVEL_DEFAULT);
+	if (ZSTD_isError(len)) {
+		free(dst);
+		errno = EINVAL;
+		return NULL;
+	}
+	*dstlen = len;
+	return dst;
+}
+
+char HIDDEN *
+xbps_zstd_decompress(const void *src, size_t srclen)
+{
+	ZSTD_DCtx *dctx;
+	ZSTD_inBuffer in = { src, srclen, 0 };
+	ZSTD_outBuffer out = { NULL, 0, 0 };
+	unsigned long long size;
+	size_t rv;
+	char *buf;
+
+	size = ZSTD_getFrameContentSize(src, srclen);
+	if (size == ZSTD_CONTENTSIZE_ERROR) {
+		errno = EINVAL;
+		return NULL;
+	}
+	out.size = size != ZSTD_CONTENTSIZE_UNKNOWN && size < SIZE_MAX ?
+	    size + 1 : srclen * 4 + 1;
+
+	if ((dctx = ZSTD_createDCtx()) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (;;) {
+		/* always leave room for the NUL terminator */
+		if ((buf = realloc(out.dst, out.size)) == NULL)
+			goto fail;
+		out.dst = buf;
+		out.size--;
+		rv = ZSTD_decompressStream(dctx, &out, &in);
+		out.size++;
+		if (ZSTD_isError(rv)) {
+			errno = EINVAL;
+			goto fail;
+		}
+		if (rv == 0 && in.pos == in.size)
+			break;
+		if (out.pos < out.size - 1) {
+			if (in.pos == in.size) {
+				/* truncated frame */
+				errno = EINVAL;
+				goto fail;
+			}
+			continue;
+		}
+		out.size *= 2;
+	}
+	ZSTD_freeDCtx(dctx);
+	buf = out.dst;
+	buf[out.pos] = '\0';
+	return buf;
+
+fail:
+	ZSTD_freeDCtx(dctx);
+	free(out.dst);
+	return NULL;
+}
+#else
+void HIDDEN *
+xbps_zstd_compress(const void *src UNUSED, size_t srclen UNUSED,
+		size_t *dstlen UNUSED)
+{
+	errno = ENOTSUP;
+	return NULL;
+}
+#endif
+
+/*
+ * Returns the NUL terminated contents of the plist `file', decompressed
+ * if it's zstd compressed, and its length in `len'. Other formats are
+ * returned as is.
+ */
+char HIDDEN *
+xbps_plist_read_file(const char *file, size_t *len)
+{
+	struct stat st;
+	char *src, *xml;
+	ssize_t rd;
+	size_t off;
+	int fd, serrno;
+
+	if ((fd = open(file, O_RDONLY|O_CLOEXEC)) == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1 || (src = malloc(st.st_size + 1)) == NULL) {
+		serrno = errno;
+		close(fd);
+		errno = serrno;
+		return NULL;
+	}
+	for (off = 0; off < (size_t)st.st_size; off += rd) {
+		rd = read(fd, src + off, st.st_size - off);
+		if (rd == -1 && errno == EINTR) {
+			rd = 0;
+			continue;
+		}
+		if (rd <= 0)
+			break;
+	}
+	close(fd);
+	if (off != (size_t)st.st_size) {
+		free(src);
+		errno = EIO;
+		return NULL;
+	}
+	src[off] = '\0';
+	*len = off;
+	if (off < sizeof(ZSTD_MAGIC)-1 ||
+	    memcmp(src, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)-1) != 0)
+		return src;
+
+	/* zstd compressed files metadata */
+#ifdef HAVE_LIBZSTD
+	xml = xbps_zstd_decompress(src, off);
+	serrno = errno;
+	free(src);
+	errno = serrno;
+	if (xml != NULL)
+		*len = strlen(xml);
+#else
+	free(src);
+	xml = NULL;
+	errno = ENOTSUP;
+#endif
+	return xml;
+}
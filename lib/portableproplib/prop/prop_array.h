@@ -33,6 +33,7 @@
 #ifndef _PROPLIB_PROP_ARRAY_H_
 #define	_PROPLIB_PROP_ARRAY_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <prop/prop_object.h>
 
@@ -72,6 +73,7 @@ bool		prop_array_externalize_to_file(prop_array_t, const char *);
 bool		prop_array_externalize_to_zfile(prop_array_t, const char *);
 prop_array_t	prop_array_internalize_from_file(const char *);
 prop_array_t	prop_array_internalize_from_zfile(const char *);
+prop_array_t	prop_array_internalize_from_zbuf(const char *, size_t);
 
 /*
  * Utility routines to make it more convenient to work with values
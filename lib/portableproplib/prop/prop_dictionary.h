@@ -72,6 +72,10 @@ bool		prop_dictionary_set_keysym(prop_dictionary_t,
 void		prop_dictionary_remove_keysym(prop_dictionary_t,
 					      prop_dictionary_keysym_t);
 
+prop_dictionary_keysym_t prop_dictionary_keysym_at(prop_dictionary_t,
+						   unsigned int);
+prop_object_t	prop_dictionary_get_at(prop_dictionary_t, unsigned int);
+
 bool		prop_dictionary_equals(prop_dictionary_t, prop_dictionary_t);
 
 char *		prop_dictionary_externalize(prop_dictionary_t);
@@ -83,6 +87,7 @@ bool		prop_dictionary_externalize_to_zfile(prop_dictionary_t,
 						     const char *);
 prop_dictionary_t prop_dictionary_internalize_from_file(const char *);
 prop_dictionary_t prop_dictionary_internalize_from_zfile(const char *);
+prop_dictionary_t prop_dictionary_internalize_from_zbuf(const char *, size_t);
 
 const char *	prop_dictionary_keysym_cstring_nocopy(prop_dictionary_keysym_t);
 
@@ -583,6 +583,13 @@ prop_array_get(prop_array_t pa, unsigned int idx)
 	if (! prop_object_is_array(pa))
 		return (NULL);
 
+	if (prop_array_is_immutable(pa)) {
+		/* Immutable arrays never change, no need to lock. */
+		if (idx < pa->pa_count)
+			po = pa->pa_array[idx];
+		return (po);
+	}
+
 	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
 	if (idx >= pa->pa_count)
 		goto out;
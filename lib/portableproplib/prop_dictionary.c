@@ -80,10 +80,21 @@ struct _prop_dict_entry {
 	prop_object_t			pde_objref;
 };
 
+/*
+ * Dictionaries created by prop_dictionary_copy() share the entry array
+ * of the original (copy-on-write), the array is duplicated by the first
+ * dictionary that modifies it.  The shared array holds one reference to
+ * each key and object, which is dropped by the last owner.
+ */
+struct _prop_dict_share {
+	uint32_t			pds_refcnt;
+};
+
 struct _prop_dictionary {
 	struct _prop_object	pd_obj;
 	_PROP_RWLOCK_DECL(pd_rwlock)
 	struct _prop_dict_entry	*pd_array;
+	struct _prop_dict_share	*pd_share;
 	unsigned int		pd_capacity;
 	unsigned int		pd_count;
 	int			pd_flags;
@@ -343,6 +354,20 @@ _prop_dictionary_free(prop_stack_t stack, prop_object_t *obj)
 	prop_dictionary_t pd = *obj;
 	prop_dictionary_keysym_t pdk;
 	prop_object_t po;
+	uint32_t refcnt;
+
+	if (pd->pd_share != NULL) {
+		_PROP_ATOMIC_DEC32_NV(&pd->pd_share->pds_refcnt, refcnt);
+		if (refcnt != 0) {
+			/* Array still in use by other dictionaries. */
+			pd->pd_array = NULL;
+			pd->pd_capacity = pd->pd_count = 0;
+		} else {
+			/* Last owner, release it as usual. */
+			_PROP_FREE(pd->pd_share, M_TEMP);
+		}
+		pd->pd_share = NULL;
+	}
 
 	_PROP_ASSERT(pd->pd_count <= pd->pd_capacity);
 	_PROP_ASSERT((pd->pd_capacity == 0 && pd->pd_array == NULL) ||
@@ -560,6 +585,7 @@ _prop_dictionary_alloc(unsigned int capacity)
 
 		_PROP_RWLOCK_INIT(pd->pd_rwlock);
 		pd->pd_array = array;
+		pd->pd_share = NULL;
 		pd->pd_capacity = capacity;
 		pd->pd_count = 0;
 		pd->pd_flags = 0;
@@ -596,6 +622,53 @@ _prop_dictionary_expand(prop_dictionary_t pd, unsigned int capacity)
 	return (true);
 }
 
+static bool
+_prop_dictionary_unshare(prop_dictionary_t pd)
+{
+	struct _prop_dict_share *share = pd->pd_share;
+	struct _prop_dict_entry *array, *oarray;
+	unsigned int idx;
+	uint32_t refcnt;
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	if (share == NULL)
+		return (true);
+
+	if (share->pds_refcnt == 1) {
+		/* We are the only owner, just take the array over. */
+		_PROP_FREE(share, M_TEMP);
+		pd->pd_share = NULL;
+		return (true);
+	}
+
+	oarray = pd->pd_array;
+	array = _PROP_CALLOC(pd->pd_capacity * sizeof(*array), M_PROP_DICT);
+	if (array == NULL)
+		return (false);
+	memcpy(array, oarray, pd->pd_count * sizeof(*array));
+	for (idx = 0; idx < pd->pd_count; idx++) {
+		prop_object_retain(array[idx].pde_key);
+		prop_object_retain(array[idx].pde_objref);
+	}
+	pd->pd_array = array;
+	pd->pd_share = NULL;
+
+	_PROP_ATOMIC_DEC32_NV(&share->pds_refcnt, refcnt);
+	if (refcnt == 0) {
+		/* Other owners went away meanwhile, drop the old array. */
+		for (idx = 0; idx < pd->pd_count; idx++) {
+			prop_object_release(oarray[idx].pde_key);
+			prop_object_release(oarray[idx].pde_objref);
+		}
+		_PROP_FREE(oarray, M_PROP_DICT);
+		_PROP_FREE(share, M_TEMP);
+	}
+	return (true);
+}
+
 static prop_object_t
 _prop_dictionary_iterator_next_object_locked(void *v)
 {
@@ -686,35 +759,44 @@ prop_dictionary_create_with_capacity(unsigned int capacity)
  *	to the number of objects stored int the original dictionary.  The new
  *	dictionary contains refrences to the original dictionary's objects,
  *	not copies of those objects (i.e. a shallow copy).
+ *
+ *	The entry array is shared with the original dictionary until
+ *	any of them is modified, so copying is O(1).
  */
 prop_dictionary_t
 prop_dictionary_copy(prop_dictionary_t opd)
 {
 	prop_dictionary_t pd;
-	prop_dictionary_keysym_t pdk;
-	prop_object_t po;
-	unsigned int idx;
 
 	if (! prop_object_is_dictionary(opd))
 		return (NULL);
 
-	_PROP_RWLOCK_RDLOCK(opd->pd_rwlock);
-
-	pd = _prop_dictionary_alloc(opd->pd_count);
-	if (pd != NULL) {
-		for (idx = 0; idx < opd->pd_count; idx++) {
-			pdk = opd->pd_array[idx].pde_key;
-			po = opd->pd_array[idx].pde_objref;
-
-			prop_object_retain(pdk);
-			prop_object_retain(po);
+	_PROP_RWLOCK_WRLOCK(opd->pd_rwlock);
 
-			pd->pd_array[idx].pde_key = pdk;
-			pd->pd_array[idx].pde_objref = po;
+	if (opd->pd_count == 0) {
+		pd = _prop_dictionary_alloc(0);
+		if (pd != NULL)
+			pd->pd_flags = opd->pd_flags;
+		goto out;
+	}
+	if (opd->pd_share == NULL) {
+		opd->pd_share = _PROP_MALLOC(sizeof(*opd->pd_share), M_TEMP);
+		if (opd->pd_share == NULL) {
+			pd = NULL;
+			goto out;
 		}
+		opd->pd_share->pds_refcnt = 1;
+	}
+	pd = _prop_dictionary_alloc(0);
+	if (pd != NULL) {
+		_PROP_ATOMIC_INC32(&opd->pd_share->pds_refcnt);
+		pd->pd_array = opd->pd_array;
+		pd->pd_share = opd->pd_share;
+		pd->pd_capacity = opd->pd_capacity;
 		pd->pd_count = opd->pd_count;
 		pd->pd_flags = opd->pd_flags;
 	}
+ out:
 	_PROP_RWLOCK_UNLOCK(opd->pd_rwlock);
 	return (pd);
 }
@@ -788,7 +870,8 @@ prop_dictionary_ensure_capacity(prop_dictionary_t pd, unsigned int capacity)
 
 	_PROP_RWLOCK_WRLOCK(pd->pd_rwlock);
 	if (capacity > pd->pd_capacity)
-		rv = _prop_dictionary_expand(pd, capacity);
+		rv = _prop_dictionary_unshare(pd) &&
+		    _prop_dictionary_expand(pd, capacity);
 	else
 		rv = true;
 	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
@@ -933,6 +1016,10 @@ prop_dictionary_get(prop_dictionary_t pd, const char *key)
 	if (! prop_object_is_dictionary(pd))
 		return (NULL);
 
+	/* Immutable dictionaries never change, no need to lock. */
+	if (prop_dictionary_is_immutable(pd))
+		return (_prop_dictionary_get(pd, key, true));
+
 	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
 	po = _prop_dictionary_get(pd, key, true);
 	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
@@ -962,6 +1049,52 @@ prop_dictionary_get_keysym(prop_dictionary_t pd, prop_dictionary_keysym_t pdk)
 	return (_prop_dictionary_get_keysym(pd, pdk, false));
 }
 
+/*
+ * prop_dictionary_keysym_at --
+ *	Return the keysym of the entry at the specified index, entries
+ *	are sorted by key as returned by prop_dictionary_iterator().
+ *	Allows to walk a dictionary without allocating an iterator.
+ */
+prop_dictionary_keysym_t
+prop_dictionary_keysym_at(prop_dictionary_t pd, unsigned int idx)
+{
+	prop_dictionary_keysym_t pdk = NULL;
+	bool locked;
+
+	if (! prop_object_is_dictionary(pd))
+		return (NULL);
+
+	if ((locked = !prop_dictionary_is_immutable(pd)))
+		_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	if (idx < pd->pd_count)
+		pdk = pd->pd_array[idx].pde_key;
+	if (locked)
+		_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	return (pdk);
+}
+
+/*
+ * prop_dictionary_get_at --
+ *	Return the object of the entry at the specified index.
+ */
+prop_object_t
+prop_dictionary_get_at(prop_dictionary_t pd, unsigned int idx)
+{
+	prop_object_t po = NULL;
+	bool locked;
+
+	if (! prop_object_is_dictionary(pd))
+		return (NULL);
+
+	if ((locked = !prop_dictionary_is_immutable(pd)))
+		_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	if (idx < pd->pd_count)
+		po = pd->pd_array[idx].pde_objref;
+	if (locked)
+		_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	return (po);
+}
+
 /*
  * prop_dictionary_set --
  *	Store a reference to an object at with the specified key.
@@ -987,7 +1120,16 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 
 	pde = _prop_dict_lookup(pd, key, &idx);
 	if (pde != NULL) {
-		prop_object_t opo = pde->pde_objref;
+		prop_object_t opo;
+
+		if (pde->pde_objref == po) {
+			rv = true;
+			goto out;
+		}
+		if (!_prop_dictionary_unshare(pd))
+			goto out;
+		pde = &pd->pd_array[idx];
+		opo = pde->pde_objref;
 		prop_object_retain(po);
 		pde->pde_objref = po;
 		prop_object_release(opo);
@@ -995,6 +1137,9 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 		goto out;
 	}
 
+	if (!_prop_dictionary_unshare(pd))
+		goto out;
+
 	pdk = _prop_dict_keysym_alloc(key);
 	if (pdk == NULL)
 		goto out;
@@ -1127,6 +1272,10 @@ prop_dictionary_remove(prop_dictionary_t pd, const char *key)
 	if (pde == NULL)
 		goto out;
 
+	if (!_prop_dictionary_unshare(pd))
+		goto out;
+	pde = &pd->pd_array[idx];
+
 	_prop_dictionary_remove(pd, pde, idx);
  out:
 	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
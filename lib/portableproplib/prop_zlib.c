@@ -27,6 +27,7 @@
 #include "prop_object_impl.h"
 
 #include <errno.h>
+#include <stdint.h>
 #include <zlib.h>
 
 #define _READ_CHUNK	8192
@@ -53,32 +54,27 @@ prop ## type ## _externalize_to_zfile(prop ## type ## _t obj, const char *fname)
 }											\
 											\
 prop ## type ## _t									\
-prop ## type ## _internalize_from_zfile(const char *fname)				\
+prop ## type ## _internalize_from_zbuf(const char *buf, size_t len)			\
 {											\
-	struct _prop_object_internalize_mapped_file *mf;				\
 	prop ## type ## _t obj = NULL;							\
 	z_stream strm;									\
 	unsigned char out[_READ_CHUNK+1];						\
-	char *uncomp_xml = NULL;							\
+	char *uncomp_xml = NULL, *p;							\
 	size_t have;									\
-	ssize_t totalsize = 0;								\
+	size_t totalsize = 0;								\
 	int rv = 0;									\
 											\
-	mf = _prop_object_internalize_map_file(fname);					\
-	if (mf == NULL)									\
-		return NULL;								\
-											\
 	/* If it's an ordinary uncompressed plist we are done */			\
-	obj = prop ## type ## _internalize(mf->poimf_xml);				\
+	obj = prop ## type ## _internalize(buf);					\
 	if (prop_object_type(obj) == PROP_TYPE_## objtype)				\
-		goto out;								\
+		return obj;								\
 											\
 	/* Output buffer (uncompressed) */						\
 	uncomp_xml = _PROP_MALLOC(_READ_CHUNK, M_TEMP);					\
 	if (uncomp_xml == NULL)								\
-		goto out;								\
+		return NULL;								\
 											\
-	/* Decompress the mmap'ed buffer with zlib */					\
+	/* Decompress the buffer with zlib */						\
 	strm.zalloc = Z_NULL;								\
 	strm.zfree = Z_NULL;								\
 	strm.opaque = Z_NULL;								\
@@ -87,10 +83,10 @@ prop ## type ## _internalize_from_zfile(const char *fname)				\
 											\
 	/* 15+16 to use gzip method */							\
 	if (inflateInit2(&strm, 15+16) != Z_OK)						\
-		goto out2;								\
+		goto out1;								\
 											\
-	strm.avail_in = mf->poimf_mapsize;						\
-	strm.next_in = (unsigned char *)mf->poimf_xml;					\
+	strm.avail_in = len;								\
+	strm.next_in = (unsigned char *)(uintptr_t)buf;					\
 											\
 	/* Inflate the input buffer and copy into 'uncomp_xml' */			\
 	do {										\
@@ -103,21 +99,38 @@ prop ## type ## _internalize_from_zfile(const char *fname)				\
 		case Z_NEED_DICT:							\
 		case Z_MEM_ERROR:							\
 			errno = EINVAL;							\
-			goto out1;							\
+			goto out2;							\
 		}									\
 		have = _READ_CHUNK - strm.avail_out;					\
 		totalsize += have;							\
-		uncomp_xml = _PROP_REALLOC(uncomp_xml, totalsize, M_TEMP);		\
+		if ((p = _PROP_REALLOC(uncomp_xml, totalsize + 1, M_TEMP)) == NULL)	\
+			goto out2;							\
+		uncomp_xml = p;								\
 		memcpy(uncomp_xml + totalsize - have, out, have);			\
+		uncomp_xml[totalsize] = '\0';						\
 	} while (strm.avail_out == 0);							\
 											\
-	/* we are done */								\
+	obj = prop ## type ## _internalize(uncomp_xml);					\
 out2:											\
 	(void)inflateEnd(&strm);							\
 out1:											\
-	obj = prop ## type ## _internalize(uncomp_xml);					\
 	_PROP_FREE(uncomp_xml, M_TEMP);							\
-out:											\
+											\
+	return obj;									\
+}											\
+											\
+prop ## type ## _t									\
+prop ## type ## _internalize_from_zfile(const char *fname)				\
+{											\
+	struct _prop_object_internalize_mapped_file *mf;				\
+	prop ## type ## _t obj;								\
+											\
+	mf = _prop_object_internalize_map_file(fname);					\
+	if (mf == NULL)									\
+		return NULL;								\
+											\
+	obj = prop ## type ## _internalize_from_zbuf(mf->poimf_xml,			\
+	    mf->poimf_mapsize);								\
 	_prop_object_internalize_unmap_file(mf);					\
 											\
 	return obj;									\
@@ -362,6 +362,18 @@ xbps_array_set_cstring_nocopy(xbps_array_t a, unsigned int i, const char *s)
 	return prop_array_set_cstring_nocopy(a, i, s);
 }
 
+const char *
+xbps_array_cstring_nocopy_at(xbps_array_t a, unsigned int i)
+{
+	xbps_object_t obj;
+
+	obj = prop_array_get(a, i);
+	if (prop_object_type(obj) != PROP_TYPE_STRING)
+		return NULL;
+
+	return prop_string_cstring_nocopy(obj);
+}
+
 bool
 xbps_array_add_and_rel(xbps_array_t a, xbps_object_t o)
 {
@@ -537,6 +549,18 @@ xbps_dictionary_remove_keysym(xbps_dictionary_t d, xbps_dictionary_keysym_t k)
 	prop_dictionary_remove_keysym(d, k);
 }
 
+xbps_dictionary_keysym_t
+xbps_dictionary_keysym_at(xbps_dictionary_t d, unsigned int i)
+{
+	return prop_dictionary_keysym_at(d, i);
+}
+
+xbps_object_t
+xbps_dictionary_get_at(xbps_dictionary_t d, unsigned int i)
+{
+	return prop_dictionary_get_at(d, i);
+}
+
 bool
 xbps_dictionary_equals(xbps_dictionary_t a, xbps_dictionary_t b)
 {
@@ -942,6 +966,8 @@ xbps_plist_array_from_file(struct xbps_handle *xhp, const char *f)
 	if (xbps_object_type(a) != XBPS_TYPE_ARRAY) {
 		xbps_dbg_printf(xhp,
 		    "xbps: failed to internalize array from %s\n", f);
+	} else {
+		xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
 	}
 	return a;
 }
@@ -949,12 +975,20 @@ xbps_plist_array_from_file(struct xbps_handle *xhp, const char *f)
 xbps_dictionary_t
 xbps_plist_dictionary_from_file(struct xbps_handle *xhp, const char *f)
 {
-	xbps_dictionary_t d;
+	xbps_dictionary_t d = NULL;
+	char *xml;
+	size_t len;
 
-	d = xbps_dictionary_internalize_from_zfile(f);
+	/* plain, gzip or zstd compressed (files metadata) */
+	if ((xml = xbps_plist_read_file(f, &len)) != NULL) {
+		d = prop_dictionary_internalize_from_zbuf(xml, len);
+		free(xml);
+	}
 	if (xbps_object_type(d) != XBPS_TYPE_DICTIONARY) {
 		xbps_dbg_printf(xhp,
 		    "xbps: failed to internalize dict from %s\n", f);
+	} else {
+		xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
 	}
 	return d;
 }
@@ -61,9 +61,29 @@ xbps_repo_path_with_name(struct xbps_handle *xhp, const char *url, const char *n
 	    url, xhp->target_arch ? xhp->target_arch : xhp->native_arch, name);
 }
 
+char *
+xbps_repo_archive_path(struct xbps_handle *xhp, const char *url)
+{
+	char *rpath, *repofile;
+
+	assert(xhp);
+	assert(url);
+
+	if (!xbps_repository_is_remote(url))
+		return xbps_repo_path(xhp, url);
+
+	if ((rpath = xbps_get_remote_repo_string(url)) == NULL)
+		return NULL;
+	repofile = xbps_xasprintf("%s/%s/%s-repodata", xhp->metadir, rpath,
+	    xhp->target_arch ? xhp->target_arch : xhp->native_arch);
+	free(rpath);
+	return repofile;
+}
+
 static xbps_dictionary_t
 repo_get_dict(struct xbps_repo *repo)
 {
+	xbps_dictionary_t d;
 	struct archive_entry *entry;
 	int rv;
 
@@ -77,7 +97,13 @@ repo_get_dict(struct xbps_repo *repo)
 		    archive_error_string(repo->ar));
 		return NULL;
 	}
-	return xbps_archive_get_dictionary(repo->ar, entry);
+	d = xbps_archive_get_dictionary(repo->ar, entry);
+	if (d != NULL && archive_entry_size(entry) > 0) {
+		repo->idx_size += (uint64_t)archive_entry_size(entry);
+		xbps_stats_mem_add(repo->xhp, XBPS_STATS_MEM_REPODATA,
+		    (uint64_t)archive_entry_size(entry));
+	}
+	return d;
 }
 
 bool
@@ -164,10 +190,16 @@ repo_open_local(struct xbps_repo *repo, const char *repofile)
 		return false;
 	}
 	xbps_dictionary_make_immutable(repo->idx);
+	xbps_stats_add(repo->xhp, XBPS_STATS_PLISTS_PARSED, 1);
 	repo->idxmeta = repo_get_dict(repo);
 	if (repo->idxmeta != NULL) {
 		repo->is_signed = true;
 		xbps_dictionary_make_immutable(repo->idxmeta);
+		xbps_stats_add(repo->xhp, XBPS_STATS_PLISTS_PARSED, 1);
+	}
+	if (archive_filter_bytes(repo->ar, 0) > 0) {
+		xbps_stats_add(repo->xhp, XBPS_STATS_BYTES_DECOMPRESSED,
+		    (uint64_t)archive_filter_bytes(repo->ar, 0));
 	}
 	/*
 	 * We don't need the archive anymore, we are only
@@ -199,12 +231,16 @@ static struct xbps_repo *
 repo_open_with_type(struct xbps_handle *xhp, const char *url, const char *name)
 {
 	struct xbps_repo *repo = NULL;
+	struct timespec ts;
 	const char *arch;
 	char *repofile = NULL;
 
 	assert(xhp);
 	assert(url);
 
+	XBPS_PROBE1(repo_open, url);
+	xbps_stats_start(&ts);
+
 	if (xhp->target_arch)
 		arch = xhp->target_arch;
 	else
@@ -236,6 +272,8 @@ repo_open_with_type(struct xbps_handle *xhp, const char *url, const char *name)
 	if (repo->is_remote && (xhp->flags & XBPS_FLAG_REPOS_MEMSYNC)) {
 		if (repo_open_remote(repo)) {
 			free(repofile);
+			xbps_stats_end(xhp, XBPS_STATS_REPO_OPEN, &ts);
+			XBPS_PROBE2(repo_open_done, url, 1);
 			return repo;
 		}
 		goto out;
@@ -252,12 +290,16 @@ repo_open_with_type(struct xbps_handle *xhp, const char *url, const char *name)
 	}
 	if (repo_open_local(repo, repofile)) {
 		free(repofile);
+		xbps_stats_end(xhp, XBPS_STATS_REPO_OPEN, &ts);
+		XBPS_PROBE2(repo_open_done, url, 1);
 		return repo;
 	}
 
 out:
 	free(repofile);
 	xbps_repo_release(repo);
+	xbps_stats_end(xhp, XBPS_STATS_REPO_OPEN, &ts);
+	XBPS_PROBE2(repo_open_done, url, 0);
 	return NULL;
 }
 
@@ -388,6 +430,7 @@ xbps_repo_release(struct xbps_repo *repo)
 	if (!repo)
 		return;
 
+	XBPS_PROBE1(repo_close, repo->uri);
 	xbps_repo_close(repo);
 
 	if (repo->idx != NULL) {
@@ -398,6 +441,7 @@ xbps_repo_release(struct xbps_repo *repo)
 		xbps_object_release(repo->idxmeta);
 		repo->idxmeta = NULL;
 	}
+	xbps_stats_mem_sub(repo->xhp, XBPS_STATS_MEM_REPODATA, repo->idx_size);
 	free(repo);
 }
 
@@ -411,6 +455,7 @@ xbps_repo_get_virtualpkg(struct xbps_repo *repo, const char *pkg)
 	if (!repo || !repo->idx || !pkg) {
 		return NULL;
 	}
+	xbps_stats_add(repo->xhp, XBPS_STATS_PKG_LOOKUPS, 1);
 	pkgd = xbps_find_virtualpkg_in_dict(repo->xhp, repo->idx, pkg);
 	if (!pkgd) {
 		return NULL;
@@ -445,6 +490,7 @@ xbps_repo_get_pkg(struct xbps_repo *repo, const char *pkg)
 	if (!repo || !repo->idx || !pkg) {
 		return NULL;
 	}
+	xbps_stats_add(repo->xhp, XBPS_STATS_PKG_LOOKUPS, 1);
 	/* Try matching vpkg from configuration files */
 	if ((pkgd = xbps_find_virtualpkg_in_conf(repo->xhp, repo->idx, pkg))) {
 		goto add;
@@ -479,17 +525,43 @@ xbps_repo_get_pkg_plist(struct xbps_handle *xhp, xbps_dictionary_t pkgd,
 		const char *plist)
 {
 	xbps_dictionary_t bpkgd;
-	char *url;
+	char *url, *buf;
+	bool indexed = false;
 
 	url = xbps_repository_pkg_path(xhp, pkgd);
 	if (url == NULL)
 		return NULL;
 
-	bpkgd = xbps_archive_fetch_plist(url, plist);
+	xbps_dictionary_get_bool(pkgd, "archive-index", &indexed);
+	buf = xbps_archive_fetch_member(url, plist, indexed);
 	free(url);
+	if (buf == NULL)
+		return NULL;
+
+	bpkgd = xbps_dictionary_internalize(buf);
+	free(buf);
 	return bpkgd;
 }
 
+int
+xbps_repo_get_pkg_file_into_fd(struct xbps_handle *xhp, xbps_dictionary_t pkgd,
+		const char *file, int fd)
+{
+	char *url;
+	int rv;
+	bool indexed = false;
+
+	url = xbps_repository_pkg_path(xhp, pkgd);
+	if (url == NULL)
+		return EINVAL;
+
+	xbps_dbg_printf(xhp, "matched pkg at %s\n", url);
+	xbps_dictionary_get_bool(pkgd, "archive-index", &indexed);
+	rv = xbps_archive_fetch_member_into_fd(url, file, indexed, fd);
+	free(url);
+	return rv;
+}
+
 static xbps_array_t
 revdeps_match(struct xbps_repo *repo, xbps_dictionary_t tpkgd, const char *str)
 {
@@ -0,0 +1,606 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_STRCASESTR
+# define _GNU_SOURCE	/* for strcasestr(3) */
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/**
+ * @file lib/repo_search.c
+ * @brief Repository search index routines
+ *
+ * The search index is stored next to the repository archive as
+ * <arch>-repodata.search and contains the pkgver, short_desc and
+ * provides of every package, plus a trigram index over them:
+ *
+ *	header | pkgs[npkgs] | trigrams[ntrigrams] | posts[nposts] | strings
+ *
+ * The index records the size and mtime of the repository archive (and
+ * of the staging archive for local repositories) it was generated from,
+ * and it's ignored if they don't match anymore.
+ */
+#define SEARCH_INDEX_MAGIC	"XBPSSIDX"
+#define SEARCH_INDEX_VERSION	1
+
+struct search_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t npkgs;
+	uint32_t ntrigrams;
+	uint32_t nposts;
+	uint32_t strsize;
+	uint32_t pad;
+	uint64_t repo_size;
+	int64_t repo_mtime_sec;
+	int64_t repo_mtime_nsec;
+	uint64_t stage_size;
+	int64_t stage_mtime_sec;
+	int64_t stage_mtime_nsec;
+};
+
+struct search_pkg {
+	uint32_t pkgver;
+	uint32_t desc;
+	uint32_t provides;
+};
+
+struct search_trigram {
+	uint32_t trigram;
+	uint32_t off;
+	uint32_t count;
+};
+
+struct search_buf {
+	char *data;
+	size_t len, size;
+};
+
+static char *
+search_index_path(const char *repofile)
+{
+	return xbps_xasprintf("%s.search", repofile);
+}
+
+/*
+ * Returns the state of the repository archive in \a repost, and of the
+ * staging archive merged by xbps_repo_open() in \a stagest (zeroed if
+ * there's none).
+ */
+static bool
+search_repo_stat(struct xbps_handle *xhp, const char *uri,
+		const char *repofile, struct stat *repost, struct stat *stagest)
+{
+	char *stagefile;
+
+	memset(stagest, 0, sizeof(*stagest));
+	if (stat(repofile, repost) == -1)
+		return false;
+	if (xbps_repository_is_remote(uri))
+		return true;
+
+	stagefile = xbps_repo_path_with_name(xhp, uri, "stagedata");
+	if (stat(stagefile, stagest) == -1) {
+		if (errno != ENOENT) {
+			free(stagefile);
+			return false;
+		}
+		memset(stagest, 0, sizeof(*stagest));
+	}
+	free(stagefile);
+	return true;
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static inline uint32_t
+trigram_fold(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 'a';
+	return c;
+}
+
+static inline uint32_t
+trigram_at(const char *s)
+{
+	const unsigned char *p = (const unsigned char *)s;
+
+	return trigram_fold(p[0]) << 16 | trigram_fold(p[1]) << 8 |
+	    trigram_fold(p[2]);
+}
+
+static bool
+buf_reserve(struct search_buf *b, size_t len)
+{
+	char *p;
+	size_t size;
+
+	if (b->len + len <= b->size)
+		return true;
+
+	size = b->size ? b->size : 4096;
+	while (size < b->len + len)
+		size *= 2;
+	if ((p = realloc(b->data, size)) == NULL)
+		return false;
+	b->data = p;
+	b->size = size;
+	return true;
+}
+
+static bool
+buf_append(struct search_buf *b, const void *data, size_t len)
+{
+	if (!buf_reserve(b, len))
+		return false;
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return true;
+}
+
+static bool
+add_trigrams(struct search_buf *tg, const char *s, uint32_t pkgidx)
+{
+	uint64_t t;
+	size_t len = strlen(s);
+
+	for (size_t i = 0; i + 3 <= len; i++) {
+		t = (uint64_t)trigram_at(s + i) << 32 | pkgidx;
+		if (!buf_append(tg, &t, sizeof(t)))
+			return false;
+	}
+	return true;
+}
+
+static int
+cmp_uint64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+search_index_write(struct xbps_handle *xhp, const char *repofile,
+		struct stat *repost, struct stat *stagest, xbps_dictionary_t idx)
+{
+	struct search_hdr hdr;
+	struct search_buf pkgs = { 0 }, strs = { 0 }, tg = { 0 };
+	struct search_buf trigrams = { 0 }, posts = { 0 };
+	struct search_trigram st;
+	xbps_array_t allkeys, provides;
+	xbps_dictionary_t pkgd;
+	uint64_t *tv;
+	size_t ntv;
+	char *path = NULL, *tname = NULL;
+	int fd = -1, rv = 0;
+
+	if (xbps_object_type(idx) != XBPS_TYPE_DICTIONARY)
+		return EINVAL;
+
+	/* offset 0 is both the empty string and the empty provides list */
+	if (!buf_append(&strs, "\0", 2)) {
+		rv = ENOMEM;
+		goto out;
+	}
+
+	allkeys = xbps_dictionary_all_keys(idx);
+	for (unsigned int i = 0; i < xbps_array_count(allkeys); i++) {
+		struct search_pkg sp = { 0 };
+		const char *pkgver = NULL, *desc = NULL, *str = NULL;
+		uint32_t pkgidx = pkgs.len / sizeof(sp);
+
+		pkgd = xbps_dictionary_get_keysym(idx, xbps_array_get(allkeys, i));
+		if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+			continue;
+		xbps_dictionary_get_cstring_nocopy(pkgd, "short_desc", &desc);
+
+		sp.pkgver = strs.len;
+		if (!buf_append(&strs, pkgver, strlen(pkgver)+1) ||
+		    !add_trigrams(&tg, pkgver, pkgidx)) {
+			rv = ENOMEM;
+			break;
+		}
+		if (desc != NULL) {
+			sp.desc = strs.len;
+			if (!buf_append(&strs, desc, strlen(desc)+1) ||
+			    !add_trigrams(&tg, desc, pkgidx)) {
+				rv = ENOMEM;
+				break;
+			}
+		}
+		provides = xbps_dictionary_get(pkgd, "provides");
+		if (xbps_array_count(provides) > 0) {
+			sp.provides = strs.len;
+			for (unsigned int x = 0; x < xbps_array_count(provides); x++) {
+				xbps_array_get_cstring_nocopy(provides, x, &str);
+				if (!buf_append(&strs, str, strlen(str)+1) ||
+				    !add_trigrams(&tg, str, pkgidx)) {
+					rv = ENOMEM;
+					break;
+				}
+			}
+			if (rv != 0 || !buf_append(&strs, "", 1)) {
+				rv = ENOMEM;
+				break;
+			}
+		}
+		if (!buf_append(&pkgs, &sp, sizeof(sp))) {
+			rv = ENOMEM;
+			break;
+		}
+	}
+	xbps_object_release(allkeys);
+	if (rv != 0)
+		goto out;
+
+	/*
+	 * Sort all (trigram, package) pairs and collapse them into
+	 * a sorted trigram table with their posting lists.
+	 */
+	tv = (uint64_t *)(void *)tg.data;
+	ntv = tg.len / sizeof(*tv);
+	qsort(tv, ntv, sizeof(*tv), cmp_uint64);
+	for (size_t i = 0; i < ntv; i++) {
+		uint32_t pkgidx = (uint32_t)tv[i];
+
+		if (i > 0 && tv[i] == tv[i-1])
+			continue;
+		if (i == 0 || (tv[i] >> 32) != (tv[i-1] >> 32)) {
+			st.trigram = tv[i] >> 32;
+			st.off = posts.len / sizeof(pkgidx);
+			st.count = 0;
+			if (!buf_append(&trigrams, &st, sizeof(st))) {
+				rv = ENOMEM;
+				goto out;
+			}
+		}
+		((struct search_trigram *)(void *)(trigrams.data + trigrams.len))[-1].count++;
+		if (!buf_append(&posts, &pkgidx, sizeof(pkgidx))) {
+			rv = ENOMEM;
+			goto out;
+		}
+	}
+	/* keep the sections 4 bytes aligned */
+	while (strs.len % sizeof(uint32_t)) {
+		if (!buf_append(&strs, "", 1)) {
+			rv = ENOMEM;
+			goto out;
+		}
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SEARCH_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = SEARCH_INDEX_VERSION;
+	hdr.npkgs = pkgs.len / sizeof(struct search_pkg);
+	hdr.ntrigrams = trigrams.len / sizeof(struct search_trigram);
+	hdr.nposts = posts.len / sizeof(uint32_t);
+	hdr.strsize = strs.len;
+	hdr.repo_size = (uint64_t)repost->st_size;
+	hdr.repo_mtime_sec = repost->st_mtim.tv_sec;
+	hdr.repo_mtime_nsec = repost->st_mtim.tv_nsec;
+	hdr.stage_size = (uint64_t)stagest->st_size;
+	hdr.stage_mtime_sec = stagest->st_mtim.tv_sec;
+	hdr.stage_mtime_nsec = stagest->st_mtim.tv_nsec;
+
+	path = search_index_path(repofile);
+	tname = xbps_xasprintf("%s.XXXXXXXXXX", path);
+	if ((fd = mkstemp(tname)) == -1) {
+		rv = errno;
+		xbps_dbg_printf(xhp, "[repo] `%s' failed to create search "
+		    "index: %s\n", path, strerror(rv));
+		goto out;
+	}
+	if (write_all(fd, &hdr, sizeof(hdr)) == -1 ||
+	    write_all(fd, pkgs.data, pkgs.len) == -1 ||
+	    write_all(fd, trigrams.data, trigrams.len) == -1 ||
+	    write_all(fd, posts.data, posts.len) == -1 ||
+	    write_all(fd, strs.data, strs.len) == -1 ||
+	    fchmod(fd, 0644) == -1) {
+		rv = errno;
+		unlink(tname);
+		goto out;
+	}
+	if (rename(tname, path) == -1) {
+		rv = errno;
+		unlink(tname);
+		goto out;
+	}
+	xbps_dbg_printf(xhp, "[repo] `%s' search index with %u packages "
+	    "and %u trigrams written\n", path, hdr.npkgs, hdr.ntrigrams);
+out:
+	if (fd != -1)
+		close(fd);
+	free(path);
+	free(tname);
+	free(pkgs.data);
+	free(strs.data);
+	free(tg.data);
+	free(trigrams.data);
+	free(posts.data);
+	return rv;
+}
+
+struct search_index {
+	void *map;
+	size_t maplen;
+	const struct search_hdr *hdr;
+	const struct search_pkg *pkgs;
+	const struct search_trigram *trigrams;
+	const uint32_t *posts;
+	const char *strs;
+};
+
+static bool
+search_index_open(struct xbps_handle *xhp, const char *uri,
+		const char *repofile, struct search_index *si)
+{
+	struct stat st, stagest;
+	size_t filelen, need;
+	char *path;
+	const char *p;
+	bool ok;
+
+	if (!search_repo_stat(xhp, uri, repofile, &st, &stagest))
+		return false;
+
+	path = search_index_path(repofile);
+	ok = xbps_mmap_file(path, &si->map, &si->maplen, &filelen);
+	if (!ok) {
+		xbps_dbg_printf(xhp, "[repo] `%s' no search index: %s\n",
+		    path, strerror(errno));
+		free(path);
+		return false;
+	}
+	p = si->map;
+	si->hdr = si->map;
+	need = sizeof(*si->hdr);
+	if (filelen < need ||
+	    memcmp(si->hdr->magic, SEARCH_INDEX_MAGIC, sizeof(si->hdr->magic)) ||
+	    si->hdr->version != SEARCH_INDEX_VERSION) {
+		xbps_dbg_printf(xhp, "[repo] `%s' unknown search index format\n", path);
+		goto fail;
+	}
+	if (si->hdr->repo_size != (uint64_t)st.st_size ||
+	    si->hdr->repo_mtime_sec != st.st_mtim.tv_sec ||
+	    si->hdr->repo_mtime_nsec != st.st_mtim.tv_nsec ||
+	    si->hdr->stage_size != (uint64_t)stagest.st_size ||
+	    si->hdr->stage_mtime_sec != stagest.st_mtim.tv_sec ||
+	    si->hdr->stage_mtime_nsec != stagest.st_mtim.tv_nsec) {
+		xbps_dbg_printf(xhp, "[repo] `%s' search index is stale\n", path);
+		goto fail;
+	}
+	need += (size_t)si->hdr->npkgs * sizeof(struct search_pkg) +
+	    (size_t)si->hdr->ntrigrams * sizeof(struct search_trigram) +
+	    (size_t)si->hdr->nposts * sizeof(uint32_t) + si->hdr->strsize;
+	if (filelen != need || si->hdr->strsize < 2) {
+		xbps_dbg_printf(xhp, "[repo] `%s' truncated search index\n", path);
+		goto fail;
+	}
+	p += sizeof(*si->hdr);
+	si->pkgs = (const void *)p;
+	p += si->hdr->npkgs * sizeof(struct search_pkg);
+	si->trigrams = (const void *)p;
+	p += si->hdr->ntrigrams * sizeof(struct search_trigram);
+	si->posts = (const void *)p;
+	p += si->hdr->nposts * sizeof(uint32_t);
+	si->strs = p;
+	free(path);
+	return true;
+fail:
+	(void)munmap(si->map, si->maplen);
+	free(path);
+	return false;
+}
+
+static const struct search_trigram *
+search_index_lookup(struct search_index *si, uint32_t trigram)
+{
+	const struct search_trigram *st;
+	uint32_t lo = 0, hi = si->hdr->ntrigrams;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		st = &si->trigrams[mid];
+		if (st->trigram == trigram)
+			return st;
+		if (st->trigram < trigram)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+static bool
+search_index_str(struct search_index *si, uint32_t off, const char **str)
+{
+	if (off >= si->hdr->strsize)
+		return false;
+	*str = si->strs + off;
+	return memchr(*str, '\0', si->hdr->strsize - off) != NULL;
+}
+
+static bool
+match_provides(struct search_index *si, uint32_t off, const char *pat,
+		bool pkgver)
+{
+	char pkgname[XBPS_NAME_SIZE];
+	const char *str;
+
+	while (search_index_str(si, off, &str) && *str != '\0') {
+		if (pkgver) {
+			if (strcmp(str, pat) == 0)
+				return true;
+		} else if (xbps_pkg_name(pkgname, sizeof(pkgname), str) &&
+		    strcmp(pkgname, pat) == 0) {
+			return true;
+		}
+		off += strlen(str) + 1;
+	}
+	return false;
+}
+
+int
+xbps_repo_search_index(struct xbps_handle *xhp, const char *uri,
+		const char *pat,
+		int (*fn)(struct xbps_handle *, const char *, const char *, void *, bool *),
+		void *arg)
+{
+	struct search_index si;
+	const struct search_trigram *st, *best = NULL;
+	char *repofile;
+	size_t patlen;
+	uint32_t count;
+	int rv = 0;
+	bool done = false, pkgver;
+
+	assert(xhp);
+	assert(uri);
+	assert(pat);
+	assert(fn);
+
+	/* package patterns can't be looked up in the trigram index */
+	if (xbps_pkgpattern_version(pat) || strpbrk(pat, "<>*?[]") != NULL)
+		return ENOTSUP;
+
+	if ((repofile = xbps_repo_archive_path(xhp, uri)) == NULL)
+		return ENOENT;
+	if (!search_index_open(xhp, uri, repofile, &si)) {
+		free(repofile);
+		return ENOENT;
+	}
+	free(repofile);
+
+	/*
+	 * Use the shortest posting list of all trigrams in the pattern
+	 * as candidates, a missing trigram means there can't be a match.
+	 */
+	patlen = strlen(pat);
+	for (size_t i = 0; i + 3 <= patlen; i++) {
+		if ((st = search_index_lookup(&si, trigram_at(pat + i))) == NULL)
+			goto out;
+		if (best == NULL || st->count < best->count)
+			best = st;
+	}
+	if (best != NULL &&
+	    ((size_t)best->off + best->count > si.hdr->nposts)) {
+		rv = EINVAL;
+		goto out;
+	}
+	count = best ? best->count : si.hdr->npkgs;
+	pkgver = xbps_pkg_version(pat) != NULL;
+
+	for (uint32_t i = 0; i < count && !done; i++) {
+		const struct search_pkg *sp;
+		const char *pv, *desc;
+		uint32_t pkgidx = best ? si.posts[best->off + i] : i;
+
+		if (pkgidx >= si.hdr->npkgs) {
+			rv = EINVAL;
+			break;
+		}
+		sp = &si.pkgs[pkgidx];
+		if (!search_index_str(&si, sp->pkgver, &pv) ||
+		    !search_index_str(&si, sp->desc, &desc)) {
+			rv = EINVAL;
+			break;
+		}
+		if (strcasestr(pv, pat) == NULL &&
+		    strcasestr(desc, pat) == NULL &&
+		    !match_provides(&si, sp->provides, pat, pkgver))
+			continue;
+
+		if ((rv = (*fn)(xhp, pv, desc, arg, &done)) != 0)
+			break;
+	}
+out:
+	(void)munmap(si.map, si.maplen);
+	return rv;
+}
+
+int
+xbps_repo_search_index_update(struct xbps_handle *xhp, const char *uri)
+{
+	struct search_index si;
+	struct stat repost, stagest;
+	struct xbps_repo *repo;
+	char *repofile;
+	int rv;
+
+	assert(xhp);
+	assert(uri);
+
+	if ((repofile = xbps_repo_archive_path(xhp, uri)) == NULL)
+		return ENOENT;
+	if (search_index_open(xhp, uri, repofile, &si)) {
+		(void)munmap(si.map, si.maplen);
+		free(repofile);
+		return 0;
+	}
+	/*
+	 * Get the state of the archives before opening them, so that
+	 * a concurrent update makes the index stale instead of wrong.
+	 */
+	if (!search_repo_stat(xhp, uri, repofile, &repost, &stagest) ||
+	    (repo = xbps_repo_open(xhp, uri)) == NULL) {
+		rv = errno ? errno : ENOENT;
+		free(repofile);
+		return rv;
+	}
+	rv = search_index_write(xhp, repofile, &repost, &stagest, repo->idx);
+	xbps_repo_release(repo);
+	free(repofile);
+	return rv;
+}
@@ -77,7 +77,7 @@ xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 	mode_t prev_umask;
 	const char *arch, *fetchstr = NULL;
 	char *repodata, *lrepodir, *uri_fixedp;
-	int rv = 0;
+	int r, rv = 0;
 
 	assert(uri != NULL);
 
@@ -141,8 +141,14 @@ xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 		    fetchLastErrCode != 0 ? fetchLastErrCode : errno, NULL,
 		    "[reposync] failed to fetch file `%s': %s",
 		    repodata, fetchstr ? fetchstr : strerror(errno));
-	} else if (rv == 1)
-		rv = 0;
+	} else {
+		if (rv == 1)
+			rv = 0;
+		/* (re)generate the search index if it's stale or missing */
+		if ((r = xbps_repo_search_index_update(xhp, uri)) != 0)
+			xbps_dbg_printf(xhp, "[reposync] failed to update "
+			    "search index for `%s': %s\n", uri, strerror(r));
+	}
 	umask(prev_umask);
 
 	free(repodata);
@@ -49,9 +49,6 @@ typedef enum {
 	REVDEPS_PKG
 } pkg_repo_type_t;
 
-static SIMPLEQ_HEAD(rpool_head, xbps_repo) rpool_queue =
-    SIMPLEQ_HEAD_INITIALIZER(rpool_queue);
-
 /**
  * @file lib/rpool.c
  * @brief Repository pool routines
@@ -77,6 +74,7 @@ xbps_rpool_sync(struct xbps_handle *xhp, const char *uri)
 			continue;
 		}
 	}
+	xbps_cb_flush(xhp);
 	return 0;
 }
 
@@ -86,7 +84,7 @@ xbps_regget_repo(struct xbps_handle *xhp, const char *url)
 	struct xbps_repo *repo;
 	const char *repouri = NULL;
 
-	if (SIMPLEQ_EMPTY(&rpool_queue)) {
+	if (SIMPLEQ_EMPTY(&xhp->rpool)) {
 		/* iterate until we have a match */
 		for (unsigned int i = 0; i < xbps_array_count(xhp->repositories); i++) {
 			xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
@@ -97,11 +95,11 @@ xbps_regget_repo(struct xbps_handle *xhp, const char *url)
 			if (!repo)
 				return NULL;
 
-			SIMPLEQ_INSERT_TAIL(&rpool_queue, repo, entries);
+			SIMPLEQ_INSERT_TAIL(&xhp->rpool, repo, entries);
 			xbps_dbg_printf(xhp, "[rpool] `%s' registered.\n", repouri);
 		}
 	}
-	SIMPLEQ_FOREACH(repo, &rpool_queue, entries)
+	SIMPLEQ_FOREACH(repo, &xhp->rpool, entries)
 		if (strcmp(url, repo->uri) == 0)
 			return repo;
 
@@ -109,11 +107,11 @@ xbps_regget_repo(struct xbps_handle *xhp, const char *url)
 }
 
 struct xbps_repo *
-xbps_rpool_get_repo(const char *url)
+xbps_rpool_get_repo(struct xbps_handle *xhp, const char *url)
 {
 	struct xbps_repo *repo;
 
-	SIMPLEQ_FOREACH(repo, &rpool_queue, entries)
+	SIMPLEQ_FOREACH(repo, &xhp->rpool, entries)
 		if (strcmp(url, repo->uri) == 0)
 			return repo;
 
@@ -125,11 +123,14 @@ xbps_rpool_release(struct xbps_handle *xhp)
 {
 	struct xbps_repo *repo;
 
-	while ((repo = SIMPLEQ_FIRST(&rpool_queue))) {
-	       SIMPLEQ_REMOVE(&rpool_queue, repo, xbps_repo, entries);
+	if (xhp == NULL)
+		return;
+
+	while ((repo = SIMPLEQ_FIRST(&xhp->rpool))) {
+	       SIMPLEQ_REMOVE(&xhp->rpool, repo, xbps_repo, entries);
 	       xbps_repo_release(repo);
 	}
-	if (xhp && xhp->repositories) {
+	if (xhp->repositories) {
 		xbps_object_release(xhp->repositories);
 		xhp->repositories = NULL;
 	}
@@ -152,13 +153,13 @@ again:
 	for (unsigned int i = n; i < xbps_array_count(xhp->repositories); i++, n++) {
 		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
 		xbps_dbg_printf(xhp, "[rpool] checking `%s' at index %u\n", repouri, n);
-		if ((repo = xbps_rpool_get_repo(repouri)) == NULL) {
+		if ((repo = xbps_rpool_get_repo(xhp, repouri)) == NULL) {
 			repo = xbps_repo_open(xhp, repouri);
 			if (!repo) {
 				xbps_repo_remove(xhp, repouri);
 				goto again;
 			}
-			SIMPLEQ_INSERT_TAIL(&rpool_queue, repo, entries);
+			SIMPLEQ_INSERT_TAIL(&xhp->rpool, repo, entries);
 			xbps_dbg_printf(xhp, "[rpool] `%s' registered.\n", repouri);
 		}
 		foundrepo = true;
@@ -355,7 +356,6 @@ xbps_rpool_get_pkg_plist(struct xbps_handle *xhp,
 			 const char *plistf)
 {
 	xbps_dictionary_t pkgd = NULL, plistd = NULL;
-	char *url;
 
 	assert(pkg != NULL);
 	assert(plistf != NULL);
@@ -372,13 +372,7 @@ xbps_rpool_get_pkg_plist(struct xbps_handle *xhp,
 	    ((pkgd = xbps_rpool_get_virtualpkg(xhp, pkg)) == NULL))
 		goto out;
 
-	url = xbps_repository_pkg_path(xhp, pkgd);
-	if (url == NULL) {
-		errno = EINVAL;
-		goto out;
-	}
-	plistd = xbps_archive_fetch_plist(url, plistf);
-	free(url);
+	plistd = xbps_repo_get_pkg_plist(xhp, pkgd, plistf);
 
 out:
 	if (plistd == NULL)
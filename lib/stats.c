@@ -0,0 +1,272 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "xbps_api_impl.h"
+
+/**
+ * @file lib/stats.c
+ * @brief Per phase timings, counters and memory accounting
+ */
+
+static const char *phase_names[XBPS_STATS_PHASE_MAX] = {
+	[XBPS_STATS_CONF] = "conf",
+	[XBPS_STATS_PKGDB_LOAD] = "pkgdb-load",
+	[XBPS_STATS_REPO_OPEN] = "repo-open",
+	[XBPS_STATS_SOLVE] = "solve",
+	[XBPS_STATS_DOWNLOAD] = "download",
+	[XBPS_STATS_VERIFY] = "verify",
+	[XBPS_STATS_INTERNALIZE] = "internalize",
+	[XBPS_STATS_FILES] = "files",
+	[XBPS_STATS_UNPACK] = "unpack",
+	[XBPS_STATS_CONFIGURE] = "configure",
+	[XBPS_STATS_PKGDB_FLUSH] = "pkgdb-flush",
+	[XBPS_STATS_SYNC] = "sync",
+};
+
+static const char *counter_names[XBPS_STATS_COUNTER_MAX] = {
+	[XBPS_STATS_BYTES_DECOMPRESSED] = "bytes-decompressed",
+	[XBPS_STATS_PLISTS_PARSED] = "plists-parsed",
+	[XBPS_STATS_PKG_LOOKUPS] = "pkg-lookups",
+	[XBPS_STATS_FILES_HASHED] = "files-hashed",
+	[XBPS_STATS_SCRIPTS_RUN] = "scripts-run",
+};
+
+static const char *mem_names[XBPS_STATS_MEM_MAX] = {
+	[XBPS_STATS_MEM_REPODATA] = "repodata",
+	[XBPS_STATS_MEM_PKGDB] = "pkgdb",
+	[XBPS_STATS_MEM_PKG_PLISTS] = "pkg-plists",
+	[XBPS_STATS_MEM_SCRIPTS] = "scripts",
+	[XBPS_STATS_MEM_FILES_TABLE] = "files-table",
+	[XBPS_STATS_MEM_ARCHIVE] = "archive",
+};
+
+void HIDDEN
+xbps_stats_start(struct timespec *ts)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	(void)clock_gettime(CLOCK_MONOTONIC, ts);
+#else
+	struct timeval tv;
+
+	(void)gettimeofday(&tv, NULL);
+	ts->tv_sec = tv.tv_sec;
+	ts->tv_nsec = tv.tv_usec * 1000;
+#endif
+}
+
+/*
+ * The counters may be updated from the worker threads of
+ * the *_foreach_cb_multi() functions.
+ */
+static void
+stats_inc(uint64_t *p, uint64_t val)
+{
+#ifdef HAVE_ATOMICS
+	__atomic_fetch_add(p, val, __ATOMIC_RELAXED);
+#else
+	*p += val;
+#endif
+}
+
+void HIDDEN
+xbps_stats_end(struct xbps_handle *xhp, xbps_stats_phase_t phase,
+		const struct timespec *start)
+{
+	struct timespec now;
+	int64_t ns;
+
+	xbps_stats_start(&now);
+	ns = (int64_t)(now.tv_sec - start->tv_sec) * 1000000000 +
+	    (now.tv_nsec - start->tv_nsec);
+	if (ns < 0)
+		ns = 0;
+	stats_inc(&xhp->stats.phase_ns[phase], (uint64_t)ns);
+	stats_inc(&xhp->stats.phase_count[phase], 1);
+}
+
+void HIDDEN
+xbps_stats_add(struct xbps_handle *xhp, xbps_stats_counter_t counter,
+		uint64_t val)
+{
+	stats_inc(&xhp->stats.counters[counter], val);
+}
+
+static void
+stats_max(uint64_t *p, uint64_t val)
+{
+#ifdef HAVE_ATOMICS
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while (val > cur && !__atomic_compare_exchange_n(p, &cur, val, true,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+#else
+	if (val > *p)
+		*p = val;
+#endif
+}
+
+void HIDDEN
+xbps_stats_mem_add(struct xbps_handle *xhp, xbps_stats_mem_t mem,
+		uint64_t val)
+{
+	uint64_t cur, total;
+
+#ifdef HAVE_ATOMICS
+	cur = __atomic_add_fetch(&xhp->stats.mem[mem], val, __ATOMIC_RELAXED);
+	total = __atomic_add_fetch(&xhp->stats.mem_total, val, __ATOMIC_RELAXED);
+#else
+	cur = xhp->stats.mem[mem] += val;
+	total = xhp->stats.mem_total += val;
+#endif
+	stats_max(&xhp->stats.mem_peak[mem], cur);
+	stats_max(&xhp->stats.mem_total_peak, total);
+}
+
+void HIDDEN
+xbps_stats_mem_sub(struct xbps_handle *xhp, xbps_stats_mem_t mem,
+		uint64_t val)
+{
+	stats_inc(&xhp->stats.mem[mem], -val);
+	stats_inc(&xhp->stats.mem_total, -val);
+}
+
+/*
+ * The low memory mode is used if requested explicitly, or once the
+ * accounted memory reaches the budget.
+ */
+bool HIDDEN
+xbps_low_memory(struct xbps_handle *xhp)
+{
+	if (xhp->flags & XBPS_FLAG_LOW_MEMORY)
+		return true;
+	if (xhp->memory_budget == 0)
+		return false;
+	return xhp->stats.mem_total >= xhp->memory_budget;
+}
+
+const char *
+xbps_stats_phase_name(xbps_stats_phase_t phase)
+{
+	if ((unsigned int)phase >= XBPS_STATS_PHASE_MAX)
+		return NULL;
+	return phase_names[phase];
+}
+
+const char *
+xbps_stats_counter_name(xbps_stats_counter_t counter)
+{
+	if ((unsigned int)counter >= XBPS_STATS_COUNTER_MAX)
+		return NULL;
+	return counter_names[counter];
+}
+
+const char *
+xbps_stats_mem_name(xbps_stats_mem_t mem)
+{
+	if ((unsigned int)mem >= XBPS_STATS_MEM_MAX)
+		return NULL;
+	return mem_names[mem];
+}
+
+static bool
+mem_set(xbps_dictionary_t memory, const char *name, uint64_t cur,
+		uint64_t peak)
+{
+	xbps_dictionary_t memd;
+	bool ok;
+
+	if ((memd = xbps_dictionary_create()) == NULL)
+		return false;
+	ok = xbps_dictionary_set_uint64(memd, "current", cur) &&
+	    xbps_dictionary_set_uint64(memd, "peak", peak) &&
+	    xbps_dictionary_set(memory, name, memd);
+	xbps_object_release(memd);
+	return ok;
+}
+
+xbps_dictionary_t
+xbps_stats_dictionary(struct xbps_handle *xhp)
+{
+	xbps_dictionary_t d, phases, counters, memory, phased;
+	bool ok = true;
+
+	assert(xhp);
+
+	d = xbps_dictionary_create();
+	phases = xbps_dictionary_create();
+	counters = xbps_dictionary_create();
+	memory = xbps_dictionary_create();
+	if (d == NULL || phases == NULL || counters == NULL || memory == NULL) {
+		ok = false;
+		goto out;
+	}
+	for (unsigned int i = 0; ok && i < XBPS_STATS_PHASE_MAX; i++) {
+		if ((phased = xbps_dictionary_create()) == NULL) {
+			ok = false;
+			break;
+		}
+		ok = xbps_dictionary_set_uint64(phased, "time-ns",
+		    xhp->stats.phase_ns[i]) &&
+		    xbps_dictionary_set_uint64(phased, "count",
+		    xhp->stats.phase_count[i]) &&
+		    xbps_dictionary_set(phases, phase_names[i], phased);
+		xbps_object_release(phased);
+	}
+	for (unsigned int i = 0; ok && i < XBPS_STATS_COUNTER_MAX; i++) {
+		ok = xbps_dictionary_set_uint64(counters, counter_names[i],
+		    xhp->stats.counters[i]);
+	}
+	for (unsigned int i = 0; ok && i < XBPS_STATS_MEM_MAX; i++) {
+		ok = mem_set(memory, mem_names[i], xhp->stats.mem[i],
+		    xhp->stats.mem_peak[i]);
+	}
+	if (ok) {
+		ok = mem_set(memory, "total", xhp->stats.mem_total,
+		    xhp->stats.mem_total_peak);
+	}
+	if (ok) {
+		ok = xbps_dictionary_set(d, "phases", phases) &&
+		    xbps_dictionary_set(d, "counters", counters) &&
+		    xbps_dictionary_set(d, "memory", memory);
+	}
+out:
+	if (phases != NULL)
+		xbps_object_release(phases);
+	if (counters != NULL)
+		xbps_object_release(counters);
+	if (memory != NULL)
+		xbps_object_release(memory);
+	if (!ok && d != NULL) {
+		xbps_object_release(d);
+		d = NULL;
+	}
+	return d;
+}
@@ -0,0 +1,358 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __linux__
+# define _GNU_SOURCE	/* for sched_getaffinity(2) */
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "xbps_api_impl.h"
+
+/**
+ * @file lib/thread_pool.c
+ * @brief Handle owned worker threads
+ *
+ * The worker threads are created on first use and kept until
+ * xbps_end() is called. A job is a function that runs concurrently in
+ * all workers and in the calling thread; splitting the work is up to
+ * the job itself (see xbps_array_foreach_cb_multi()).
+ *
+ * Only one job runs at a time, xbps_thread_pool_run() returns EBUSY
+ * if the pool is already busy (i.e when called from a job), and the
+ * caller is expected to do the work by itself.
+ */
+struct xbps_thread_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	pthread_t *threads;
+	unsigned int nthreads;
+	unsigned int running;
+	unsigned long generation;
+	pid_t pid;
+	bool busy;
+	bool shutdown;
+	void (*fn)(void *);
+	void *arg;
+};
+
+static pthread_mutex_t pool_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Returns the number of CPUs allowed by the CFS quota set in the cgroup
+ * directory `dir' (cpu.max for v2, cpu.cfs_{quota,period}_us for v1),
+ * or 0 if there is no limit.
+ */
+static unsigned int
+cgroup_dir_limit(const char *dir, bool v2)
+{
+	FILE *fp;
+	long long quota = -1, period = 0;
+	char path[PATH_MAX + 64], buf[64];
+
+	if (v2) {
+		snprintf(path, sizeof(path), "%s/cpu.max", dir);
+		if ((fp = fopen(path, "r")) == NULL)
+			return 0;
+		if (fgets(buf, sizeof(buf), fp) != NULL &&
+		    sscanf(buf, "%lld %lld", &quota, &period) != 2)
+			quota = -1;
+		fclose(fp);
+	} else {
+		snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+		if ((fp = fopen(path, "r")) == NULL)
+			return 0;
+		if (fscanf(fp, "%lld", &quota) != 1)
+			quota = -1;
+		fclose(fp);
+		snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+		if ((fp = fopen(path, "r")) != NULL) {
+			if (fscanf(fp, "%lld", &period) != 1)
+				period = 0;
+			fclose(fp);
+		}
+	}
+	if (quota <= 0 || period <= 0)
+		return 0;
+
+	return (unsigned int)((quota + period - 1) / period);
+}
+
+/*
+ * Finds the cgroup of the process that owns the cpu controller in
+ * /proc/self/cgroup: a v1 hierarchy listing "cpu" if there is one,
+ * otherwise the v2 "0::<path>" entry.
+ */
+static bool
+cgroup_cpu_path(char *path, size_t len, bool *v2)
+{
+	FILE *fp;
+	char line[PATH_MAX + 64], *ctrls, *cgpath, *tok, *saveptr;
+	bool found = false;
+
+	if ((fp = fopen("/proc/self/cgroup", "r")) == NULL)
+		return false;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if ((ctrls = strchr(line, ':')) == NULL)
+			continue;
+		*ctrls++ = '\0';
+		if ((cgpath = strchr(ctrls, ':')) == NULL)
+			continue;
+		*cgpath++ = '\0';
+		if (strcmp(line, "0") == 0 && *ctrls == '\0') {
+			if (!found) {
+				snprintf(path, len, "%s", cgpath);
+				*v2 = found = true;
+			}
+			continue;
+		}
+		for (tok = strtok_r(ctrls, ",", &saveptr); tok;
+		    tok = strtok_r(NULL, ",", &saveptr)) {
+			if (strcmp(tok, "cpu") == 0)
+				break;
+		}
+		if (tok != NULL) {
+			snprintf(path, len, "%s", cgpath);
+			*v2 = false;
+			found = true;
+			break;
+		}
+	}
+	fclose(fp);
+
+	return found;
+}
+
+/*
+ * Returns the number of CPUs allowed by the CFS quotas of the cgroup
+ * (v2 or v1) the process is running in and its parents, or 0 if there
+ * is no limit.
+ */
+static unsigned int
+cgroup_cpu_limit(void)
+{
+	char cgpath[PATH_MAX], dir[PATH_MAX + 32], *p;
+	unsigned int limit = 0, n;
+	size_t len;
+	bool v2 = true;
+
+	if (!cgroup_cpu_path(cgpath, sizeof(cgpath), &v2))
+		return 0;
+
+	len = strlen(cgpath);
+	while (len > 0 && cgpath[len - 1] == '/')
+		cgpath[--len] = '\0';
+	for (;;) {
+		snprintf(dir, sizeof(dir), "/sys/fs/cgroup%s%s",
+		    v2 ? "" : "/cpu", cgpath);
+		n = cgroup_dir_limit(dir, v2);
+		if (n > 0 && (limit == 0 || n < limit))
+			limit = n;
+		if ((p = strrchr(cgpath, '/')) == NULL)
+			break;
+		*p = '\0';
+	}
+	return limit;
+}
+
+unsigned int HIDDEN
+xbps_cpu_count(void)
+{
+	long ncpus;
+	unsigned int limit;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+#ifdef __linux__
+	{
+		cpu_set_t set;
+
+		if (sched_getaffinity(0, sizeof(set), &set) == 0 &&
+		    CPU_COUNT(&set) < ncpus)
+			ncpus = CPU_COUNT(&set);
+	}
+#endif
+	if (ncpus < 1)
+		ncpus = 1;
+
+	limit = cgroup_cpu_limit();
+	if (limit > 0 && limit < ncpus)
+		ncpus = limit;
+
+	return (unsigned int)ncpus;
+}
+
+static void *
+pool_worker(void *arg)
+{
+	struct xbps_thread_pool *pool = arg;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->shutdown && pool->generation == seen)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		if (pool->shutdown)
+			break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		(*pool->fn)(pool->arg);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->running == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static struct xbps_thread_pool *
+pool_create(struct xbps_handle *xhp)
+{
+	struct xbps_thread_pool *pool;
+	unsigned int i, nthreads;
+	int rv;
+
+	/* the calling thread is a worker too */
+	nthreads = xhp->jobs - 1;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return NULL;
+	pool->threads = calloc(nthreads, sizeof(*pool->threads));
+	if (pool->threads == NULL) {
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		rv = pthread_create(&pool->threads[i], NULL, pool_worker, pool);
+		if (rv != 0) {
+			xbps_dbg_printf(xhp, "[pool] failed to create thread: "
+			    "%s\n", strerror(rv));
+			break;
+		}
+	}
+	pool->nthreads = i;
+	pool->pid = getpid();
+	xbps_dbg_printf(xhp, "[pool] started %u worker threads\n", i);
+	return pool;
+}
+
+int HIDDEN
+xbps_thread_pool_run(struct xbps_handle *xhp, void (*fn)(void *), void *arg)
+{
+	struct xbps_thread_pool *pool;
+
+	if (xhp->jobs <= 1)
+		return ENOTSUP;
+
+	pthread_mutex_lock(&pool_create_lock);
+	/*
+	 * The worker threads don't survive fork(2), start a new pool
+	 * in the child and leave the inherited one alone.
+	 */
+	if (xhp->thread_pool != NULL && xhp->thread_pool->pid != getpid())
+		xhp->thread_pool = NULL;
+	if (xhp->thread_pool == NULL)
+		xhp->thread_pool = pool_create(xhp);
+	pool = xhp->thread_pool;
+	pthread_mutex_unlock(&pool_create_lock);
+
+	if (pool == NULL)
+		return ENOMEM;
+	if (pool->nthreads == 0)
+		return ENOTSUP;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->busy) {
+		pthread_mutex_unlock(&pool->lock);
+		return EBUSY;
+	}
+	pool->busy = true;
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->running = pool->nthreads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	(*fn)(arg);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->running > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pool->busy = false;
+	pool->fn = NULL;
+	pool->arg = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+unsigned int HIDDEN
+xbps_thread_pool_size(struct xbps_handle *xhp)
+{
+	return xhp->jobs > 1 ? xhp->jobs : 1;
+}
+
+void HIDDEN
+xbps_thread_pool_destroy(struct xbps_handle *xhp)
+{
+	struct xbps_thread_pool *pool = xhp->thread_pool;
+
+	if (pool == NULL || pool->pid != getpid())
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+	xhp->thread_pool = NULL;
+}
@@ -23,6 +23,10 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_SYNCFS
+# define _GNU_SOURCE	/* for syncfs(2) */
+#endif
+
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -32,6 +36,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <locale.h>
+#include <fcntl.h>
 
 #include "xbps_api_impl.h"
 
@@ -56,6 +61,41 @@
  * data type is specified on its edge, i.e string, array, integer, dictionary.
  */
 
+/*
+ * Syncs the filesystem of rootdir as requested by xbps_handle::durability,
+ * `pkg' is set when called after a package has been unpacked.
+ */
+static int
+sync_rootdir(struct xbps_handle *xhp, bool pkg)
+{
+	struct timespec ts;
+	int fd, rv = 0;
+
+	if (xhp->durability == XBPS_DURABILITY_NONE ||
+	    (pkg && xhp->durability != XBPS_DURABILITY_PACKAGE))
+		return 0;
+
+	xbps_stats_start(&ts);
+	if ((fd = open(xhp->rootdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) == -1) {
+		rv = errno;
+	} else {
+#ifdef HAVE_SYNCFS
+		if (syncfs(fd) == -1)
+			rv = errno;
+#else
+		sync();
+#endif
+		close(fd);
+	}
+	xbps_stats_end(xhp, XBPS_STATS_SYNC, &ts);
+	if (rv != 0) {
+		xbps_set_cb_state(xhp, XBPS_STATE_TRANS_FAIL, rv, NULL,
+		    "[trans] failed to sync `%s': %s", xhp->rootdir,
+		    strerror(rv));
+	}
+	return rv;
+}
+
 static int
 run_post_remove_scripts(struct xbps_handle *xhp, xbps_array_t remove_scripts)
 {
@@ -110,9 +150,9 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
 	xbps_trans_type_t ttype;
-	const char *pkgver = NULL, *pkgname = NULL;
-	int rv = 0;
-	bool update;
+	const char *pkgver = NULL, *pkgname = NULL, *instver;
+	int rv = 0, rv2;
+	bool update, deferred;
 
 	setlocale(LC_ALL, "");
 
@@ -293,7 +333,18 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 			    "%s: %d\n", __func__, pkgver, ttype);
 			continue;
 		}
+		deferred = false;
+		xbps_dictionary_get_bool(obj, "scripts-deferred", &deferred);
+		if (deferred &&
+		    (rv = xbps_transaction_load_scripts(xhp, obj)) != 0) {
+			xbps_set_cb_state(xhp, XBPS_STATE_TRANS_FAIL, rv, pkgver,
+			    "%s: [trans] failed to read INSTALL script: %s",
+			    pkgver, strerror(rv));
+			goto out;
+		}
 		rv = xbps_pkg_exec_script(xhp, obj, "install-script", "pre", ttype == XBPS_TRANS_UPDATE);
+		if (deferred)
+			xbps_transaction_release_scripts(xhp, obj);
 		if (rv != 0) {
 			xbps_set_cb_state(xhp, XBPS_STATE_TRANS_FAIL, rv, pkgver,
 			    "%s: [trans] INSTALL script failed to execute pre ACTION: %s",
@@ -303,6 +354,12 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	}
 	xbps_object_iterator_reset(iter);
 
+	/*
+	 * Alternatives symlinks are switched at once after all packages
+	 * have been removed and unpacked.
+	 */
+	if ((rv = xbps_alternatives_begin(xhp)) != 0)
+		goto out;
 
 	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
 		xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
@@ -327,7 +384,13 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 			 * Update a package: execute pre-remove action of
 			 * existing package before unpacking new version.
 			 */
-			xbps_set_cb_state(xhp, XBPS_STATE_UPDATE, 0, pkgver, NULL);
+			xbps_dictionary_get_cstring_nocopy(obj, "pkgname", &pkgname);
+			pkgdb_pkgd = xbps_pkgdb_get_pkg(xhp, pkgname);
+			instver = NULL;
+			xbps_dictionary_get_cstring_nocopy(pkgdb_pkgd, "pkgver", &instver);
+			xbps_set_cb_state(xhp, XBPS_STATE_UPDATE, 0, pkgver,
+			    "%s: updating to %s ...", instver ? instver : pkgver,
+			    xbps_pkg_version(pkgver));
 			rv = xbps_remove_pkg(xhp, pkgver, true);
 			if (rv != 0) {
 				xbps_set_cb_state(xhp,
@@ -356,6 +419,8 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 			    "%s: %s\n", pkgver, strerror(rv));
 			goto out;
 		}
+		if ((rv = sync_rootdir(xhp, true)) != 0)
+			goto out;
 		/*
 		 * Register package.
 		 */
@@ -364,6 +429,14 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 			    "%s: %s\n", pkgver, strerror(rv));
 			goto out;
 		}
+		/* the scripts are owned by the pkgdb now */
+		xbps_transaction_release_scripts(xhp, obj);
+	}
+	if ((rv = xbps_alternatives_commit(xhp)) != 0) {
+		xbps_set_cb_state(xhp, XBPS_STATE_TRANS_FAIL, rv, NULL,
+		    "[trans] failed to switch alternatives symlinks: %s",
+		    strerror(rv));
+		goto out;
 	}
 	/* if there are no packages to install or update we are done */
 	if (!xbps_dictionary_get(xhp->transd, "total-update-pkgs") &&
@@ -380,6 +453,8 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 
 	xbps_object_iterator_reset(iter);
 	/* Force a pkgdb write for all unpacked pkgs in transaction */
+	if ((rv = sync_rootdir(xhp, false)) != 0)
+		goto out;
 	if ((rv = xbps_pkgdb_update(xhp, true, true)) != 0)
 		goto out;
 
@@ -429,11 +504,18 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	}
 
 out:
+	/* apply the alternatives of the packages unpacked so far */
+	rv2 = xbps_alternatives_commit(xhp);
+	if (rv == 0)
+		rv = rv2;
 	xbps_object_release(remove_scripts);
 	xbps_object_iterator_release(iter);
+	if (rv == 0)
+		rv = sync_rootdir(xhp, false);
 	if (rv == 0) {
 		/* Force a pkgdb write for all unpacked pkgs in transaction */
 		rv = xbps_pkgdb_update(xhp, true, true);
 	}
+	xbps_cb_flush(xhp);
 	return rv;
 }
@@ -48,11 +48,12 @@ verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 	if (binfile == NULL) {
 		return ENOMEM;
 	}
+	XBPS_PROBE1(verify, pkgver);
 	/*
 	 * For pkgs in local repos check the sha256 hash.
 	 * For pkgs in remote repos check the RSA signature.
 	 */
-	if ((repo = xbps_rpool_get_repo(repoloc)) == NULL) {
+	if ((repo = xbps_rpool_get_repo(xhp, repoloc)) == NULL) {
 		rv = errno;
 		xbps_dbg_printf(xhp, "%s: failed to get repository "
 			"%s: %s\n", pkgver, repoloc, strerror(errno));
@@ -81,6 +82,7 @@ verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 		xbps_set_cb_state(xhp, XBPS_STATE_VERIFY, 0, pkgver,
 			"%s: verifying SHA256 hash...", pkgver);
 		xbps_dictionary_get_cstring_nocopy(pkgd, "filename-sha256", &sha256);
+		xbps_stats_add(xhp, XBPS_STATS_FILES_HASHED, 1);
 		if ((rv = xbps_file_sha256_check(binfile, sha256)) != 0) {
 			xbps_set_cb_state(xhp, XBPS_STATE_VERIFY_FAIL, rv, pkgver,
 				"%s: SHA256 hash is not valid: %s", pkgver, strerror(rv));
@@ -90,6 +92,87 @@ verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 	}
 out:
 	free(binfile);
+	XBPS_PROBE2(verify_done, pkgver, rv);
+	return rv;
+}
+
+/*
+ * Rebuilds the binary package in the cachedir from the one of the
+ * installed version, if it's still in the cachedir, and a delta
+ * announced by the repository index. Returns 0 on success.
+ */
+static int
+download_delta(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
+{
+	xbps_array_t deltas;
+	xbps_dictionary_t pkgd, deltad = NULL;
+	const char *pkgver, *arch, *repoloc, *sha256 = NULL, *opkgver = NULL;
+	const char *oarch = NULL, *fromver, *dfile = NULL, *dsha256 = NULL;
+	const char *fetchstr;
+	char pkgname[XBPS_NAME_SIZE];
+	char *oldbin, *newbin, *delta, *uri;
+	int rv;
+
+	if (xbps_transaction_pkg_type(repo_pkgd) != XBPS_TRANS_UPDATE)
+		return ENOENT;
+	deltas = xbps_dictionary_get(repo_pkgd, "deltas");
+	if (xbps_array_count(deltas) == 0)
+		return ENOENT;
+
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "pkgver", &pkgver);
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "architecture", &arch);
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "repository", &repoloc);
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "filename-sha256", &sha256);
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver) ||
+	    (pkgd = xbps_pkgdb_get_pkg(xhp, pkgname)) == NULL)
+		return ENOENT;
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &opkgver);
+	xbps_dictionary_get_cstring_nocopy(pkgd, "architecture", &oarch);
+
+	for (unsigned int i = 0; i < xbps_array_count(deltas); i++) {
+		deltad = xbps_array_get(deltas, i);
+		if (xbps_dictionary_get_cstring_nocopy(deltad, "from-pkgver",
+		    &fromver) && strcmp(fromver, opkgver) == 0)
+			break;
+		deltad = NULL;
+	}
+	if (deltad == NULL ||
+	    !xbps_dictionary_get_cstring_nocopy(deltad, "filename", &dfile) ||
+	    !xbps_dictionary_get_cstring_nocopy(deltad, "filename-sha256", &dsha256) ||
+	    strchr(dfile, '/') != NULL)
+		return ENOENT;
+
+	oldbin = xbps_xasprintf("%s/%s.%s.xbps", xhp->cachedir, opkgver,
+	    oarch ? oarch : arch);
+	if (access(oldbin, R_OK) == -1) {
+		rv = errno;
+		free(oldbin);
+		return rv;
+	}
+
+	xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD, 0, pkgver,
+		"Downloading `%s' delta from `%s' (from `%s')...", pkgver,
+		opkgver, repoloc);
+
+	uri = xbps_xasprintf("%s/%s", repoloc, dfile);
+	delta = xbps_xasprintf("%s/%s", xhp->cachedir, dfile);
+	newbin = xbps_xasprintf("%s/%s.%s.xbps", xhp->cachedir, pkgver, arch);
+	if (xbps_fetch_file(xhp, uri, NULL) == -1) {
+		rv = fetchLastErrCode ? fetchLastErrCode : errno;
+		fetchstr = xbps_fetch_error_string();
+		xbps_dbg_printf(xhp, "[trans] failed to download `%s': %s\n",
+		    uri, fetchstr ? fetchstr : strerror(rv));
+	} else if ((rv = xbps_file_sha256_check(delta, dsha256)) == 0) {
+		rv = xbps_delta_apply(oldbin, delta, newbin, sha256);
+		xbps_dbg_printf(xhp, "[trans] %s: rebuilt from `%s': %s\n",
+		    pkgver, dfile, strerror(rv));
+	}
+	(void)remove(delta);
+
+	free(uri);
+	free(delta);
+	free(newbin);
+	free(oldbin);
 	return rv;
 }
 
@@ -101,6 +184,7 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 	char *sigsuffix;
 	const char *pkgver, *arch, *fetchstr, *repoloc;
 	unsigned char digest[XBPS_SHA256_DIGEST_SIZE] = {0};
+	bool delta;
 	int rv = 0;
 
 	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "repository", &repoloc);
@@ -110,6 +194,8 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "pkgver", &pkgver);
 	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "architecture", &arch);
 
+	XBPS_PROBE2(download, pkgver, repoloc);
+
 	snprintf(buf, sizeof buf, "%s/%s.%s.xbps.sig", repoloc, pkgver, arch);
 	sigsuffix = buf+(strlen(buf)-sizeof (".sig")+1);
 
@@ -122,25 +208,32 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 		xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD_FAIL, rv,
 			pkgver, "[trans] failed to download `%s' signature from `%s': %s",
 			pkgver, repoloc, fetchstr ? fetchstr : strerror(rv));
-		return rv;
+		goto out;
 	}
 	rv = 0;
 
 	*sigsuffix = '\0';
 
-	xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD, 0, pkgver,
-		"Downloading `%s' package (from `%s')...", pkgver, repoloc);
+	/*
+	 * Prefer rebuilding the binary package from a delta, and fall
+	 * back to downloading it.
+	 */
+	delta = download_delta(xhp, repo_pkgd) == 0;
+	if (!delta) {
+		xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD, 0, pkgver,
+			"Downloading `%s' package (from `%s')...", pkgver, repoloc);
 
-	if ((rv = xbps_fetch_file_sha256(xhp, buf, NULL, digest,
-	    sizeof digest)) == -1) {
-		rv = fetchLastErrCode ? fetchLastErrCode : errno;
-		fetchstr = xbps_fetch_error_string();
-		xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD_FAIL, rv,
-			pkgver, "[trans] failed to download `%s' package from `%s': %s",
-			pkgver, repoloc, fetchstr ? fetchstr : strerror(rv));
-		return rv;
+		if ((rv = xbps_fetch_file_sha256(xhp, buf, NULL, digest,
+		    sizeof digest)) == -1) {
+			rv = fetchLastErrCode ? fetchLastErrCode : errno;
+			fetchstr = xbps_fetch_error_string();
+			xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD_FAIL, rv,
+				pkgver, "[trans] failed to download `%s' package from `%s': %s",
+				pkgver, repoloc, fetchstr ? fetchstr : strerror(rv));
+			goto out;
+		}
+		rv = 0;
 	}
-	rv = 0;
 
 	xbps_set_cb_state(xhp, XBPS_STATE_VERIFY, 0, pkgver,
 		"%s: verifying RSA signature...", pkgver);
@@ -148,18 +241,18 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 	snprintf(buf, sizeof buf, "%s/%s.%s.xbps.sig", xhp->cachedir, pkgver, arch);
 	sigsuffix = buf+(strlen(buf)-sizeof (".sig")+1);
 
-	if ((repo = xbps_rpool_get_repo(repoloc)) == NULL) {
+	if ((repo = xbps_rpool_get_repo(xhp, repoloc)) == NULL) {
 		rv = errno;
 		xbps_dbg_printf(xhp, "%s: failed to get repository "
 			"%s: %s\n", pkgver, repoloc, strerror(errno));
-		return rv;
+		goto out;
 	}
 
 	/*
 	 * If digest is not set, binary package was not downloaded,
 	 * i.e. 304 not modified, verify by file instead.
 	 */
-	if (*digest) {
+	if (delta || *digest) {
 		*sigsuffix = '\0';
 		if (!xbps_verify_file_signature(repo, buf)) {
 			rv = EPERM;
@@ -187,6 +280,8 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 			"%s: removed pkg archive and its signature.", pkgver);
 	}
 
+out:
+	XBPS_PROBE2(download_done, pkgver, rv);
 	return rv;
 }
 
@@ -196,6 +291,7 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	xbps_array_t fetch = NULL, verify = NULL;
 	xbps_object_t obj;
 	xbps_trans_type_t ttype;
+	struct timespec ts;
 	const char *repoloc;
 	int rv = 0;
 	unsigned int i, n;
@@ -245,7 +341,10 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		xbps_dbg_printf(xhp, "[trans] downloading %d packages.\n", n);
 	}
 	for (i = 0; i < n; i++) {
-		if ((rv = download_binpkg(xhp, xbps_array_get(fetch, i))) != 0) {
+		xbps_stats_start(&ts);
+		rv = download_binpkg(xhp, xbps_array_get(fetch, i));
+		xbps_stats_end(xhp, XBPS_STATS_DOWNLOAD, &ts);
+		if (rv != 0) {
 			xbps_dbg_printf(xhp, "[trans] failed to download binpkgs: "
 				"%s\n", strerror(rv));
 			goto out;
@@ -261,7 +360,10 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		xbps_dbg_printf(xhp, "[trans] verifying %d packages.\n", n);
 	}
 	for (i = 0; i < n; i++) {
-		if ((rv = verify_binpkg(xhp, xbps_array_get(verify, i))) != 0) {
+		xbps_stats_start(&ts);
+		rv = verify_binpkg(xhp, xbps_array_get(verify, i));
+		xbps_stats_end(xhp, XBPS_STATS_VERIFY, &ts);
+		if (rv != 0) {
 			xbps_dbg_printf(xhp, "[trans] failed to check binpkgs: "
 				"%s\n", strerror(rv));
 			goto out;
@@ -62,56 +62,73 @@ struct item {
 	UT_hash_handle hh;
 };
 
-/* hash table to look up files by path */
-static struct item *hashtab = NULL;
-
-/* list of files to be sorted using qsort */
-static struct item **items = NULL;
-static size_t itemsidx = 0;
-static size_t itemssz = 0;
+/* per transaction state, kept out of globals to allow concurrent handles */
+struct files_state {
+	struct xbps_handle *xhp;
+	/* hash table to look up files by path */
+	struct item *hashtab;
+	/* list of files to be sorted using qsort */
+	struct item **items;
+	size_t itemsidx;
+	size_t itemssz;
+	/* files plists of installed packages, items point into them */
+	xbps_array_t plists;
+	/* bytes accounted to XBPS_STATS_MEM_{FILES_TABLE,PKG_PLISTS} */
+	uint64_t table_size;
+	uint64_t plists_size;
+};
 
 static struct item *
-lookupItem(const char *file)
+lookupItem(struct files_state *fs, const char *file)
 {
 	struct item *item = NULL;
 
 	assert(file);
 
-	HASH_FIND_STR(hashtab, file, item);
+	HASH_FIND_STR(fs->hashtab, file, item);
 	return item;
 }
 
 static struct item *
-addItem(const char *file)
+addItem(struct files_state *fs, const char *file)
 {
 	struct item *item = calloc(1, sizeof (struct item));
+	size_t grow;
+
 	if (item == NULL)
 		return NULL;
 
 	assert(file);
 	assert(item);
 
-	if (itemsidx+1 >= itemssz) {
-		itemssz = itemssz ? itemssz*2 : 64;
-		items = realloc(items, itemssz*sizeof (struct item *));
-		if (items == NULL) {
+	if (fs->itemsidx+1 >= fs->itemssz) {
+		grow = fs->itemssz ? fs->itemssz : 64;
+		fs->itemssz += grow;
+		fs->items = realloc(fs->items, fs->itemssz*sizeof (struct item *));
+		if (fs->items == NULL) {
 			free(item);
 			return NULL;
 		}
+		xbps_stats_mem_add(fs->xhp, XBPS_STATS_MEM_FILES_TABLE,
+		    grow*sizeof (struct item *));
+		fs->table_size += grow*sizeof (struct item *);
 	}
-	items[itemsidx++] = item;
+	fs->items[fs->itemsidx++] = item;
 
 	if ((item->file = xbps_xasprintf(".%s", file)) == NULL) {
 		free(item);
 		return NULL;
 	}
 	item->len = strlen(item->file);
+	xbps_stats_mem_add(fs->xhp, XBPS_STATS_MEM_FILES_TABLE,
+	    sizeof (struct item) + item->len + 1);
+	fs->table_size += sizeof (struct item) + item->len + 1;
 
 	/*
 	 * File paths are stored relative, but looked up absolute.
 	 * Skip the leading . (dot) and substract it from the length.
 	 */
-	HASH_ADD_KEYPTR(hh, hashtab, item->file+1, item->len-1, item);
+	HASH_ADD_KEYPTR(hh, fs->hashtab, item->file+1, item->len-1, item);
 
 	return item;
 }
@@ -139,7 +156,8 @@ match_preserved_file(struct xbps_handle *xhp, const char *file)
 }
 
 static bool
-can_delete_directory(struct xbps_handle *xhp, const char *file, size_t len, size_t max)
+can_delete_directory(struct xbps_handle *xhp, struct files_state *fs,
+		const char *file, size_t len, size_t max)
 {
 	struct item *item;
 	size_t rmcount = 0, fcount = 0;
@@ -162,7 +180,7 @@ can_delete_directory(struct xbps_handle *xhp, const char *file, size_t len, size
 	 * 2. Count deletable directory content.
 	 */
 	for (size_t i = 0; i < max; i++) {
-		item = items[i];
+		item = fs->items[i];
 		if (strncmp(item->file, file, len) == 0) {
 			if (!item->deleted) {
 				closedir(dp);
@@ -192,7 +210,7 @@ can_delete_directory(struct xbps_handle *xhp, const char *file, size_t len, size
 }
 
 static int
-collect_obsoletes(struct xbps_handle *xhp)
+collect_obsoletes(struct xbps_handle *xhp, struct files_state *fs)
 {
 	/* These are symlinks in Void and must not be removed */
 	const char *basesymlinks[] = {
@@ -225,12 +243,12 @@ collect_obsoletes(struct xbps_handle *xhp)
 	 * - Check if obsolete file can be deleted.
 	 * - Check if directory needs and can be deleted.
 	 */
-	for (size_t i = 0; i < itemsidx; i++) {
+	for (size_t i = 0; i < fs->itemsidx; i++) {
 		xbps_array_t a;
 		const char *pkgname;
 		bool alloc = false, found = false;
 
-		item = items[i];
+		item = fs->items[i];
 
 		if (match_preserved_file(xhp, item->file)) {
 			xbps_dbg_printf(xhp, "[obsoletes] %s: file exists on disk"
@@ -278,7 +296,7 @@ collect_obsoletes(struct xbps_handle *xhp)
 			 */
 			xbps_dbg_printf(xhp, "[files] %s: directory changed to %s: %s\n",
 			    item->new.pkgver, typestr(item->new.type), item->file);
-			if (!can_delete_directory(xhp, item->file, item->len, i)) {
+			if (!can_delete_directory(xhp, fs, item->file, item->len, i)) {
 				xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
 				    ENOTEMPTY, item->old.pkgver,
 				    "%s: directory `%s' can not be deleted.",
@@ -309,6 +327,7 @@ collect_obsoletes(struct xbps_handle *xhp)
 		 * Skip unexisting files and keep files with hash mismatch.
 		 */
 		if (item->old.sha256 != NULL) {
+			xbps_stats_add(xhp, XBPS_STATS_FILES_HASHED, 1);
 			rv = xbps_file_sha256_check(item->file, item->old.sha256);
 			switch (rv) {
 			case 0:
@@ -421,7 +440,8 @@ collect_obsoletes(struct xbps_handle *xhp)
 }
 
 static int
-collect_file(struct xbps_handle *xhp, const char *file, size_t size,
+collect_file(struct xbps_handle *xhp, struct files_state *fs,
+		const char *file, size_t size,
 		const char *pkgname, const char *pkgver, unsigned int idx,
 		const char *sha256, enum type type, bool update, bool removepkg,
 		bool preserve, bool removefile, const char *target)
@@ -430,8 +450,8 @@ collect_file(struct xbps_handle *xhp, const char *file, size_t size,
 
 	assert(file);
 
-	if ((item = lookupItem(file)) == NULL) {
-		item = addItem(file);
+	if ((item = lookupItem(fs, file)) == NULL) {
+		item = addItem(fs, file);
 		if (item == NULL)
 			return ENOMEM;
 		item->deleted = false;
@@ -561,7 +581,8 @@ add:
 }
 
 static int
-collect_files(struct xbps_handle *xhp, xbps_dictionary_t d,
+collect_files(struct xbps_handle *xhp, struct files_state *fs,
+			xbps_dictionary_t d,
 			const char *pkgname, const char *pkgver, unsigned int idx,
 			bool update, bool removepkg, bool preserve, bool removefile)
 {
@@ -581,7 +602,7 @@ collect_files(struct xbps_handle *xhp, xbps_dictionary_t d,
 				xbps_dictionary_get_cstring_nocopy(filed, "sha256", &sha256);
 			size = 0;
 			xbps_dictionary_get_uint64(filed, "size", &size);
-			rv = collect_file(xhp, file, size, pkgname, pkgver, idx, sha256,
+			rv = collect_file(xhp, fs, file, size, pkgname, pkgver, idx, sha256,
 			    TYPE_FILE, update, removepkg, preserve, removefile, NULL);
 			if (rv == EEXIST) {
 				error = true;
@@ -604,7 +625,7 @@ collect_files(struct xbps_handle *xhp, xbps_dictionary_t d,
 			if (removefile && stat(file, &st) != -1 && size != (uint64_t)st.st_size)
 				size = 0;
 #endif
-			rv = collect_file(xhp, file, size, pkgname, pkgver, idx, sha256,
+			rv = collect_file(xhp, fs, file, size, pkgname, pkgver, idx, sha256,
 			    TYPE_CONFFILE, update, removepkg, preserve, removefile, NULL);
 			if (rv == EEXIST) {
 				error = true;
@@ -621,7 +642,7 @@ collect_files(struct xbps_handle *xhp, xbps_dictionary_t d,
 			xbps_dictionary_get_cstring_nocopy(filed, "file", &file);
 			xbps_dictionary_get_cstring_nocopy(filed, "target", &target);
 			assert(target);
-			rv = collect_file(xhp, file, 0, pkgname, pkgver, idx, NULL,
+			rv = collect_file(xhp, fs, file, 0, pkgname, pkgver, idx, NULL,
 			    TYPE_LINK, update, removepkg, preserve, removefile, target);
 			if (rv == EEXIST) {
 				error = true;
@@ -635,7 +656,7 @@ collect_files(struct xbps_handle *xhp, xbps_dictionary_t d,
 		for (i = 0; i < xbps_array_count(a); i++) {
 			filed = xbps_array_get(a, i);
 			xbps_dictionary_get_cstring_nocopy(filed, "file", &file);
-			rv = collect_file(xhp, file, 0, pkgname, pkgver, idx, NULL,
+			rv = collect_file(xhp, fs, file, 0, pkgname, pkgver, idx, NULL,
 			    TYPE_DIR, update, removepkg, preserve, removefile, NULL);
 			if (rv == EEXIST) {
 				error = true;
@@ -654,7 +675,8 @@ out:
 }
 
 static int
-collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+collect_binpkg_files(struct xbps_handle *xhp, struct files_state *fs,
+		xbps_dictionary_t pkg_repod,
 		unsigned int idx, bool update)
 {
 	xbps_dictionary_t filesd;
@@ -663,6 +685,7 @@ collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
 	struct stat st;
 	const char *pkgver, *pkgname;
 	char *bpkg;
+	uint64_t blksize = 0;
 	/* size_t entry_size; */
 	int rv = 0, pkg_fd = -1;
 
@@ -709,6 +732,8 @@ collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
 		    pkgver, bpkg, strerror(rv));
 		goto out;
 	}
+	blksize = (uint64_t)st.st_blksize;
+	xbps_stats_mem_add(xhp, XBPS_STATS_MEM_ARCHIVE, blksize);
 	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
 		rv = archive_errno(ar);
 		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
@@ -733,9 +758,13 @@ collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
 				rv = EINVAL;
 				goto out;
 			}
-			rv = collect_files(xhp, filesd, pkgname, pkgver, idx,
+			xbps_stats_mem_add(xhp, XBPS_STATS_MEM_PKG_PLISTS,
+			    (uint64_t)archive_entry_size(entry));
+			rv = collect_files(xhp, fs, filesd, pkgname, pkgver, idx,
 			    update, false, false, false);
 			xbps_object_release(filesd);
+			xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_PKG_PLISTS,
+			    (uint64_t)archive_entry_size(entry));
 			goto out;
 		}
 		archive_read_data_skip(ar);
@@ -746,6 +775,7 @@ out:
 		close(pkg_fd);
 	if (ar != NULL)
 		archive_read_free(ar);
+	xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_ARCHIVE, blksize);
 	free(bpkg);
 	return rv;
 }
@@ -759,18 +789,22 @@ pathcmp(const void *l1, const void *l2)
 }
 
 static void
-cleanup(void)
+cleanup(struct files_state *fs)
 {
 	struct item *item, *itmp;
 
-	HASH_ITER(hh, hashtab, item, itmp) {
-		HASH_DEL(hashtab, item);
+	HASH_ITER(hh, fs->hashtab, item, itmp) {
+		HASH_DEL(fs->hashtab, item);
 		free(item->file);
 		free(item->old.sha256);
 		free(item->new.sha256);
 		free(item);
 	}
-	free(items);
+	free(fs->items);
+	if (fs->plists != NULL)
+		xbps_object_release(fs->plists);
+	xbps_stats_mem_sub(fs->xhp, XBPS_STATS_MEM_FILES_TABLE, fs->table_size);
+	xbps_stats_mem_sub(fs->xhp, XBPS_STATS_MEM_PKG_PLISTS, fs->plists_size);
 }
 
 /*
@@ -796,9 +830,13 @@ cleanup(void)
 int HIDDEN
 xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 {
+	struct files_state fs = { xhp, NULL, NULL, 0, 0, NULL, 0, 0 };
 	xbps_dictionary_t pkgd, filesd;
+	struct stat st;
+	char *plist;
 	xbps_object_t obj;
 	xbps_trans_type_t ttype;
+	struct timespec ts;
 	const char *pkgver, *pkgname;
 	int rv = 0;
 	unsigned int idx = 0;
@@ -806,6 +844,8 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	assert(xhp);
 	assert(iter);
 
+	xbps_stats_start(&ts);
+
 	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
 		bool update = false;
 
@@ -819,10 +859,12 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		}
 
 		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver)) {
-			return EINVAL;
+			rv = EINVAL;
+			goto out;
 		}
 		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgname", &pkgname)) {
-			return EINVAL;
+			rv = EINVAL;
+			goto out;
 		}
 
 		update = (ttype == XBPS_TRANS_UPDATE);
@@ -830,7 +872,7 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		if (ttype == XBPS_TRANS_INSTALL || ttype == XBPS_TRANS_UPDATE) {
 			xbps_set_cb_state(xhp, XBPS_STATE_FILES, 0, pkgver,
 			    "%s: collecting files...", pkgver);
-			rv = collect_binpkg_files(xhp, obj, idx, update);
+			rv = collect_binpkg_files(xhp, &fs, obj, idx, update);
 			if (rv != 0)
 				goto out;
 		}
@@ -857,11 +899,31 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 			if (filesd == NULL) {
 				continue;
 			}
+			/*
+			 * Keep it until the obsoletes have been collected,
+			 * the items point to its strings.
+			 */
+			if ((fs.plists == NULL &&
+			    (fs.plists = xbps_array_create()) == NULL) ||
+			    !xbps_array_add(fs.plists, filesd)) {
+				xbps_object_release(filesd);
+				rv = ENOMEM;
+				goto out;
+			}
+			xbps_object_release(filesd);
+			plist = xbps_xasprintf("%s/.%s-files.plist",
+			    xhp->metadir, pkgname);
+			if (stat(plist, &st) == 0 && st.st_size > 0) {
+				xbps_stats_mem_add(xhp, XBPS_STATS_MEM_PKG_PLISTS,
+				    (uint64_t)st.st_size);
+				fs.plists_size += (uint64_t)st.st_size;
+			}
+			free(plist);
 
 			assert(oldpkgver);
 			xbps_set_cb_state(xhp, XBPS_STATE_FILES, 0, oldpkgver,
 			    "%s: collecting files...", oldpkgver);
-			rv = collect_files(xhp, filesd, pkgname, pkgver, idx,
+			rv = collect_files(xhp, &fs, filesd, pkgname, pkgver, idx,
 			    update, removepkg, preserve, true);
 			if (rv != 0)
 				goto out;
@@ -873,7 +935,7 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	 * Sort items by path length, to make it easier to find files in
 	 * directories.
 	 */
-	qsort(items, itemsidx, sizeof (struct item *), pathcmp);
+	qsort(fs.items, fs.itemsidx, sizeof (struct item *), pathcmp);
 
 	if (chdir(xhp->rootdir) == -1) {
 		rv = errno;
@@ -882,11 +944,10 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		    xhp->rootdir, strerror(errno));
 	}
 
+	if (rv == 0)
+		rv = collect_obsoletes(xhp, &fs);
 out:
-	if (rv != 0)
-		return rv;
-
-	rv = collect_obsoletes(xhp);
-	cleanup();
+	cleanup(&fs);
+	xbps_stats_end(xhp, XBPS_STATS_FILES, &ts);
 	return rv;
 }
@@ -29,9 +29,10 @@
 
 #include "xbps_api_impl.h"
 
-static int
-internalize_script(xbps_dictionary_t pkg_repod, const char *script,
-		struct archive *ar, struct archive_entry *entry)
+int HIDDEN
+xbps_internalize_script(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		const char *script, struct archive *ar,
+		struct archive_entry *entry)
 {
 	char buffer[BUFSIZ];
 	xbps_data_t data = NULL;
@@ -63,26 +64,58 @@ internalize_script(xbps_dictionary_t pkg_repod, const char *script,
 	free(buf);
 	xbps_dictionary_set(pkg_repod, script, data);
 	xbps_object_release(data);
+	xbps_stats_mem_add(xhp, XBPS_STATS_MEM_SCRIPTS, (uint64_t)entry_size);
 	return 0;
 }
 
+/*
+ * Drops the scripts of a package from the transaction accounting and,
+ * unless it has been registered already, from the package dictionary.
+ */
+void HIDDEN
+xbps_transaction_release_scripts(struct xbps_handle *xhp,
+		xbps_dictionary_t pkg_repod)
+{
+	static const char *scripts[] = { "install-script", "remove-script" };
+	xbps_data_t data;
+
+	for (unsigned int i = 0; i < __arraycount(scripts); i++) {
+		if ((data = xbps_dictionary_get(pkg_repod, scripts[i])) == NULL)
+			continue;
+		xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_SCRIPTS,
+		    xbps_data_size(data));
+		xbps_dictionary_remove(pkg_repod, scripts[i]);
+	}
+}
+
+/*
+ * In low memory mode the scripts are not kept in the transaction,
+ * the package is marked with "scripts-deferred" and they are read
+ * again when needed (scripts_only).
+ */
 static int
-internalize_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
+internalize_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		bool scripts_only)
 {
 	xbps_dictionary_t filesd = NULL, propsd = NULL;
 	struct stat st;
 	struct archive *ar = NULL;
 	struct archive_entry *entry;
 	const char *pkgver, *pkgname, *binpkg_pkgver;
+	uint64_t plists_size = 0;
 	int pkg_fd = -1;
 	char *pkgfile;
 	int rv = 0;
+	bool defer;
 
 	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
 	assert(pkgver);
 	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgname", &pkgname);
 	assert(pkgname);
 
+	defer = !scripts_only && xbps_low_memory(xhp);
+	st.st_blksize = 0;
+
 	pkgfile = xbps_repository_pkg_path(xhp, pkg_repod);
 	if (pkgfile == NULL)
 		return -errno;
@@ -113,12 +146,14 @@ internalize_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	}
 	if (fstat(pkg_fd, &st) == -1) {
 		rv = -errno;
+		st.st_blksize = 0;
 		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
 		    -rv, pkgver,
 		    "%s: failed to fstat binary package `%s': %s",
 		    pkgver, pkgfile, strerror(rv));
 		goto out;
 	}
+	xbps_stats_mem_add(xhp, XBPS_STATS_MEM_ARCHIVE, (uint64_t)st.st_blksize);
 	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
 		rv = archive_errno(ar);
 		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
@@ -139,29 +174,53 @@ internalize_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 		entry_pname = archive_entry_pathname(entry);
 
 		if (strcmp("./INSTALL", entry_pname) == 0) {
-			rv = internalize_script(pkg_repod, "install-script", ar, entry);
+			if (defer) {
+				xbps_dictionary_set_bool(pkg_repod,
+				    "scripts-deferred", true);
+				continue;
+			}
+			rv = xbps_internalize_script(xhp, pkg_repod,
+			    "install-script", ar, entry);
 			if (rv < 0)
 				goto out;
 		} else if (strcmp("./REMOVE", entry_pname) == 0) {
-			rv = internalize_script(pkg_repod, "remove-script", ar, entry);
+			if (defer) {
+				xbps_dictionary_set_bool(pkg_repod,
+				    "scripts-deferred", true);
+				continue;
+			}
+			rv = xbps_internalize_script(xhp, pkg_repod,
+			    "remove-script", ar, entry);
 			if (rv < 0)
 				goto out;
+		} else if (scripts_only) {
+			goto out;
 		} else if ((strcmp("./files.plist", entry_pname)) == 0) {
 			filesd = xbps_archive_get_dictionary(ar, entry);
 			if (filesd == NULL) {
 				rv = -EINVAL;
 				goto out;
 			}
+			xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
+			plists_size += (uint64_t)archive_entry_size(entry);
+			xbps_stats_mem_add(xhp, XBPS_STATS_MEM_PKG_PLISTS,
+			    (uint64_t)archive_entry_size(entry));
 		} else if (strcmp("./props.plist", entry_pname) == 0) {
 			propsd = xbps_archive_get_dictionary(ar, entry);
 			if (propsd == NULL) {
 				rv = -EINVAL;
 				goto out;
 			}
+			xbps_stats_add(xhp, XBPS_STATS_PLISTS_PARSED, 1);
+			plists_size += (uint64_t)archive_entry_size(entry);
+			xbps_stats_mem_add(xhp, XBPS_STATS_MEM_PKG_PLISTS,
+			    (uint64_t)archive_entry_size(entry));
 		} else {
 			break;
 		}
 	}
+	if (scripts_only)
+		goto out;
 
 	/*
 	 * Bail out if required metadata files are not in archive.
@@ -187,20 +246,37 @@ internalize_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	}
 
 out:
-	xbps_object_release(propsd);
-	xbps_object_release(filesd);
+	if (propsd != NULL)
+		xbps_object_release(propsd);
+	if (filesd != NULL)
+		xbps_object_release(filesd);
+	xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_PKG_PLISTS, plists_size);
 	if (pkg_fd != -1)
 		close(pkg_fd);
-	if (ar != NULL)
+	if (ar != NULL) {
+		if (archive_filter_bytes(ar, 0) > 0) {
+			xbps_stats_add(xhp, XBPS_STATS_BYTES_DECOMPRESSED,
+			    (uint64_t)archive_filter_bytes(ar, 0));
+		}
 		archive_read_free(ar);
+	}
+	xbps_stats_mem_sub(xhp, XBPS_STATS_MEM_ARCHIVE, (uint64_t)st.st_blksize);
 	free(pkgfile);
 	return rv;
 }
 
+int HIDDEN
+xbps_transaction_load_scripts(struct xbps_handle *xhp,
+		xbps_dictionary_t pkg_repod)
+{
+	return -internalize_binpkg(xhp, pkg_repod, true);
+}
+
 int
 xbps_transaction_internalize(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 {
 	xbps_object_t obj;
+	struct timespec ts;
 
 	assert(xhp);
 	assert(iter);
@@ -213,7 +289,9 @@ xbps_transaction_internalize(struct xbps_handle *xhp, xbps_object_iterator_t ite
 		if (ttype != XBPS_TRANS_INSTALL && ttype != XBPS_TRANS_UPDATE)
 			continue;
 
-		rv = internalize_binpkg(xhp, obj);
+		xbps_stats_start(&ts);
+		rv = internalize_binpkg(xhp, obj, false);
+		xbps_stats_end(xhp, XBPS_STATS_INTERNALIZE, &ts);
 		if (rv < 0)
 			return rv;
 	}
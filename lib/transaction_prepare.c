@@ -275,8 +275,8 @@ xbps_transaction_init(struct xbps_handle *xhp)
 	return 0;
 }
 
-int
-xbps_transaction_prepare(struct xbps_handle *xhp)
+static int
+transaction_prepare(struct xbps_handle *xhp)
 {
 	xbps_array_t pkgs, edges;
 	xbps_dictionary_t tpkgd;
@@ -297,6 +297,7 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	if ((edges = xbps_array_create()) == NULL)
 		return ENOMEM;
 
+	XBPS_PROBE1(transaction_prepare_phase, "deps");
 	xbps_dbg_printf(xhp, "%s: processing deps\n", __func__);
 	/*
 	 * The edges are also appended after its dependencies have been
@@ -364,6 +365,7 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	/*
 	 * Check for packages to be replaced.
 	 */
+	XBPS_PROBE1(transaction_prepare_phase, "replaces");
 	xbps_dbg_printf(xhp, "%s: checking replaces\n", __func__);
 	if (!xbps_transaction_check_replaces(xhp, pkgs)) {
 		xbps_object_release(xhp->transd);
@@ -373,6 +375,7 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	/*
 	 * Check if there are missing revdeps.
 	 */
+	XBPS_PROBE1(transaction_prepare_phase, "revdeps");
 	xbps_dbg_printf(xhp, "%s: checking revdeps\n", __func__);
 	if (!xbps_transaction_check_revdeps(xhp, pkgs)) {
 		xbps_object_release(xhp->transd);
@@ -389,6 +392,7 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	/*
 	 * Check for package conflicts.
 	 */
+	XBPS_PROBE1(transaction_prepare_phase, "conflicts");
 	xbps_dbg_printf(xhp, "%s: checking conflicts\n", __func__);
 	if (!xbps_transaction_check_conflicts(xhp, pkgs)) {
 		xbps_object_release(xhp->transd);
@@ -401,6 +405,7 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	/*
 	 * Check for unresolved shared libraries.
 	 */
+	XBPS_PROBE1(transaction_prepare_phase, "shlibs");
 	xbps_dbg_printf(xhp, "%s: checking shlibs\n", __func__);
 	if (!xbps_transaction_check_shlibs(xhp, pkgs)) {
 		xbps_object_release(xhp->transd);
@@ -420,6 +425,7 @@ out:
 	 * number of packages to be installed, updated, configured
 	 * and removed to the transaction dictionary.
 	 */
+	XBPS_PROBE1(transaction_prepare_phase, "stats");
 	xbps_dbg_printf(xhp, "%s: computing stats\n", __func__);
 	if ((rv = compute_transaction_stats(xhp)) != 0) {
 		return rv;
@@ -431,3 +437,19 @@ out:
 
 	return 0;
 }
+
+int
+xbps_transaction_prepare(struct xbps_handle *xhp)
+{
+	struct timespec ts;
+	int rv;
+
+	XBPS_PROBE0(transaction_prepare);
+	xbps_stats_start(&ts);
+	rv = transaction_prepare(xhp);
+	xbps_stats_end(xhp, XBPS_STATS_SOLVE, &ts);
+	XBPS_PROBE1(transaction_prepare_done, rv);
+	xbps_cb_flush(xhp);
+
+	return rv;
+}
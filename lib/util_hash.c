@@ -213,20 +213,23 @@ xbps_file_sha256_check(const char *file, const char *sha256)
 static const char *
 file_hash_dictionary(xbps_dictionary_t d, const char *key, const char *file)
 {
+	xbps_array_t array;
 	xbps_object_t obj;
-	xbps_object_iterator_t iter;
 	const char *curfile = NULL, *sha256 = NULL;
+	unsigned int i, cnt;
 
 	assert(xbps_object_type(d) == XBPS_TYPE_DICTIONARY);
 	assert(key != NULL);
 	assert(file != NULL);
 
-	iter = xbps_array_iter_from_dict(d, key);
-	if (iter == NULL) {
+	array = xbps_dictionary_get(d, key);
+	if (xbps_object_type(array) != XBPS_TYPE_ARRAY) {
 		errno = ENOENT;
 		return NULL;
 	}
-	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
+	cnt = xbps_array_count(array);
+	for (i = 0; i < cnt; i++) {
+		obj = xbps_array_get(array, i);
 		xbps_dictionary_get_cstring_nocopy(obj,
 		    "file", &curfile);
 		if (strcmp(file, curfile) == 0) {
@@ -236,7 +239,6 @@ file_hash_dictionary(xbps_dictionary_t d, const char *key, const char *file)
 			break;
 		}
 	}
-	xbps_object_iterator_release(iter);
 	if (sha256 == NULL)
 		errno = ENOENT;
 
@@ -264,6 +266,7 @@ xbps_file_hash_check_dictionary(struct xbps_handle *xhp,
 		return -1; /* error */
 	}
 
+	xbps_stats_add(xhp, XBPS_STATS_FILES_HASHED, 1);
 	if (strcmp(xhp->rootdir, "/") == 0) {
 		rv = xbps_file_sha256_check(file, sha256d);
 	} else {
@@ -278,3 +281,90 @@ xbps_file_hash_check_dictionary(struct xbps_handle *xhp,
 	else
 		return -1; /* error */
 }
+
+/*
+ * Externalizes `d' to `file' atomically, like
+ * xbps_dictionary_externalize_to_file(), compressed with zstd if
+ * `compress' is set and libxbps was built with libzstd. If `sha256' is
+ * set it stores the hex SHA256 digest of the written data, hashed as
+ * it's written. The file is synced unless xbps_handle::durability is
+ * XBPS_DURABILITY_NONE.
+ */
+bool HIDDEN
+xbps_dictionary_write_file(struct xbps_handle *xhp, xbps_dictionary_t d,
+		const char *file, bool compress, char *sha256)
+{
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	SHA256_CTX ctx;
+	char *xml, *zxml, *tname;
+	size_t len, off;
+	ssize_t wr;
+	mode_t mask;
+	int fd, serrno;
+
+	if ((xml = xbps_dictionary_externalize(d)) == NULL)
+		return false;
+	len = strlen(xml);
+	if (compress && (zxml = xbps_zstd_compress(xml, len, &len)) != NULL) {
+		free(xml);
+		xml = zxml;
+	}
+
+	tname = xbps_xasprintf("%s.XXXXXX", file);
+	if ((fd = mkstemp(tname)) == -1) {
+		serrno = errno;
+		free(tname);
+		free(xml);
+		errno = serrno;
+		return false;
+	}
+	SHA256_Init(&ctx);
+	for (off = 0; off < len; off += wr) {
+		if ((wr = write(fd, xml + off, len - off)) == -1) {
+			if (errno == EINTR) {
+				wr = 0;
+				continue;
+			}
+			goto bad;
+		}
+		if (sha256 != NULL)
+			SHA256_Update(&ctx, xml + off, wr);
+	}
+	if (xhp->durability != XBPS_DURABILITY_NONE) {
+#ifdef HAVE_FDATASYNC
+		if (fdatasync(fd) == -1)
+#else
+		if (fsync(fd) == -1)
+#endif
+			goto bad;
+	}
+	mask = umask(0);
+	(void)umask(mask);
+	if (fchmod(fd, 0666 & ~mask) == -1)
+		goto bad;
+	if (close(fd) == -1) {
+		fd = -1;
+		goto bad;
+	}
+	fd = -1;
+	if (rename(tname, file) == -1)
+		goto bad;
+
+	if (sha256 != NULL) {
+		SHA256_Final(digest, &ctx);
+		digest2string(digest, sha256, XBPS_SHA256_DIGEST_SIZE);
+	}
+	free(tname);
+	free(xml);
+	return true;
+
+bad:
+	serrno = errno;
+	if (fd != -1)
+		(void)close(fd);
+	(void)unlink(tname);
+	free(tname);
+	free(xml);
+	errno = serrno;
+	return false;
+}
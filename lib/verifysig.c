@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include <openssl/err.h>
 #include <openssl/sha.h>
@@ -40,95 +41,189 @@
 
 #include "xbps_api_impl.h"
 
-static bool
-rsa_verify_hash(struct xbps_repo *repo, xbps_data_t pubkey,
-		unsigned char *sig, unsigned int siglen,
-		unsigned char *sha256)
+/*
+ * Public keys of the repositories are parsed once per handle and kept
+ * in its keyring, keyed by the public key in the repository index
+ * meta, so that verifying the packages of a transaction doesn't read
+ * `keys/<fp>.plist' and decode the PEM key for every package.
+ * Keys failing to load are not cached, they might be imported later.
+ */
+struct keyring_key {
+	struct keyring_key *next;
+	xbps_data_t pubkey;
+	RSA *rsa;
+};
+
+struct xbps_keyring {
+	pthread_mutex_t lock;
+	struct keyring_key *keys;
+};
+
+static pthread_mutex_t keyring_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct xbps_keyring *
+keyring_get(struct xbps_handle *xhp)
 {
+	struct xbps_keyring *kr;
+
+	pthread_mutex_lock(&keyring_create_lock);
+	if ((kr = xhp->keyring) == NULL &&
+	    (kr = calloc(1, sizeof(*kr))) != NULL) {
+		pthread_mutex_init(&kr->lock, NULL);
+		xhp->keyring = kr;
+	}
+	pthread_mutex_unlock(&keyring_create_lock);
+	return kr;
+}
+
+static RSA *
+keyring_load(struct xbps_repo *repo, xbps_data_t pubkey)
+{
+	xbps_dictionary_t repokeyd;
+	xbps_data_t rpubkey;
 	BIO *bio;
-	RSA *rsa;
-	int rv;
+	RSA *rsa = NULL;
+	char *hexfp, *rkeyfile;
+	char errbuf[256];
 
-	ERR_load_crypto_strings();
-	SSL_load_error_strings();
+	hexfp = xbps_pubkey2fp(repo->xhp, pubkey);
+	if (hexfp == NULL) {
+		xbps_dbg_printf(repo->xhp, "%s: incomplete signed repo, missing hexfp obj\n", repo->uri);
+		return NULL;
+	}
 
-	bio = BIO_new_mem_buf(xbps_data_data_nocopy(pubkey),
-			xbps_data_size(pubkey));
+	/*
+	 * Prepare repository RSA public key to verify fname signature.
+	 */
+	rkeyfile = xbps_xasprintf("%s/keys/%s.plist", repo->xhp->metadir, hexfp);
+	free(hexfp);
+	repokeyd = xbps_plist_dictionary_from_file(repo->xhp, rkeyfile);
+	if (xbps_object_type(repokeyd) != XBPS_TYPE_DICTIONARY) {
+		xbps_dbg_printf(repo->xhp, "cannot read rkey data at %s: %s\n",
+		    rkeyfile, strerror(errno));
+		free(rkeyfile);
+		return NULL;
+	}
+	free(rkeyfile);
+
+	rpubkey = xbps_dictionary_get(repokeyd, "public-key");
+	if (xbps_object_type(rpubkey) != XBPS_TYPE_DATA) {
+		xbps_object_release(repokeyd);
+		return NULL;
+	}
+
+	bio = BIO_new_mem_buf(xbps_data_data_nocopy(rpubkey),
+			xbps_data_size(rpubkey));
 	assert(bio);
 
 	rsa = PEM_read_bio_RSA_PUBKEY(bio, NULL, NULL, NULL);
 	if (rsa == NULL) {
+		ERR_error_string_n(ERR_get_error(), errbuf, sizeof(errbuf));
 		xbps_dbg_printf(repo->xhp, "`%s' error reading public key: %s\n",
-		    repo->uri, ERR_error_string(ERR_get_error(), NULL));
-		return false;
+		    repo->uri, errbuf);
 	}
-
-	rv = RSA_verify(NID_sha1, sha256, SHA256_DIGEST_LENGTH, sig, siglen, rsa);
-	RSA_free(rsa);
 	BIO_free(bio);
-	ERR_free_strings();
+	xbps_object_release(repokeyd);
+
+	return rsa;
+}
 
-	return rv ? true : false;
+static RSA *
+keyring_lookup(struct xbps_repo *repo)
+{
+	struct xbps_keyring *kr;
+	struct keyring_key *k;
+	xbps_data_t pubkey;
+	RSA *rsa = NULL;
+
+	pubkey = xbps_dictionary_get(repo->idxmeta, "public-key");
+	if (xbps_object_type(pubkey) != XBPS_TYPE_DATA) {
+		xbps_dbg_printf(repo->xhp, "%s: incomplete signed repo, missing public-key obj\n", repo->uri);
+		return NULL;
+	}
+	if ((kr = keyring_get(repo->xhp)) == NULL)
+		return NULL;
+
+	/*
+	 * Keys are loaded with the lock held, a transaction only
+	 * loads one per repository.
+	 */
+	pthread_mutex_lock(&kr->lock);
+	for (k = kr->keys; k != NULL; k = k->next) {
+		if (xbps_data_equals(k->pubkey, pubkey)) {
+			rsa = k->rsa;
+			break;
+		}
+	}
+	if (rsa == NULL && (rsa = keyring_load(repo, pubkey)) != NULL) {
+		if ((k = malloc(sizeof(*k))) == NULL ||
+		    (k->pubkey = xbps_data_create_data(
+		    xbps_data_data_nocopy(pubkey),
+		    xbps_data_size(pubkey))) == NULL) {
+			free(k);
+			RSA_free(rsa);
+			rsa = NULL;
+		} else {
+			xbps_dbg_printf(repo->xhp, "[keyring] %s: loaded public key\n",
+			    repo->uri);
+			k->rsa = rsa;
+			k->next = kr->keys;
+			kr->keys = k;
+		}
+	}
+	pthread_mutex_unlock(&kr->lock);
+
+	return rsa;
+}
+
+void HIDDEN
+xbps_keyring_release(struct xbps_handle *xhp)
+{
+	struct xbps_keyring *kr = xhp->keyring;
+	struct keyring_key *k;
+
+	if (kr == NULL)
+		return;
+	while ((k = kr->keys) != NULL) {
+		kr->keys = k->next;
+		RSA_free(k->rsa);
+		xbps_object_release(k->pubkey);
+		free(k);
+	}
+	pthread_mutex_destroy(&kr->lock);
+	free(kr);
+	xhp->keyring = NULL;
 }
 
 bool
 xbps_verify_signature(struct xbps_repo *repo, const char *sigfile,
 		unsigned char *digest)
 {
-	xbps_dictionary_t repokeyd = NULL;
-	xbps_data_t pubkey;
-	char *hexfp = NULL;
+	RSA *rsa;
 	unsigned char *sig_buf = NULL;
 	size_t sigbuflen, sigfilelen;
-	char *rkeyfile = NULL;
 	bool val = false;
 
 	if (!xbps_dictionary_count(repo->idxmeta)) {
 		xbps_dbg_printf(repo->xhp, "%s: unsigned repository\n", repo->uri);
 		return false;
 	}
-	hexfp = xbps_pubkey2fp(repo->xhp,
-	    xbps_dictionary_get(repo->idxmeta, "public-key"));
-	if (hexfp == NULL) {
-		xbps_dbg_printf(repo->xhp, "%s: incomplete signed repo, missing hexfp obj\n", repo->uri);
+	if ((rsa = keyring_lookup(repo)) == NULL)
 		return false;
-	}
-
-	/*
-	 * Prepare repository RSA public key to verify fname signature.
-	 */
-	rkeyfile = xbps_xasprintf("%s/keys/%s.plist", repo->xhp->metadir, hexfp);
-	repokeyd = xbps_plist_dictionary_from_file(repo->xhp, rkeyfile);
-	if (xbps_object_type(repokeyd) != XBPS_TYPE_DICTIONARY) {
-		xbps_dbg_printf(repo->xhp, "cannot read rkey data at %s: %s\n",
-		    rkeyfile, strerror(errno));
-		goto out;
-	}
-
-	pubkey = xbps_dictionary_get(repokeyd, "public-key");
-	if (xbps_object_type(pubkey) != XBPS_TYPE_DATA)
-		goto out;
 
 	if (!xbps_mmap_file(sigfile, (void *)&sig_buf, &sigbuflen, &sigfilelen)) {
 		xbps_dbg_printf(repo->xhp, "can't open signature file %s: %s\n",
 		    sigfile, strerror(errno));
-		goto out;
+		return false;
 	}
 	/*
 	 * Verify fname RSA signature.
 	 */
-	if (rsa_verify_hash(repo, pubkey, sig_buf, sigfilelen, digest))
+	if (RSA_verify(NID_sha1, digest, SHA256_DIGEST_LENGTH, sig_buf,
+	    sigfilelen, rsa))
 		val = true;
 
-out:
-	if (hexfp)
-		free(hexfp);
-	if (rkeyfile)
-		free(rkeyfile);
-	if (sig_buf)
-		(void)munmap(sig_buf, sigbuflen);
-	if (repokeyd)
-		xbps_object_release(repokeyd);
+	(void)munmap(sig_buf, sigbuflen);
 
 	return val;
 }
@@ -140,6 +235,7 @@ xbps_verify_file_signature(struct xbps_repo *repo, const char *fname)
 	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
 	bool val = false;
 
+	xbps_stats_add(repo->xhp, XBPS_STATS_FILES_HASHED, 1);
 	if (!xbps_file_sha256_raw(digest, sizeof digest, fname)) {
 		xbps_dbg_printf(repo->xhp, "can't open file %s: %s\n", fname, strerror(errno));
 		return false;
@@ -0,0 +1,784 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+#include <assert.h>
+#include <dlfcn.h>
+
+#include <openssl/sha.h>
+#include <archive.h>
+#include <xbps.h>
+
+/*
+ * Synthetic benchmark for libxbps and the xbps utilities.
+ *
+ * Two repositories with the same packages are generated in a work
+ * directory, `repo-1' with revision _1 and `repo-2' with revision _2
+ * (half of the files changed, one file added and one removed). The
+ * packages from repo-1 are installed into a rootdir, updated from
+ * repo-2 and finally removed, timing each step. Results are written
+ * as JSON.
+ *
+ * When run with syscount.so preloaded (as `make bench' does), the
+ * number of file system calls of the remove step is reported too.
+ */
+
+#define BENCH_MAXITER	64
+
+struct bench_params {
+	unsigned int npkgs;
+	unsigned int fanout;
+	unsigned int nfiles;
+	unsigned int filesize;
+	unsigned int provides;
+	unsigned int conflicts;
+	unsigned int iterations;
+	unsigned int seed;
+};
+
+struct bench_result {
+	const char *name;
+	uint64_t ns[BENCH_MAXITER];
+	unsigned int n;
+	int rv;
+	bool counted;
+	unsigned long syscalls;
+};
+
+struct bench {
+	struct bench_params p;
+	char workdir[PATH_MAX - 32];
+	char repo1[PATH_MAX];
+	char repo2[PATH_MAX];
+	char rootdir[PATH_MAX];
+	char cachedir[PATH_MAX];
+	char confdir[PATH_MAX];
+	struct bench_result results[16];
+	unsigned int nresults;
+	uint64_t unpack_bytes;
+	uint64_t unpack_files;
+	uint64_t unpack_ns;
+};
+
+static void __attribute__((noreturn))
+usage(bool fail)
+{
+	fprintf(stdout,
+	    "Usage: xbps-bench [OPTIONS]\n\n"
+	    "OPTIONS\n"
+	    " -c, --conflicts <pct>   Packages with conflicts (default 5)\n"
+	    " -d, --fanout <n>        Dependencies per package (default 3)\n"
+	    " -f, --files <n>         Files per package (default 20)\n"
+	    " -h, --help              Show usage\n"
+	    " -i, --iterations <n>    Iterations per benchmark (default 3)\n"
+	    " -k, --keep              Do not remove the work directory\n"
+	    " -n, --packages <n>      Number of packages (default 500)\n"
+	    " -o, --output <file>     Write JSON results to <file> (default stdout)\n"
+	    " -p, --provides <pct>    Packages with provides (default 10)\n"
+	    " -S, --seed <n>          Random seed (default 1)\n"
+	    " -s, --filesize <bytes>  Size of each file (default 4096)\n"
+	    " -w, --workdir <dir>     Work directory (default a new one in TMPDIR)\n");
+	exit(fail ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned int
+rnd(unsigned int *state)
+{
+	/* xorshift32, good enough for a reproducible package set */
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static struct bench_result *
+result_get(struct bench *b, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->nresults; i++) {
+		if (strcmp(b->results[i].name, name) == 0)
+			return &b->results[i];
+	}
+	assert(b->nresults < sizeof(b->results) / sizeof(b->results[0]));
+	b->results[b->nresults].name = name;
+	return &b->results[b->nresults++];
+}
+
+static void
+result_add(struct bench *b, const char *name, uint64_t ns, int rv)
+{
+	struct bench_result *r = result_get(b, name);
+
+	if (rv != 0)
+		r->rv = rv;
+	if (r->n < BENCH_MAXITER)
+		r->ns[r->n++] = ns;
+}
+
+/* provided by syscount.so, NULL if it's not preloaded */
+static unsigned long (*bench_syscalls)(void);
+
+static void
+result_syscalls(struct bench *b, const char *name, unsigned long n)
+{
+	struct bench_result *r = result_get(b, name);
+
+	r->counted = true;
+	r->syscalls = n;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Package generation.
+ */
+static void
+fill_file(unsigned char *buf, size_t len, unsigned int pkg, unsigned int file,
+		unsigned int rev)
+{
+	unsigned int state = (pkg + 1) * 2654435761U ^ (file + 1) * 40503U ^ rev;
+	size_t i;
+
+	if (state == 0)
+		state = 1;
+	for (i = 0; i < len; i++) {
+		if ((i & 3) == 0)
+			rnd(&state);
+		buf[i] = (unsigned char)(state >> ((i & 3) * 8));
+	}
+}
+
+static void
+sha256_hex(char *dst, const unsigned char *buf, size_t len)
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	unsigned int i;
+
+	SHA256(buf, len, digest);
+	for (i = 0; i < SHA256_DIGEST_LENGTH; i++)
+		sprintf(dst + i * 2, "%02x", digest[i]);
+}
+
+static bool
+add_cstring(xbps_array_t a, const char *str)
+{
+	if (xbps_match_string_in_array(a, str))
+		return true;
+	return xbps_array_add_cstring(a, str);
+}
+
+static int
+gen_pkg(struct bench *b, const char *repodir, unsigned int idx,
+		unsigned int rev, unsigned char *fbuf)
+{
+	struct archive *ar;
+	xbps_dictionary_t props, filesd, fileinfo;
+	xbps_array_t deps, provides, conflicts, files, dirs;
+	char pkgname[XBPS_NAME_SIZE], pkgver[XBPS_NAME_SIZE*2];
+	char path[PATH_MAX], sha256[XBPS_SHA256_SIZE], *xml;
+	char buf[XBPS_NAME_SIZE * 2];
+	unsigned int state = (b->p.seed + idx) * 2246822519U | 1;
+	unsigned int i, first, last;
+	int rv = 0;
+
+	snprintf(pkgname, sizeof(pkgname), "bench-%05u", idx);
+	snprintf(pkgver, sizeof(pkgver), "%s-1.0_%u", pkgname, rev);
+
+	props = xbps_dictionary_create();
+	filesd = xbps_dictionary_create();
+	deps = xbps_array_create();
+	provides = xbps_array_create();
+	conflicts = xbps_array_create();
+	files = xbps_array_create();
+	dirs = xbps_array_create();
+	if (!props || !filesd || !deps || !provides || !conflicts ||
+	    !files || !dirs)
+		return ENOMEM;
+
+	xbps_dictionary_set_cstring(props, "pkgname", pkgname);
+	xbps_dictionary_set_cstring(props, "pkgver", pkgver);
+	xbps_dictionary_set_cstring_nocopy(props, "version", "1.0");
+	xbps_dictionary_set_cstring_nocopy(props, "architecture", "noarch");
+	xbps_dictionary_set_cstring_nocopy(props, "short_desc",
+	    "xbps-bench synthetic package");
+	xbps_dictionary_set_uint64(props, "installed_size",
+	    (uint64_t)b->p.nfiles * b->p.filesize);
+
+	/* dependencies only point to lower indexes, no cycles */
+	for (i = 0; idx > 0 && i < b->p.fanout; i++) {
+		snprintf(buf, sizeof(buf), "bench-%05u>=1.0_1",
+		    rnd(&state) % idx);
+		add_cstring(deps, buf);
+	}
+	if (rnd(&state) % 100 < b->p.provides) {
+		snprintf(buf, sizeof(buf), "virtual-bench-%05u-1.0_1", idx);
+		add_cstring(provides, buf);
+	}
+	if (rnd(&state) % 100 < b->p.conflicts) {
+		snprintf(buf, sizeof(buf), "absent-%05u>=0",
+		    rnd(&state) % b->p.npkgs);
+		add_cstring(conflicts, buf);
+	}
+	if (xbps_array_count(deps))
+		xbps_dictionary_set(props, "run_depends", deps);
+	if (xbps_array_count(provides))
+		xbps_dictionary_set(props, "provides", provides);
+	if (xbps_array_count(conflicts))
+		xbps_dictionary_set(props, "conflicts", conflicts);
+
+	/* revision 2 drops the first file and adds a new one */
+	first = (rev > 1 && b->p.nfiles > 1) ? 1 : 0;
+	last = b->p.nfiles + first;
+
+	snprintf(path, sizeof(path), "/usr/share/bench/%s", pkgname);
+	fileinfo = xbps_dictionary_create();
+	xbps_dictionary_set_cstring(fileinfo, "file", path);
+	xbps_array_add(dirs, fileinfo);
+	xbps_object_release(fileinfo);
+
+	for (i = first; i < last; i++) {
+		/* odd files are the same in all revisions */
+		fill_file(fbuf, b->p.filesize, idx, i, (i & 1) ? 1 : rev);
+		sha256_hex(sha256, fbuf, b->p.filesize);
+		snprintf(path, sizeof(path), "/usr/share/bench/%s/file-%u",
+		    pkgname, i);
+		fileinfo = xbps_dictionary_create();
+		xbps_dictionary_set_cstring(fileinfo, "file", path);
+		xbps_dictionary_set_cstring(fileinfo, "sha256", sha256);
+		xbps_dictionary_set_uint64(fileinfo, "size", b->p.filesize);
+		xbps_array_add(files, fileinfo);
+		xbps_object_release(fileinfo);
+	}
+	xbps_dictionary_set(filesd, "files", files);
+	xbps_dictionary_set(filesd, "dirs", dirs);
+
+	snprintf(path, sizeof(path), "%s/%s.noarch.xbps", repodir, pkgver);
+	if ((ar = archive_write_new()) == NULL)
+		return ENOMEM;
+	archive_write_add_filter_zstd(ar);
+	archive_write_set_format_pax_restricted(ar);
+	if (archive_write_open_filename(ar, path) != ARCHIVE_OK) {
+		rv = archive_errno(ar);
+		archive_write_free(ar);
+		goto out;
+	}
+	xml = xbps_dictionary_externalize(props);
+	rv = xbps_archive_append_buf(ar, xml, strlen(xml), "./props.plist",
+	    0644, "root", "root");
+	free(xml);
+	if (rv == 0) {
+		xml = xbps_dictionary_externalize(filesd);
+		rv = xbps_archive_append_buf(ar, xml, strlen(xml),
+		    "./files.plist", 0644, "root", "root");
+		free(xml);
+	}
+	for (i = first; rv == 0 && i < last; i++) {
+		fill_file(fbuf, b->p.filesize, idx, i, (i & 1) ? 1 : rev);
+		snprintf(path, sizeof(path), "./usr/share/bench/%s/file-%u",
+		    pkgname, i);
+		rv = xbps_archive_append_buf(ar, fbuf, b->p.filesize, path,
+		    0644, "root", "root");
+	}
+	if (archive_write_close(ar) != ARCHIVE_OK && rv == 0)
+		rv = EIO;
+	archive_write_free(ar);
+out:
+	xbps_object_release(props);
+	xbps_object_release(filesd);
+	xbps_object_release(deps);
+	xbps_object_release(provides);
+	xbps_object_release(conflicts);
+	xbps_object_release(files);
+	xbps_object_release(dirs);
+	return rv;
+}
+
+static int
+gen_repo(struct bench *b, const char *repodir, unsigned int rev)
+{
+	unsigned char *fbuf;
+	char *cmd;
+	unsigned int i;
+	int rv = 0;
+
+	if (xbps_mkpath(repodir, 0755) == -1)
+		return errno;
+	if ((fbuf = malloc(b->p.filesize ? b->p.filesize : 1)) == NULL)
+		return ENOMEM;
+	for (i = 0; i < b->p.npkgs; i++) {
+		if ((rv = gen_pkg(b, repodir, i, rev, fbuf)) != 0)
+			break;
+	}
+	free(fbuf);
+	if (rv != 0)
+		return rv;
+
+	cmd = xbps_xasprintf("xbps-rindex -a '%s'/*.xbps >/dev/null", repodir);
+	rv = system(cmd) == 0 ? 0 : EINVAL;
+	free(cmd);
+	return rv;
+}
+
+/*
+ * Benchmarks.
+ */
+static int
+bench_init(struct bench *b, struct xbps_handle *xhp, const char *repo)
+{
+	memset(xhp, 0, sizeof(*xhp));
+	xbps_strlcpy(xhp->rootdir, b->rootdir, sizeof(xhp->rootdir));
+	xbps_strlcpy(xhp->cachedir, b->cachedir, sizeof(xhp->cachedir));
+	xbps_strlcpy(xhp->confdir, b->confdir, sizeof(xhp->confdir));
+	xhp->flags = XBPS_FLAG_IGNORE_CONF_REPOS;
+	if (repo != NULL)
+		xbps_repo_store(xhp, repo);
+	return xbps_init(xhp);
+}
+
+static void
+bench_repo_open(struct bench *b)
+{
+	struct xbps_handle xh;
+	struct xbps_repo *repo;
+	uint64_t t;
+	unsigned int i;
+
+	for (i = 0; i < b->p.iterations; i++) {
+		if (bench_init(b, &xh, NULL) != 0) {
+			result_add(b, "repo_open", 0, EINVAL);
+			return;
+		}
+		t = now_ns();
+		repo = xbps_repo_open(&xh, b->repo1);
+		t = now_ns() - t;
+		result_add(b, "repo_open", t, repo ? 0 : errno);
+		xbps_repo_release(repo);
+		xbps_end(&xh);
+	}
+}
+
+static int
+install_all(struct xbps_handle *xhp, unsigned int npkgs)
+{
+	char pkgname[XBPS_NAME_SIZE];
+	unsigned int i;
+	int rv;
+
+	for (i = 0; i < npkgs; i++) {
+		snprintf(pkgname, sizeof(pkgname), "bench-%05u", i);
+		rv = xbps_transaction_install_pkg(xhp, pkgname, false);
+		if (rv != 0 && rv != EEXIST)
+			return rv;
+	}
+	return 0;
+}
+
+static void
+bench_install(struct bench *b)
+{
+	struct xbps_handle xh;
+	char *cmd;
+	uint64_t t;
+	unsigned int i;
+	int rv;
+
+	for (i = 0; i < b->p.iterations; i++) {
+		cmd = xbps_xasprintf("rm -rf '%s'", b->rootdir);
+		(void)system(cmd);
+		free(cmd);
+		if ((rv = bench_init(b, &xh, b->repo1)) != 0 ||
+		    (rv = xbps_pkgdb_lock(&xh)) != 0) {
+			result_add(b, "install_prepare", 0, rv);
+			return;
+		}
+		t = now_ns();
+		if ((rv = install_all(&xh, b->p.npkgs)) == 0)
+			rv = xbps_transaction_prepare(&xh);
+		t = now_ns() - t;
+		result_add(b, "install_prepare", t, rv);
+		if (rv != 0) {
+			xbps_end(&xh);
+			return;
+		}
+		t = now_ns();
+		rv = xbps_transaction_commit(&xh);
+		t = now_ns() - t;
+		result_add(b, "install_commit", t, rv);
+		result_add(b, "install_files",
+		    xh.stats.phase_ns[XBPS_STATS_FILES], rv);
+		result_add(b, "install_unpack",
+		    xh.stats.phase_ns[XBPS_STATS_UNPACK], rv);
+		b->unpack_ns += xh.stats.phase_ns[XBPS_STATS_UNPACK];
+		b->unpack_bytes += (uint64_t)b->p.npkgs * b->p.nfiles *
+		    b->p.filesize;
+		b->unpack_files += (uint64_t)b->p.npkgs * b->p.nfiles;
+		xbps_end(&xh);
+		if (rv != 0)
+			return;
+	}
+}
+
+static void
+bench_update(struct bench *b, bool commit)
+{
+	struct xbps_handle xh;
+	uint64_t t;
+	int rv;
+
+	if ((rv = bench_init(b, &xh, b->repo2)) != 0 ||
+	    (rv = xbps_pkgdb_lock(&xh)) != 0) {
+		result_add(b, "update_prepare", 0, rv);
+		return;
+	}
+	t = now_ns();
+	if ((rv = xbps_transaction_update_packages(&xh)) == 0)
+		rv = xbps_transaction_prepare(&xh);
+	t = now_ns() - t;
+	if (!commit)
+		result_add(b, "update_prepare", t, rv);
+	else if (rv != 0)
+		result_add(b, "update_commit", 0, rv);
+	if (rv == 0 && commit) {
+		t = now_ns();
+		rv = xbps_transaction_commit(&xh);
+		t = now_ns() - t;
+		result_add(b, "update_commit", t, rv);
+		result_add(b, "update_files",
+		    xh.stats.phase_ns[XBPS_STATS_FILES], rv);
+	}
+	xbps_end(&xh);
+}
+
+static void
+bench_remove(struct bench *b)
+{
+	struct xbps_handle xh;
+	char pkgname[XBPS_NAME_SIZE];
+	uint64_t t;
+	unsigned long nsys;
+	unsigned int i;
+	int rv;
+
+	if ((rv = bench_init(b, &xh, NULL)) != 0 ||
+	    (rv = xbps_pkgdb_lock(&xh)) != 0) {
+		result_add(b, "remove_commit", 0, rv);
+		return;
+	}
+	for (i = 0; i < b->p.npkgs; i++) {
+		snprintf(pkgname, sizeof(pkgname), "bench-%05u", i);
+		rv = xbps_transaction_remove_pkg(&xh, pkgname, false);
+		if (rv != 0 && rv != ENOENT)
+			break;
+		rv = 0;
+	}
+	if (rv == 0)
+		rv = xbps_transaction_prepare(&xh);
+	if (rv == 0) {
+		nsys = bench_syscalls ? bench_syscalls() : 0;
+		t = now_ns();
+		rv = xbps_transaction_commit(&xh);
+		t = now_ns() - t;
+		result_add(b, "remove_commit", t, rv);
+		if (bench_syscalls)
+			result_syscalls(b, "remove_commit",
+			    bench_syscalls() - nsys);
+	} else {
+		result_add(b, "remove_commit", 0, rv);
+	}
+	xbps_end(&xh);
+}
+
+static void __attribute__((format(printf, 3, 4)))
+bench_cmd(struct bench *b, const char *name, const char *fmt, ...)
+{
+	va_list ap;
+	char cmd[PATH_MAX * 4];
+	uint64_t t;
+	unsigned int i;
+	int rv, len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(cmd, sizeof(cmd), fmt, ap);
+	va_end(ap);
+	if (len < 0 || (size_t)len >= sizeof(cmd) - sizeof(" >/dev/null 2>&1"))
+		return;
+	xbps_strlcat(cmd, " >/dev/null 2>&1", sizeof(cmd));
+	for (i = 0; i < b->p.iterations; i++) {
+		t = now_ns();
+		rv = system(cmd);
+		t = now_ns() - t;
+		result_add(b, name, t, rv == 0 ? 0 : EINVAL);
+	}
+}
+
+static void
+write_json(struct bench *b, FILE *f)
+{
+	struct bench_result *r;
+	unsigned int i;
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"xbps_version\": \"%s\",\n", XBPS_RELVER);
+	fprintf(f, "  \"params\": {\n");
+	fprintf(f, "    \"packages\": %u,\n", b->p.npkgs);
+	fprintf(f, "    \"fanout\": %u,\n", b->p.fanout);
+	fprintf(f, "    \"files\": %u,\n", b->p.nfiles);
+	fprintf(f, "    \"filesize\": %u,\n", b->p.filesize);
+	fprintf(f, "    \"provides\": %u,\n", b->p.provides);
+	fprintf(f, "    \"conflicts\": %u,\n", b->p.conflicts);
+	fprintf(f, "    \"iterations\": %u,\n", b->p.iterations);
+	fprintf(f, "    \"seed\": %u\n", b->p.seed);
+	fprintf(f, "  },\n");
+	fprintf(f, "  \"results\": {\n");
+	for (i = 0; i < b->nresults; i++) {
+		r = &b->results[i];
+		qsort(r->ns, r->n, sizeof(r->ns[0]), cmp_u64);
+		fprintf(f, "    \"%s\": { \"status\": %d, \"iterations\": %u, "
+		    "\"min_ns\": %" PRIu64 ", \"median_ns\": %" PRIu64 ", "
+		    "\"max_ns\": %" PRIu64, r->name, r->rv, r->n,
+		    r->n ? r->ns[0] : 0, r->n ? r->ns[r->n / 2] : 0,
+		    r->n ? r->ns[r->n - 1] : 0);
+		if (r->counted)
+			fprintf(f, ", \"syscalls\": %lu", r->syscalls);
+		fprintf(f, " }%s\n", i + 1 < b->nresults ? "," : "");
+	}
+	fprintf(f, "  },\n");
+	fprintf(f, "  \"unpack\": { \"bytes_per_sec\": %.0f, "
+	    "\"files_per_sec\": %.0f }\n",
+	    b->unpack_ns ? (double)b->unpack_bytes * 1e9 / b->unpack_ns : 0,
+	    b->unpack_ns ? (double)b->unpack_files * 1e9 / b->unpack_ns : 0);
+	fprintf(f, "}\n");
+}
+
+static unsigned int
+parse_uint(const char *s)
+{
+	char *end;
+	unsigned long v;
+
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno != 0 || *end != '\0' || v > UINT_MAX)
+		usage(true);
+	return (unsigned int)v;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *shortopts = "c:d:f:hi:kn:o:p:S:s:w:";
+	const struct option longopts[] = {
+		{ "conflicts", required_argument, NULL, 'c' },
+		{ "fanout", required_argument, NULL, 'd' },
+		{ "files", required_argument, NULL, 'f' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "iterations", required_argument, NULL, 'i' },
+		{ "keep", no_argument, NULL, 'k' },
+		{ "packages", required_argument, NULL, 'n' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "provides", required_argument, NULL, 'p' },
+		{ "seed", required_argument, NULL, 'S' },
+		{ "filesize", required_argument, NULL, 's' },
+		{ "workdir", required_argument, NULL, 'w' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bench b;
+	const char *output = NULL, *workdir = NULL, *tmpdir;
+	void *handle;
+	char *cmd;
+	FILE *f = stdout;
+	unsigned int i;
+	int c, rv = 0;
+	bool keep = false;
+
+	memset(&b, 0, sizeof(b));
+	b.p.npkgs = 500;
+	b.p.fanout = 3;
+	b.p.nfiles = 20;
+	b.p.filesize = 4096;
+	b.p.provides = 10;
+	b.p.conflicts = 5;
+	b.p.iterations = 3;
+	b.p.seed = 1;
+
+	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
+		switch (c) {
+		case 'c':
+			b.p.conflicts = parse_uint(optarg);
+			break;
+		case 'd':
+			b.p.fanout = parse_uint(optarg);
+			break;
+		case 'f':
+			b.p.nfiles = parse_uint(optarg);
+			break;
+		case 'h':
+			usage(false);
+			/* NOTREACHED */
+		case 'i':
+			b.p.iterations = parse_uint(optarg);
+			break;
+		case 'k':
+			keep = true;
+			break;
+		case 'n':
+			b.p.npkgs = parse_uint(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'p':
+			b.p.provides = parse_uint(optarg);
+			break;
+		case 'S':
+			b.p.seed = parse_uint(optarg);
+			break;
+		case 's':
+			b.p.filesize = parse_uint(optarg);
+			break;
+		case 'w':
+			workdir = optarg;
+			break;
+		case '?':
+		default:
+			usage(true);
+			/* NOTREACHED */
+		}
+	}
+	if (b.p.npkgs == 0 || b.p.npkgs > 99999 || b.p.iterations == 0 ||
+	    b.p.iterations > BENCH_MAXITER)
+		usage(true);
+
+	/* the counter is only for this process, not for the utilities */
+	if ((handle = dlopen(NULL, RTLD_LAZY)) != NULL)
+		bench_syscalls = (unsigned long (*)(void))dlsym(handle,
+		    "xbps_bench_syscalls");
+	unsetenv("LD_PRELOAD");
+
+	if (workdir != NULL) {
+		xbps_strlcpy(b.workdir, workdir, sizeof(b.workdir));
+		if (xbps_mkpath(b.workdir, 0755) == -1 && errno != EEXIST) {
+			xbps_error_printf("xbps-bench: cannot create %s: %s\n",
+			    b.workdir, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		if ((tmpdir = getenv("TMPDIR")) == NULL)
+			tmpdir = "/tmp";
+		snprintf(b.workdir, sizeof(b.workdir),
+		    "%s/xbps-bench.XXXXXX", tmpdir);
+		if (mkdtemp(b.workdir) == NULL) {
+			xbps_error_printf("xbps-bench: mkdtemp: %s\n",
+			    strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+	snprintf(b.repo1, sizeof(b.repo1), "%s/repo-1", b.workdir);
+	snprintf(b.repo2, sizeof(b.repo2), "%s/repo-2", b.workdir);
+	snprintf(b.rootdir, sizeof(b.rootdir), "%s/root", b.workdir);
+	snprintf(b.cachedir, sizeof(b.cachedir), "%s/cache", b.workdir);
+	snprintf(b.confdir, sizeof(b.confdir), "%s/xbps.d", b.workdir);
+
+	if ((rv = gen_repo(&b, b.repo1, 1)) != 0 ||
+	    (rv = gen_repo(&b, b.repo2, 2)) != 0) {
+		xbps_error_printf("xbps-bench: failed to generate "
+		    "repositories: %s\n", strerror(rv));
+		goto out;
+	}
+
+	bench_repo_open(&b);
+	bench_install(&b);
+	if (result_get(&b, "install_commit")->n == b.p.iterations) {
+		for (i = 0; i < b.p.iterations; i++)
+			bench_update(&b, false);
+		bench_cmd(&b, "ownedby",
+		    "xbps-query -r '%s' -C '%s' -o /usr/share/bench/bench-00000/file-1",
+		    b.rootdir, b.confdir);
+		bench_cmd(&b, "ownedby_glob",
+		    "xbps-query -r '%s' -C '%s' -o '*/file-1*'",
+		    b.rootdir, b.confdir);
+		bench_cmd(&b, "search",
+		    "xbps-query -r '%s' -C '%s' -i --repository='%s' -s 'bench-0001'",
+		    b.rootdir, b.confdir, b.repo1);
+		bench_cmd(&b, "pkgdb_check",
+		    "xbps-pkgdb -r '%s' -C '%s' -a",
+		    b.rootdir, b.confdir);
+		bench_update(&b, true);
+		if (result_get(&b, "update_commit")->rv == 0)
+			bench_remove(&b);
+	}
+
+	if (output != NULL && (f = fopen(output, "w")) == NULL) {
+		rv = errno;
+		xbps_error_printf("xbps-bench: cannot open %s: %s\n",
+		    output, strerror(rv));
+		goto out;
+	}
+	write_json(&b, f);
+	if (f != stdout)
+		fclose(f);
+	for (i = 0; i < b.nresults; i++) {
+		if (b.results[i].rv != 0)
+			rv = b.results[i].rv;
+	}
+out:
+	if (!keep) {
+		cmd = xbps_xasprintf("rm -rf '%s'", b.workdir);
+		(void)system(cmd);
+		free(cmd);
+	}
+	exit(rv ? EXIT_FAILURE : EXIT_SUCCESS);
+}
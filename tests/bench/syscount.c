@@ -0,0 +1,143 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* both the plain and the *64 variants are wrapped explicitly */
+#undef _FILE_OFFSET_BITS
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+/*
+ * Syscall counter for xbps-bench, loaded with LD_PRELOAD.
+ *
+ * Wraps the libc file system calls used by libxbps and counts every
+ * call; xbps-bench reads the counter with xbps_bench_syscalls() around
+ * the measured step. Calls made internally by libc (e.g. by opendir(3)
+ * or fopen(3)) are not seen, so the count is a lower bound that is
+ * meant to be compared across commits.
+ */
+
+unsigned long xbps_bench_syscalls(void);
+
+static unsigned long nsyscalls;
+
+unsigned long
+xbps_bench_syscalls(void)
+{
+	return __atomic_load_n(&nsyscalls, __ATOMIC_RELAXED);
+}
+
+#define NEXT(name)							\
+	static __typeof__(&name) next;					\
+	if (next == NULL)						\
+		next = (__typeof__(&name))dlsym(RTLD_NEXT, #name);	\
+	__atomic_add_fetch(&nsyscalls, 1, __ATOMIC_RELAXED)
+
+#define WRAP(ret, name, params, args)					\
+ret									\
+name params								\
+{									\
+	NEXT(name);							\
+	return next args;						\
+}
+
+#define WRAP_OPEN(name)							\
+int									\
+name(const char *path, int flags, ...)					\
+{									\
+	va_list ap;							\
+	mode_t mode = 0;						\
+									\
+	NEXT(name);							\
+	if (flags & (O_CREAT|O_TMPFILE)) {				\
+		va_start(ap, flags);					\
+		mode = va_arg(ap, mode_t);				\
+		va_end(ap);						\
+	}								\
+	return next(path, flags, mode);					\
+}
+
+#define WRAP_OPENAT(name)						\
+int									\
+name(int dirfd, const char *path, int flags, ...)			\
+{									\
+	va_list ap;							\
+	mode_t mode = 0;						\
+									\
+	NEXT(name);							\
+	if (flags & (O_CREAT|O_TMPFILE)) {				\
+		va_start(ap, flags);					\
+		mode = va_arg(ap, mode_t);				\
+		va_end(ap);						\
+	}								\
+	return next(dirfd, path, flags, mode);				\
+}
+
+WRAP_OPEN(open)
+WRAP_OPENAT(openat)
+WRAP(int, close, (int fd), (fd))
+WRAP(ssize_t, read, (int fd, void *buf, size_t n), (fd, buf, n))
+WRAP(ssize_t, write, (int fd, const void *buf, size_t n), (fd, buf, n))
+WRAP(int, stat, (const char *path, struct stat *st), (path, st))
+WRAP(int, lstat, (const char *path, struct stat *st), (path, st))
+WRAP(int, fstat, (int fd, struct stat *st), (fd, st))
+WRAP(int, fstatat, (int dirfd, const char *path, struct stat *st, int flags),
+    (dirfd, path, st, flags))
+WRAP(int, access, (const char *path, int mode), (path, mode))
+WRAP(int, faccessat, (int dirfd, const char *path, int mode, int flags),
+    (dirfd, path, mode, flags))
+WRAP(int, unlink, (const char *path), (path))
+WRAP(int, unlinkat, (int dirfd, const char *path, int flags),
+    (dirfd, path, flags))
+WRAP(int, rmdir, (const char *path), (path))
+WRAP(int, rename, (const char *from, const char *to), (from, to))
+WRAP(int, renameat, (int fromfd, const char *from, int tofd, const char *to),
+    (fromfd, from, tofd, to))
+WRAP(int, mkdir, (const char *path, mode_t mode), (path, mode))
+WRAP(int, mkdirat, (int dirfd, const char *path, mode_t mode),
+    (dirfd, path, mode))
+WRAP(ssize_t, readlink, (const char *path, char *buf, size_t n),
+    (path, buf, n))
+WRAP(ssize_t, readlinkat, (int dirfd, const char *path, char *buf, size_t n),
+    (dirfd, path, buf, n))
+WRAP(int, fsync, (int fd), (fd))
+WRAP(int, chdir, (const char *path), (path))
+WRAP(int, fchdir, (int fd), (fd))
+
+#ifdef __GLIBC__
+WRAP_OPEN(open64)
+WRAP_OPENAT(openat64)
+WRAP(int, stat64, (const char *path, struct stat64 *st), (path, st))
+WRAP(int, lstat64, (const char *path, struct stat64 *st), (path, st))
+WRAP(int, fstat64, (int fd, struct stat64 *st), (fd, st))
+WRAP(int, fstatat64, (int dirfd, const char *path, struct stat64 *st,
+    int flags), (dirfd, path, st, flags))
+#endif
@@ -0,0 +1,228 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atf-c.h>
+#include <xbps.h>
+
+#define SRCSIZE	(128 * 4096)
+
+static char events[16][64];
+static unsigned int nevents;
+static int gate[2];
+
+static void
+fetch_cb(const struct xbps_fetch_cb_data *xfcd, void *arg)
+{
+	char c;
+
+	(void)arg;
+	if (nevents == 16)
+		return;
+	if (xfcd->cb_start) {
+		/* hold the dispatcher until everything is queued */
+		ATF_REQUIRE_EQ(read(gate[0], &c, 1), 1);
+		snprintf(events[nevents++], 64, "start");
+	} else if (xfcd->cb_update) {
+		snprintf(events[nevents++], 64, "update %jd",
+		    (intmax_t)xfcd->file_dloaded);
+	} else if (xfcd->cb_end) {
+		snprintf(events[nevents++], 64, "end");
+	}
+}
+
+static void
+fetch_err_cb(const struct xbps_fetch_cb_data *xfcd, void *arg)
+{
+	(void)arg;
+	if (!xfcd->cb_start)
+		return;
+	sleep(1);
+	/* must not wait for the queue it's being called from */
+	xbps_error_printf("start\n");
+}
+
+static char *nested_uri;
+static int nested_rv;
+
+static void
+fetch_nested_cb(const struct xbps_fetch_cb_data *xfcd, void *arg)
+{
+	(void)arg;
+	if (strcmp(xfcd->file_name, "dst") != 0) {
+		/* events of the nested fetch are delivered synchronously */
+		if (nevents < 16)
+			nevents++;
+		return;
+	}
+	if (!xfcd->cb_start)
+		return;
+	/* let the main thread start draining the queues */
+	sleep(1);
+	nested_rv = xbps_fetch_file_dest(xfcd->xhp, nested_uri, "dst2", NULL);
+}
+
+static void
+handle_init(struct xbps_handle *xhp, const char *rootdir)
+{
+	memset(xhp, 0, sizeof(*xhp));
+	xbps_strlcpy(xhp->rootdir, rootdir, sizeof(xhp->rootdir));
+	xbps_strlcpy(xhp->metadir, rootdir, sizeof(xhp->metadir));
+	xhp->flags = XBPS_FLAG_ASYNC_CB;
+	ATF_REQUIRE_EQ(xbps_init(xhp), 0);
+	nevents = 0;
+}
+
+static char *
+make_source(void)
+{
+	char buf[4096], *cwd, *uri;
+	int fd, i;
+
+	memset(buf, 'x', sizeof(buf));
+	(void)unlink("dst");
+	(void)unlink("dst2");
+	ATF_REQUIRE((fd = open("src", O_WRONLY|O_CREAT|O_TRUNC, 0644)) != -1);
+	for (i = 0; i < SRCSIZE / (int)sizeof(buf); i++)
+		ATF_REQUIRE_EQ(write(fd, buf, sizeof(buf)), (ssize_t)sizeof(buf));
+	close(fd);
+	ATF_REQUIRE((cwd = getcwd(NULL, 0)) != NULL);
+	uri = xbps_xasprintf("file://%s/src", cwd);
+	free(cwd);
+	return uri;
+}
+
+ATF_TC(coalesce_order_test);
+ATF_TC_HEAD(coalesce_order_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "Test async callbacks are delivered in order and fetch updates coalesced");
+}
+ATF_TC_BODY(coalesce_order_test, tc)
+{
+	struct xbps_handle xh;
+	char *uri, *cwd;
+
+	ATF_REQUIRE((cwd = getcwd(NULL, 0)) != NULL);
+	handle_init(&xh, cwd);
+	xh.fetch_cb = fetch_cb;
+	ATF_REQUIRE_EQ(pipe(gate), 0);
+	uri = make_source();
+
+	ATF_REQUIRE_EQ(xbps_fetch_file_dest(&xh, uri, "dst", NULL), 1);
+	ATF_REQUIRE_EQ(write(gate[1], "x", 1), 1);
+	xbps_cb_flush(&xh);
+
+	/* the dispatcher was held, all updates were merged into one */
+	ATF_REQUIRE_EQ(nevents, 3);
+	ATF_CHECK_STREQ(events[0], "start");
+	ATF_CHECK_STREQ(events[1], "update 524288");
+	ATF_CHECK_STREQ(events[2], "end");
+
+	xbps_end(&xh);
+	close(gate[0]);
+	close(gate[1]);
+	free(uri);
+	free(cwd);
+}
+
+ATF_TC(error_order_test);
+ATF_TC_HEAD(error_order_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "Test queued callbacks are delivered before errors are printed");
+}
+ATF_TC_BODY(error_order_test, tc)
+{
+	struct xbps_handle xh;
+	char buf[128], *uri, *cwd;
+	FILE *f;
+	size_t len;
+	int fd;
+
+	ATF_REQUIRE((cwd = getcwd(NULL, 0)) != NULL);
+	handle_init(&xh, cwd);
+	xh.fetch_cb = fetch_err_cb;
+	uri = make_source();
+	ATF_REQUIRE((f = tmpfile()) != NULL);
+	ATF_REQUIRE((fd = dup(STDERR_FILENO)) != -1);
+	ATF_REQUIRE(dup2(fileno(f), STDERR_FILENO) != -1);
+
+	ATF_REQUIRE_EQ(xbps_fetch_file_dest(&xh, uri, "dst", NULL), 1);
+	xbps_error_printf("after\n");
+	xbps_end(&xh);
+
+	ATF_REQUIRE(dup2(fd, STDERR_FILENO) != -1);
+	close(fd);
+	rewind(f);
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = '\0';
+	fclose(f);
+	ATF_CHECK_STREQ(buf, "ERROR: start\nERROR: after\n");
+	free(uri);
+	free(cwd);
+}
+
+ATF_TC(nested_event_test);
+ATF_TC_HEAD(nested_event_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "Test callbacks emitting events while the queues are drained");
+	atf_tc_set_md_var(tc, "timeout", "30");
+}
+ATF_TC_BODY(nested_event_test, tc)
+{
+	struct xbps_handle xh;
+	char *cwd;
+
+	ATF_REQUIRE((cwd = getcwd(NULL, 0)) != NULL);
+	handle_init(&xh, cwd);
+	xh.fetch_cb = fetch_nested_cb;
+	nested_uri = make_source();
+
+	ATF_REQUIRE_EQ(xbps_fetch_file_dest(&xh, nested_uri, "dst", NULL), 1);
+	xbps_warn_printf("draining\n");
+	xbps_end(&xh);
+
+	ATF_CHECK_EQ(nested_rv, 1);
+	ATF_CHECK(nevents > 2);
+	free(nested_uri);
+	free(cwd);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, coalesce_order_test);
+	ATF_TP_ADD_TC(tp, error_order_test);
+	ATF_TP_ADD_TC(tp, nested_event_test);
+
+	return atf_no_error();
+}
@@ -0,0 +1,152 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdio.h>
+#include <string.h>
+#include <atf-c.h>
+#include <xbps.h>
+
+static xbps_dictionary_t
+dict_init(void)
+{
+	xbps_dictionary_t d;
+
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE(xbps_dictionary_set_cstring(d, "pkgver", "foo-1.0_1"));
+	ATF_REQUIRE(xbps_dictionary_set_cstring(d, "arch", "noarch"));
+	ATF_REQUIRE(xbps_dictionary_set_cstring(d, "short_desc", "foo pkg"));
+
+	return d;
+}
+
+static void
+check_orig(xbps_dictionary_t d)
+{
+	const char *str = NULL;
+
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 3);
+	ATF_REQUIRE(xbps_dictionary_get_cstring_nocopy(d, "pkgver", &str));
+	ATF_REQUIRE_STREQ(str, "foo-1.0_1");
+	ATF_REQUIRE(xbps_dictionary_get_cstring_nocopy(d, "arch", &str));
+	ATF_REQUIRE_STREQ(str, "noarch");
+	ATF_REQUIRE(xbps_dictionary_get_cstring_nocopy(d, "short_desc", &str));
+	ATF_REQUIRE_STREQ(str, "foo pkg");
+}
+
+static void
+modify(xbps_dictionary_t d)
+{
+	const char *str = NULL;
+
+	ATF_REQUIRE(xbps_dictionary_set_cstring(d, "pkgver", "foo-2.0_1"));
+	ATF_REQUIRE(xbps_dictionary_set_cstring(d, "automatic-install", "yes"));
+	xbps_dictionary_remove(d, "arch");
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 3);
+	ATF_REQUIRE(xbps_dictionary_get_cstring_nocopy(d, "pkgver", &str));
+	ATF_REQUIRE_STREQ(str, "foo-2.0_1");
+	ATF_REQUIRE_EQ(xbps_dictionary_get(d, "arch"), NULL);
+}
+
+ATF_TC(copy_modify_free_orig_test);
+ATF_TC_HEAD(copy_modify_free_orig_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test modifying a dictionary copy "
+	    "and releasing the original first");
+}
+
+ATF_TC_BODY(copy_modify_free_orig_test, tc)
+{
+	xbps_dictionary_t d, copy;
+
+	d = dict_init();
+	copy = xbps_dictionary_copy_mutable(d);
+	ATF_REQUIRE(copy != NULL);
+	check_orig(copy);
+	modify(copy);
+	check_orig(d);
+	xbps_object_release(d);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(copy), 3);
+	xbps_object_release(copy);
+}
+
+ATF_TC(copy_modify_free_copy_test);
+ATF_TC_HEAD(copy_modify_free_copy_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test modifying the original of a "
+	    "dictionary copy and releasing the copy first");
+}
+
+ATF_TC_BODY(copy_modify_free_copy_test, tc)
+{
+	xbps_dictionary_t d, copy;
+
+	d = dict_init();
+	copy = xbps_dictionary_copy_mutable(d);
+	ATF_REQUIRE(copy != NULL);
+	modify(d);
+	check_orig(copy);
+	xbps_object_release(copy);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 3);
+	xbps_object_release(d);
+}
+
+ATF_TC(copy_ensure_capacity_test);
+ATF_TC_HEAD(copy_ensure_capacity_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_dictionary_ensure_capacity "
+	    "on a dictionary copy");
+}
+
+ATF_TC_BODY(copy_ensure_capacity_test, tc)
+{
+	xbps_dictionary_t d, copy;
+	char key[32];
+
+	d = dict_init();
+	copy = xbps_dictionary_copy_mutable(d);
+	ATF_REQUIRE(copy != NULL);
+	ATF_REQUIRE(xbps_dictionary_ensure_capacity(copy, 64));
+	check_orig(d);
+	check_orig(copy);
+	for (unsigned int i = 0; i < 61; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		ATF_REQUIRE(xbps_dictionary_set_bool(copy, key, true));
+	}
+	ATF_REQUIRE_EQ(xbps_dictionary_count(copy), 64);
+	check_orig(d);
+	xbps_object_release(d);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(copy), 64);
+	xbps_object_release(copy);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, copy_modify_free_orig_test);
+	ATF_TP_ADD_TC(tp, copy_modify_free_copy_test);
+	ATF_TP_ADD_TC(tp, copy_ensure_capacity_test);
+
+	return atf_no_error();
+}
@@ -23,6 +23,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *-
  */
+#include <pthread.h>
 #include <atf-c.h>
 #include <xbps.h>
 
@@ -176,12 +177,137 @@ ATF_TC_BODY(pkgdb_pkg_reverts_test, tc)
 	ATF_REQUIRE_EQ(xbps_pkg_reverts(pkgd, "reverts-0.5_1"), 0);
 }
 
+#define STRESS_THREADS	8
+#define STRESS_LOOPS	64
+
+struct stress_arg {
+	const char *tcsdir;
+	const char *deptree;
+	unsigned int failed;
+};
+
+static char *
+array_join(xbps_array_t a)
+{
+	xbps_string_t pstr;
+	const char *str;
+	char *res;
+
+	pstr = xbps_string_create();
+	for (unsigned int i = 0; i < xbps_array_count(a); i++) {
+		xbps_array_get_cstring_nocopy(a, i, &str);
+		xbps_string_append_cstring(pstr, str);
+		xbps_string_append_cstring(pstr, "\n");
+	}
+	res = xbps_string_cstring(pstr);
+	xbps_object_release(pstr);
+	return res;
+}
+
+/*
+ * Initializes a new handle and exercises the pkgdb, fulldeptree
+ * and rpool state kept in it.
+ */
+static char *
+stress_run(const char *tcsdir)
+{
+	struct xbps_handle xh;
+	xbps_dictionary_t pkgd;
+	xbps_array_t res;
+	const char *pkgver = NULL;
+	char *deptree = NULL, *revdeps = NULL;
+
+	memset(&xh, 0, sizeof(xh));
+	xbps_strlcpy(xh.rootdir, tcsdir, sizeof(xh.rootdir));
+	xbps_strlcpy(xh.metadir, tcsdir, sizeof(xh.metadir));
+	xbps_repo_store(&xh, "/nonexistent/repository");
+	xh.flags = XBPS_FLAG_IGNORE_CONF_REPOS;
+	if (xbps_init(&xh) != 0)
+		return NULL;
+
+	if ((pkgd = xbps_pkgdb_get_pkg(&xh, "mixed")) == NULL ||
+	    !xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver) ||
+	    strcmp(pkgver, "mixed-0.1_1"))
+		goto out;
+	if ((res = xbps_pkgdb_get_pkg_revdeps(&xh, "virtual-mixed")) == NULL)
+		goto out;
+	revdeps = array_join(res);
+	if (strcmp(revdeps, "four-0.1_1\ntwo-0.1_1\n"))
+		goto out;
+	if ((res = xbps_pkgdb_get_pkg_fulldeptree(&xh, "two")) == NULL)
+		goto out;
+	deptree = array_join(res);
+	xbps_object_release(res);
+	/* the unreachable repository is dropped from this handle only */
+	if (xbps_rpool_get_pkg(&xh, "mixed") != NULL ||
+	    xbps_rpool_get_repo(&xh, "/nonexistent/repository") != NULL) {
+		free(deptree);
+		deptree = NULL;
+	}
+out:
+	free(revdeps);
+	xbps_end(&xh);
+	return deptree;
+}
+
+static void *
+stress_thread(void *data)
+{
+	struct stress_arg *arg = data;
+	char *deptree;
+
+	for (unsigned int i = 0; i < STRESS_LOOPS; i++) {
+		deptree = stress_run(arg->tcsdir);
+		if (deptree == NULL || strcmp(deptree, arg->deptree))
+			arg->failed++;
+		free(deptree);
+	}
+	return NULL;
+}
+
+ATF_TC(pkgdb_concurrent_handles_test);
+ATF_TC_HEAD(pkgdb_concurrent_handles_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test independent handles used concurrently from several threads");
+}
+
+ATF_TC_BODY(pkgdb_concurrent_handles_test, tc)
+{
+	pthread_t threads[STRESS_THREADS];
+	struct stress_arg args[STRESS_THREADS];
+	const char *tcsdir;
+	char *deptree;
+	unsigned int i;
+
+	/* get test source dir */
+	tcsdir = atf_tc_get_config_var(tc, "srcdir");
+
+	/* reference result from a single handle */
+	deptree = stress_run(tcsdir);
+	ATF_REQUIRE(deptree != NULL);
+	ATF_REQUIRE_STREQ(deptree, "three-0.1_1\nfour-0.1_1\nmixed-0.1_1\n");
+
+	for (i = 0; i < STRESS_THREADS; i++) {
+		args[i].tcsdir = tcsdir;
+		args[i].deptree = deptree;
+		args[i].failed = 0;
+		ATF_REQUIRE_EQ(pthread_create(&threads[i], NULL,
+		    stress_thread, &args[i]), 0);
+	}
+	for (i = 0; i < STRESS_THREADS; i++) {
+		ATF_REQUIRE_EQ(pthread_join(threads[i], NULL), 0);
+		ATF_CHECK_EQ(args[i].failed, 0);
+	}
+	free(deptree);
+}
+
 ATF_TP_ADD_TCS(tp)
 {
 	ATF_TP_ADD_TC(tp, pkgdb_get_pkg_test);
 	ATF_TP_ADD_TC(tp, pkgdb_get_virtualpkg_test);
 	ATF_TP_ADD_TC(tp, pkgdb_get_pkg_revdeps_test);
 	ATF_TP_ADD_TC(tp, pkgdb_pkg_reverts_test);
+	ATF_TP_ADD_TC(tp, pkgdb_concurrent_handles_test);
 
 	return atf_no_error();
 }
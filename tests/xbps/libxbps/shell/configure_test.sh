@@ -31,6 +31,115 @@ EOF
 	atf_check_equal $perms 644
 }
 
+atf_test_case configure_all_deps
+
+configure_all_deps_head() {
+	atf_set "descr" "Tests for pkg configuration: concurrent configuration honors run_depends"
+}
+
+configure_all_deps_body() {
+	umask 077
+	mkdir -p repo pkg_A pkg_B pkg_C
+	cat >>pkg_A/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	sleep 1
+	touch A.done
+	;;
+esac
+EOF
+	cat >>pkg_B/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	[ -f A.done ] && touch B.done
+	;;
+esac
+EOF
+	cat >>pkg_C/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	touch C.done
+	;;
+esac
+EOF
+	chmod 755 pkg_A/INSTALL pkg_B/INSTALL pkg_C/INSTALL
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" -D "A>=0" ../pkg_B
+	atf_check_equal $? 0
+	xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_C
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C empty.conf -r root --repository=$PWD/repo -Uyd B C
+	atf_check_equal $? 0
+	atf_check_equal "$(xbps-query -C empty.conf -r root -p state B)" unpacked
+
+	XBPS_JOBS=4 xbps-reconfigure -C empty.conf -r root -a --parallel
+	atf_check_equal $? 0
+	atf_check -o ignore -- test -f root/B.done
+	atf_check -o ignore -- test -f root/C.done
+	atf_check_equal "$(stat --format=%a root/C.done)" 644
+	for p in A B C; do
+		atf_check_equal "$(xbps-query -C empty.conf -r root -p state $p)" installed
+	done
+}
+
+atf_test_case configure_all_serial
+
+configure_all_serial_head() {
+	atf_set "descr" "Tests for pkg configuration: scripts run one at a time by default"
+}
+
+configure_all_serial_body() {
+	mkdir -p repo pkg_A pkg_C
+	cat >>pkg_A/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	touch A.running
+	sleep 1
+	rm A.running
+	;;
+esac
+EOF
+	cat >>pkg_C/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	[ -f A.running ] && touch overlap
+	sleep 1
+	;;
+esac
+EOF
+	chmod 755 pkg_A/INSTALL pkg_C/INSTALL
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_C
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C empty.conf -r root --repository=$PWD/repo -Uyd A C
+	atf_check_equal $? 0
+
+	XBPS_JOBS=4 xbps-reconfigure -C empty.conf -r root -a
+	atf_check_equal $? 0
+	test -f root/overlap
+	atf_check_equal $? 1
+	for p in A C; do
+		atf_check_equal "$(xbps-query -C empty.conf -r root -p state $p)" installed
+	done
+}
+
 atf_init_test_cases() {
 	atf_add_test_case filemode
+	atf_add_test_case configure_all_deps
+	atf_add_test_case configure_all_serial
 }
@@ -725,12 +725,181 @@ update_issue_218_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case install_metafile_sha256
+
+install_metafile_sha256_head() {
+	atf_set "descr" "Tests for package install: metafile-sha256 matches the files plist"
+}
+
+install_metafile_sha256_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_B
+	echo "A-1.0_1" > pkg_A/usr/bin/A
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root --repo=repo -yd A B
+	atf_check_equal $? 0
+	sha=$(xbps-digest root/var/db/xbps/.A-files.plist)
+	atf_check_equal "$(xbps-query -r root -p metafile-sha256 A)" "$sha"
+	atf_check_equal "$(xbps-query -r root -p metafile-sha256 B)" ""
+
+	mkdir -p pkg_A/usr/lib
+	echo "A-1.1_1" > pkg_A/usr/lib/libA
+	cd repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root --repo=repo -yud
+	atf_check_equal $? 0
+	sha=$(xbps-digest root/var/db/xbps/.A-files.plist)
+	atf_check_equal "$(xbps-query -r root -p metafile-sha256 A)" "$sha"
+	xbps-pkgdb -r root -a
+	atf_check_equal $? 0
+}
+
+atf_test_case install_metafile_zstd
+
+install_metafile_zstd_head() {
+	atf_set "descr" "Tests for package install: zstd compressed files plist"
+}
+
+install_metafile_zstd_body() {
+	mkdir -p repo pkg_A/usr/bin xbps.d
+	echo "A-1.0_1" > pkg_A/usr/bin/A
+	echo "metacompression=zstd" > xbps.d/zstd.conf
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root -C $PWD/xbps.d --repo=repo -yd A
+	atf_check_equal $? 0
+	if [ "$(head -c4 root/var/db/xbps/.A-files.plist | od -An -tx1 | tr -d ' ')" != "28b52ffd" ]; then
+		atf_skip "xbps built without zstd support"
+	fi
+	sha=$(xbps-digest root/var/db/xbps/.A-files.plist)
+	atf_check_equal "$(xbps-query -r root -p metafile-sha256 A)" "$sha"
+	atf_check_equal "$(xbps-query -r root -f A)" "/usr/bin/A"
+	xbps-pkgdb -r root -a
+	atf_check_equal $? 0
+	# a truncated metafile is an error
+	cp root/var/db/xbps/.A-files.plist A-files.plist
+	head -c 16 A-files.plist > root/var/db/xbps/.A-files.plist
+	atf_check_equal "$(xbps-query -r root -f A)" ""
+	cp A-files.plist root/var/db/xbps/.A-files.plist
+	xbps-remove -r root -yd A
+	atf_check_equal $? 0
+	test -e root/usr/bin/A
+	atf_check_equal $? 1
+}
+
+atf_test_case install_pkgstore
+
+install_pkgstore_head() {
+	atf_set "descr" "Tests for package install: files taken from the package store"
+}
+
+install_pkgstore_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_A/usr/lib pkg_A/etc
+	echo "binary" > pkg_A/usr/bin/A
+	chmod 755 pkg_A/usr/bin/A
+	echo "library" > pkg_A/usr/lib/A
+	ln pkg_A/usr/lib/A pkg_A/usr/lib/A2
+	ln -s A pkg_A/usr/lib/A3
+	echo "conf" > pkg_A/etc/A.conf
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" -F "/etc/A.conf" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root1 --repo=repo --pkgstore=store -yd A
+	atf_check_equal $? 0
+	atf_check_equal "$(cat store/A-1.0_1.*/files/usr/bin/A)" binary
+	atf_check_equal "$(cat store/A-1.0_1.*/files/etc/A.conf)" conf
+	atf_check_equal "$(ls -a store | grep -c '^\.A-1.0_1')" 0
+
+	xbps-install -r root2 --repo=repo --pkgstore=store -yd A
+	atf_check_equal $? 0
+	atf_check_equal "$(cat root2/usr/bin/A)" binary
+	atf_check_equal "$(cat root2/etc/A.conf)" conf
+	atf_check_equal "$(stat -c %a root2/usr/bin/A)" 755
+	atf_check_equal "$(cat root2/usr/lib/A2)" library
+	atf_check test root2/usr/lib/A -ef root2/usr/lib/A2
+	atf_check_equal "$(readlink root2/usr/lib/A3)" A
+	xbps-pkgdb -r root2 A
+	atf_check_equal $? 0
+
+	# installed files don't share the store
+	echo "modified" > root2/usr/bin/A
+	atf_check_equal "$(cat store/A-1.0_1.*/files/usr/bin/A)" binary
+	atf_check_equal "$(cat root1/usr/bin/A)" binary
+
+	# a corrupted store entry is replaced
+	echo "modified" > store/A-1.0_1.*/files/usr/bin/A
+	xbps-install -r root3 --repo=repo --pkgstore=store -yd A
+	atf_check_equal $? 0
+	atf_check_equal "$(cat root3/usr/bin/A)" binary
+	atf_check_equal "$(cat store/A-1.0_1.*/files/usr/bin/A)" binary
+	atf_check_equal "$(ls store | grep -c '^A-1.0_1')" 1
+}
+
+atf_test_case install_pkgstore_skipped
+
+install_pkgstore_skipped_head() {
+	atf_set "descr" "Tests for package install: package store filled with files that are not extracted"
+}
+
+install_pkgstore_skipped_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_A/usr/share
+	echo "binary" > pkg_A/usr/bin/A
+	echo "data" > pkg_A/usr/share/A
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	# usr/bin/A matches its checksum, usr/share/A is not extracted
+	mkdir -p root1/usr/bin xbps.d
+	echo "binary" > root1/usr/bin/A
+	echo "noextract=/usr/share/*" > xbps.d/noextract.conf
+	xbps-install -C $PWD/xbps.d -r root1 --repo=repo --pkgstore=store -yd A
+	atf_check_equal $? 0
+	test -e root1/usr/share/A
+	atf_check_equal $? 1
+	atf_check_equal "$(cat store/A-1.0_1.*/files/usr/bin/A)" binary
+	atf_check_equal "$(cat store/A-1.0_1.*/files/usr/share/A)" data
+
+	xbps-install -r root2 --repo=repo --pkgstore=store -yd A
+	atf_check_equal $? 0
+	atf_check_equal "$(cat root2/usr/bin/A)" binary
+	atf_check_equal "$(cat root2/usr/share/A)" data
+}
+
 atf_init_test_cases() {
 	atf_add_test_case install_empty
 	atf_add_test_case install_with_deps
 	atf_add_test_case install_with_vpkg_deps
 	atf_add_test_case install_if_not_installed_on_update
 	atf_add_test_case install_dups
+	atf_add_test_case install_metafile_sha256
+	atf_add_test_case install_metafile_zstd
+	atf_add_test_case install_pkgstore
+	atf_add_test_case install_pkgstore_skipped
 	atf_add_test_case install_bestmatch
 	atf_add_test_case install_bestmatch_deps
 	atf_add_test_case install_bestmatch_disabled
@@ -489,6 +489,32 @@ remove_directory_body() {
 	atf_check_equal $? 1
 }
 
+atf_test_case remove_directory_tree
+
+remove_directory_tree_head() {
+	atf_set "descr" "xbps-remove(1): remove files from many directories"
+}
+
+remove_directory_tree_body() {
+	mkdir -p some_repo pkg_A/B/C/D pkg_A/B/E pkg_A/F
+	touch pkg_A/B/C/D/file00 pkg_A/B/C/file01 pkg_A/B/E/file02 \
+		pkg_A/B/file03 pkg_A/F/file04 pkg_A/file05
+	ln -s C pkg_A/B/link
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root -C empty.conf --repository=$PWD/some_repo -y A
+	atf_check_equal $? 0
+	touch root/B/E/unowned
+	xbps-remove -r root -C empty.conf -y A
+	atf_check_equal $? 0
+	atf_check -o inline:"root\nroot/B\nroot/B/E\nroot/B/E/unowned\n" -- \
+		sh -c "find root -path root/var -prune -o -print | sort"
+}
+
 atf_test_case keep_modified_files
 
 keep_modified_files_head() {
@@ -633,6 +659,7 @@ atf_init_test_cases() {
 	atf_add_test_case remove_with_revdeps_in_trans_inverted
 	atf_add_test_case remove_with_revdeps_in_trans_recursive
 	atf_add_test_case remove_directory
+	atf_add_test_case remove_directory_tree
 	atf_add_test_case keep_modified_files
 	atf_add_test_case remove_modified_files
 	atf_add_test_case keep_modified_conf_files
@@ -159,8 +159,55 @@ script_action_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case script_low_memory
+
+script_low_memory_head() {
+	atf_set "descr" "Tests for package scripts: scripts read again in low memory mode"
+}
+
+script_low_memory_body() {
+	mkdir some_repo root
+	mkdir -p pkg_A/usr/bin
+	echo "A-1.0_1" > pkg_A/usr/bin/foo
+	create_script pkg_A/INSTALL
+	create_script pkg_A/REMOVE
+
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C empty.conf -r root --repository=$PWD/some_repo --low-memory -y A 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep "^pre A 1.0_1 no" out
+	atf_check -o ignore -- grep "^post A 1.0_1 no" out
+
+	cd some_repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	# a budget of one byte is always exceeded
+	XBPS_MEMORY_BUDGET=1 xbps-install -C empty.conf -r root --repository=$PWD/some_repo -yu 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep "^pre A 1.1_1 yes" out
+	atf_check -o ignore -- grep "^post A 1.1_1 yes" out
+
+	# the scripts have been registered in the pkgdb
+	xbps-reconfigure -C empty.conf -r root -f A 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep "^post A 1.1_1 no" out
+	xbps-remove -C empty.conf -r root -y A 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep "^pre A 1.1_1 no" out
+	atf_check -o ignore -- grep "^post A 1.1_1 no" out
+}
+
 atf_init_test_cases() {
 	atf_add_test_case script_nargs
 	atf_add_test_case script_arch
 	atf_add_test_case script_action
+	atf_add_test_case script_low_memory
 }
@@ -905,8 +905,6 @@ cc_alternatives_removal_head() {
 	atf_set "descr" "xbps-alternatives: removal of the cc alternatives group"
 }
 cc_alternatives_removal_body() {
-	atf_expect_fail "https://github.com/void-linux/xbps/pull/253"
-
 	mkdir -p repo pkg_A/usr/bin
 	mkdir -p repo pkg_B/usr/bin
 	touch pkg_A/usr/bin/gcc
@@ -942,6 +940,108 @@ cc_alternatives_removal_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case set_switch_links
+
+set_switch_links_head() {
+	atf_set "descr" "xbps-alternatives: switch a group with links only one provider has"
+}
+set_switch_links_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_B/usr/bin
+	touch pkg_A/usr/bin/fileA pkg_A/usr/bin/fileA2 pkg_B/usr/bin/fileB pkg_B/usr/bin/fileB2
+	cd repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" --alternatives "file:/usr/bin/file:/usr/bin/fileA file:/usr/bin/file2:/usr/bin/fileA2 file:/usr/bin/only:/usr/bin/fileA" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.1_1 -s "B pkg" --alternatives "file:/usr/bin/file:/usr/bin/fileB file:/usr/bin/file2:/usr/bin/fileB2" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root --repository=repo -ydv A B
+	atf_check_equal $? 0
+
+	xbps-alternatives -r root -s B
+	atf_check_equal $? 0
+	atf_check_equal "$(readlink root/usr/bin/file)" fileB
+	atf_check_equal "$(readlink root/usr/bin/file2)" fileB2
+	test -h root/usr/bin/only
+	atf_check_equal $? 1
+
+	xbps-alternatives -r root -s A
+	atf_check_equal $? 0
+	atf_check_equal "$(readlink root/usr/bin/file)" fileA
+	atf_check_equal "$(readlink root/usr/bin/file2)" fileA2
+	atf_check_equal "$(readlink root/usr/bin/only)" fileA
+	ls root/usr/bin/*.xbps-alt-new
+	atf_check_equal $? 2
+}
+
+atf_test_case set_failed_stage
+
+set_failed_stage_head() {
+	atf_set "descr" "xbps-alternatives: nothing is switched if a new link can't be created"
+}
+set_failed_stage_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_B/usr/bin
+	touch pkg_A/usr/bin/fileA pkg_A/usr/bin/fileA2 pkg_B/usr/bin/fileB pkg_B/usr/bin/fileB2
+	cd repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" --alternatives "file:/usr/bin/file:/usr/bin/fileA file:/usr/bin/file2:/usr/bin/fileA2 file:/usr/bin/only:/usr/bin/fileA" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.1_1 -s "B pkg" --alternatives "file:/usr/bin/file:/usr/bin/fileB file:/usr/bin/file2:/usr/bin/fileB2" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root --repository=repo -ydv A B
+	atf_check_equal $? 0
+
+	# the new link of file2 can't be staged
+	mkdir -p root/usr/bin/file2.xbps-alt-new/dir
+	xbps-alternatives -r root -s B
+	atf_check_equal $? 1
+	atf_check_equal "$(readlink root/usr/bin/file)" fileA
+	atf_check_equal "$(readlink root/usr/bin/file2)" fileA2
+	atf_check_equal "$(readlink root/usr/bin/only)" fileA
+	test -e root/usr/bin/file.xbps-alt-new
+	atf_check_equal $? 1
+	out=$(xbps-alternatives -r root -l -g file | sed -n 2p)
+	atf_check_equal "$out" " - A (current)"
+}
+
+atf_test_case set_failed_switch
+
+set_failed_switch_head() {
+	atf_set "descr" "xbps-alternatives: a partially switched group is rolled back"
+}
+set_failed_switch_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_B/usr/bin
+	touch pkg_A/usr/bin/fileA pkg_A/usr/bin/fileA2 pkg_B/usr/bin/fileB pkg_B/usr/bin/fileB2
+	cd repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" --alternatives "file:/usr/bin/file:/usr/bin/fileA file:/usr/bin/file2:/usr/bin/fileA2 file:/usr/bin/only:/usr/bin/fileA" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.1_1 -s "B pkg" --alternatives "file:/usr/bin/file:/usr/bin/fileB file:/usr/bin/file2:/usr/bin/fileB2" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root --repository=repo -ydv A B
+	atf_check_equal $? 0
+
+	# file is switched before file2 can't be replaced
+	rm root/usr/bin/file2
+	mkdir -p root/usr/bin/file2/dir
+	xbps-alternatives -r root -s B
+	atf_check_equal $? 1
+	atf_check_equal "$(readlink root/usr/bin/file)" fileA
+	atf_check_equal "$(readlink root/usr/bin/only)" fileA
+	test -d root/usr/bin/file2/dir
+	atf_check_equal $? 0
+	ls root/usr/bin/*.xbps-alt-new
+	atf_check_equal $? 2
+}
+
 atf_init_test_cases() {
 	atf_add_test_case register_one
 	atf_add_test_case register_one_dangling
@@ -965,4 +1065,7 @@ atf_init_test_cases() {
 	atf_add_test_case keep_provider_on_update
 	atf_add_test_case replace_file_with_alternative
 	atf_add_test_case cc_alternatives_removal
+	atf_add_test_case set_switch_links
+	atf_add_test_case set_failed_stage
+	atf_add_test_case set_failed_switch
 }
@@ -592,6 +592,105 @@ EOF
 	atf_check_equal "$(tr '\n' ' ' < out.sorted)" "$(tr '\n' ' ' < expected)"
 }
 
+cache_repo() {
+	mkdir -p some_repo pkg_A void-packages/srcpkgs/A
+	touch pkg_A/file00
+	cat > void-packages/srcpkgs/A/template <<EOF
+pkgname=A
+version=2
+revision=1
+EOF
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	out=$(xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages)
+	atf_check_equal $? 0
+	atf_check_equal "$out" "A 1.0_1 2_1 A $PWD/some_repo"
+	# tamper with the cached version to tell cached and parsed results apart
+	cache=void-packages/.xbps-checkvers-0.58.plist
+	sed -i -e 's|<string>2</string>|<string>3</string>|' $cache
+	grep -q "<string>3</string>" $cache
+	atf_check_equal $? 0
+}
+
+atf_test_case cache_unchanged
+
+cache_unchanged_head() {
+	atf_set "descr" "xbps-checkvers(1): unchanged templates are served from the cache"
+}
+cache_unchanged_body() {
+	cache_repo
+	out=$(xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages)
+	atf_check_equal $? 0
+	atf_check_equal "$out" "A 1.0_1 3_1 A $PWD/some_repo"
+	# a new mtime with the same contents, e.g. a fresh checkout
+	touch -d "2000-01-01" void-packages/srcpkgs/A/template
+	out=$(xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages)
+	atf_check_equal $? 0
+	atf_check_equal "$out" "A 1.0_1 3_1 A $PWD/some_repo"
+}
+
+atf_test_case cache_modified
+
+cache_modified_head() {
+	atf_set "descr" "xbps-checkvers(1): modified templates are parsed again"
+}
+cache_modified_body() {
+	cache_repo
+	# same size, different contents
+	sed -i -e 's/version=2/version=4/' void-packages/srcpkgs/A/template
+	touch -d "2000-01-01" void-packages/srcpkgs/A/template
+	out=$(xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages)
+	atf_check_equal $? 0
+	atf_check_equal "$out" "A 1.0_1 4_1 A $PWD/some_repo"
+	# different size
+	sed -i -e 's/version=4/version=4.1/' void-packages/srcpkgs/A/template
+	touch -d "2000-01-01" void-packages/srcpkgs/A/template
+	out=$(xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages)
+	atf_check_equal $? 0
+	atf_check_equal "$out" "A 1.0_1 4.1_1 A $PWD/some_repo"
+}
+
+atf_test_case parallel
+
+parallel_head() {
+	atf_set "descr" "xbps-checkvers(1): parallel output is sorted and matches serial output"
+}
+parallel_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	for i in 01 02 03 04 05 06 07 08 09 10 11 12 13 14 15 16 17 18 19 20; do
+		mkdir -p void-packages/srcpkgs/pkg$i
+		cat > void-packages/srcpkgs/pkg$i/template <<EOF
+pkgname=pkg$i
+version=2
+revision=1
+EOF
+		cd some_repo
+		xbps-create -A noarch -n pkg$i-1_1 -s "pkg$i pkg" ../pkg_A
+		atf_check_equal $? 0
+		cd ..
+	done
+	xbps-rindex -d -a $PWD/some_repo/*.xbps
+	atf_check_equal $? 0
+
+	XBPS_JOBS=1 xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages > serial
+	atf_check_equal $? 0
+	atf_check_equal "$(wc -l < serial)" 20
+	sort -c serial
+	atf_check_equal $? 0
+	for run in 1 2 3; do
+		rm -f void-packages/.xbps-checkvers-*.plist
+		XBPS_JOBS=8 xbps-checkvers -R $PWD/some_repo -D $PWD/void-packages > parallel
+		atf_check_equal $? 0
+		cmp serial parallel
+		atf_check_equal $? 0
+	done
+}
+
 atf_init_test_cases() {
 	atf_add_test_case srcpkg_newer
 	atf_add_test_case srcpkg_newer_with_refs
@@ -612,4 +711,7 @@ atf_init_test_cases() {
 	atf_add_test_case subpkg
 	atf_add_test_case removed
 	atf_add_test_case removed_subpkgs
+	atf_add_test_case parallel
+	atf_add_test_case cache_unchanged
+	atf_add_test_case cache_modified
 }
@@ -0,0 +1,65 @@
+#! /usr/bin/env atf-sh
+# Test that xbps-dgraph(1) works as expected.
+
+dgraph_repo() {
+	mkdir -p some_repo pkg_A pkg_B pkg_C
+	touch pkg_A/file00 pkg_B/file01 pkg_C/file02
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" --dependencies "B>=0" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_B
+	atf_check_equal $? 0
+	xbps-create -A noarch -n C-1.0_1 -s "C pkg" --dependencies "A>=0" ../pkg_C
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+	mkdir -p xbps.d
+	echo "repository=$PWD/some_repo" > xbps.d/repo.conf
+}
+
+atf_test_case all_pkgdb
+
+all_pkgdb_head() {
+	atf_set "descr" "xbps-dgraph(1) -a: graph of installed packages"
+}
+
+all_pkgdb_body() {
+	dgraph_repo
+	out=$(xbps-dgraph -r root -a -T json)
+	atf_check_equal $? 0
+	atf_check_equal "$out" '{"nodes":[{"id":0,"pkgver":"A-1.0_1","installed":true},{"id":1,"pkgver":"B-1.0_1","installed":true}],"edges":[[0,1]]}'
+}
+
+atf_test_case all_repo
+
+all_repo_head() {
+	atf_set "descr" "xbps-dgraph(1) -aR: graph of repository packages"
+}
+
+all_repo_body() {
+	dgraph_repo
+	out=$(xbps-dgraph -C $PWD/xbps.d -r root -aR -T json)
+	atf_check_equal $? 0
+	atf_check_equal "$out" '{"nodes":[{"id":0,"pkgver":"A-1.0_1","installed":true},{"id":1,"pkgver":"B-1.0_1","installed":true},{"id":2,"pkgver":"C-1.0_1"}],"edges":[[0,1],[2,0]]}'
+}
+
+atf_test_case format_without_all
+
+format_without_all_head() {
+	atf_set "descr" "xbps-dgraph(1) -T: rejected without -a"
+}
+
+format_without_all_body() {
+	dgraph_repo
+	xbps-dgraph -r root -T json A
+	atf_check_equal $? 1
+}
+
+atf_init_test_cases() {
+	atf_add_test_case all_pkgdb
+	atf_add_test_case all_repo
+	atf_add_test_case format_without_all
+}
@@ -175,6 +175,70 @@ reproducible_body() {
 	atf_check_equal $? 1
 }
 
+atf_test_case timings
+
+timings_head() {
+	atf_set "descr" "xbps-install(1): --timings output and plist dump"
+}
+
+timings_body() {
+	mkdir -p repo pkg_A
+	touch pkg_A/file00
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y --timings A 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep -E "^unpack +1 " out
+	atf_check -o ignore -- grep -E "^scripts-run " out
+
+	rm -rf root
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y --timings=$PWD/t.plist A
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep "<key>phases</key>" t.plist
+	atf_check -o ignore -- grep "<key>pkgdb-flush</key>" t.plist
+	atf_check -o ignore -- grep "<key>bytes-decompressed</key>" t.plist
+}
+
+atf_test_case durability
+
+durability_head() {
+	atf_set "descr" "xbps-install(1): --durability syncs the rootdir as requested"
+}
+
+durability_body() {
+	mkdir -p repo pkg_A pkg_B
+	touch pkg_A/file00 pkg_B/file01
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y --timings --durability=none A B 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep -E "^sync +0 " out
+	atf_check -o ignore -- test -s root/var/db/xbps/pkgdb-0.38.plist
+
+	rm -rf root
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y --timings A B 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep -E "^sync +2 " out
+
+	rm -rf root
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y --timings --durability=package A B 2>out
+	atf_check_equal $? 0
+	atf_check -o ignore -- grep -E "^sync +4 " out
+
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y --durability=foo A
+	atf_check_equal $? 1
+}
+
 atf_init_test_cases() {
 	atf_add_test_case install_existent
 	atf_add_test_case update_existent
@@ -182,4 +246,6 @@ atf_init_test_cases() {
 	atf_add_test_case unpacked_dep
 	atf_add_test_case reinstall_unpacked_unpack_only
 	atf_add_test_case reproducible
+	atf_add_test_case timings
+	atf_add_test_case durability
 }
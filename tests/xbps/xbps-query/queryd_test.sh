@@ -0,0 +1,81 @@
+#! /usr/bin/env atf-sh
+# Test that xbps-queryd(8) works as expected.
+
+queryd_start() {
+	export XBPS_QUERYD_SOCKET=$PWD/queryd.sock
+	xbps-queryd -d -r root -C empty.conf --repository=$PWD/repo 2>queryd.log &
+	echo $! > queryd.pid
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		[ -S queryd.sock ] && return 0
+		sleep 0.5
+	done
+	atf_fail "xbps-queryd did not start"
+}
+
+queryd_stop() {
+	kill $(cat queryd.pid)
+	wait $(cat queryd.pid)
+}
+
+atf_test_case queryd_serve
+
+queryd_serve_head() {
+	atf_set "descr" "xbps-queryd(8): queries served by the daemon"
+}
+
+queryd_serve_body() {
+	mkdir -p repo pkg_A/bin pkg_B/bin
+	echo "hello world!" > pkg_A/bin/file
+	cd repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	mkdir root
+	xbps-install -r root -C empty.conf --repository=$PWD/repo -y foo
+	atf_check_equal $? 0
+	queryd_start
+	grep -q "state generation 1 loaded" queryd.log
+	atf_check_equal $? 0
+	atf_check_equal "$(stat -c %a queryd.sock)" 600
+	res=$(xbps-query -r root -C empty.conf --repository=$PWD/repo -l)
+	atf_check_equal $? 0
+	atf_check_equal "$res" "ii foo-1.0_1 foo pkg"
+	res=$(xbps-query -r root -C empty.conf --repository=$PWD/repo -f foo)
+	atf_check_equal $? 0
+	atf_check_equal "$res" "/bin/file"
+	xbps-query -r root -C empty.conf --repository=$PWD/repo bar
+	atf_check_equal $? 2
+	# the daemon doesn't write files for the client
+	res=$(xbps-query -r root -C empty.conf --repository=$PWD/repo --timings=timings.out -l 2>query.log)
+	atf_check_equal $? 0
+	atf_check_equal "$res" "ii foo-1.0_1 foo pkg"
+	grep -q "request not served, falling back" query.log
+	atf_check_equal $? 0
+	[ -s timings.out ]
+	atf_check_equal $? 0
+	# a different repository list falls back to a local query
+	res=$(xbps-query -r root -C empty.conf -l)
+	atf_check_equal $? 0
+	atf_check_equal "$res" "ii foo-1.0_1 foo pkg"
+	# the daemon reloads its state when the repository changes
+	cd repo
+	xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/bar-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+	cd ..
+	res=$(xbps-query -r root -C empty.conf --repository=$PWD/repo -Rs bar)
+	atf_check_equal $? 0
+	atf_check_equal "$res" "[-] bar-1.0_1 bar pkg"
+	grep -q "state generation 2 loaded" queryd.log
+	atf_check_equal $? 0
+	queryd_stop
+	[ -e queryd.sock ]
+	atf_check_equal $? 1
+}
+
+atf_init_test_cases() {
+	atf_add_test_case queryd_serve
+}
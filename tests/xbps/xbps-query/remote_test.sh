@@ -23,6 +23,155 @@ remote_files_body() {
 	atf_check_equal $? 2
 }
 
+# Serves the current directory over HTTP on a free port written to
+# http.port, logging the requests and their Range header to http.log;
+# ranges are only supported with "range".
+http_start() {
+	command -v python3 >/dev/null || atf_skip "python3 not found"
+	cat > httpd.py <<'EOF'
+import http.server, os, sys
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+	def send_head(self):
+		rng = self.headers.get("Range")
+		with open("../http.log", "a") as log:
+			log.write("%s %s %s\n" % (self.command, self.path, rng))
+		if sys.argv[1] != "range" or rng is None:
+			return super().send_head()
+		path = self.translate_path(self.path)
+		size = os.path.getsize(path)
+		start = int(rng.split("=")[1].split("-")[0])
+		f = open(path, "rb")
+		f.seek(start)
+		self.send_response(206)
+		self.send_header("Content-Length", str(size - start))
+		self.send_header("Content-Range", "bytes %d-%d/%d" % (start, size - 1, size))
+		self.end_headers()
+		return f
+
+	def log_message(self, *args):
+		pass
+
+os.chdir("some_repo")
+srv = http.server.HTTPServer(("127.0.0.1", 0), Handler)
+# clients close the connection once they have what they need
+srv.handle_error = lambda *args: None
+with open("../http.port", "w") as f:
+	f.write(str(srv.server_address[1]))
+srv.serve_forever()
+EOF
+	python3 httpd.py $1 &
+	echo $! > http.pid
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		[ -s http.port ] && return 0
+		sleep 0.5
+	done
+	atf_fail "http server did not start"
+}
+
+http_stop() {
+	kill $(cat http.pid)
+}
+
+# Creates a repository with a package of 3MB; with an index if "indexed".
+remote_repo() {
+	mkdir -p some_repo pkg_A/bin
+	dd if=/dev/urandom of=pkg_A/bin/big bs=1024 count=3072
+	echo "hello world!" > pkg_A/bin/file
+	# stored last, after 3MB of data
+	echo "last" > pkg_A/bin/a
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" \
+	    ${1:+--indexed} ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+}
+
+atf_test_case remote_cat_range
+
+remote_cat_range_head() {
+	atf_set "descr" "xbps-query(1) -R --cat: members extracted with range requests"
+}
+
+remote_cat_range_body() {
+	remote_repo indexed
+	http_start range
+	repo=http://127.0.0.1:$(cat http.port)
+	xbps-query -C empty.conf -M --repository=$repo --cat /bin/big foo > big
+	atf_check_equal $? 0
+	cmp big pkg_A/bin/big
+	atf_check_equal $? 0
+	out=$(xbps-query -C empty.conf -M --repository=$repo --cat /bin/file foo)
+	atf_check_equal "$out" "hello world!"
+	out=$(xbps-query -C empty.conf -M --repository=$repo -f foo | tr '\n' ' ')
+	atf_check_equal "$out" "/bin/a /bin/big /bin/file "
+	: > http.log
+	out=$(xbps-query -C empty.conf -M --repository=$repo --cat /bin/a foo)
+	atf_check_equal "$out" "last"
+	http_stop
+	# the package was not fetched from the beginning
+	grep -q "^GET /foo-1.0_1.noarch.xbps bytes=" http.log
+	atf_check_equal $? 0
+	grep -q "^GET /foo-1.0_1.noarch.xbps None" http.log
+	atf_check_equal $? 1
+	# a missing package is an error
+	mv some_repo/foo-1.0_1.noarch.xbps .
+	http_start range
+	repo=http://127.0.0.1:$(cat http.port)
+	xbps-query -C empty.conf -M --repository=$repo --cat /bin/file foo
+	rv=$?
+	grep -q "^GET /foo-1.0_1.noarch.xbps" http.log
+	atf_check_equal $? 0
+	http_stop
+	[ $rv -ne 0 ]
+	atf_check_equal $? 0
+}
+
+atf_test_case remote_cat_norange
+
+remote_cat_norange_head() {
+	atf_set "descr" "xbps-query(1) -R --cat: streaming without range support"
+}
+
+remote_cat_norange_body() {
+	remote_repo indexed
+	http_start norange
+	repo=http://127.0.0.1:$(cat http.port)
+	xbps-query -C empty.conf -M --repository=$repo --cat /bin/big foo > big
+	atf_check_equal $? 0
+	cmp big pkg_A/bin/big
+	atf_check_equal $? 0
+	out=$(xbps-query -C empty.conf -M --repository=$repo -f foo | tr '\n' ' ')
+	atf_check_equal "$out" "/bin/a /bin/big /bin/file "
+	out=$(xbps-query -C empty.conf -M --repository=$repo --cat /bin/a foo)
+	atf_check_equal "$out" "last"
+	http_stop
+}
+
+atf_test_case remote_cat_noindex
+
+remote_cat_noindex_head() {
+	atf_set "descr" "xbps-query(1) -R --cat: packages without index are streamed"
+}
+
+remote_cat_noindex_body() {
+	remote_repo
+	http_start range
+	repo=http://127.0.0.1:$(cat http.port)
+	out=$(xbps-query -C empty.conf -M --repository=$repo --cat /bin/a foo)
+	atf_check_equal "$out" "last"
+	http_stop
+	# a single request, no range requests looking for the index
+	atf_check_equal "$(grep -c /foo-1.0_1.noarch.xbps http.log)" 1
+	grep -q "^GET /foo-1.0_1.noarch.xbps None" http.log
+	atf_check_equal $? 0
+}
+
 atf_init_test_cases() {
 	atf_add_test_case remote_files
+	atf_add_test_case remote_cat_range
+	atf_add_test_case remote_cat_norange
+	atf_add_test_case remote_cat_noindex
 }
@@ -0,0 +1,63 @@
+#! /usr/bin/env atf-sh
+# Test that xbps-query(1) -Rs works with and without the search index
+
+atf_test_case search_index
+
+search_index_head() {
+	atf_set "descr" "xbps-query(1) -Rs: search index matches the repository index"
+}
+
+search_index_body() {
+	mkdir -p repo pkg_A
+	cd repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n bar-1.0_1 -s "A Foo helper" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n baz-1.0_1 -s "baz pkg" --provides "vfoo-1_1" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	atf_check -o ignore -- test -f *-repodata.search
+	cd ..
+	for pat in foo FOO vfoo "o p" pkg zzz; do
+		idx=$(xbps-query -C empty.conf --repository=repo -Rs "$pat")
+		atf_check_equal $? 0
+		mv repo/*-repodata.search repo/search.bak
+		noidx=$(xbps-query -C empty.conf --repository=repo -Rs "$pat")
+		atf_check_equal $? 0
+		mv repo/search.bak repo/$(ls repo | grep 'repodata$').search
+		atf_check_equal "$idx" "$noidx"
+	done
+}
+
+atf_test_case search_index_stale
+
+search_index_stale_head() {
+	atf_set "descr" "xbps-query(1) -Rs: stale search index is ignored"
+}
+
+search_index_stale_body() {
+	mkdir -p repo pkg_A
+	cd repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	searchidx=$(echo *-repodata.search)
+	cp $searchidx search.old
+	xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	mv search.old $searchidx
+	cd ..
+	out=$(xbps-query -C empty.conf --repository=repo -Rs foo)
+	atf_check_equal $? 0
+	atf_check_equal "$out" "[-] foo-1.1_1 foo pkg"
+}
+
+atf_init_test_cases() {
+	atf_add_test_case search_index
+	atf_add_test_case search_index_stale
+}
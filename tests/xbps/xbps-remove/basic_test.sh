@@ -136,10 +136,86 @@ clean_cache_dry_run_perm_body() {
 	atf_check_equal "$out" "Removed A-1.0_1.noarch.xbps from cachedir (obsolete)"
 }
 
+atf_test_case clean_cache_keep_versions
+
+clean_cache_keep_versions_head() {
+	atf_set "descr" "xbps-remove(1): clean cache keeping the last N versions"
+}
+
+clean_cache_keep_versions_body() {
+	mkdir -p repo pkg_A/B/C
+	touch pkg_A/
+	cd repo
+	for v in 1 2 3; do
+		xbps-create -A noarch -n A-1.0_${v} -s "A pkg" ../pkg_A
+		atf_check_equal $? 0
+	done
+	mkdir -p ../root/var/cache/xbps
+	mv A-1.0_1.noarch.xbps A-1.0_2.noarch.xbps ../root/var/cache/xbps
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	mkdir -p root/etc/xbps.d root/var/db/xbps/https___localhost_
+	cp repo/*-repodata root/var/db/xbps/https___localhost_
+	atf_check_equal $? 0
+	cp repo/*.xbps root/var/cache/xbps
+	atf_check_equal $? 0
+	echo "repository=https://localhost/" >root/etc/xbps.d/localrepo.conf
+	out="$(XBPS_JOBS=4 xbps-remove -r root -C etc/xbps.d -O --keep-versions 2)"
+	atf_check_equal $? 0
+	atf_check_equal "$out" "Removed A-1.0_1.noarch.xbps from cachedir (obsolete)"
+	test -f root/var/cache/xbps/A-1.0_2.noarch.xbps
+	atf_check_equal $? 0
+	test -f root/var/cache/xbps/A-1.0_3.noarch.xbps
+	atf_check_equal $? 0
+	# the sidecar index is kept for the next run
+	test -f root/var/cache/xbps/.xbps-cache-index.plist
+	atf_check_equal $? 0
+	grep -q "<key>A-1.0_3.noarch.xbps</key>" root/var/cache/xbps/.xbps-cache-index.plist
+	atf_check_equal $? 0
+	out="$(xbps-remove -r root -C etc/xbps.d -O)"
+	atf_check_equal $? 0
+	atf_check_equal "$out" "Removed A-1.0_2.noarch.xbps from cachedir (obsolete)"
+}
+
+atf_test_case clean_cache_max_size
+
+clean_cache_max_size_head() {
+	atf_set "descr" "xbps-remove(1): clean cache with a byte budget"
+}
+
+clean_cache_max_size_body() {
+	mkdir -p repo pkg_A/B/C
+	touch pkg_A/
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	mkdir -p root/etc/xbps.d root/var/db/xbps/https___localhost_ root/var/cache/xbps
+	cp repo/*-repodata root/var/db/xbps/https___localhost_
+	atf_check_equal $? 0
+	cp repo/*.xbps root/var/cache/xbps
+	atf_check_equal $? 0
+	touch -d "2000-01-01" root/var/cache/xbps/B-1.0_1.noarch.xbps
+	echo "repository=https://localhost/" >root/etc/xbps.d/localrepo.conf
+	size=$(wc -c < root/var/cache/xbps/A-1.0_1.noarch.xbps)
+	out="$(xbps-remove -r root -C etc/xbps.d -O --max-cache-size $size)"
+	atf_check_equal $? 0
+	atf_check_equal "$out" "Removed B-1.0_1.noarch.xbps from cachedir (cache size limit)"
+	test -f root/var/cache/xbps/A-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+}
+
 atf_init_test_cases() {
 	atf_add_test_case remove_directory
 	atf_add_test_case remove_orphans
 	atf_add_test_case clean_cache
 	atf_add_test_case clean_cache_dry_run
 	atf_add_test_case clean_cache_dry_run_perm
+	atf_add_test_case clean_cache_keep_versions
+	atf_add_test_case clean_cache_max_size
 }
@@ -0,0 +1,188 @@
+#! /usr/bin/env atf-sh
+# Test that xbps-rindex(1) -D (delta mode) works as expected.
+
+atf_test_case delta_index
+
+delta_index_head() {
+	atf_set "descr" "xbps-rindex(1) -D: delta announced in the index"
+}
+
+delta_index_body() {
+	mkdir -p some_repo pkg_A
+	echo 1.0 > pkg_A/file
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	echo 1.1 > ../pkg_A/file
+	xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -D $PWD/foo-1.1_1.noarch.xbps $PWD/foo-1.0_1.noarch.xbps
+	atf_check_equal $? 1
+	xbps-rindex -d -a $PWD/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-rindex -d -D $PWD/foo-1.1_1.noarch.xbps $PWD/foo-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+	[ -f foo-1.1_1.noarch.from-1.0_1.xbps-delta ]
+	atf_check_equal $? 0
+	cd ..
+	out=$(xbps-query -r root --repository=$PWD/some_repo -p deltas foo | sed -n 4p)
+	atf_check_equal "$out" "foo-1.0_1"
+	# registering the package again drops its deltas
+	xbps-rindex -d -f -a $PWD/some_repo/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	out=$(xbps-query -r root --repository=$PWD/some_repo -p deltas foo)
+	atf_check_equal "$out" ""
+}
+
+# Serves some_repo over HTTP on a free port written to http.port,
+# logging the requested paths to http.log.
+http_start() {
+	command -v python3 >/dev/null || atf_skip "python3 not found"
+	cat > httpd.py <<'EOF'
+import http.server, os
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+	def send_head(self):
+		with open("../http.log", "a") as log:
+			log.write("%s %s\n" % (self.command, self.path))
+		return super().send_head()
+
+	def log_message(self, *args):
+		pass
+
+os.chdir("some_repo")
+srv = http.server.HTTPServer(("127.0.0.1", 0), Handler)
+with open("../http.port", "w") as f:
+	f.write(str(srv.server_address[1]))
+srv.serve_forever()
+EOF
+	python3 httpd.py &
+	echo $! > http.pid
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		[ -s http.port ] && return 0
+		sleep 0.5
+	done
+	atf_fail "http server did not start"
+}
+
+http_stop() {
+	kill $(cat http.pid)
+}
+
+atf_test_case delta_update
+
+delta_update_head() {
+	atf_set "descr" "xbps-rindex(1) -D: update rebuilds the package from a delta"
+}
+
+delta_update_body() {
+	command -v openssl >/dev/null || atf_skip "openssl(1) not found"
+	openssl genrsa -out privkey.pem 2048
+	atf_check_equal $? 0
+
+	mkdir -p some_repo pkg_A/usr/bin
+	echo 1.0 > pkg_A/usr/bin/foo
+	dd if=/dev/urandom of=pkg_A/usr/bin/data bs=1024 count=256
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" --compression none ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	xbps-rindex -s --signedby test --privkey ../privkey.pem $PWD
+	atf_check_equal $? 0
+	xbps-rindex -S --privkey ../privkey.pem $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	http_start
+	repo=http://127.0.0.1:$(cat http.port)
+	yes | xbps-install -r root -R $repo -Syd foo
+	atf_check_equal $? 0
+
+	# repodata is refetched if its mtime changed
+	sleep 1
+	echo 1.1 > pkg_A/usr/bin/foo
+	cd some_repo
+	xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" --compression none ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-rindex -S --privkey ../privkey.pem $PWD/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-rindex -d -D $PWD/foo-1.1_1.noarch.xbps $PWD/foo-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+	size=$(wc -c < foo-1.1_1.noarch.from-1.0_1.xbps-delta)
+	[ $size -lt 65536 ]
+	atf_check_equal $? 0
+	# the update can only succeed through the delta
+	mv foo-1.1_1.noarch.xbps ..
+	cd ..
+	: > http.log
+	xbps-install -r root -R $repo -Syud
+	rv=$?
+	http_stop
+	atf_check_equal $rv 0
+	grep -q "^GET /foo-1.1_1.noarch.from-1.0_1.xbps-delta$" http.log
+	atf_check_equal $? 0
+	grep -q "^GET /foo-1.1_1.noarch.xbps$" http.log
+	atf_check_equal $? 1
+	atf_check_equal "$(xbps-query -r root -p pkgver foo)" "foo-1.1_1"
+	atf_check_equal "$(cat root/usr/bin/foo)" "1.1"
+	cmp root/var/cache/xbps/foo-1.1_1.noarch.xbps foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	[ -f root/var/cache/xbps/foo-1.1_1.noarch.from-1.0_1.xbps-delta ]
+	atf_check_equal $? 1
+}
+
+atf_test_case delta_clean
+
+delta_clean_head() {
+	atf_set "descr" "xbps-rindex(1) -c/-r: stale deltas are removed"
+}
+
+delta_clean_body() {
+	mkdir -p some_repo pkg_A
+	cd some_repo
+	for v in 1.0 1.1; do
+		echo $v > ../pkg_A/file
+		xbps-create -A noarch -n foo-${v}_1 -s "foo pkg" ../pkg_A
+		atf_check_equal $? 0
+	done
+	xbps-rindex -d -a $PWD/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-rindex -d -D $PWD/foo-1.1_1.noarch.xbps $PWD/foo-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+	# deltas still announced are kept
+	xbps-rindex -r $PWD
+	atf_check_equal $? 0
+	[ -f foo-1.1_1.noarch.from-1.0_1.xbps-delta ]
+	atf_check_equal $? 0
+	# deltas of a replaced package are removed
+	echo 1.2 > ../pkg_A/file
+	xbps-create -A noarch -n foo-1.2_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/foo-1.2_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-rindex -r $PWD
+	atf_check_equal $? 0
+	[ -f foo-1.1_1.noarch.from-1.0_1.xbps-delta ]
+	atf_check_equal $? 1
+	# deltas of a removed entry are removed
+	echo 1.1 > ../pkg_A/file
+	xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -D $PWD/foo-1.2_1.noarch.xbps $PWD/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	[ -f foo-1.2_1.noarch.from-1.1_1.xbps-delta ]
+	atf_check_equal $? 0
+	rm foo-1.2_1.noarch.xbps
+	xbps-rindex -c $PWD
+	atf_check_equal $? 0
+	[ -f foo-1.2_1.noarch.from-1.1_1.xbps-delta ]
+	atf_check_equal $? 1
+}
+
+atf_init_test_cases() {
+	atf_add_test_case delta_clean
+	atf_add_test_case delta_index
+	atf_add_test_case delta_update
+}